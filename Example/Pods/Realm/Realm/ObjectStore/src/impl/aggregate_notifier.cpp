@@ -0,0 +1,472 @@
+////////////////////////////////////////////////////////////////////////////
+//
+// Copyright 2016 Realm Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+////////////////////////////////////////////////////////////////////////////
+
+#include "impl/aggregate_notifier.hpp"
+
+#include "shared_realm.hpp"
+
+#include <realm/table.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+using namespace realm;
+using namespace realm::_impl;
+
+// The values of the aggregated column for the rows matching the query, sorted
+// by row index, along with their running aggregates
+class AggregateNotifier::Values {
+public:
+    virtual ~Values() = default;
+
+    // Replace the values with those of the rows in `tv`. Returns whether the
+    // aggregates changed.
+    virtual bool assign(TableView const& tv, size_t column) = 0;
+    // Update the values for the given changes to the query's table,
+    // re-evaluating the query for only the inserted and modified rows. Returns
+    // whether the aggregates changed.
+    virtual bool apply(CollectionChangeBuilder const& changes, Query& query, size_t column) = 0;
+    // Remove all of the values. Returns whether the aggregates changed.
+    virtual bool clear() = 0;
+
+    virtual Results::Aggregates aggregates() const = 0;
+};
+
+namespace {
+template<typename T> struct ColumnTraits;
+template<> struct ColumnTraits<int64_t> {
+    using Sum = int64_t;
+    static constexpr bool has_sum = true;
+    static constexpr bool exact_sum = true;
+    static int64_t get(Table const& table, size_t col, size_t row) { return table.get_int(col, row); }
+    static Sum to_sum(int64_t value) { return value; }
+};
+template<> struct ColumnTraits<float> {
+    using Sum = double;
+    static constexpr bool has_sum = true;
+    static constexpr bool exact_sum = false;
+    static float get(Table const& table, size_t col, size_t row) { return table.get_float(col, row); }
+    static Sum to_sum(float value) { return value; }
+};
+template<> struct ColumnTraits<double> {
+    using Sum = double;
+    static constexpr bool has_sum = true;
+    static constexpr bool exact_sum = false;
+    static double get(Table const& table, size_t col, size_t row) { return table.get_double(col, row); }
+    static Sum to_sum(double value) { return value; }
+};
+template<> struct ColumnTraits<Timestamp> {
+    using Sum = int64_t;
+    static constexpr bool has_sum = false;
+    static constexpr bool exact_sum = true;
+    static Timestamp get(Table const& table, size_t col, size_t row) { return table.get_timestamp(col, row); }
+    static Sum to_sum(Timestamp) { return 0; }
+};
+
+template<typename T>
+bool same_value(util::Optional<T> const& a, util::Optional<T> const& b)
+{
+    if (!a || !b)
+        return !a == !b;
+    return !(*a < *b) && !(*b < *a);
+}
+
+template<typename T>
+class ColumnValues : public AggregateNotifier::Values {
+public:
+    using Traits = ColumnTraits<T>;
+    using Sum = typename Traits::Sum;
+
+    bool assign(TableView const& tv, size_t column) override
+    {
+        auto before = state();
+
+        auto& table = tv.get_parent();
+        std::vector<std::pair<size_t, T>> entries;
+        entries.reserve(tv.size());
+        for (size_t i = 0; i < tv.size(); ++i) {
+            if (!tv.is_row_attached(i))
+                continue;
+            size_t row = tv.get_source_ndx(i);
+            if (!table.is_null(column, row))
+                entries.emplace_back(row, Traits::get(table, column, row));
+        }
+        std::stable_sort(entries.begin(), entries.end(),
+                         [](auto const& a, auto const& b) { return a.first < b.first; });
+
+        m_rows.resize(entries.size());
+        m_values.resize(entries.size());
+        for (size_t i = 0; i < entries.size(); ++i) {
+            m_rows[i] = entries[i].first;
+            m_values[i] = entries[i].second;
+        }
+        recalculate();
+        return state() != before;
+    }
+
+    bool apply(CollectionChangeBuilder const& changes, Query& query, size_t column) override
+    {
+        // Integer sums can be kept up to date by adding and subtracting the
+        // changed values, but subtracting floating point values leaves behind
+        // the rounding error from when they were added, so those sums are
+        // recalculated from the remaining values instead
+        auto before = state();
+        bool extreme_removed = false;
+        bool values_changed = false;
+        auto remove = [&](T const& value) {
+            values_changed = true;
+            if (Traits::has_sum && Traits::exact_sum)
+                m_sum -= Traits::to_sum(value);
+            extreme_removed = extreme_removed || same_value(util::make_optional(value), m_min)
+                                              || same_value(util::make_optional(value), m_max);
+        };
+        auto add = [&](T const& value) {
+            values_changed = true;
+            if (Traits::has_sum && Traits::exact_sum)
+                m_sum += Traits::to_sum(value);
+            if (!m_min || value < *m_min)
+                m_min = value;
+            if (!m_max || *m_max < value)
+                m_max = value;
+        };
+
+        // Move the existing rows to their new indices, dropping deleted ones
+        if (!changes.deletions.empty() || !changes.insertions.empty()) {
+            bool sorted = true;
+            size_t kept = 0;
+            for (size_t i = 0; i < m_rows.size(); ++i) {
+                size_t row = changes.new_index_of(m_rows[i]);
+                if (row == npos) {
+                    remove(m_values[i]);
+                    continue;
+                }
+                sorted = sorted && (kept == 0 || m_rows[kept - 1] < row);
+                m_rows[kept] = row;
+                m_values[kept] = m_values[i];
+                ++kept;
+            }
+            m_rows.resize(kept);
+            m_values.resize(kept);
+            if (!sorted)
+                sort_by_row();
+        }
+
+        // Re-evaluate the inserted and modified rows, merging them in with the
+        // existing ones
+        std::vector<size_t> candidates;
+        candidates.reserve(changes.insertions.count() + changes.modifications.count());
+        for (auto row : changes.insertions.as_indexes())
+            candidates.push_back(row);
+        for (auto row : changes.modifications.as_indexes())
+            candidates.push_back(row);
+        if (!candidates.empty()) {
+            std::sort(candidates.begin(), candidates.end());
+            candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+
+            auto& table = *query.get_table();
+            std::vector<size_t> rows;
+            std::vector<T> values;
+            rows.reserve(m_rows.size() + candidates.size());
+            values.reserve(m_rows.size() + candidates.size());
+            size_t i = 0;
+            for (size_t row : candidates) {
+                for (; i < m_rows.size() && m_rows[i] < row; ++i) {
+                    rows.push_back(m_rows[i]);
+                    values.push_back(m_values[i]);
+                }
+                if (i < m_rows.size() && m_rows[i] == row)
+                    remove(m_values[i++]);
+                if (row >= table.size() || table.is_null(column, row) || query.count(row, row + 1, 1) == 0)
+                    continue;
+                auto value = Traits::get(table, column, row);
+                add(value);
+                rows.push_back(row);
+                values.push_back(value);
+            }
+            rows.insert(rows.end(), m_rows.begin() + i, m_rows.end());
+            values.insert(values.end(), m_values.begin() + i, m_values.end());
+            m_rows = std::move(rows);
+            m_values = std::move(values);
+        }
+
+        // Removing the current min or max means we no longer know what the
+        // new one is, so look through the remaining values for it
+        if (extreme_removed)
+            recalculate_extremes();
+        if (values_changed && !Traits::exact_sum)
+            recalculate_sum();
+        return state() != before;
+    }
+
+    bool clear() override
+    {
+        auto before = state();
+        m_rows.clear();
+        m_values.clear();
+        recalculate();
+        return state() != before;
+    }
+
+    Results::Aggregates aggregates() const override
+    {
+        Results::Aggregates aggregates;
+        aggregates.count = m_values.size();
+        if (m_min)
+            aggregates.min = Mixed(*m_min);
+        if (m_max)
+            aggregates.max = Mixed(*m_max);
+        if (Traits::has_sum) {
+            aggregates.sum = Mixed(m_sum);
+            if (!m_values.empty())
+                aggregates.average = double(m_sum) / m_values.size();
+        }
+        return aggregates;
+    }
+
+private:
+    std::vector<size_t> m_rows;
+    std::vector<T> m_values;
+    Sum m_sum = 0;
+    util::Optional<T> m_min;
+    util::Optional<T> m_max;
+
+    struct State {
+        size_t count;
+        Sum sum;
+        util::Optional<T> min;
+        util::Optional<T> max;
+
+        bool operator!=(State const& other) const
+        {
+            return count != other.count || sum != other.sum
+                || !same_value(min, other.min) || !same_value(max, other.max);
+        }
+    };
+    State state() const { return {m_values.size(), m_sum, m_min, m_max}; }
+
+    void recalculate()
+    {
+        recalculate_sum();
+        recalculate_extremes();
+    }
+
+    void recalculate_sum()
+    {
+        m_sum = 0;
+        if (!Traits::has_sum)
+            return;
+        if (Traits::exact_sum) {
+            for (auto& value : m_values)
+                m_sum += Traits::to_sum(value);
+            return;
+        }
+
+        // Neumaier's compensated summation, so that the result doesn't depend
+        // on how large the values are relative to the running total
+        Sum compensation = 0;
+        for (auto& value : m_values) {
+            Sum addend = Traits::to_sum(value);
+            Sum total = m_sum + addend;
+            if (std::abs(m_sum) >= std::abs(addend))
+                compensation += (m_sum - total) + addend;
+            else
+                compensation += (addend - total) + m_sum;
+            m_sum = total;
+        }
+        m_sum += compensation;
+    }
+
+    void recalculate_extremes()
+    {
+        m_min = util::none;
+        m_max = util::none;
+        if (m_values.empty())
+            return;
+        auto extremes = std::minmax_element(m_values.begin(), m_values.end());
+        m_min = *extremes.first;
+        m_max = *extremes.second;
+    }
+
+    void sort_by_row()
+    {
+        std::vector<size_t> order(m_rows.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return m_rows[a] < m_rows[b]; });
+
+        std::vector<size_t> rows(m_rows.size());
+        std::vector<T> values(m_values.size());
+        for (size_t i = 0; i < order.size(); ++i) {
+            rows[i] = m_rows[order[i]];
+            values[i] = m_values[order[i]];
+        }
+        m_rows = std::move(rows);
+        m_values = std::move(values);
+    }
+};
+
+std::unique_ptr<AggregateNotifier::Values> make_values(DataType type)
+{
+    switch (type) {
+        case type_Int:       return std::make_unique<ColumnValues<int64_t>>();
+        case type_Float:     return std::make_unique<ColumnValues<float>>();
+        case type_Double:    return std::make_unique<ColumnValues<double>>();
+        case type_Timestamp: return std::make_unique<ColumnValues<Timestamp>>();
+        default: REALM_COMPILER_HINT_UNREACHABLE();
+    }
+}
+} // anonymous namespace
+
+AggregateNotifier::AggregateNotifier(Results& target, size_t column)
+: CollectionNotifier(target.get_realm())
+, m_column(column)
+{
+    Query q = target.get_query();
+    set_table(*q.get_table());
+    m_values = make_values(q.get_table()->get_column_type(column));
+    m_query_handover = source_shared_group().export_for_handover(q, MutableSourcePayload::Move);
+    DescriptorOrdering::generate_patch(target.get_descriptor_ordering(), m_ordering_handover);
+}
+
+AggregateNotifier::~AggregateNotifier() = default;
+
+void AggregateNotifier::release_data() noexcept
+{
+    m_query = nullptr;
+}
+
+void AggregateNotifier::do_attach_to(SharedGroup& sg)
+{
+    REALM_ASSERT(m_query_handover);
+    m_query = sg.import_from_handover(std::move(m_query_handover));
+    m_descriptor_ordering = DescriptorOrdering::create_from_and_consume_patch(m_ordering_handover, *m_query->get_table());
+    m_incremental = can_update_incrementally();
+}
+
+void AggregateNotifier::do_detach_from(SharedGroup& sg)
+{
+    REALM_ASSERT(m_query);
+    DescriptorOrdering::generate_patch(m_descriptor_ordering, m_ordering_handover);
+    m_query_handover = sg.export_for_handover(*m_query, MutableSourcePayload::Move);
+    m_query = nullptr;
+}
+
+bool AggregateNotifier::can_update_incrementally() const
+{
+    // Queries restricted to a LinkView or TableView, and distinct and limit,
+    // depend on more than just whether each row matches
+    auto& table = *m_query->get_table();
+    if (table.get_index_in_group() == npos || !m_query->produces_results_in_table_order())
+        return false;
+    if (m_descriptor_ordering.will_apply_distinct() || m_descriptor_ordering.will_apply_limit())
+        return false;
+
+    // Changes to other tables can change which rows match queries which
+    // follow links in either direction, and they aren't in this table's changes
+    return table_is_unlinked(table);
+}
+
+bool AggregateNotifier::do_add_required_change_info(TransactionChangeInfo& info)
+{
+    REALM_ASSERT(m_query);
+    m_info = &info;
+
+    auto& table = *m_query->get_table();
+    if (!m_incremental || !table.is_attached())
+        return false;
+
+    auto table_ndx = table.get_index_in_group();
+    if (info.table_modifications_needed.size() <= table_ndx)
+        info.table_modifications_needed.resize(table_ndx + 1);
+    if (info.table_moves_needed.size() <= table_ndx)
+        info.table_moves_needed.resize(table_ndx + 1);
+    info.table_modifications_needed[table_ndx] = true;
+    info.table_moves_needed[table_ndx] = true;
+    return false;
+}
+
+void AggregateNotifier::run()
+{
+    auto& table = *m_query->get_table();
+    if (!table.is_attached()) {
+        if (m_values->clear()) {
+            m_aggregates = m_values->aggregates();
+            m_changed = true;
+        }
+        m_have_values = false;
+        return;
+    }
+
+    // Without callbacks the values aren't kept up to date, so they're
+    // recalculated from scratch if callbacks are added again
+    if (!have_callbacks()) {
+        m_have_values = false;
+        return;
+    }
+
+    auto version = m_query->sync_view_if_needed();
+    if (m_have_values && version == m_last_seen_version)
+        return;
+
+    // Columns may have been added to or removed from the table, which can
+    // change whether it links to other tables
+    if (m_info->schema_changed)
+        m_incremental = can_update_incrementally();
+
+    bool changed;
+    if (m_incremental && m_have_values && !m_info->schema_changed) {
+        size_t table_ndx = table.get_index_in_group();
+        if (table_ndx >= m_info->tables.size())
+            changed = false;
+        else
+            changed = m_values->apply(m_info->tables[table_ndx], *m_query, m_column);
+    }
+    else {
+        TableView tv = m_query->find_all();
+        tv.apply_descriptor_ordering(m_descriptor_ordering);
+        changed = m_values->assign(tv, m_column);
+    }
+
+    m_have_values = true;
+    m_last_seen_version = version;
+    if (changed) {
+        m_aggregates = m_values->aggregates();
+        m_changed = true;
+    }
+}
+
+void AggregateNotifier::do_prepare_handover(SharedGroup&)
+{
+    // The aggregates are reported as a modification of the single "row" of
+    // the aggregate so that callbacks are only called when they change.
+    // add_changes() needs to be called even if there are no changes to clear
+    // the skip flag on the callbacks.
+    CollectionChangeBuilder change;
+    if (m_changed) {
+        m_aggregates_to_deliver = m_aggregates;
+        change.modifications.add(0);
+        m_changed = false;
+    }
+    add_changes(std::move(change));
+}
+
+bool AggregateNotifier::prepare_to_deliver()
+{
+    m_delivered = m_aggregates_to_deliver;
+    return true;
+}
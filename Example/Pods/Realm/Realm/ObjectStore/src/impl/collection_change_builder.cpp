@@ -308,6 +308,17 @@ void CollectionChangeBuilder::move(size_t from, size_t to)
     });
 }
 
+size_t CollectionChangeBuilder::new_index_of(size_t old_ndx) const
+{
+    if (deletions.contains(old_ndx)) {
+        // check if this deletion was actually a move
+        auto it = lower_bound(begin(moves), end(moves), old_ndx,
+                              [](auto const& a, auto b) { return a.from < b; });
+        return it != moves.end() && it->from == old_ndx ? it->to : IndexSet::npos;
+    }
+    return insertions.shift(deletions.unshift(old_ndx));
+}
+
 void CollectionChangeBuilder::move_over(size_t row_ndx, size_t last_row, bool track_moves)
 {
     REALM_ASSERT(row_ndx <= last_row);
@@ -510,8 +521,63 @@ struct RowInfo {
     size_t prev_tv_index;
     size_t tv_index;
     size_t shifted_tv_index;
+    bool modified;
 };
 
+// Stable LSD radix sort of `values` by the unsigned integer `key(value)`.
+// The vectors sorted here hold one entry per row of the collection and are
+// keyed on row or table view indices, which radix sort handles in a few
+// linear passes rather than the O(N log N) comparisons of std::sort. Only as
+// many digits as the largest key needs are sorted on, and passes where every
+// key has the same digit are skipped. Input which is already in order (e.g.
+// rows of a table in table order) is detected up front and left alone.
+template<typename T, typename Key>
+void radix_sort(std::vector<T>& values, Key key)
+{
+    auto less = [&](auto const& lft, auto const& rgt) { return key(lft) < key(rgt); };
+    if (std::is_sorted(begin(values), end(values), less))
+        return;
+    if (values.size() < 256) {
+        std::stable_sort(begin(values), end(values), less);
+        return;
+    }
+
+    size_t max_key = 0;
+    for (auto const& value : values)
+        max_key = std::max<size_t>(max_key, key(value));
+
+    const size_t bits = 11;
+    const size_t radix = size_t(1) << bits;
+    std::vector<size_t> offsets(radix);
+    std::vector<T> buffer(values.size());
+    for (size_t shift = 0; shift < sizeof(size_t) * 8 && (max_key >> shift) != 0; shift += bits) {
+        std::fill(begin(offsets), end(offsets), 0);
+        for (auto const& value : values)
+            ++offsets[(key(value) >> shift) & (radix - 1)];
+        if (offsets[(key(values.front()) >> shift) & (radix - 1)] == values.size())
+            continue;
+
+        size_t total = 0;
+        for (auto& offset : offsets) {
+            auto count = offset;
+            offset = total;
+            total += count;
+        }
+        for (auto const& value : values)
+            buffer[offsets[(key(value) >> shift) & (radix - 1)]++] = value;
+        values.swap(buffer);
+    }
+}
+
+// Build an IndexSet from unordered indices. Adding them in ascending order
+// means every add() lands at the end of the set.
+void add_all(IndexSet& set, std::vector<size_t>& indices)
+{
+    radix_sort(indices, [](size_t index) { return index; });
+    for (auto index : indices)
+        set.add(index);
+}
+
 // Calculates the insertions/deletions required for a query on a table without
 // a sort, where `removed` includes the rows which were modified to no longer
 // match the query (but not outright deleted rows, which are filtered out long
@@ -713,9 +779,8 @@ void calculate_moves_sorted(std::vector<RowInfo>& rows, CollectionChangeSet& cha
     for (auto& row : rows) {
         a.push_back({row.row_index, row.prev_tv_index});
     }
-    std::sort(begin(a), end(a), [](auto lft, auto rgt) {
-        return std::tie(lft.tv_index, lft.row_index) < std::tie(rgt.tv_index, rgt.row_index);
-    });
+    // Each old TV index appears at most once, so there are no ties to break
+    radix_sort(a, [](auto const& row) { return row.tv_index; });
 
     // Before constructing `b`, first find the first index in `a` which will
     // actually differ in `b`, and skip everything else if there aren't any
@@ -733,9 +798,9 @@ void calculate_moves_sorted(std::vector<RowInfo>& rows, CollectionChangeSet& cha
     b.reserve(rows.size());
     for (size_t i = 0; i < rows.size(); ++i)
         b.push_back({rows[i].row_index, i});
-    std::sort(begin(b), end(b), [](auto lft, auto rgt) {
-        return std::tie(lft.row_index, lft.tv_index) < std::tie(rgt.row_index, rgt.tv_index);
-    });
+    // The sort is stable and `b` starts out in TV order, so rows with the same
+    // row index stay ordered by TV index
+    radix_sort(b, [](auto const& row) { return row.row_index; });
 
     // Calculate the LCS of the two sequences
     auto matches = LongestCommonSubsequenceCalculator(a, b, first_difference,
@@ -759,6 +824,17 @@ CollectionChangeBuilder CollectionChangeBuilder::calculate(std::vector<size_t> c
                                                            std::vector<size_t> const& next_rows,
                                                            std::function<bool (size_t)> row_did_change,
                                                            util::Optional<IndexSet> const& move_candidates)
+{
+    return calculate(prev_rows, next_rows, [&](size_t const* rows, size_t count, bool* modified) {
+        for (size_t i = 0; i < count; ++i)
+            modified[i] = row_did_change(rows[i]);
+    }, move_candidates);
+}
+
+CollectionChangeBuilder CollectionChangeBuilder::calculate(std::vector<size_t> const& prev_rows,
+                                                           std::vector<size_t> const& next_rows,
+                                                           BatchModificationChecker rows_did_change,
+                                                           util::Optional<IndexSet> const& move_candidates)
 {
     REALM_ASSERT_DEBUG(!move_candidates || std::is_sorted(begin(next_rows), end(next_rows)));
 
@@ -775,27 +851,21 @@ CollectionChangeBuilder CollectionChangeBuilder::calculate(std::vector<size_t> c
         else
             old_rows.push_back({prev_rows[i], IndexSet::npos, i, i - deleted});
     }
-    std::sort(begin(old_rows), end(old_rows), [](auto& lft, auto& rgt) {
-        return lft.row_index < rgt.row_index;
-    });
+    radix_sort(old_rows, [](auto const& row) { return row.row_index; });
 
     std::vector<RowInfo> new_rows;
     new_rows.reserve(next_rows.size());
     for (size_t i = 0; i < next_rows.size(); ++i) {
         new_rows.push_back({next_rows[i], IndexSet::npos, i, 0});
     }
-    std::sort(begin(new_rows), end(new_rows), [](auto& lft, auto& rgt) {
-        return lft.row_index < rgt.row_index;
-    });
-
-    // Don't add rows which were modified to not match the query to `deletions`
-    // immediately because the unsorted move logic needs to be able to
-    // distinguish them from rows which were outright deleted
-    IndexSet removed;
+    radix_sort(new_rows, [](auto const& row) { return row.row_index; });
 
     // Now that our old and new sets of rows are sorted by row index, we can
     // iterate over them and either record old+new TV indices for rows present
-    // in both, or mark them as inserted/deleted if they appear only in one
+    // in both, or mark them as inserted/deleted if they appear only in one.
+    // The TV indices come out in no particular order, so they're gathered up
+    // and added to the IndexSets in order afterwards.
+    std::vector<size_t> removed_indices, inserted_indices;
     size_t i = 0, j = 0;
     while (i < old_rows.size() && j < new_rows.size()) {
         auto old_index = old_rows[i];
@@ -807,30 +877,59 @@ CollectionChangeBuilder CollectionChangeBuilder::calculate(std::vector<size_t> c
             ++j;
         }
         else if (old_index.row_index < new_index.row_index) {
-            removed.add(old_index.tv_index);
+            removed_indices.push_back(old_index.tv_index);
             ++i;
         }
         else {
-            ret.insertions.add(new_index.tv_index);
+            inserted_indices.push_back(new_index.tv_index);
             ++j;
         }
     }
 
     for (; i < old_rows.size(); ++i)
-        removed.add(old_rows[i].tv_index);
+        removed_indices.push_back(old_rows[i].tv_index);
     for (; j < new_rows.size(); ++j)
-        ret.insertions.add(new_rows[j].tv_index);
+        inserted_indices.push_back(new_rows[j].tv_index);
+
+    // Don't add rows which were modified to not match the query to `deletions`
+    // immediately because the unsorted move logic needs to be able to
+    // distinguish them from rows which were outright deleted
+    IndexSet removed;
+    add_all(removed, removed_indices);
+    add_all(ret.insertions, inserted_indices);
+
+    // Check the retained rows for modifications in one batch while they're
+    // still in row order, so that the checker can walk the per-table
+    // modification sets forward, and so that a row which appears several
+    // times (in a LinkList) is only checked once
+    std::vector<size_t> checked_rows;
+    checked_rows.reserve(new_rows.size());
+    for (auto& row : new_rows) {
+        if (row.prev_tv_index != IndexSet::npos && (checked_rows.empty() || checked_rows.back() != row.row_index))
+            checked_rows.push_back(row.row_index);
+    }
+    if (!checked_rows.empty()) {
+        std::unique_ptr<bool[]> modified(new bool[checked_rows.size()]);
+        rows_did_change(checked_rows.data(), checked_rows.size(), modified.get());
+        size_t checked = 0;
+        for (auto& row : new_rows) {
+            if (row.prev_tv_index == IndexSet::npos)
+                continue;
+            while (checked_rows[checked] != row.row_index)
+                ++checked;
+            row.modified = modified[checked];
+        }
+    }
 
     // Filter out the new insertions since we don't need them for any of the
     // further calculations
     new_rows.erase(std::remove_if(begin(new_rows), end(new_rows),
                                   [](auto& row) { return row.prev_tv_index == IndexSet::npos; }),
                    end(new_rows));
-    std::sort(begin(new_rows), end(new_rows),
-              [](auto& lft, auto& rgt) { return lft.tv_index < rgt.tv_index; });
+    radix_sort(new_rows, [](auto const& row) { return row.tv_index; });
 
     for (auto& row : new_rows) {
-        if (row_did_change(row.row_index)) {
+        if (row.modified) {
             ret.modifications.add(row.tv_index);
         }
     }
@@ -864,6 +963,59 @@ CollectionChangeBuilder CollectionChangeBuilder::calculate(std::vector<size_t> c
     return ret;
 }
 
+CollectionChangeBuilder CollectionChangeBuilder::calculate_sorted(std::vector<size_t> const& prev_rows,
+                                                                  std::vector<size_t> const& next_rows,
+                                                                  std::function<bool (size_t)> row_did_change)
+{
+    return calculate_sorted(prev_rows, next_rows, [&](size_t const* rows, size_t count, bool* modified) {
+        for (size_t i = 0; i < count; ++i)
+            modified[i] = row_did_change(rows[i]);
+    });
+}
+
+CollectionChangeBuilder CollectionChangeBuilder::calculate_sorted(std::vector<size_t> const& prev_rows,
+                                                                  std::vector<size_t> const& next_rows,
+                                                                  BatchModificationChecker rows_did_change)
+{
+    REALM_ASSERT_DEBUG(std::is_sorted(begin(next_rows), end(next_rows)));
+
+    CollectionChangeBuilder ret;
+
+    // The retained rows come out of the merge in ascending order, so they're
+    // gathered up and checked for modifications in one batch afterwards
+    std::vector<size_t> retained_rows, retained_indices;
+    size_t i = 0, j = 0;
+    while (i < prev_rows.size() || j < next_rows.size()) {
+        if (i < prev_rows.size() && prev_rows[i] == IndexSet::npos) {
+            ret.deletions.add(i++);
+        }
+        else if (i < prev_rows.size() && j < next_rows.size() && prev_rows[i] == next_rows[j]) {
+            retained_rows.push_back(next_rows[j]);
+            retained_indices.push_back(j);
+            ++i;
+            ++j;
+        }
+        else if (j == next_rows.size() || (i < prev_rows.size() && prev_rows[i] < next_rows[j])) {
+            ret.deletions.add(i++);
+        }
+        else {
+            REALM_ASSERT_DEBUG(i == prev_rows.size() || prev_rows[i] > next_rows[j]);
+            ret.insertions.add(j++);
+        }
+    }
+    if (!retained_rows.empty()) {
+        std::unique_ptr<bool[]> modified(new bool[retained_rows.size()]);
+        rows_did_change(retained_rows.data(), retained_rows.size(), modified.get());
+        for (size_t k = 0; k < retained_rows.size(); ++k) {
+            if (modified[k])
+                ret.modifications.add(retained_indices[k]);
+        }
+    }
+    ret.verify();
+
+    return ret;
+}
+
 CollectionChangeSet CollectionChangeBuilder::finalize() &&
 {
     // Calculate which indices in the old collection were modified
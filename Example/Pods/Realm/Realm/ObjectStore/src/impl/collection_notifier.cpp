@@ -19,14 +19,30 @@
 #include "impl/collection_notifier.hpp"
 
 #include "impl/realm_coordinator.hpp"
+#include "object_store.hpp"
 #include "shared_realm.hpp"
 
+#include <realm/group.hpp>
 #include <realm/group_shared.hpp>
 #include <realm/link_view.hpp>
 
 using namespace realm;
 using namespace realm::_impl;
 
+namespace {
+// Check if any of the tables accessible from the root table were actually
+// modified. This can be false if there were only insertions, or deletions
+// which were not linked to by any row in the linking table
+bool any_related_table_modified(TransactionChangeInfo const& info,
+                                std::vector<DeepChangeChecker::RelatedTable> const& related_tables)
+{
+    return any_of(begin(related_tables), end(related_tables), [&](auto& tbl) {
+        return tbl.table_ndx < info.tables.size()
+            && !info.tables[tbl.table_ndx].modifications.empty();
+    });
+}
+} // anonymous namespace
+
 std::function<bool (size_t)>
 CollectionNotifier::get_modification_checker(TransactionChangeInfo const& info,
                                              Table const& root_table)
@@ -34,14 +50,7 @@ CollectionNotifier::get_modification_checker(TransactionChangeInfo const& info,
     if (info.schema_changed)
         set_table(root_table);
 
-    // First check if any of the tables accessible from the root table were
-    // actually modified. This can be false if there were only insertions, or
-    // deletions which were not linked to by any row in the linking table
-    auto table_modified = [&](auto& tbl) {
-        return tbl.table_ndx < info.tables.size()
-            && !info.tables[tbl.table_ndx].modifications.empty();
-    };
-    if (!any_of(begin(m_related_tables), end(m_related_tables), table_modified)) {
+    if (!any_related_table_modified(info, m_related_tables)) {
         return [](size_t) { return false; };
     }
     if (m_related_tables.size() == 1) {
@@ -49,9 +58,166 @@ CollectionNotifier::get_modification_checker(TransactionChangeInfo const& info,
         return [&](size_t row) { return modifications.contains(row); };
     }
 
+    // When several notifiers share this transaction, walk the link graph once
+    // for all of them rather than having each search its own outgoing links
+    if (info.deep_change_checkers > 1) {
+        if (auto group = _impl::TableFriend::get_parent_group(root_table)) {
+            auto& cache = info.deep_change_cache;
+            cache.build(info, *group);
+            size_t root_table_ndx = root_table.get_index_in_group();
+            return [&cache, root_table_ndx](size_t row) {
+                return cache.reaches_modification(root_table_ndx, row);
+            };
+        }
+    }
+
     return DeepChangeChecker(info, root_table, m_related_tables);
 }
 
+BatchModificationChecker
+CollectionNotifier::get_batch_modification_checker(TransactionChangeInfo const& info,
+                                                   Table const& root_table)
+{
+    if (info.schema_changed)
+        set_table(root_table);
+
+    if (!any_related_table_modified(info, m_related_tables)) {
+        return [](size_t const*, size_t count, bool* modified) {
+            std::fill(modified, modified + count, false);
+        };
+    }
+    if (m_related_tables.size() == 1) {
+        // The rows come in ascending order, both within a block and from one
+        // block to the next, so a single forward walk over the modified ranges
+        // answers all of them. Start over if a caller goes back.
+        auto& modifications = info.tables[m_related_tables[0].table_ndx].modifications;
+        return [&modifications, range = modifications.begin(), last_row = size_t(0)]
+               (size_t const* rows, size_t count, bool* modified) mutable {
+            if (count && rows[0] < last_row)
+                range = modifications.begin();
+            for (size_t i = 0; i < count; ++i) {
+                while (range != modifications.end() && range->second <= rows[i])
+                    ++range;
+                modified[i] = range != modifications.end() && range->first <= rows[i];
+            }
+            if (count)
+                last_row = rows[count - 1];
+        };
+    }
+
+    if (info.deep_change_checkers > 1) {
+        if (auto group = _impl::TableFriend::get_parent_group(root_table)) {
+            auto& cache = info.deep_change_cache;
+            cache.build(info, *group);
+            size_t root_table_ndx = root_table.get_index_in_group();
+            return [&cache, root_table_ndx](size_t const* rows, size_t count, bool* modified) {
+                for (size_t i = 0; i < count; ++i)
+                    modified[i] = cache.reaches_modification(root_table_ndx, rows[i]);
+            };
+        }
+    }
+
+    return [checker = DeepChangeChecker(info, root_table, m_related_tables)]
+           (size_t const* rows, size_t count, bool* modified) mutable {
+        for (size_t i = 0; i < count; ++i)
+            modified[i] = checker(rows[i]);
+    };
+}
+
+IndexSet const* CollectionNotifier::get_direct_modifications(TransactionChangeInfo const& info,
+                                                             Table const& root_table)
+{
+    if (info.schema_changed)
+        set_table(root_table);
+
+    // Matches the single-table case in get_modification_checker()
+    if (m_related_tables.size() != 1)
+        return nullptr;
+    static const IndexSet no_modifications;
+    size_t table_ndx = m_related_tables[0].table_ndx;
+    return table_ndx < info.tables.size() ? &info.tables[table_ndx].modifications : &no_modifications;
+}
+
+void DeepChangeCache::build(TransactionChangeInfo const& info, Group const& group)
+{
+    std::call_once(m_built, [&] { do_build(info, group); });
+}
+
+void DeepChangeCache::do_build(TransactionChangeInfo const& info, Group const& group)
+{
+    size_t table_count = std::min(info.tables.size(), group.size());
+    m_rows.resize(table_count);
+
+    // Only tables with tracked modifications are related to some notifier, so
+    // only links from those need to be followed back
+    struct IncomingLink {
+        ConstTableRef origin;
+        size_t origin_table_ndx;
+        size_t col_ndx;
+    };
+    std::vector<std::vector<IncomingLink>> incoming(table_count);
+    for (size_t i = 0; i < table_count; ++i) {
+        if (i >= info.table_modifications_needed.size() || !info.table_modifications_needed[i])
+            continue;
+        auto table = group.get_table(i);
+        for (size_t col = 0, count = table->get_column_count(); col != count; ++col) {
+            auto type = table->get_column_type(col);
+            if (type != type_Link && type != type_LinkList)
+                continue;
+            size_t target_ndx = table->get_link_target(col)->get_index_in_group();
+            if (target_ndx < table_count)
+                incoming[target_ndx].push_back({table, i, col});
+        }
+    }
+
+    // Returns true if the row was not already known to reach a modification
+    auto mark = [&](size_t table_ndx, size_t row_ndx) {
+        auto& rows = m_rows[table_ndx];
+        if (rows.size() <= row_ndx)
+            rows.resize(std::max(row_ndx + 1, group.get_table(table_ndx)->size()));
+        if (rows[row_ndx])
+            return false;
+        rows[row_ndx] = true;
+        return true;
+    };
+
+    // Breadth-first so that each row is first reached along its shortest path,
+    // which is what the depth limit applies to
+    std::vector<std::vector<size_t>> current(table_count), next(table_count);
+    for (size_t i = 0; i < table_count; ++i) {
+        for (auto row : info.tables[i].modifications.as_indexes()) {
+            if (mark(i, row))
+                current[i].push_back(row);
+        }
+    }
+
+    for (size_t depth = 0; depth < max_depth; ++depth) {
+        bool found_any = false;
+        for (size_t i = 0; i < table_count; ++i) {
+            if (current[i].empty() || incoming[i].empty())
+                continue;
+            auto target = group.get_table(i);
+            for (auto& link : incoming[i]) {
+                for (auto row : current[i]) {
+                    size_t count = target->get_backlink_count(row, *link.origin, link.col_ndx);
+                    for (size_t j = 0; j < count; ++j) {
+                        size_t origin_row = target->get_backlink(row, *link.origin, link.col_ndx, j);
+                        if (mark(link.origin_table_ndx, origin_row)) {
+                            next[link.origin_table_ndx].push_back(origin_row);
+                            found_any = true;
+                        }
+                    }
+                }
+            }
+        }
+        if (!found_any)
+            break;
+        current.swap(next);
+        for (auto& rows : next)
+            rows.clear();
+    }
+}
+
 void DeepChangeChecker::find_related_tables(std::vector<RelatedTable>& out, Table const& table)
 {
     auto table_ndx = table.get_index_in_group();
@@ -170,6 +336,7 @@ bool DeepChangeChecker::operator()(size_t ndx)
 CollectionNotifier::CollectionNotifier(std::shared_ptr<Realm> realm)
 : m_realm(std::move(realm))
 , m_sg_version(Realm::Internal::get_shared_group(*m_realm)->get_version_of_current_transaction())
+, m_metrics(Realm::Internal::get_coordinator(*m_realm).notifier_metrics())
 {
 }
 
@@ -178,15 +345,29 @@ CollectionNotifier::~CollectionNotifier()
     // Need to do this explicitly to ensure m_realm is destroyed with the mutex
     // held to avoid potential double-deletion
     unregister();
+    delete m_timings.load();
 }
 
-uint64_t CollectionNotifier::add_callback(CollectionChangeCallback callback)
+uint64_t CollectionNotifier::add_callback(CollectionChangeCallback callback, NotificationPriority priority)
 {
     m_realm->verify_thread();
 
     std::lock_guard<std::mutex> lock(m_callback_mutex);
-    auto token = m_next_token++;
-    m_callbacks.push_back({std::move(callback), {}, {}, token, false, false});
+    uint32_t slot;
+    if (m_free_callback_slots.empty()) {
+        slot = static_cast<uint32_t>(m_callback_slots.size());
+        m_callback_slots.push_back({0, 0});
+    }
+    else {
+        slot = m_free_callback_slots.back();
+        m_free_callback_slots.pop_back();
+    }
+    m_callback_slots[slot].index = static_cast<uint32_t>(m_callbacks.size());
+    auto token = uint64_t(m_callback_slots[slot].generation) << 32 | slot;
+
+    m_callbacks.push_back({std::move(callback), {}, {}, token, false, false, priority});
+    if (priority > m_priority)
+        m_priority = priority;
     if (m_callback_index == npos) { // Don't need to wake up if we're already sending notifications
         Realm::Internal::get_coordinator(*m_realm).wake_up_notifier_worker();
         m_have_callbacks = true;
@@ -206,18 +387,74 @@ void CollectionNotifier::remove_callback(uint64_t token)
             return;
         }
 
-        size_t idx = distance(begin(m_callbacks), it);
-        if (m_callback_index != npos) {
-            if (m_callback_index >= idx)
-                --m_callback_index;
-        }
-        --m_callback_count;
-
+        // Leave a tombstone in place so that neither the positions of the
+        // other callbacks nor an in-progress for_each_callback() are disturbed
         old = std::move(*it);
-        m_callbacks.erase(it);
+        *it = Callback{};
+        it->token = removed_token;
+        ++m_removed_callback_count;
+
+        auto& slot = m_callback_slots[token & 0xffffffff];
+        ++slot.generation;
+        m_free_callback_slots.push_back(static_cast<uint32_t>(token & 0xffffffff));
 
-        m_have_callbacks = !m_callbacks.empty();
+        if (m_callback_index == npos)
+            compact_callbacks();
+
+        m_have_callbacks = m_callbacks.size() != m_removed_callback_count;
+        if (old.priority == m_priority)
+            update_priority();
+    }
+    did_remove_callback(token);
+}
+
+void CollectionNotifier::update_priority()
+{
+    auto priority = NotificationPriority::low;
+    for (auto& callback : m_callbacks) {
+        if (callback.token != removed_token && callback.priority > priority)
+            priority = callback.priority;
+    }
+    m_priority = priority;
+}
+
+void CollectionNotifier::record_run_cost(std::chrono::nanoseconds cost) noexcept
+{
+    // Weight the latest run by a quarter so that a single slow run (such as
+    // the first one) doesn't dominate the estimate for long
+    if (m_run_cost.count() == 0)
+        m_run_cost = cost;
+    else
+        m_run_cost += (cost - m_run_cost) / 4;
+}
+
+std::string const& CollectionNotifier::shard_affinity_key() const noexcept
+{
+    static const std::string no_key;
+    return no_key;
+}
+
+void CollectionNotifier::compact_callbacks()
+{
+    if (m_removed_callback_count * 2 < m_callbacks.size())
+        return;
+
+    size_t kept = 0;
+    size_t kept_before_count = 0;
+    for (size_t i = 0; i < m_callbacks.size(); ++i) {
+        if (m_callbacks[i].token == removed_token)
+            continue;
+        if (i < m_callback_count)
+            ++kept_before_count;
+        if (kept != i)
+            m_callbacks[kept] = std::move(m_callbacks[i]);
+        m_callback_slots[m_callbacks[kept].token & 0xffffffff].index = static_cast<uint32_t>(kept);
+        ++kept;
     }
+    m_callbacks.resize(kept);
+    if (m_callback_count != npos)
+        m_callback_count = kept_before_count;
+    m_removed_callback_count = 0;
 }
 
 void CollectionNotifier::suppress_next_notification(uint64_t token)
@@ -240,8 +477,10 @@ std::vector<CollectionNotifier::Callback>::iterator CollectionNotifier::find_cal
 {
     REALM_ASSERT(m_error || m_callbacks.size() > 0);
 
-    auto it = find_if(begin(m_callbacks), end(m_callbacks),
-                      [=](const auto& c) { return c.token == token; });
+    auto slot = token & 0xffffffff;
+    auto it = end(m_callbacks);
+    if (slot < m_callback_slots.size() && m_callback_slots[slot].generation == token >> 32)
+        it = begin(m_callbacks) + m_callback_slots[slot].index;
     // We should only fail to find the callback if it was removed due to an error
     REALM_ASSERT(m_error || it != end(m_callbacks));
     return it;
@@ -266,6 +505,12 @@ std::unique_lock<std::mutex> CollectionNotifier::lock_target()
 
 void CollectionNotifier::set_table(Table const& table)
 {
+    // Only set the first time, from the constructor, as it's read from other threads
+    if (m_object_type.empty()) {
+        StringData name = table.get_name();
+        StringData object_type = ObjectStore::object_type_for_table_name(name);
+        m_object_type = object_type.size() ? object_type : name.size() ? name : "(subtable)";
+    }
     m_related_tables.clear();
     DeepChangeChecker::find_related_tables(m_related_tables, table);
 }
@@ -284,11 +529,14 @@ void CollectionNotifier::add_required_change_info(TransactionChangeInfo& info)
     for (auto& tbl : m_related_tables) {
         info.table_modifications_needed[tbl.table_ndx] = true;
     }
+    if (m_related_tables.size() > 1)
+        ++info.deep_change_checkers;
 }
 
 void CollectionNotifier::prepare_handover()
 {
     REALM_ASSERT(m_sg);
+    NotifierStageTimer timer(*this, NotifierStage::prepare_handover);
     m_sg_version = m_sg->get_version_of_current_transaction();
     do_prepare_handover(*m_sg);
     m_has_run = true;
@@ -303,7 +551,7 @@ void CollectionNotifier::prepare_handover()
 void CollectionNotifier::before_advance()
 {
     for_each_callback([&](auto& lock, auto& callback) {
-        if (callback.changes_to_deliver.empty()) {
+        if (!callback.changes_to_deliver) {
             return;
         }
 
@@ -312,14 +560,15 @@ void CollectionNotifier::before_advance()
         // callback from within it can't result in a dangling pointer
         auto cb = callback.fn;
         lock.unlock();
-        cb.before(changes);
+        cb.before(*changes);
     });
 }
 
 void CollectionNotifier::after_advance()
 {
+    NotifierStageTimer timer(*this, NotifierStage::callbacks);
     for_each_callback([&](auto& lock, auto& callback) {
-        if (callback.initial_delivered && callback.changes_to_deliver.empty()) {
+        if (callback.initial_delivered && !callback.changes_to_deliver) {
             return;
         }
         callback.initial_delivered = true;
@@ -329,7 +578,7 @@ void CollectionNotifier::after_advance()
         // callback from within it can't result in a dangling pointer
         auto cb = callback.fn;
         lock.unlock();
-        cb.after(changes);
+        cb.after(changes ? *changes : CollectionChangeSet{});
     });
 }
 
@@ -363,8 +612,37 @@ bool CollectionNotifier::package_for_delivery()
     if (!prepare_to_deliver())
         return false;
     std::lock_guard<std::mutex> l(m_callback_mutex);
+
+    // Callbacks which saw the same sequence of changesets get the same merged
+    // result, so each distinct sequence is merged and finalized only once.
+    // Normally every callback has the same pending changes and this is a
+    // single merge no matter how many callbacks there are.
+    std::vector<Callback const*> merged;
+    for (auto& callback : m_callbacks) {
+        callback.changes_to_deliver = nullptr;
+        if (callback.pending_changes.empty())
+            continue;
+
+        auto same_changes = [&](Callback const* other) {
+            return other->pending_changes == callback.pending_changes;
+        };
+        auto it = std::find_if(merged.begin(), merged.end(), same_changes);
+        if (it != merged.end()) {
+            callback.changes_to_deliver = (*it)->changes_to_deliver;
+        }
+        else {
+            CollectionChangeBuilder changes;
+            for (auto& pending : callback.pending_changes)
+                changes.merge(CollectionChangeBuilder(*pending));
+            auto finalized = std::move(changes).finalize();
+            if (!finalized.empty())
+                callback.changes_to_deliver = std::make_shared<CollectionChangeSet>(std::move(finalized));
+            merged.push_back(&callback);
+        }
+    }
     for (auto& callback : m_callbacks)
-        callback.changes_to_deliver = std::move(callback.accumulated_changes).finalize();
+        callback.pending_changes.clear();
+
     m_callback_count = m_callbacks.size();
     return true;
 }
@@ -375,19 +653,23 @@ void CollectionNotifier::for_each_callback(Fn&& fn)
     std::unique_lock<std::mutex> callback_lock(m_callback_mutex);
     REALM_ASSERT_DEBUG(m_callback_count <= m_callbacks.size());
     for (++m_callback_index; m_callback_index < m_callback_count; ++m_callback_index) {
+        if (m_callbacks[m_callback_index].token == removed_token)
+            continue;
         fn(callback_lock, m_callbacks[m_callback_index]);
         if (!callback_lock.owns_lock())
             callback_lock.lock();
     }
 
     m_callback_index = npos;
+    compact_callbacks();
 }
 
-void CollectionNotifier::attach_to(SharedGroup& sg)
+void CollectionNotifier::attach_to(SharedGroup& sg, NotifierShardState* shard_state)
 {
     REALM_ASSERT(!m_sg);
 
     m_sg = &sg;
+    m_shard_state = shard_state;
     do_attach_to(sg);
 }
 
@@ -396,6 +678,7 @@ void CollectionNotifier::detach()
     REALM_ASSERT(m_sg);
     do_detach_from(*m_sg);
     m_sg = nullptr;
+    m_shard_state = nullptr;
 }
 
 SharedGroup& CollectionNotifier::source_shared_group()
@@ -405,26 +688,86 @@ SharedGroup& CollectionNotifier::source_shared_group()
 
 void CollectionNotifier::add_changes(CollectionChangeBuilder change)
 {
+    // Merging an empty changeset is a no-op, so there's nothing to share
+    SharedChanges shared;
+    if (!change.empty())
+        shared = std::make_shared<CollectionChangeBuilder>(std::move(change));
+    add_changes(std::move(shared));
+}
+
+void CollectionNotifier::add_changes(SharedChanges shared)
+{
+    if (shared && shared->empty())
+        shared = nullptr;
+
     std::lock_guard<std::mutex> lock(m_callback_mutex);
     for (auto& callback : m_callbacks) {
+        if (callback.token == removed_token)
+            continue;
         if (callback.skip_next) {
-            REALM_ASSERT_DEBUG(callback.accumulated_changes.empty());
+            REALM_ASSERT_DEBUG(callback.pending_changes.empty());
             callback.skip_next = false;
         }
-        else {
-            if (&callback == &m_callbacks.back())
-                callback.accumulated_changes.merge(std::move(change));
-            else
-                callback.accumulated_changes.merge(CollectionChangeBuilder(change));
+        else if (shared) {
+            callback.pending_changes.push_back(shared);
         }
     }
 }
 
+void CollectionNotifier::add_changes(std::vector<std::pair<uint64_t, SharedChanges>> changes)
+{
+    std::lock_guard<std::mutex> lock(m_callback_mutex);
+    for (auto& change : changes) {
+        auto slot = change.first & 0xffffffff;
+        if (slot >= m_callback_slots.size() || m_callback_slots[slot].generation != change.first >> 32)
+            continue;
+        auto& callback = m_callbacks[m_callback_slots[slot].index];
+        if (!callback.skip_next && change.second && !change.second->empty())
+            callback.pending_changes.push_back(std::move(change.second));
+    }
+    // Suppressing a notification skips the changes from that transaction for
+    // the callback whether or not it had any
+    for (auto& callback : m_callbacks)
+        callback.skip_next = false;
+}
+
+NotifierStageTimer::NotifierStageTimer(CollectionNotifier& notifier, NotifierStage stage)
+: m_stage(stage)
+{
+    if (notifier.m_metrics && notifier.m_metrics->is_enabled()) {
+        m_notifier = &notifier;
+        m_start = NotifierMetrics::Clock::now();
+    }
+}
+
+NotifierStageTimer::~NotifierStageTimer()
+{
+    if (!m_notifier)
+        return;
+
+    auto end = NotifierMetrics::Clock::now();
+    auto duration = std::chrono::duration_cast<LatencyHistogram::Duration>(end - m_start);
+
+    auto timings = m_notifier->m_timings.load(std::memory_order_acquire);
+    if (!timings) {
+        // The worker and target threads can both get here first
+        auto new_timings = std::make_unique<NotifierTimings>();
+        if (m_notifier->m_timings.compare_exchange_strong(timings, new_timings.get(), std::memory_order_acq_rel))
+            timings = new_timings.release();
+    }
+    (*timings)[m_stage].record(duration);
+
+    auto& metrics = *m_notifier->m_metrics;
+    metrics.totals()[m_stage].record(duration);
+    metrics.add_trace_event(m_stage, m_notifier->m_object_type, m_start, end);
+}
+
 NotifierPackage::NotifierPackage(std::exception_ptr error,
                                  std::vector<std::shared_ptr<CollectionNotifier>> notifiers,
                                  RealmCoordinator* coordinator)
 : m_notifiers(std::move(notifiers))
 , m_coordinator(coordinator)
+, m_metrics(coordinator ? coordinator->notifier_metrics() : nullptr)
 , m_error(std::move(error))
 {
 }
@@ -478,8 +821,10 @@ void NotifierPackage::deliver(SharedGroup& sg)
     // Can't deliver while in a write transaction
     if (sg.get_transact_stage() != SharedGroup::transact_Reading)
         return;
-    for (auto& notifier : m_notifiers)
+    for (auto& notifier : m_notifiers) {
+        NotifierStageTimer timer(*notifier, NotifierStage::deliver);
         notifier->deliver(sg);
+    }
 }
 
 void NotifierPackage::after_advance()
@@ -488,6 +833,8 @@ void NotifierPackage::after_advance()
         return;
     for (auto& notifier : m_notifiers)
         notifier->after_advance();
+    if (m_metrics && m_version && !m_notifiers.empty())
+        m_metrics->did_call_callbacks(m_version->version);
 }
 
 void NotifierPackage::add_notifier(std::shared_ptr<CollectionNotifier> notifier)
@@ -495,3 +842,15 @@ void NotifierPackage::add_notifier(std::shared_ptr<CollectionNotifier> notifier)
     m_notifiers.push_back(notifier);
     m_coordinator->register_notifier(notifier);
 }
+
+bool realm::_impl::table_is_unlinked(Table const& table)
+{
+    if (TableFriend::get_spec(table).has_backlinks())
+        return false;
+    for (size_t i = 0, count = table.get_column_count(); i < count; ++i) {
+        auto type = table.get_column_type(i);
+        if (type == type_Link || type == type_LinkList || type == type_Table)
+            return false;
+    }
+    return true;
+}
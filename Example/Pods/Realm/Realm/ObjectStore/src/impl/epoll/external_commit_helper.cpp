@@ -0,0 +1,233 @@
+////////////////////////////////////////////////////////////////////////////
+//
+// Copyright 2015 Realm Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+////////////////////////////////////////////////////////////////////////////
+
+#include "impl/external_commit_helper.hpp"
+#include "impl/realm_coordinator.hpp"
+
+#include <realm/group_shared_options.hpp>
+#include <realm/util/fifo_helper.hpp>
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <system_error>
+#include <unistd.h>
+
+#if REALM_ANDROID
+#include <android/log.h>
+#endif
+
+using namespace realm;
+using namespace realm::_impl;
+
+namespace {
+// Write a byte to a pipe to notify anyone waiting for data on the pipe
+void notify_fd(int fd)
+{
+    while (true) {
+        char c = 0;
+        ssize_t ret = write(fd, &c, 1);
+        if (ret == 1) {
+            break;
+        }
+        if (ret == -1 && errno == EINTR) {
+            continue;
+        }
+
+        // If the pipe's buffer is full, we need to read some of the old data in
+        // it to make space. We don't just read in the code waiting for
+        // notifications so that we can notify multiple waiters with a single
+        // write.
+        assert(ret == -1 && errno == EAGAIN);
+        char buff[1024];
+        ssize_t ignored = read(fd, buff, sizeof buff);
+        static_cast<void>(ignored);
+    }
+}
+
+void log_uncaught_exception(const char* message)
+{
+    fprintf(stderr, "%s\n", message);
+#if REALM_ANDROID
+    __android_log_print(ANDROID_LOG_ERROR, "REALM", "%s", message);
+#endif
+}
+
+} // anonymous namespace
+
+void ExternalCommitHelper::FdHolder::close()
+{
+    if (m_fd != -1) {
+        ::close(m_fd);
+    }
+    m_fd = -1;
+}
+
+// This is the epoll() counterpart of the kqueue() implementation in
+// impl/apple. Inter-thread and inter-process notifications of changes are
+// done using a named pipe in the filesystem next to the Realm file. Everyone
+// who wants to be notified of commits waits for data to become available on
+// the pipe, and anyone who commits a write transaction writes data to the
+// pipe after releasing the write lock. As with kqueue() no one ever reads
+// from the pipe for notifications: epoll re-checks readiness before
+// reporting an event, so a listener which drained the pipe could swallow the
+// wakeup of a listener in another process.
+//
+// Each helper has a background thread which waits on the pipe and on an
+// eventfd used for shutdown. The pipe is registered edge-triggered, so
+// epoll_wait() reports new data rather than the presence of data, and all of
+// the writes which land while the listener is busy in
+// RealmCoordinator::on_change() collapse into a single event. A burst of
+// commits therefore costs one extra pass, which picks up the newest version,
+// rather than one pass per commit.
+ExternalCommitHelper::ExternalCommitHelper(RealmCoordinator& parent)
+: m_parent(parent)
+{
+    m_epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (m_epfd == -1) {
+        throw std::system_error(errno, std::system_category());
+    }
+
+    // Object Store needs to create a named pipe in order to coordinate notifications.
+    // This can be a problem on some file systems (e.g. FAT32) or due to security policies in SELinux. Most commonly
+    // it is a problem when saving Realms on external storage: https://stackoverflow.com/questions/2740321/how-to-create-named-pipe-mkfifo-in-android
+    //
+    // For this reason we attempt to create this file in a temporary location known to be safe to write these files.
+    //
+    // In order of priority we attempt to write the file in the following locations:
+    //  1) Next to the Realm file itself
+    //  2) A location defined by `Realm::Config::fifo_files_fallback_path`
+    //  3) A location defined by `SharedGroupOptions::set_sys_tmp_dir()`
+    //
+    // Core has a similar policy for its named pipes.
+    //
+    // Also see https://github.com/realm/realm-java/issues/3140
+    // Note that hash collisions are okay here because they just result in doing extra work instead of resulting
+    // in correctness problems.
+
+    std::string path;
+    std::string temp_dir = util::normalize_dir(parent.get_config().fifo_files_fallback_path);
+    std::string sys_temp_dir = util::normalize_dir(SharedGroupOptions::get_sys_tmp_dir());
+
+    path = parent.get_path() + ".note";
+    bool fifo_created = realm::util::try_create_fifo(path);
+    if (!fifo_created && !temp_dir.empty()) {
+        path = util::format("%1realm_%2.note", temp_dir, std::hash<std::string>()(parent.get_path()));
+        fifo_created = realm::util::try_create_fifo(path);
+    }
+    if (!fifo_created && !sys_temp_dir.empty()) {
+        path = util::format("%1realm_%2.note", sys_temp_dir, std::hash<std::string>()(parent.get_path()));
+        realm::util::create_fifo(path);
+    }
+
+    // Opening read-write means the open never blocks waiting for a peer, and
+    // O_NONBLOCK makes writing to a full pipe return -1 rather than blocking
+    // until there's space available.
+    m_notify_fd = open(path.c_str(), O_RDWR | O_NONBLOCK | O_CLOEXEC);
+    if (m_notify_fd == -1) {
+        throw std::system_error(errno, std::system_category());
+    }
+
+    m_shutdown_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (m_shutdown_fd == -1) {
+        throw std::system_error(errno, std::system_category());
+    }
+
+    // EPOLLIN indicates that we care about data being available to read on
+    // the given file descriptor. EPOLLET makes it wait for new data to arrive
+    // rather than just returning when there is any data to read.
+    struct epoll_event event{};
+    event.events = EPOLLIN | EPOLLET;
+    event.data.fd = m_notify_fd;
+    if (epoll_ctl(m_epfd, EPOLL_CTL_ADD, m_notify_fd, &event) == -1) {
+        throw std::system_error(errno, std::system_category());
+    }
+    event.events = EPOLLIN;
+    event.data.fd = m_shutdown_fd;
+    if (epoll_ctl(m_epfd, EPOLL_CTL_ADD, m_shutdown_fd, &event) == -1) {
+        throw std::system_error(errno, std::system_category());
+    }
+
+    m_thread = std::thread([=] {
+        try {
+            listen();
+        }
+        catch (std::exception const& e) {
+            log_uncaught_exception(util::format("uncaught exception in notifier thread: %1: %2",
+                                                typeid(e).name(), e.what()).c_str());
+            throw;
+        }
+        catch (...) {
+            log_uncaught_exception("uncaught exception in notifier thread");
+            throw;
+        }
+    });
+}
+
+ExternalCommitHelper::~ExternalCommitHelper()
+{
+    uint64_t value = 1;
+    ssize_t ret;
+    do {
+        ret = write(m_shutdown_fd, &value, sizeof value);
+    } while (ret == -1 && errno == EINTR);
+    m_thread.join(); // Wait for the thread to exit
+}
+
+void ExternalCommitHelper::listen()
+{
+    // Thread names are limited to 15 characters on Linux
+    pthread_setname_np(pthread_self(), "Realm notifier");
+
+    while (true) {
+        struct epoll_event events[2];
+        int ret = epoll_wait(m_epfd, events, 2, -1);
+        if (ret == 0 || (ret < 0 && errno == EINTR)) {
+            // Spurious wakeup; just wait again
+            continue;
+        }
+        if (ret < 0) {
+            throw std::system_error(errno, std::system_category());
+        }
+
+        // Check shutdown first so that a commit arriving at the same time as
+        // the destructor doesn't start a pass on a coordinator being torn down
+        bool changed = false;
+        for (int i = 0; i < ret; ++i) {
+            if (events[i].data.fd == m_shutdown_fd) {
+                return;
+            }
+            assert(events[i].data.fd == m_notify_fd);
+            changed = true;
+        }
+
+        if (changed) {
+            m_parent.on_change();
+        }
+    }
+}
+
+void ExternalCommitHelper::notify_others()
+{
+    notify_fd(m_notify_fd);
+}
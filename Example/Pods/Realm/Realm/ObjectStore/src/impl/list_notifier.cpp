@@ -22,6 +22,8 @@
 
 #include <realm/link_view.hpp>
 
+#include <algorithm>
+
 using namespace realm;
 using namespace realm::_impl;
 
@@ -63,8 +65,8 @@ bool ListNotifier::do_add_required_change_info(TransactionChangeInfo& info)
 
     auto& table = m_lv->get_origin_table();
     size_t row_ndx = m_lv->get_origin_row_index();
-    size_t col_ndx = find_container_column(table, row_ndx, m_lv, type_LinkList, &Table::get_linklist);
-    info.lists.push_back({table.get_index_in_group(), row_ndx, col_ndx, &m_change});
+    m_col_ndx = find_container_column(table, row_ndx, m_lv, type_LinkList, &Table::get_linklist);
+    info.lists.push_back({table.get_index_in_group(), row_ndx, m_col_ndx, &m_change});
 
     m_info = &info;
     return true;
@@ -85,6 +87,80 @@ void ListNotifier::run()
         return;
     }
 
+    NotifierStageTimer timer(*this, NotifierStage::calculate_changes);
+    // When only the target rows themselves matter, start from the modified
+    // rows instead of the list if there are fewer of them
+    auto modifications = get_direct_modifications(*m_info, m_lv->get_target_table());
+    if (modifications && modifications->count() < m_lv->size() && update_column_index())
+        add_modified_targets(*modifications);
+    else
+        check_all_rows();
+
+    m_prev_size = m_lv->size();
+}
+
+bool ListNotifier::update_column_index()
+{
+    // Inserting and moving columns while advancing updates the column index
+    // in the change info's entry for this list but not the one computed when
+    // the entry was added
+    for (auto const& list : m_info->lists) {
+        if (list.changes == &m_change) {
+            m_col_ndx = list.col_ndx;
+            return true;
+        }
+    }
+    return false;
+}
+
+void ListNotifier::add_modified_targets(IndexSet const& modifications)
+{
+    auto const& origin = m_lv->get_origin_table();
+    auto const& target = m_lv->get_target_table();
+    size_t origin_row = m_lv->get_origin_row_index();
+
+    // Count the links to each modified row from this list. This is usually
+    // just a few backlinks, so rows which aren't in the list are skipped
+    // without searching it.
+    std::vector<std::pair<size_t, size_t>> linked_rows;
+    for (auto row : modifications.as_indexes()) {
+        size_t links = 0;
+        for (size_t i = 0, count = target.get_backlink_count(row, origin, m_col_ndx); i < count; ++i) {
+            if (target.get_backlink(row, origin, m_col_ndx, i) == origin_row)
+                ++links;
+        }
+        if (links)
+            linked_rows.emplace_back(row, links);
+    }
+
+    // Each search for a row scans the list from the start, so past a few rows
+    // it's cheaper to check every element of the list against them once
+    const size_t max_searched_rows = 4;
+    if (linked_rows.size() > max_searched_rows) {
+        // as_indexes() is in ascending order, so linked_rows is sorted by row
+        auto less = [](std::pair<size_t, size_t> const& a, size_t row) { return a.first < row; };
+        for (size_t pos = 0, size = m_lv->size(); pos < size; ++pos) {
+            size_t row = m_lv->get(pos).get_index();
+            auto it = std::lower_bound(linked_rows.begin(), linked_rows.end(), row, less);
+            if (it != linked_rows.end() && it->first == row)
+                m_change.modifications.add(pos);
+        }
+        return;
+    }
+
+    for (auto const& linked : linked_rows) {
+        for (size_t pos = 0, links = linked.second; links > 0; --links, ++pos) {
+            pos = m_lv->find(linked.first, pos);
+            REALM_ASSERT_DEBUG(pos != npos);
+            if (pos == npos)
+                break;
+            m_change.modifications.add(pos);
+        }
+    }
+}
+
+void ListNotifier::check_all_rows()
+{
     auto row_did_change = get_modification_checker(*m_info, m_lv->get_target_table());
     for (size_t i = 0; i < m_lv->size(); ++i) {
         if (m_change.modifications.contains(i))
@@ -99,8 +175,6 @@ void ListNotifier::run()
         if (row_did_change(m_lv->get(move.to).get_index()))
             m_change.modifications.add(move.to);
     }
-
-    m_prev_size = m_lv->size();
 }
 
 void ListNotifier::do_prepare_handover(SharedGroup&)
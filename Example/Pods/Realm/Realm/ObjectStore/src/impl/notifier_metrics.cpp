@@ -0,0 +1,248 @@
+////////////////////////////////////////////////////////////////////////////
+//
+// Copyright 2016 Realm Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+////////////////////////////////////////////////////////////////////////////
+
+#include "impl/notifier_metrics.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <limits>
+#include <thread>
+
+using namespace realm;
+using namespace realm::_impl;
+
+namespace {
+// Enough to cover every commit which a notifier run can still be behind
+const size_t max_tracked_commits = 64;
+// Tens of megabytes of events, which is more than the trace viewer copes with
+const size_t max_trace_events = 1000000;
+
+size_t highest_bit(uint64_t value) noexcept
+{
+    size_t bit = 0;
+    while (value >>= 1)
+        ++bit;
+    return bit;
+}
+
+void append_escaped(std::string& out, std::string const& str)
+{
+    for (char c : str) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        }
+        else if (static_cast<unsigned char>(c) < 0x20) {
+            char buffer[8];
+            snprintf(buffer, sizeof(buffer), "\\u%04x", c);
+            out += buffer;
+        }
+        else {
+            out += c;
+        }
+    }
+}
+} // anonymous namespace
+
+LatencyHistogram::LatencyHistogram() noexcept
+{
+    reset();
+}
+
+size_t LatencyHistogram::bucket_for(uint64_t value) noexcept
+{
+    const uint64_t sub_bucket_count = uint64_t(1) << sub_bucket_bits;
+    if (value < sub_bucket_count)
+        return size_t(value);
+    size_t exponent = highest_bit(value);
+    if (exponent >= max_exponent)
+        return bucket_count - 1;
+    size_t shift = exponent - sub_bucket_bits;
+    return ((shift + 1) << sub_bucket_bits) + size_t((value >> shift) - sub_bucket_count);
+}
+
+uint64_t LatencyHistogram::highest_value_in(size_t bucket) noexcept
+{
+    const size_t sub_bucket_count = size_t(1) << sub_bucket_bits;
+    if (bucket < sub_bucket_count)
+        return bucket;
+    size_t shift = (bucket >> sub_bucket_bits) - 1;
+    uint64_t first = uint64_t((bucket & (sub_bucket_count - 1)) + sub_bucket_count) << shift;
+    return first + (uint64_t(1) << shift) - 1;
+}
+
+void LatencyHistogram::record(Duration duration) noexcept
+{
+    uint64_t value = duration.count() > 0 ? uint64_t(duration.count()) : 0;
+    m_buckets[bucket_for(value)].fetch_add(1, std::memory_order_relaxed);
+    m_total.fetch_add(value, std::memory_order_relaxed);
+
+    uint64_t current = m_min.load(std::memory_order_relaxed);
+    while (value < current && !m_min.compare_exchange_weak(current, value, std::memory_order_relaxed))
+        ;
+    current = m_max.load(std::memory_order_relaxed);
+    while (value > current && !m_max.compare_exchange_weak(current, value, std::memory_order_relaxed))
+        ;
+}
+
+LatencyHistogram::Snapshot LatencyHistogram::snapshot() const
+{
+    Snapshot snapshot;
+    snapshot.buckets.resize(bucket_count);
+    for (size_t i = 0; i < bucket_count; ++i) {
+        snapshot.buckets[i] = m_buckets[i].load(std::memory_order_relaxed);
+        snapshot.count += snapshot.buckets[i];
+    }
+    if (snapshot.count) {
+        snapshot.min = Duration(m_min.load(std::memory_order_relaxed));
+        snapshot.max = Duration(m_max.load(std::memory_order_relaxed));
+        snapshot.total = Duration(m_total.load(std::memory_order_relaxed));
+    }
+    return snapshot;
+}
+
+void LatencyHistogram::reset() noexcept
+{
+    for (auto& bucket : m_buckets)
+        bucket.store(0, std::memory_order_relaxed);
+    m_total.store(0, std::memory_order_relaxed);
+    m_min.store(std::numeric_limits<uint64_t>::max(), std::memory_order_relaxed);
+    m_max.store(0, std::memory_order_relaxed);
+}
+
+LatencyHistogram::Duration LatencyHistogram::Snapshot::mean() const noexcept
+{
+    return count ? Duration(total.count() / Duration::rep(count)) : Duration(0);
+}
+
+LatencyHistogram::Duration LatencyHistogram::Snapshot::percentile(double percentile) const noexcept
+{
+    if (!count)
+        return Duration(0);
+    auto target = uint64_t(std::ceil(count * std::min(std::max(percentile, 0.0), 100.0) / 100.0));
+    target = std::max<uint64_t>(target, 1);
+
+    uint64_t seen = 0;
+    for (size_t i = 0; i < buckets.size(); ++i) {
+        seen += buckets[i];
+        if (seen >= target) {
+            auto value = Duration(highest_value_in(i));
+            return std::max(min, std::min(value, max));
+        }
+    }
+    return max;
+}
+
+const char* realm::_impl::notifier_stage_name(NotifierStage stage) noexcept
+{
+    switch (stage) {
+        case NotifierStage::run:               return "run";
+        case NotifierStage::calculate_changes: return "calculate_changes";
+        case NotifierStage::prepare_handover:  return "prepare_handover";
+        case NotifierStage::deliver:           return "deliver";
+        case NotifierStage::callbacks:         return "callbacks";
+    }
+    return "";
+}
+
+void NotifierMetrics::did_commit(uint64_t version)
+{
+    if (!is_enabled())
+        return;
+
+    auto now = Clock::now();
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_commits.size() == max_tracked_commits)
+        m_commits.erase(m_commits.begin());
+    m_commits.push_back({version, now});
+}
+
+void NotifierMetrics::did_call_callbacks(uint64_t version)
+{
+    if (!is_enabled())
+        return;
+
+    auto now = Clock::now();
+    std::unique_lock<std::mutex> lock(m_mutex);
+    auto it = std::upper_bound(m_commits.begin(), m_commits.end(), version,
+                               [](uint64_t v, auto const& commit) { return v < commit.version; });
+    if (it == m_commits.begin())
+        return;
+    auto commit_time = std::prev(it)->time;
+    lock.unlock();
+
+    m_commit_to_callback.record(std::chrono::duration_cast<LatencyHistogram::Duration>(now - commit_time));
+}
+
+void NotifierMetrics::start_tracing()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_trace_events.clear();
+    m_trace_start = Clock::now();
+    m_tracing.store(true, std::memory_order_relaxed);
+}
+
+void NotifierMetrics::add_trace_event(NotifierStage stage, std::string const& object_type,
+                                      Clock::time_point start, Clock::time_point end)
+{
+    if (!is_tracing())
+        return;
+
+    auto thread = uint64_t(std::hash<std::thread::id>()(std::this_thread::get_id()) & 0xffffffff);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_trace_events.size() < max_trace_events)
+        m_trace_events.push_back({stage, object_type, thread, start, end});
+}
+
+std::string NotifierMetrics::stop_tracing()
+{
+    std::vector<TraceEvent> events;
+    Clock::time_point trace_start;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_tracing.store(false, std::memory_order_relaxed);
+        events.swap(m_trace_events);
+        trace_start = m_trace_start;
+    }
+
+    // Timestamps and durations are in microseconds, relative to start_tracing()
+    auto micros = [](Clock::duration d) {
+        return std::to_string(std::chrono::duration_cast<std::chrono::nanoseconds>(d).count() / 1000.0);
+    };
+
+    std::string json = "{\"traceEvents\":[";
+    for (size_t i = 0; i < events.size(); ++i) {
+        auto& event = events[i];
+        if (i)
+            json += ',';
+        json += "{\"name\":\"";
+        json += notifier_stage_name(event.stage);
+        json += "\",\"cat\":\"notifier\",\"ph\":\"X\",\"pid\":1,\"tid\":";
+        json += std::to_string(event.thread);
+        json += ",\"ts\":";
+        json += micros(event.start - trace_start);
+        json += ",\"dur\":";
+        json += micros(event.end - event.start);
+        json += ",\"args\":{\"object_type\":\"";
+        append_escaped(json, event.object_type);
+        json += "\"}}";
+    }
+    json += "]}";
+    return json;
+}
@@ -0,0 +1,86 @@
+////////////////////////////////////////////////////////////////////////////
+//
+// Copyright 2016 Realm Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+////////////////////////////////////////////////////////////////////////////
+
+#include "impl/notifier_worker_pool.hpp"
+
+using namespace realm;
+using namespace realm::_impl;
+
+NotifierWorkerPool::~NotifierWorkerPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_work_cv.notify_all();
+
+    for (auto& thread : m_threads)
+        thread.join();
+}
+
+void NotifierWorkerPool::run(size_t count, std::function<void(size_t)> const& fn)
+{
+    if (count == 0)
+        return;
+    if (count == 1) {
+        fn(0);
+        return;
+    }
+
+    std::lock_guard<std::mutex> run_lock(m_run_mutex);
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        while (m_threads.size() < count - 1) {
+            size_t index = m_threads.size() + 1;
+            m_threads.emplace_back([=] { worker_main(index); });
+        }
+        m_fn = &fn;
+        m_count = count;
+        m_pending = count - 1;
+        ++m_generation;
+    }
+    m_work_cv.notify_all();
+
+    fn(0);
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_done_cv.wait(lock, [&] { return m_pending == 0; });
+    m_fn = nullptr;
+}
+
+void NotifierWorkerPool::worker_main(size_t index)
+{
+    // A thread started during a pass has that pass's work waiting for it
+    std::unique_lock<std::mutex> lock(m_mutex);
+    uint64_t generation = m_generation - 1;
+    while (true) {
+        m_work_cv.wait(lock, [&] { return m_stopping || m_generation != generation; });
+        if (m_stopping)
+            return;
+        generation = m_generation;
+        if (index >= m_count)
+            continue;
+
+        auto& fn = *m_fn;
+        lock.unlock();
+        fn(index);
+        lock.lock();
+        if (--m_pending == 0)
+            m_done_cv.notify_one();
+    }
+}
@@ -20,78 +20,256 @@
 
 #include "shared_realm.hpp"
 
+#include <realm/group_shared.hpp>
+
+#include <algorithm>
+#include <map>
+#include <unordered_set>
+
 using namespace realm;
 using namespace realm::_impl;
 
-ObjectNotifier::ObjectNotifier(Row const& row, std::shared_ptr<Realm> realm)
+ObjectNotifier::ObjectNotifier(Table const& table, std::shared_ptr<Realm> realm)
 : CollectionNotifier(std::move(realm))
+, m_table_ndx(table.get_index_in_group())
+, m_new_rows_version(version())
+, m_new_rows_table_ndx(m_table_ndx)
 {
-    REALM_ASSERT(row.get_table());
-    set_table(*row.get_table());
+    REALM_ASSERT(m_table_ndx != npos);
+    set_table(table);
 
-    m_handover = source_shared_group().export_for_handover(row);
+    CollectionChangeBuilder deletion;
+    deletion.deletions.add(0);
+    m_deletion = std::make_shared<CollectionChangeBuilder>(std::move(deletion));
+}
+
+util::Optional<uint64_t> ObjectNotifier::add_callback(Row const& row, CollectionChangeCallback& callback,
+                                                      NotificationPriority priority)
+{
+    std::lock_guard<std::mutex> lock(m_new_rows_mutex);
+    if (!is_alive())
+        return util::none;
+    if (source_shared_group().get_version_of_current_transaction() != m_new_rows_version
+        || row.get_table()->get_index_in_group() != m_new_rows_table_ndx) {
+        // The notifier is about to be replaced, so it's only needed for the
+        // callbacks it already has
+        if (m_callback_count == 0)
+            unregister();
+        return util::none;
+    }
+
+    auto token = CollectionNotifier::add_callback(std::move(callback), priority);
+    m_new_rows.emplace_back(row.get_index(), token);
+    ++m_callback_count;
+    return token;
+}
+
+void ObjectNotifier::did_remove_callback(uint64_t token)
+{
+    std::lock_guard<std::mutex> lock(m_new_rows_mutex);
+    m_removed_tokens.push_back(token);
+    if (--m_callback_count == 0)
+        unregister();
 }
 
 void ObjectNotifier::release_data() noexcept
 {
-    m_row = nullptr;
+    m_table.reset();
+    m_rows.clear();
+    m_row_for_token.clear();
+}
+
+void ObjectNotifier::add_row(size_t row_ndx, uint64_t token)
+{
+    m_rows.emplace(row_ndx, token);
+    m_row_for_token.emplace(token, row_ndx);
+}
+
+void ObjectNotifier::remove_token(uint64_t token)
+{
+    auto it = m_row_for_token.find(token);
+    if (it == m_row_for_token.end())
+        return;
+    auto range = m_rows.equal_range(it->second);
+    for (auto row = range.first; row != range.second; ++row) {
+        if (row->second == token) {
+            m_rows.erase(row);
+            break;
+        }
+    }
+    m_row_for_token.erase(it);
+}
+
+void ObjectNotifier::delete_all_rows()
+{
+    for (auto& entry : m_row_for_token)
+        m_changes.emplace_back(entry.first, m_deletion);
+    m_rows.clear();
+    m_row_for_token.clear();
 }
 
 void ObjectNotifier::do_attach_to(SharedGroup& sg)
 {
-    REALM_ASSERT(m_handover);
-    REALM_ASSERT(!m_row);
-    m_row = sg.import_from_handover(std::move(m_handover));
+    REALM_ASSERT(!m_table);
+    if (m_table_ndx != npos)
+        m_table = SharedGroupFriend::get_group(sg).get_table(m_table_ndx);
 }
 
-void ObjectNotifier::do_detach_from(SharedGroup& sg)
+void ObjectNotifier::do_detach_from(SharedGroup&)
 {
-    REALM_ASSERT(!m_handover);
-    if (m_row) {
-        m_handover = sg.export_for_handover(*m_row);
-        m_row = nullptr;
+    if (!m_table)
+        return;
+    if (m_table->is_attached()) {
+        m_table_ndx = m_table->get_index_in_group();
+    }
+    else {
+        delete_all_rows();
+        m_table_ndx = npos;
     }
+    m_table.reset();
 }
 
 bool ObjectNotifier::do_add_required_change_info(TransactionChangeInfo& info)
 {
-    REALM_ASSERT(!m_handover);
     m_info = &info;
-    if (m_row && m_row->is_attached()) {
-        size_t table_ndx = m_row->get_table()->get_index_in_group();
+    // Callbacks can be added for rows at the version the notifier is advancing
+    // from right up until it runs, so the changes are needed even if no rows
+    // are observed yet
+    if (m_table && m_table->is_attached()) {
+        size_t table_ndx = m_table->get_index_in_group();
         if (table_ndx >= info.table_modifications_needed.size())
             info.table_modifications_needed.resize(table_ndx + 1);
+        if (table_ndx >= info.table_moves_needed.size())
+            info.table_moves_needed.resize(table_ndx + 1);
         info.table_modifications_needed[table_ndx] = true;
+        // The row indexes are kept up to date from the moves rather than by core
+        info.table_moves_needed[table_ndx] = true;
     }
     return false;
 }
 
 void ObjectNotifier::run()
 {
-    if (!m_row)
-        return;
-    if (!m_row->is_attached()) {
-        m_change.deletions.add(0);
-        m_row = nullptr;
-        return;
+    // The rows of the callbacks added since the last run are at the version
+    // the notifier advanced from, and so are updated along with the others.
+    // Any added from now on are at the version it advanced to.
+    std::vector<std::pair<size_t, uint64_t>> new_rows;
+    std::vector<uint64_t> removed_tokens;
+    {
+        std::lock_guard<std::mutex> lock(m_new_rows_mutex);
+        new_rows.swap(m_new_rows);
+        removed_tokens.swap(m_removed_tokens);
+        m_new_rows_version = attached_shared_group()->get_version_of_current_transaction();
+        m_new_rows_table_ndx = m_table && m_table->is_attached() ? m_table->get_index_in_group() : npos;
+    }
+
+    if (!removed_tokens.empty()) {
+        std::unordered_set<uint64_t> removed(removed_tokens.begin(), removed_tokens.end());
+        new_rows.erase(std::remove_if(new_rows.begin(), new_rows.end(), [&](auto& row) {
+            return removed.count(row.second) != 0;
+        }), new_rows.end());
+        for (auto token : removed_tokens)
+            remove_token(token);
     }
 
-    size_t table_ndx = m_row->get_table()->get_index_in_group();
-    if (table_ndx >= m_info->tables.size())
+    if (!m_table || !m_table->is_attached()) {
+        for (auto& row : new_rows)
+            m_changes.emplace_back(row.second, m_deletion);
+        delete_all_rows();
         return;
-    auto& change = m_info->tables[table_ndx];
-    if (!change.modifications.contains(m_row->get_index()))
+    }
+
+    size_t table_ndx = m_table->get_index_in_group();
+    if (m_info && table_ndx < m_info->tables.size())
+        update(m_info->tables[table_ndx], new_rows);
+    else {
+        for (auto& row : new_rows)
+            add_row(row.first, row.second);
+    }
+}
+
+void ObjectNotifier::update(CollectionChangeBuilder const& changes,
+                            std::vector<std::pair<size_t, uint64_t>>& new_rows)
+{
+    // Existing rows can only be moved or removed if rows were deleted or
+    // inserted somewhere other than the end, so normally this is skipped
+    if (!changes.deletions.empty() || !changes.insertions.empty()) {
+        std::vector<std::pair<size_t, uint64_t>> moved;
+        for (auto it = m_rows.begin(); it != m_rows.end(); ) {
+            size_t row = changes.new_index_of(it->first);
+            if (row == it->first) {
+                ++it;
+                continue;
+            }
+
+            if (row == npos) {
+                m_changes.emplace_back(it->second, m_deletion);
+                m_row_for_token.erase(it->second);
+            }
+            else {
+                moved.emplace_back(row, it->second);
+                m_row_for_token[it->second] = row;
+            }
+            it = m_rows.erase(it);
+        }
+        m_rows.insert(moved.begin(), moved.end());
+
+        for (auto& row : new_rows)
+            row.first = changes.new_index_of(row.first);
+    }
+    for (auto& row : new_rows) {
+        if (row.first == npos)
+            m_changes.emplace_back(row.second, m_deletion);
+        else
+            add_row(row.first, row.second);
+    }
+
+    if (changes.modifications.empty())
         return;
-    m_change.modifications.add(0);
-    m_change.columns.reserve(change.columns.size());
-    for (auto& col : change.columns) {
-        m_change.columns.emplace_back();
-        if (col.contains(m_row->get_index()))
-            m_change.columns.back().add(0);
+
+    // Rows modified in the same columns share a changeset, which also lets
+    // package_for_delivery() merge it once for all of their callbacks
+    std::map<std::vector<bool>, SharedChanges> modifications;
+    auto add_modification = [&](size_t row, uint64_t token) {
+        std::vector<bool> columns;
+        columns.reserve(changes.columns.size());
+        for (auto& col : changes.columns)
+            columns.push_back(col.contains(row));
+
+        auto& shared = modifications[columns];
+        if (!shared) {
+            CollectionChangeBuilder change;
+            change.modifications.add(0);
+            change.columns.reserve(columns.size());
+            for (bool modified : columns) {
+                change.columns.emplace_back();
+                if (modified)
+                    change.columns.back().add(0);
+            }
+            shared = std::make_shared<CollectionChangeBuilder>(std::move(change));
+        }
+        m_changes.emplace_back(token, shared);
+    };
+
+    // Look the modified rows up in the observed rows or vice versa, whichever
+    // there are fewer of
+    if (changes.modifications.count() < m_rows.size()) {
+        for (auto row : changes.modifications.as_indexes()) {
+            auto range = m_rows.equal_range(row);
+            for (auto it = range.first; it != range.second; ++it)
+                add_modification(row, it->second);
+        }
+    }
+    else {
+        for (auto& entry : m_rows) {
+            if (changes.modifications.contains(entry.first))
+                add_modification(entry.first, entry.second);
+        }
     }
 }
 
 void ObjectNotifier::do_prepare_handover(SharedGroup&)
 {
-    add_changes(std::move(m_change));
+    add_changes(std::move(m_changes));
+    m_changes.clear();
 }
@@ -20,6 +20,8 @@
 
 #include "impl/collection_notifier.hpp"
 #include "impl/external_commit_helper.hpp"
+#include "impl/notifier_worker_pool.hpp"
+#include "impl/object_notifier.hpp"
 #include "impl/transact_log_handler.hpp"
 #include "impl/weak_realm_notifier.hpp"
 #include "binding_context.hpp"
@@ -43,6 +45,7 @@
 #include <realm/string_data.hpp>
 
 #include <algorithm>
+#include <chrono>
 #include <unordered_map>
 
 using namespace realm;
@@ -508,6 +511,7 @@ void RealmCoordinator::commit_write(Realm& realm)
         std::lock_guard<std::mutex> l(m_notifier_mutex);
 
         transaction::commit(*Realm::Internal::get_shared_group(realm));
+        m_notifier_metrics->did_commit(Realm::Internal::get_shared_group(realm)->get_version_of_current_transaction().version);
 
         // Don't need to check m_new_notifiers because those don't skip versions
         bool have_notifiers = std::any_of(m_notifiers.begin(), m_notifiers.end(),
@@ -581,6 +585,33 @@ void RealmCoordinator::register_notifier(std::shared_ptr<CollectionNotifier> not
     }
 }
 
+std::shared_ptr<ObjectNotifier> RealmCoordinator::get_object_notifier(std::shared_ptr<Realm> const& realm,
+                                                                     Table const& table, ObjectNotifier const* stale)
+{
+    auto& self = Realm::Internal::get_coordinator(*realm);
+    std::shared_ptr<ObjectNotifier> notifier;
+    {
+        std::lock_guard<std::mutex> lock(self.m_object_notifier_mutex);
+        auto& entry = self.m_object_notifiers[{realm.get(), table.get_index_in_group()}];
+        notifier = entry.lock();
+        if (notifier && notifier.get() != stale)
+            return notifier;
+
+        // Drop the entries for notifiers which are gone while we're
+        // replacing one anyway
+        for (auto it = self.m_object_notifiers.begin(); it != self.m_object_notifiers.end(); ) {
+            if (&it->second != &entry && it->second.expired())
+                it = self.m_object_notifiers.erase(it);
+            else
+                ++it;
+        }
+        notifier = std::make_shared<ObjectNotifier>(table, realm);
+        entry = notifier;
+    }
+    register_notifier(notifier);
+    return notifier;
+}
+
 void RealmCoordinator::clean_up_dead_notifiers()
 {
     auto swap_remove = [&](auto& container) {
@@ -602,15 +633,21 @@ void RealmCoordinator::clean_up_dead_notifiers()
         return did_remove;
     };
 
-    if (swap_remove(m_notifiers)) {
-        // Make sure we aren't holding on to read versions needlessly if there
-        // are no notifiers left, but don't close them entirely as opening shared
-        // groups is expensive
-        if (m_notifiers.empty() && m_notifier_sg) {
-            REALM_ASSERT_3(m_notifier_sg->get_transact_stage(), ==, SharedGroup::transact_Reading);
-            m_notifier_sg->end_read();
-            m_notifier_skip_version = {0, 0};
-        }
+    if (swap_remove(m_notifiers) && m_notifiers.empty()) {
+        m_notifier_skip_version = {0, 0};
+    }
+
+    // Make sure we aren't holding on to read versions needlessly for shards
+    // which have no notifiers left, but don't close them entirely as opening
+    // shared groups is expensive
+    for (auto& shard : m_notifier_shards) {
+        if (shard.sg->get_transact_stage() != SharedGroup::transact_Reading)
+            continue;
+        bool in_use = std::any_of(m_notifiers.begin(), m_notifiers.end(), [&](auto&& notifier) {
+            return notifier->attached_shared_group() == shard.sg.get();
+        });
+        if (!in_use)
+            shard.sg->end_read();
     }
     if (swap_remove(m_new_notifiers) && m_advancer_sg) {
         REALM_ASSERT_3(m_advancer_sg->get_transact_stage(), ==, SharedGroup::transact_Reading);
@@ -723,6 +760,59 @@ private:
     TransactionChangeInfo* m_current = nullptr;
     SharedGroup& m_sg;
 };
+
+// The notifiers which run on a single notifier shard during one pass
+struct ShardWork {
+    SharedGroup* sg;
+    _impl::NotifierShardState* state;
+    std::vector<std::shared_ptr<_impl::CollectionNotifier>> notifiers;
+    std::vector<std::shared_ptr<_impl::CollectionNotifier>> new_notifiers;
+    // The sum of the estimated run costs of the notifiers
+    std::chrono::nanoseconds estimated_cost{0};
+};
+
+void run_notifier(_impl::CollectionNotifier& notifier)
+{
+    NotifierStageTimer timer(notifier, NotifierStage::run);
+    auto start = std::chrono::steady_clock::now();
+    notifier.run();
+    notifier.record_run_cost(std::chrono::steady_clock::now() - start);
+}
+
+// Run the notifiers with the highest priority callbacks first, and within each
+// priority the cheapest first, so that as many notifiers as possible finish
+// before the deadline and the ones left to defer are the least important
+void sort_for_running(std::vector<std::shared_ptr<_impl::CollectionNotifier>>& notifiers)
+{
+    std::stable_sort(notifiers.begin(), notifiers.end(), [](auto const& a, auto const& b) {
+        auto a_priority = a->priority(), b_priority = b->priority();
+        if (a_priority != b_priority)
+            return a_priority > b_priority;
+        return a->estimated_run_cost() < b->estimated_run_cost();
+    });
+}
+
+// Call `fn` for each shard, running all but the first on the coordinator's
+// worker threads, and rethrow the first error reported by any of them once
+// they've all finished
+template<typename Fn>
+void for_each_shard(NotifierWorkerPool& workers, std::vector<ShardWork>& shards, Fn&& fn)
+{
+    std::vector<std::exception_ptr> errors(shards.size());
+    workers.run(shards.size(), [&](size_t i) {
+        try {
+            fn(shards[i]);
+        }
+        catch (...) {
+            errors[i] = std::current_exception();
+        }
+    });
+
+    for (auto& error : errors) {
+        if (error)
+            std::rethrow_exception(error);
+    }
+}
 } // anonymous namespace
 
 void RealmCoordinator::run_async_notifiers()
@@ -800,57 +890,142 @@ void RealmCoordinator::run_async_notifiers()
     auto skip_version = m_notifier_skip_version;
     m_notifier_skip_version = {0, 0};
 
-    // Make a copy of the notifiers vector and then release the lock to avoid
-    // blocking other threads trying to register or unregister notifiers while we run them
-    auto notifiers = m_notifiers;
+    // Group the notifiers by the shard they run on. Existing notifiers stay on
+    // the SharedGroup they're attached to, as their accessors belong to it,
+    // while new notifiers are spread over the shards with the lowest estimated
+    // cost from previous runs. A new notifier which is equivalent to one which
+    // is already placed goes to the same shard, so that they can share their
+    // results.
+    std::vector<ShardWork> shards;
+    shards.reserve(m_notifier_shards.size());
+    for (auto& shard : m_notifier_shards)
+        shards.push_back({shard.sg.get(), shard.state.get(), {}, {}});
+    std::chrono::nanoseconds total_cost{0};
+    for (auto& notifier : m_notifiers) {
+        auto it = std::find_if(shards.begin(), shards.end(), [&](auto& shard) {
+            return shard.sg == notifier->attached_shared_group();
+        });
+        REALM_ASSERT(it != shards.end());
+        it->notifiers.push_back(notifier);
+        it->estimated_cost += notifier->estimated_run_cost();
+        total_cost += notifier->estimated_run_cost();
+    }
+    // New notifiers haven't been run yet, so assume they cost as much as the
+    // average existing one
+    std::chrono::nanoseconds new_notifier_cost{1};
+    if (!m_notifiers.empty())
+        new_notifier_cost = std::max(new_notifier_cost, total_cost / std::chrono::nanoseconds::rep(m_notifiers.size()));
+    std::unordered_map<std::string, size_t> shard_for_key;
+    if (!new_notifiers.empty()) {
+        for (size_t i = 0; i < shards.size(); ++i) {
+            for (auto& notifier : shards[i].notifiers) {
+                auto& key = notifier->shard_affinity_key();
+                if (!key.empty())
+                    shard_for_key.emplace(key, i);
+            }
+        }
+    }
+    for (auto& notifier : new_notifiers) {
+        auto& key = notifier->shard_affinity_key();
+        auto placed = key.empty() ? shard_for_key.end() : shard_for_key.find(key);
+        auto it = shards.begin();
+        if (placed != shard_for_key.end()) {
+            it += placed->second;
+        }
+        else {
+            it = std::min_element(shards.begin(), shards.end(), [](auto& a, auto& b) {
+                if (a.estimated_cost != b.estimated_cost)
+                    return a.estimated_cost < b.estimated_cost;
+                return a.notifiers.size() + a.new_notifiers.size() < b.notifiers.size() + b.new_notifiers.size();
+            });
+            if (!key.empty())
+                shard_for_key.emplace(key, it - shards.begin());
+        }
+        it->new_notifiers.push_back(notifier);
+        it->estimated_cost += new_notifier_cost;
+    }
+    for (auto& shard : shards)
+        sort_for_running(shard.notifiers);
+    // Shards with nothing to run are left alone, and clean_up_dead_notifiers()
+    // will release their read transaction
+    shards.erase(std::remove_if(shards.begin(), shards.end(), [](auto& shard) {
+        return shard.notifiers.empty() && shard.new_notifiers.empty();
+    }), shards.end());
+
+    // Release the lock to avoid blocking other threads trying to register or
+    // unregister notifiers while we run them
     m_notifiers.insert(m_notifiers.end(), new_notifiers.begin(), new_notifiers.end());
+    auto deadline = m_config.notifier_deadline;
+    if (!m_notifier_workers)
+        m_notifier_workers = std::make_unique<NotifierWorkerPool>();
     lock.unlock();
 
+    auto start = std::chrono::steady_clock::now();
     if (skip_version.version) {
-        REALM_ASSERT(!notifiers.empty());
         REALM_ASSERT(version >= skip_version);
-        IncrementalChangeInfo change_info(*m_notifier_sg, notifiers);
-        for (auto& notifier : notifiers)
-            notifier->add_required_change_info(change_info.current());
-        change_info.advance_to_final(skip_version);
+        for_each_shard(*m_notifier_workers, shards, [&](ShardWork& shard) {
+            if (shard.notifiers.empty())
+                return;
+            IncrementalChangeInfo change_info(*shard.sg, shard.notifiers);
+            for (auto& notifier : shard.notifiers)
+                notifier->add_required_change_info(change_info.current());
+            change_info.advance_to_final(skip_version);
 
-        for (auto& notifier : notifiers)
-            notifier->run();
+            for (auto& notifier : shard.notifiers)
+                run_notifier(*notifier);
+        });
 
+        // The handover for every shard is done under a single acquisition of
+        // the lock so that delivery never sees notifiers at mixed versions
         lock.lock();
-        for (auto& notifier : notifiers)
-            notifier->prepare_handover();
+        for (auto& shard : shards) {
+            for (auto& notifier : shard.notifiers)
+                notifier->prepare_handover();
+        }
         lock.unlock();
     }
 
-    // Advance the non-new notifiers to the same version as we advanced the new
-    // ones to (or the latest if there were no new ones)
-    IncrementalChangeInfo change_info(*m_notifier_sg, notifiers);
-    for (auto& notifier : notifiers) {
-        notifier->add_required_change_info(change_info.current());
-    }
-    change_info.advance_to_final(version);
+    for_each_shard(*m_notifier_workers, shards, [&](ShardWork& shard) {
+        // Advance the non-new notifiers to the same version as we advanced the
+        // new ones to (or the latest if there were no new ones)
+        IncrementalChangeInfo change_info(*shard.sg, shard.notifiers);
+        for (auto& notifier : shard.notifiers) {
+            notifier->add_required_change_info(change_info.current());
+        }
+        change_info.advance_to_final(version);
 
-    // Attach the new notifiers to the main SG and move them to the main list
-    for (auto& notifier : new_notifiers) {
-        notifier->attach_to(*m_notifier_sg);
-        notifier->run();
-    }
+        // Attach the new notifiers to the shard's SG
+        for (auto& notifier : shard.new_notifiers) {
+            notifier->attach_to(*shard.sg, shard.state);
+            run_notifier(*notifier);
+        }
 
-    // Change info is now all ready, so the notifiers can now perform their
-    // background work
-    for (auto& notifier : notifiers) {
-        notifier->run();
-    }
+        // Change info is now all ready, so the notifiers can now perform their
+        // background work.
+        // Once the deadline has passed and there's a newer version which will
+        // trigger another pass, notifiers which can catch up later skip this
+        // version and merge its changes into the next one instead. New
+        // notifiers and high-priority ones are always run.
+        bool behind = false;
+        for (auto& notifier : shard.notifiers) {
+            if (!behind && deadline.count() && notifier->priority() != NotificationPriority::high)
+                behind = std::chrono::steady_clock::now() - start >= deadline && shard.sg->has_changed();
+            if (behind && notifier->priority() != NotificationPriority::high && notifier->defer())
+                continue;
+            run_notifier(*notifier);
+        }
+    });
 
     // Reacquire the lock while updating the fields that are actually read on
     // other threads
     lock.lock();
-    for (auto& notifier : new_notifiers) {
-        notifier->prepare_handover();
-    }
-    for (auto& notifier : notifiers) {
-        notifier->prepare_handover();
+    for (auto& shard : shards) {
+        for (auto& notifier : shard.new_notifiers) {
+            notifier->prepare_handover();
+        }
+        for (auto& notifier : shard.notifiers) {
+            notifier->prepare_handover();
+        }
     }
     clean_up_dead_notifiers();
     m_notifier_cv.notify_all();
@@ -858,22 +1033,36 @@ void RealmCoordinator::run_async_notifiers()
 
 void RealmCoordinator::open_helper_shared_group()
 {
-    if (!m_notifier_sg) {
+    // Open one shard per notifier up to the configured limit. Shards are never
+    // closed once opened, as opening shared groups is expensive
+    size_t notifier_count = m_notifiers.size() + m_new_notifiers.size();
+    size_t shard_count = std::max<size_t>(1, std::min(m_config.max_notifier_threads, notifier_count));
+    while (m_notifier_shards.size() < shard_count) {
+        NotifierShard shard;
         try {
             std::unique_ptr<Group> read_only_group;
-            Realm::open_with_config(m_config, m_notifier_history, m_notifier_sg, read_only_group, nullptr);
+            Realm::open_with_config(m_config, shard.history, shard.sg, read_only_group, nullptr);
             REALM_ASSERT(!read_only_group);
-            m_notifier_sg->begin_read();
         }
         catch (...) {
-            // Store the error to be passed to the async notifiers
-            m_async_error = std::current_exception();
-            m_notifier_sg = nullptr;
-            m_notifier_history = nullptr;
+            // Without any shard there's nowhere to run notifiers, so store the
+            // error to be passed to the async notifiers. Failing to open an
+            // additional shard only costs concurrency, so the notifiers are
+            // left to share the shards which are already open
+            if (m_notifier_shards.empty()) {
+                m_async_error = std::current_exception();
+                return;
+            }
+            break;
         }
+        shard.state = std::make_unique<NotifierShardState>();
+        m_notifier_shards.push_back(std::move(shard));
     }
-    else if (m_notifiers.empty()) {
-        m_notifier_sg->begin_read();
+
+    // Shards without any notifiers don't hold a read transaction between runs
+    for (auto& shard : m_notifier_shards) {
+        if (shard.sg->get_transact_stage() == SharedGroup::transact_Ready)
+            shard.sg->begin_read();
     }
 }
 
@@ -1000,18 +1189,50 @@ void RealmCoordinator::process_available_async(Realm& realm)
 
     // Skip delivering if the Realm isn't in a read transaction
     if (in_read) {
-        for (auto& notifier : notifiers)
+        for (auto& notifier : notifiers) {
+            NotifierStageTimer timer(*notifier, NotifierStage::deliver);
             notifier->deliver(*sg);
+        }
     }
 
     // but still call the change callbacks
     for (auto& notifier : notifiers)
         notifier->after_advance();
+    if (in_read)
+        m_notifier_metrics->did_call_callbacks(version.version);
 
     if (realm.m_binding_context)
         realm.m_binding_context->did_send_notifications();
 }
 
+std::vector<RealmCoordinator::NotifierStatistics> RealmCoordinator::get_notifier_statistics()
+{
+    std::vector<std::shared_ptr<_impl::CollectionNotifier>> notifiers;
+    {
+        std::lock_guard<std::mutex> lock(m_notifier_mutex);
+        notifiers = m_notifiers;
+        notifiers.insert(notifiers.end(), m_new_notifiers.begin(), m_new_notifiers.end());
+    }
+
+    std::vector<NotifierStatistics> statistics;
+    for (auto& notifier : notifiers) {
+        auto timings = notifier->timings();
+        if (!timings)
+            continue;
+        NotifierStatistics stats;
+        stats.object_type = notifier->object_type();
+        for (size_t i = 0; i < notifier_stage_count; ++i)
+            stats.stages[i] = timings->stages[i].snapshot();
+        statistics.push_back(std::move(stats));
+    }
+
+    auto run_time = [](auto const& stats) { return stats.stages[size_t(NotifierStage::run)].total; };
+    std::sort(statistics.begin(), statistics.end(), [&](auto const& a, auto const& b) {
+        return run_time(a) > run_time(b);
+    });
+    return statistics;
+}
+
 void RealmCoordinator::set_transaction_callback(std::function<void(VersionID, VersionID)> fn)
 {
     create_sync_session(false, false);
@@ -20,9 +20,95 @@
 
 #include "shared_realm.hpp"
 
+#include <algorithm>
+
 using namespace realm;
 using namespace realm::_impl;
 
+namespace {
+// A description of the table, query and ordering which is only the same for
+// two notifiers on the same shard if they'll produce the same results, or an
+// empty string if the query can't be described. Queries on specific objects
+// can't be described, so the description never contains row indices and only
+// changes with the schema.
+std::string evaluation_key(Query& query, DescriptorOrdering const& ordering, bool in_table_order)
+{
+    // Queries restricted to a LinkView or TableView aren't fully described by
+    // the query description, and subtables have no index to identify them
+    if (!query.produces_results_in_table_order())
+        return {};
+    auto& table = query.get_table();
+    size_t table_ndx = table->get_index_in_group();
+    if (table_ndx == npos)
+        return {};
+
+    try {
+        std::string key = std::to_string(table_ndx);
+        key += in_table_order ? " T " : " F ";
+        key += query.get_description();
+        key += ' ';
+        key += ordering.get_description(table);
+        return key;
+    }
+    catch (std::exception const&) {
+        // Not every query can be serialized
+        return {};
+    }
+}
+
+std::vector<size_t> rows_of(TableView const& tv)
+{
+    std::vector<size_t> rows;
+    rows.reserve(tv.size());
+    for (size_t i = 0; i < tv.size(); ++i)
+        rows.push_back(tv[i].get_index());
+    return rows;
+}
+
+// Take the value shared through `shared`, moving it out if nothing else
+// refers to it and copying it otherwise
+template<typename T>
+T take_shared(std::shared_ptr<T>& shared)
+{
+    T value = shared.use_count() == 1 ? std::move(*shared) : *shared;
+    shared = nullptr;
+    return value;
+}
+
+// A TableView of the query holding the given rows, indistinguishable from the
+// one find_all() would return if they're the rows the query matches. The
+// constructor which sets up a TableView to rerun a query when it's out of date
+// is only available to subclasses.
+class IncrementalTableView : public TableView {
+public:
+    IncrementalTableView(Query& query, std::vector<size_t> const& rows)
+    : TableView(query.get_table().get(), query, 0, size_t(-1), size_t(-1))
+    {
+        for (auto row : rows)
+            m_row_indexes.add(row);
+    }
+};
+
+// Update row indices from before `changes` to the row indices after them, with
+// npos for rows which were deleted
+void translate_rows(std::vector<size_t>& rows, CollectionChangeBuilder const& changes)
+{
+    for (auto& idx : rows) {
+        if (idx != npos)
+            idx = changes.new_index_of(idx);
+    }
+}
+
+// Merge `new_rows` into the sorted set of row indices `rows`
+void merge_sorted_rows(std::vector<size_t>& rows, std::vector<size_t> const& new_rows)
+{
+    rows.insert(rows.end(), new_rows.begin(), new_rows.end());
+    rows.erase(std::remove(rows.begin(), rows.end(), npos), rows.end());
+    std::sort(rows.begin(), rows.end());
+    rows.erase(std::unique(rows.begin(), rows.end()), rows.end());
+}
+} // anonymous namespace
+
 ResultsNotifier::ResultsNotifier(Results& target)
 : CollectionNotifier(target.get_realm())
 , m_target_results(&target)
@@ -30,6 +116,9 @@ ResultsNotifier::ResultsNotifier(Results& target)
 {
     Query q = target.get_query();
     set_table(*q.get_table());
+    // Known before the notifier is attached so that the coordinator can place
+    // it on the same shard as any equivalent notifiers
+    m_evaluation_key = evaluation_key(q, target.get_descriptor_ordering(), m_target_is_in_table_order);
     m_query_handover = source_shared_group().export_for_handover(q, MutableSourcePayload::Move);
     DescriptorOrdering::generate_patch(target.get_descriptor_ordering(), m_ordering_handover);
 }
@@ -45,6 +134,8 @@ void ResultsNotifier::target_results_moved(Results& old_target, Results& new_tar
 void ResultsNotifier::release_data() noexcept
 {
     m_query = nullptr;
+    m_evaluation = nullptr;
+    m_shared_tv = nullptr;
 }
 
 // Most of the inter-thread synchronization for run(), prepare_handover(),
@@ -88,6 +179,14 @@ bool ResultsNotifier::do_add_required_change_info(TransactionChangeInfo& info)
         if (info.table_moves_needed.size() <= table_ndx)
             info.table_moves_needed.resize(table_ndx + 1);
         info.table_moves_needed[table_ndx] = true;
+
+        // Updating the rows incrementally needs the table's changes even if
+        // there are no callbacks to calculate changes for
+        if (m_incremental) {
+            if (info.table_modifications_needed.size() <= table_ndx)
+                info.table_modifications_needed.resize(table_ndx + 1);
+            info.table_modifications_needed[table_ndx] = true;
+        }
     }
 
     return has_run() && have_callbacks();
@@ -102,6 +201,8 @@ bool ResultsNotifier::need_to_run()
         auto lock = lock_target();
         // Don't run the query if the results aren't actually going to be used
         if (!get_realm() || (!have_callbacks() && !m_target_results->wants_background_updates())) {
+            // and the previous rows fall behind while they aren't
+            m_previous_rows_current = false;
             return false;
         }
     }
@@ -114,74 +215,330 @@ bool ResultsNotifier::need_to_run()
     return true;
 }
 
-void ResultsNotifier::calculate_changes()
+std::vector<size_t>& ResultsNotifier::previous_rows()
+{
+    if (m_previous_rows.use_count() > 1)
+        m_previous_rows = std::make_shared<std::vector<size_t>>(*m_previous_rows);
+    return *m_previous_rows;
+}
+
+// Calculate the changes from the previous rows to `next_rows` into m_changes.
+// The caller then makes `next_rows` the previous rows.
+void ResultsNotifier::calculate_changes(std::vector<size_t> const& next_rows)
 {
     size_t table_ndx = m_query->get_table()->get_index_in_group();
     if (has_run() && have_callbacks()) {
+        NotifierStageTimer timer(*this, NotifierStage::calculate_changes);
         CollectionChangeBuilder* changes = nullptr;
         if (table_ndx == npos)
             changes = &m_changes;
         else if (table_ndx < m_info->tables.size())
             changes = &m_info->tables[table_ndx];
 
-        std::vector<size_t> next_rows;
-        next_rows.reserve(m_tv.size());
-        for (size_t i = 0; i < m_tv.size(); ++i)
-            next_rows.push_back(m_tv[i].get_index());
-
+        auto& previous = previous_rows();
         util::Optional<IndexSet> move_candidates;
+        bool table_order = m_target_is_in_table_order && m_descriptor_ordering.is_empty();
         if (changes) {
-            auto const& moves = changes->moves;
-            for (auto& idx : m_previous_rows) {
-                if (changes->deletions.contains(idx)) {
-                    // check if this deletion was actually a move
-                    auto it = lower_bound(begin(moves), end(moves), idx,
-                                          [](auto const& a, auto b) { return a.from < b; });
-                    idx = it != moves.end() && it->from == idx ? it->to : npos;
-                }
-                else
-                    idx = changes->insertions.shift(changes->deletions.unshift(idx));
+            translate_rows(previous, *changes);
+            if (m_deferred) {
+                translate_rows(m_deferred_modifications, *changes);
+                merge_sorted_rows(m_deferred_modifications, {});
             }
             if (m_target_is_in_table_order && !m_descriptor_ordering.will_apply_sort())
                 move_candidates = changes->insertions;
+            table_order = table_order && changes->moves.empty();
         }
 
-        m_changes = CollectionChangeBuilder::calculate(m_previous_rows, next_rows,
-                                                       get_modification_checker(*m_info, *m_query->get_table()),
-                                                       move_candidates);
+        auto modification_checker = get_batch_modification_checker(*m_info, *m_query->get_table());
+        if (m_deferred) {
+            // The changes from the skipped versions weren't captured in
+            // `changes`, so neither it nor the table order of the previous rows
+            // can be relied on
+            move_candidates = util::none;
+            table_order = false;
+            modification_checker = [&, checker = std::move(modification_checker)](size_t const* rows, size_t count, bool* modified) {
+                checker(rows, count, modified);
+                // Both are in ascending order, so each search starts where the last one ended
+                auto it = m_deferred_modifications.begin(), end = m_deferred_modifications.end();
+                for (size_t i = 0; i < count; ++i) {
+                    it = std::lower_bound(it, end, rows[i]);
+                    modified[i] = modified[i] || (it != end && *it == rows[i]);
+                }
+            };
+        }
 
-        m_previous_rows = std::move(next_rows);
+        // If the results are in table order and no rows were moved then the
+        // updated previous rows are still in table order, so the changes can
+        // be found with a linear merge and only the surviving rows need to be
+        // checked for modifications
+        if (table_order) {
+            m_changes = CollectionChangeBuilder::calculate_sorted(previous, next_rows,
+                                                                  std::move(modification_checker));
+        }
+        else {
+            m_changes = CollectionChangeBuilder::calculate(previous, next_rows,
+                                                           std::move(modification_checker),
+                                                           move_candidates);
+        }
     }
-    else {
-        m_previous_rows.resize(m_tv.size());
-        for (size_t i = 0; i < m_tv.size(); ++i)
-            m_previous_rows[i] = m_tv[i].get_index();
+    m_deferred = false;
+    m_deferred_modifications.clear();
+}
+
+void ResultsNotifier::join_evaluation()
+{
+    auto state = shard_state();
+    if (!state)
+        return;
+
+    // The key contains the table's index, which only changes with the schema
+    if (m_info->schema_changed)
+        m_evaluation_key = evaluation_key(*m_query, m_descriptor_ordering, m_target_is_in_table_order);
+    if (m_evaluation_key.empty()) {
+        m_evaluation = nullptr;
+        return;
+    }
+
+    auto& entry = state->results[m_evaluation_key];
+    auto evaluation = entry.lock();
+    if (!evaluation) {
+        // Drop the entries for evaluations whose notifiers have all gone away
+        // while we're creating a new one anyway
+        for (auto it = state->results.begin(); it != state->results.end(); ) {
+            if (&it->second != &entry && it->second.expired())
+                it = state->results.erase(it);
+            else
+                ++it;
+        }
+        evaluation = std::make_shared<ResultsEvaluation>();
+        entry = evaluation;
+    }
+
+    if (evaluation != m_evaluation) {
+        m_evaluation = std::move(evaluation);
+        m_evaluation_generation = 0;
     }
 }
 
+bool ResultsNotifier::reuse_evaluation()
+{
+    if (!m_evaluation || !m_evaluation->tv)
+        return false;
+    auto& evaluation = *m_evaluation;
+    if (!(m_query->sync_view_if_needed() == evaluation.table_version))
+        return false;
+
+    // An equivalent notifier on this shard has already run the query at this
+    // version, so use its results
+    uint64_t previous_generation = m_evaluation_generation;
+    m_shared_tv = evaluation.tv;
+    m_last_seen_version = evaluation.table_version;
+    m_evaluation_generation = evaluation.generation;
+
+    // and its changes too if it started from the same rows and version as us
+    if (evaluation.changes && has_run() && have_callbacks()
+        && previous_generation != 0 && previous_generation + 1 == evaluation.generation
+        && evaluation.changes_source_version == version()) {
+        m_shared_changes = evaluation.changes;
+        m_previous_rows = evaluation.rows;
+        m_previous_rows_current = true;
+        return true;
+    }
+
+    calculate_changes(*evaluation.rows);
+    m_previous_rows = evaluation.rows;
+    m_previous_rows_current = true;
+    share_changes(previous_generation);
+    return true;
+}
+
+void ResultsNotifier::share_changes(uint64_t previous_generation)
+{
+    // Only the changes from the generation right before the current one are
+    // useful to other notifiers, and the first notifier to calculate them wins
+    auto& evaluation = *m_evaluation;
+    if (evaluation.changes || !has_run() || !have_callbacks())
+        return;
+    if (previous_generation == 0 || previous_generation + 1 != evaluation.generation)
+        return;
+
+    evaluation.changes_source_version = version();
+    m_shared_changes = std::make_shared<CollectionChangeBuilder>(std::move(m_changes));
+    evaluation.changes = m_shared_changes;
+    m_changes = {};
+}
+
+bool ResultsNotifier::can_update_incrementally() const
+{
+    // Sorting, distinct and limit depend on more than whether each row
+    // matches, as do queries restricted to a LinkView or TableView
+    auto& table = *m_query->get_table();
+    if (table.get_index_in_group() == npos || !m_query->produces_results_in_table_order())
+        return false;
+    if (!m_descriptor_ordering.is_empty())
+        return false;
+    return table_is_unlinked(table);
+}
+
+bool ResultsNotifier::update_rows_incrementally(std::vector<size_t>& rows)
+{
+    // The changes from versions skipped by defer() or while there was nothing
+    // to run for weren't captured, and a schema change can change what the
+    // query matches without changing any rows
+    if (!m_incremental || !has_run() || !m_previous_rows_current || m_deferred || m_info->schema_changed)
+        return false;
+
+    rows = *m_previous_rows;
+    auto& table = *m_query->get_table();
+    size_t table_ndx = table.get_index_in_group();
+    if (table_ndx >= m_info->tables.size())
+        return true;
+    auto const& changes = m_info->tables[table_ndx];
+
+    // Move the existing rows to their new indices, dropping deleted ones
+    translate_rows(rows, changes);
+    merge_sorted_rows(rows, {});
+
+    // Re-evaluate the inserted and modified rows, merging them in with the
+    // existing ones
+    std::vector<size_t> candidates;
+    candidates.reserve(changes.insertions.count() + changes.modifications.count());
+    for (auto row : changes.insertions.as_indexes())
+        candidates.push_back(row);
+    for (auto row : changes.modifications.as_indexes())
+        candidates.push_back(row);
+    if (candidates.empty())
+        return true;
+    std::sort(candidates.begin(), candidates.end());
+    candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+
+    std::vector<size_t> next_rows;
+    next_rows.reserve(rows.size() + candidates.size());
+    size_t i = 0;
+    for (size_t row : candidates) {
+        for (; i < rows.size() && rows[i] < row; ++i)
+            next_rows.push_back(rows[i]);
+        if (i < rows.size() && rows[i] == row)
+            ++i;
+        if (row < table.size() && m_query->count(row, row + 1, 1) != 0)
+            next_rows.push_back(row);
+    }
+    next_rows.insert(next_rows.end(), rows.begin() + i, rows.end());
+    rows = std::move(next_rows);
+    return true;
+}
+
 void ResultsNotifier::run()
 {
     // Table's been deleted, so report all rows as deleted
     if (!m_query->get_table()->is_attached()) {
         m_changes = {};
-        m_changes.deletions.set(m_previous_rows.size());
-        m_previous_rows.clear();
+        m_changes.deletions.set(m_previous_rows->size());
+        m_previous_rows = std::make_shared<std::vector<size_t>>();
+        m_deferred = false;
+        m_deferred_modifications.clear();
         return;
     }
 
     if (!need_to_run())
         return;
 
+    // Columns may have been added to or removed from the table, which can
+    // change whether it links to other tables
+    if (m_info->schema_changed)
+        m_incremental = can_update_incrementally();
+
+    join_evaluation();
+    if (reuse_evaluation())
+        return;
+
     m_query->sync_view_if_needed();
-    m_tv = m_query->find_all();
-    m_tv.apply_descriptor_ordering(m_descriptor_ordering);
+    auto next_rows = std::make_shared<std::vector<size_t>>();
+    if (update_rows_incrementally(*next_rows)) {
+        m_tv = IncrementalTableView(*m_query, *next_rows);
+    }
+    else {
+        m_tv = m_query->find_all();
+        m_tv.apply_descriptor_ordering(m_descriptor_ordering);
+        *next_rows = rows_of(m_tv);
+    }
     m_last_seen_version = m_tv.sync_if_needed();
+    m_previous_rows_current = true;
 
-    calculate_changes();
+    if (!m_evaluation) {
+        calculate_changes(*next_rows);
+        m_previous_rows = std::move(next_rows);
+        return;
+    }
+
+    // Publish the results for any equivalent notifiers which run after us
+    auto& evaluation = *m_evaluation;
+    uint64_t previous_generation = m_evaluation_generation;
+    ++evaluation.generation;
+    evaluation.table_version = m_last_seen_version;
+    evaluation.changes = nullptr;
+    m_evaluation_generation = evaluation.generation;
+
+    calculate_changes(*next_rows);
+    m_previous_rows = next_rows;
+    evaluation.rows = std::move(next_rows);
+    m_shared_tv = std::make_shared<TableView>(std::move(m_tv));
+    m_tv = {};
+    evaluation.tv = m_shared_tv;
+    share_changes(previous_generation);
+}
+
+bool ResultsNotifier::defer()
+{
+    // Notifiers which haven't produced results yet, or which would have
+    // nothing to do anyway, are just run. Subtables report their changes
+    // through the change info's list entries and so can't skip a version.
+    if (!has_run() || !m_query->get_table()->is_attached())
+        return false;
+    size_t table_ndx = m_query->get_table()->get_index_in_group();
+    if (table_ndx == npos || !need_to_run())
+        return false;
+
+    // Bring the previous rows up to date so that the next run can diff
+    // against them, and remember which of them were modified
+    auto& previous = previous_rows();
+    if (table_ndx < m_info->tables.size()) {
+        auto const& changes = m_info->tables[table_ndx];
+        translate_rows(previous, changes);
+        translate_rows(m_deferred_modifications, changes);
+    }
+    std::vector<size_t> modified;
+    if (have_callbacks()) {
+        auto row_did_change = get_modification_checker(*m_info, *m_query->get_table());
+        for (auto row : previous) {
+            if (row != npos && row_did_change(row))
+                modified.push_back(row);
+        }
+    }
+    merge_sorted_rows(m_deferred_modifications, modified);
+    m_deferred = true;
+
+    // The last handed-over TableView is no longer up to date, so the target
+    // Results has to sync it itself if it's used before the next run, and
+    // the next run can't reuse changes calculated by equivalent notifiers as
+    // they didn't skip this version
+    m_tv_handover.reset();
+    m_evaluation_generation = 0;
+    return true;
 }
 
 void ResultsNotifier::do_prepare_handover(SharedGroup& sg)
 {
+    // The shared results are only reused by notifiers run for the same
+    // transaction, and all of them have run by now
+    if (m_evaluation) {
+        m_evaluation->tv = nullptr;
+        m_evaluation->rows = nullptr;
+        m_evaluation->changes = nullptr;
+    }
+    if (m_shared_tv)
+        m_tv = take_shared(m_shared_tv);
+
     if (!m_tv.is_attached()) {
         // if the table version didn't change we can just reuse the same handover
         // object and bump its version to the current SG version
@@ -190,7 +547,10 @@ void ResultsNotifier::do_prepare_handover(SharedGroup& sg)
 
         // add_changes() needs to be called even if there are no changes to
         // clear the skip flag on the callbacks
-        add_changes(std::move(m_changes));
+        if (m_shared_changes)
+            add_changes(std::move(m_shared_changes));
+        else
+            add_changes(std::move(m_changes));
         return;
     }
 
@@ -198,7 +558,10 @@ void ResultsNotifier::do_prepare_handover(SharedGroup& sg)
 
     m_tv_handover = sg.export_for_handover(m_tv, MutableSourcePayload::Move);
 
-    add_changes(std::move(m_changes));
+    if (m_shared_changes)
+        add_changes(std::move(m_shared_changes));
+    else
+        add_changes(std::move(m_changes));
     REALM_ASSERT(m_changes.empty());
 
     // detach the TableView as we won't need it again and keeping it around
@@ -239,14 +602,18 @@ void ResultsNotifier::do_attach_to(SharedGroup& sg)
     REALM_ASSERT(m_query_handover);
     m_query = sg.import_from_handover(std::move(m_query_handover));
     m_descriptor_ordering = DescriptorOrdering::create_from_and_consume_patch(m_ordering_handover, *m_query->get_table());
+    m_evaluation_key = evaluation_key(*m_query, m_descriptor_ordering, m_target_is_in_table_order);
+    m_incremental = can_update_incrementally();
 }
 
 void ResultsNotifier::do_detach_from(SharedGroup& sg)
 {
     REALM_ASSERT(m_query);
     REALM_ASSERT(!m_tv.is_attached());
+    REALM_ASSERT(!m_shared_tv);
 
     DescriptorOrdering::generate_patch(m_descriptor_ordering, m_ordering_handover);
     m_query_handover = sg.export_for_handover(*m_query, MutableSourcePayload::Move);
     m_query = nullptr;
+    m_evaluation = nullptr;
 }
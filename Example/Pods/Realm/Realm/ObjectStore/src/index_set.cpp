@@ -19,6 +19,7 @@
 #include "index_set.hpp"
 
 #include <realm/util/assert.hpp>
+#include <realm/utilities.hpp>
 
 #include <algorithm>
 
@@ -27,9 +28,98 @@ using namespace realm::_impl;
 
 const size_t IndexSet::npos;
 
+namespace {
+using Chunk = ChunkedRangeVector::Chunk;
+
+// Chunks with at least half of the maximum number of ranges get a bitmap if
+// their ranges and the gaps between them average no more than this many
+// indices, i.e. if a bitmap is no bigger than their ranges
+const size_t max_bitmap_spacing = 8 * sizeof(std::pair<size_t, size_t>);
+
+int count_bits(uint64_t word) noexcept
+{
+    return fast_popcount64(static_cast<int64_t>(word));
+}
+
+uint64_t bit_mask(size_t first, size_t last) noexcept
+{
+    // The bits from first up to but not including last, within one word
+    uint64_t mask = last == 64 ? ~uint64_t(0) : (uint64_t(1) << last) - 1;
+    return mask & ~((uint64_t(1) << first) - 1);
+}
+
+void set_bits(std::vector<uint64_t>& bits, size_t begin, size_t end) noexcept
+{
+    for (size_t i = begin / 64; i * 64 < end; ++i) {
+        size_t first = std::max(begin, i * 64) - i * 64;
+        size_t last = std::min(end, i * 64 + 64) - i * 64;
+        bits[i] |= bit_mask(first, last);
+    }
+}
+
+size_t count_set_bits(std::vector<uint64_t> const& bits, size_t begin, size_t end) noexcept
+{
+    size_t count = 0;
+    for (size_t i = begin / 64; i * 64 < end; ++i) {
+        size_t first = std::max(begin, i * 64) - i * 64;
+        size_t last = std::min(end, i * 64 + 64) - i * 64;
+        count += count_bits(bits[i] & bit_mask(first, last));
+    }
+    return count;
+}
+
+// The position of the nth (from zero) unset bit, or npos if there are fewer
+// than n + 1. The unused bits at the end of the last word count as unset.
+size_t find_unset_bit(std::vector<uint64_t> const& bits, size_t n) noexcept
+{
+    for (size_t i = 0; i < bits.size(); ++i) {
+        uint64_t unset = ~bits[i];
+        size_t count = count_bits(unset);
+        if (n >= count) {
+            n -= count;
+            continue;
+        }
+        for (; n > 0; --n)
+            unset &= unset - 1;
+        // The number of trailing zeros, i.e. the position of the lowest set bit
+        return i * 64 + count_bits((unset & (~unset + 1)) - 1);
+    }
+    return IndexSet::npos;
+}
+
+// Build or drop the chunk's bitmap to match its ranges
+void update_bitmap(Chunk& chunk)
+{
+    chunk.bits.clear();
+    size_t span = chunk.end - chunk.begin;
+    if (chunk.data.size() < ChunkedRangeVector::max_size / 2 || span > chunk.data.size() * max_bitmap_spacing)
+        return;
+    chunk.bits.resize((span + 63) / 64);
+    for (auto range : chunk.data)
+        set_bits(chunk.bits, range.first - chunk.begin, range.second - chunk.begin);
+}
+
+// The number of indices in the chunk which are in [begin, end)
+size_t count_in_chunk(Chunk const& chunk, size_t begin, size_t end) noexcept
+{
+    begin = std::max(begin, chunk.begin);
+    end = std::min(end, chunk.end);
+    if (!chunk.bits.empty())
+        return count_set_bits(chunk.bits, begin - chunk.begin, end - chunk.begin);
+
+    auto it = std::lower_bound(chunk.data.begin(), chunk.data.end(), begin,
+                               [](auto const& lft, size_t index) { return lft.second <= index; });
+    size_t count = 0;
+    for (; it != chunk.data.end() && it->first < end; ++it)
+        count += std::min(it->second, end) - std::max(it->first, begin);
+    return count;
+}
+} // anonymous namespace
+
 template<typename T>
 void MutableChunkedRangeVectorIterator<T>::set(size_t front, size_t back)
 {
+    this->m_outer->bits.clear();
     this->m_outer->count -= this->m_inner->second - this->m_inner->first;
     if (this->offset() == 0) {
         this->m_outer->begin = front;
@@ -45,6 +135,7 @@ void MutableChunkedRangeVectorIterator<T>::set(size_t front, size_t back)
 template<typename T>
 void MutableChunkedRangeVectorIterator<T>::adjust(ptrdiff_t front, ptrdiff_t back)
 {
+    this->m_outer->bits.clear();
     if (this->offset() == 0) {
         this->m_outer->begin += front;
     }
@@ -59,6 +150,7 @@ void MutableChunkedRangeVectorIterator<T>::adjust(ptrdiff_t front, ptrdiff_t bac
 template<typename T>
 void MutableChunkedRangeVectorIterator<T>::shift(ptrdiff_t distance)
 {
+    this->m_outer->bits.clear();
     if (this->offset() == 0) {
         this->m_outer->begin += distance;
     }
@@ -78,6 +170,18 @@ void ChunkedRangeVector::push_back(value_type value)
         range.data.push_back(value);
         range.count += value.second - value.first;
         range.end = value.second;
+
+        // Appending to a bitmap only needs the new range's bits, and the
+        // bitmap for a chunk filled by appending is built once it's full
+        if (!range.bits.empty()) {
+            range.bits.resize((range.end - range.begin + 63) / 64);
+            set_bits(range.bits, value.first - range.begin, value.second - range.begin);
+            if (range.end - range.begin > range.data.size() * max_bitmap_spacing)
+                range.bits.clear();
+        }
+        else if (range.data.size() == max_size) {
+            update_bitmap(range);
+        }
     }
     else {
         m_data.push_back({{value}, value.first, value.second, value.second - value.first});
@@ -98,6 +202,7 @@ ChunkedRangeVector::iterator ChunkedRangeVector::insert(iterator pos, value_type
     chunk.count += value.second - value.first;
     chunk.begin = std::min(chunk.begin, value.first);
     chunk.end = std::max(chunk.end, value.second);
+    update_bitmap(chunk);
 
     verify();
     return pos;
@@ -127,6 +232,8 @@ ChunkedRangeVector::iterator ChunkedRangeVector::ensure_space(iterator pos)
     new_pos->begin = new_pos->data.front().first;
     new_pos->end = new_pos->data.back().second;
     new_pos->count = moved_count;
+    update_bitmap(*prev);
+    update_bitmap(*new_pos);
 
     if (offset >= to_move) {
         pos.m_outer = new_pos;
@@ -158,6 +265,7 @@ ChunkedRangeVector::iterator ChunkedRangeVector::erase(iterator pos) noexcept
 
     chunk.begin = chunk.data.front().first;
     chunk.end = chunk.data.back().second;
+    update_bitmap(chunk);
     if (offset < chunk.data.size())
         pos.m_inner = &chunk.data[offset];
     else {
@@ -188,6 +296,13 @@ void ChunkedRangeVector::verify() const noexcept
         for (auto range : chunk.data)
             count += range.second - range.first;
         REALM_ASSERT(count == chunk.count);
+
+        if (!chunk.bits.empty()) {
+            REALM_ASSERT(chunk.bits.size() == (chunk.end - chunk.begin + 63) / 64);
+            REALM_ASSERT(count_set_bits(chunk.bits, 0, chunk.bits.size() * 64) == chunk.count);
+            for (auto range : chunk.data)
+                REALM_ASSERT(count_set_bits(chunk.bits, range.first - chunk.begin, range.second - chunk.begin) == range.second - range.first);
+        }
     }
 #endif
 }
@@ -241,7 +356,7 @@ void ChunkedRangeVectorBuilder::push_back(std::pair<size_t, size_t> range)
         chunk.end = chunk.data.back().second;
         ++m_outer_pos;
         if (m_outer_pos >= m_data.size())
-            m_data.push_back({{range}, range.first, 0, 1});
+            m_data.push_back({{range}, range.first, 0, range.second - range.first});
         else {
             auto& chunk = m_data[m_outer_pos];
             chunk.data.push_back(range);
@@ -260,8 +375,32 @@ std::vector<ChunkedRangeVector::Chunk> ChunkedRangeVectorBuilder::finalize()
         else
             m_data.back().end = m_data.back().data.back().second;
     }
+    for (auto& chunk : m_data)
+        update_bitmap(chunk);
     return std::move(m_data);
 }
+
+// The number of ranges and the number of indices in the vector, from the
+// per-chunk bookkeeping rather than by walking the ranges
+size_t range_count(ChunkedRangeVector const& ranges) noexcept
+{
+    size_t count = 0;
+    for (auto const& chunk : ranges.m_data)
+        count += chunk.data.size();
+    return count;
+}
+
+size_t index_count(ChunkedRangeVector const& ranges) noexcept
+{
+    size_t count = 0;
+    for (auto const& chunk : ranges.m_data)
+        count += chunk.count;
+    return count;
+}
+
+// Below this many indices (for add) or ranges (for remove) in the argument,
+// updating the existing chunks in place beats rebuilding them
+const size_t small_set_threshold = 8;
 }
 
 IndexSet::IndexSet(std::initializer_list<size_t> values)
@@ -272,51 +411,39 @@ IndexSet::IndexSet(std::initializer_list<size_t> values)
 
 bool IndexSet::contains(size_t index) const noexcept
 {
-    auto it = const_cast<IndexSet*>(this)->find(index);
-    return it != end() && it->first <= index;
+    auto chunk = std::partition_point(m_data.begin(), m_data.end(),
+                                      [&](auto const& lft) { return lft.end <= index; });
+    if (chunk == m_data.end() || index < chunk->begin)
+        return false;
+    if (!chunk->bits.empty()) {
+        size_t bit = index - chunk->begin;
+        return (chunk->bits[bit / 64] >> (bit % 64)) & 1;
+    }
+    auto it = std::lower_bound(chunk->data.begin(), chunk->data.end(), index,
+                               [](auto const& lft, size_t value) { return lft.second <= value; });
+    return it->first <= index;
 }
 
 size_t IndexSet::count(size_t start_index, size_t end_index) const noexcept
 {
-    auto it = const_cast<IndexSet*>(this)->find(start_index);
-    const auto end = this->end();
-    if (it == end || it->first >= end_index) {
+    if (start_index >= end_index)
         return 0;
-    }
-    if (it->second >= end_index)
-        return std::min(it->second, end_index) - std::max(it->first, start_index);
-
-    size_t ret = 0;
-
-    if (start_index > it->first || it.offset() != 0) {
-        // Start index is in the middle of a chunk, so start by counting the
-        // rest of that chunk
-        ret = it->second - std::max(it->first, start_index);
-        for (++it; it != end && it->second < end_index && it.offset() != 0; ++it) {
-            ret += it->second - it->first;
-        }
-        if (it != end && it->first < end_index && it.offset() != 0)
-            ret += end_index - it->first;
-        if (it == end || it->second >= end_index)
-            return ret;
-    }
 
-    // Now count all complete chunks that fall within the range
-    while (it != end && it.outer()->end <= end_index) {
-        REALM_ASSERT_DEBUG(it.offset() == 0);
-        ret += it.outer()->count;
-        it.next_chunk();
-    }
-
-    // Cound all complete ranges within the last chunk
-    while (it != end && it->second <= end_index) {
-        ret += it->second - it->first;
-        ++it;
-    }
+    auto chunk = std::partition_point(m_data.begin(), m_data.end(),
+                                      [&](auto const& lft) { return lft.end <= start_index; });
+    auto end = m_data.end();
+    if (chunk == end || chunk->begin >= end_index)
+        return 0;
 
-    // And finally add in the partial last range
-    if (it != end && it->first < end_index)
-        ret += end_index - it->first;
+    // Only the chunks containing start_index and end_index can be partially
+    // in the range, and the ones between are counted using their cached count
+    size_t ret = 0;
+    if (start_index > chunk->begin || chunk->end > end_index)
+        ret += count_in_chunk(*chunk++, start_index, end_index);
+    for (; chunk != end && chunk->end <= end_index; ++chunk)
+        ret += chunk->count;
+    if (chunk != end && chunk->begin < end_index)
+        ret += count_in_chunk(*chunk, start_index, end_index);
     return ret;
 }
 
@@ -327,8 +454,9 @@ IndexSet::iterator IndexSet::find(size_t index) noexcept
 
 IndexSet::iterator IndexSet::find(size_t index, iterator begin) noexcept
 {
-    auto it = std::find_if(begin.outer(), m_data.end(),
-                           [&](auto const& lft) { return lft.end > index; });
+    // Chunks are sorted and disjoint, so their ends are sorted too
+    auto it = std::partition_point(begin.outer(), m_data.end(),
+                                   [&](auto const& lft) { return lft.end <= index; });
     if (it == m_data.end())
         return end();
     if (index < it->begin)
@@ -350,10 +478,47 @@ void IndexSet::add(size_t index)
 
 void IndexSet::add(IndexSet const& other)
 {
-    auto it = begin();
-    for (size_t index : other.as_indexes()) {
-        it = do_add(find(index, it), index);
+    if (other.empty())
+        return;
+    if (empty()) {
+        *this = other;
+        return;
+    }
+
+    if (index_count(other) <= small_set_threshold) {
+        auto it = begin();
+        for (size_t index : other.as_indexes()) {
+            it = do_add(find(index, it), index);
+        }
+        return;
+    }
+
+    // Otherwise merge the two sorted lists of ranges in a single pass, which
+    // is linear in the number of ranges rather than in the number of indices
+    // being added
+    ChunkedRangeVectorBuilder builder(*this);
+    auto it1 = cbegin(), end1 = cend();
+    auto it2 = other.cbegin(), end2 = other.cend();
+    auto next = [&] {
+        if (it2 == end2 || (it1 != end1 && it1->first < it2->first))
+            return *it1++;
+        return *it2++;
+    };
+
+    auto current = next();
+    while (it1 != end1 || it2 != end2) {
+        auto range = next();
+        if (range.first <= current.second) {
+            current.second = std::max(current.second, range.second);
+        }
+        else {
+            builder.push_back(current);
+            current = range;
+        }
     }
+    builder.push_back(current);
+    m_data = builder.finalize();
+    verify();
 }
 
 size_t IndexSet::add_shifted(size_t index)
@@ -645,21 +810,69 @@ void IndexSet::remove(size_t index, size_t count)
 
 void IndexSet::remove(realm::IndexSet const& values)
 {
-    auto it = begin();
-    for (auto range : values) {
-        it = do_remove(it, range.first, range.second);
-        if (it == end())
-            return;
+    if (empty() || values.empty())
+        return;
+
+    if (range_count(values) <= small_set_threshold) {
+        auto it = begin();
+        for (auto range : values) {
+            it = do_remove(it, range.first, range.second);
+            if (it == end())
+                return;
+        }
+        return;
+    }
+
+    // Walk both sorted lists of ranges together, keeping the parts of each
+    // of our ranges which aren't covered by a range being removed
+    ChunkedRangeVectorBuilder builder(*this);
+    auto remove_it = values.cbegin(), remove_end = values.cend();
+    for (auto range : *this) {
+        while (remove_it != remove_end && remove_it->second <= range.first)
+            ++remove_it;
+
+        size_t begin = range.first;
+        for (; remove_it != remove_end && remove_it->first < range.second; ++remove_it) {
+            if (remove_it->first > begin)
+                builder.push_back({begin, remove_it->first});
+            begin = std::max(begin, remove_it->second);
+            // A removed range which extends past this one may also cover
+            // the next one, so don't step past it
+            if (remove_it->second > range.second)
+                break;
+        }
+        if (begin < range.second)
+            builder.push_back({begin, range.second});
     }
+    m_data = builder.finalize();
+    verify();
 }
 
 size_t IndexSet::shift(size_t index) const noexcept
 {
-    // FIXME: optimize
-    for (auto range : *this) {
-        if (range.first > index)
-            break;
-        index += range.second - range.first;
+    for (auto const& chunk : m_data) {
+        // Every range in a chunk which ends at or before the index shifts it,
+        // so the whole chunk can be applied at once using its cached count
+        if (chunk.end <= index) {
+            index += chunk.count;
+            continue;
+        }
+        if (index < chunk.begin)
+            return index;
+        // The shifted index is the (index - begin)th position in the chunk
+        // which isn't in it, if there are that many
+        if (!chunk.bits.empty()) {
+            size_t pos = find_unset_bit(chunk.bits, index - chunk.begin);
+            if (pos < chunk.end - chunk.begin)
+                return chunk.begin + pos;
+            index += chunk.count;
+            continue;
+        }
+        for (auto range : chunk.data) {
+            if (range.first > index)
+                return index;
+            index += range.second - range.first;
+        }
     }
     return index;
 }
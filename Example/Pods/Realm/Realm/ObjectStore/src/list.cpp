@@ -413,7 +413,7 @@ bool List::operator==(List const& rgt) const noexcept
     return m_link_view == rgt.m_link_view && m_table.get() == rgt.m_table.get();
 }
 
-NotificationToken List::add_notification_callback(CollectionChangeCallback cb) &
+NotificationToken List::add_notification_callback(CollectionChangeCallback cb, NotificationPriority priority) &
 {
     verify_attached();
     // Adding a new callback to a notifier which had all of its callbacks
@@ -431,7 +431,7 @@ NotificationToken List::add_notification_callback(CollectionChangeCallback cb) &
             m_notifier = std::static_pointer_cast<_impl::CollectionNotifier>(std::make_shared<PrimitiveListNotifier>(m_table, m_realm));
         RealmCoordinator::register_notifier(m_notifier);
     }
-    return {m_notifier, m_notifier->add_callback(std::move(cb))};
+    return {m_notifier, m_notifier->add_callback(std::move(cb), priority)};
 }
 
 List::OutOfBoundsIndexException::OutOfBoundsIndexException(size_t r, size_t c)
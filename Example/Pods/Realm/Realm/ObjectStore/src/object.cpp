@@ -69,14 +69,17 @@ Object::Object(Object&&) = default;
 Object& Object::operator=(Object const&) = default;
 Object& Object::operator=(Object&&) = default;
 
-NotificationToken Object::add_notification_callback(CollectionChangeCallback callback) &
+NotificationToken Object::add_notification_callback(CollectionChangeCallback callback, NotificationPriority priority) &
 {
     verify_attached();
-    if (!m_notifier) {
-        m_notifier = std::make_shared<_impl::ObjectNotifier>(m_row, m_realm);
-        _impl::RealmCoordinator::register_notifier(m_notifier);
+    // The notifier is shared by every Object observing a row of this table,
+    // and is replaced once it's moved on from the version the row is from
+    std::shared_ptr<_impl::ObjectNotifier> notifier;
+    while (true) {
+        notifier = _impl::RealmCoordinator::get_object_notifier(m_realm, *m_row.get_table(), notifier.get());
+        if (auto token = notifier->add_callback(m_row, callback, priority))
+            return {std::move(notifier), *token};
     }
-    return {m_notifier, m_notifier->add_callback(std::move(callback))};
 }
 
 void Object::verify_attached() const
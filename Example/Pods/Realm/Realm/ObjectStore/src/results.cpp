@@ -18,6 +18,7 @@
 
 #include "results.hpp"
 
+#include "impl/aggregate_notifier.hpp"
 #include "impl/realm_coordinator.hpp"
 #include "impl/results_notifier.hpp"
 #include "audit.hpp"
@@ -82,6 +83,7 @@ Results::Results(Results&& other)
 , m_table(std::move(other.m_table))
 , m_descriptor_ordering(std::move(other.m_descriptor_ordering))
 , m_notifier(std::move(other.m_notifier))
+, m_aggregate_notifiers(std::move(other.m_aggregate_notifiers))
 , m_mode(other.m_mode)
 , m_update_policy(other.m_update_policy)
 , m_has_used_table_view(other.m_has_used_table_view)
@@ -704,34 +706,42 @@ Results Results::snapshot() &&
     REALM_COMPILER_HINT_UNREACHABLE();
 }
 
-void Results::prepare_async(ForCallback force)
+bool Results::can_prepare_async(ForCallback force)
 {
-    if (m_notifier) {
-        return;
-    }
     if (m_realm->config().immutable()) {
         if (force)
             throw InvalidTransactionException("Cannot create asynchronous query for immutable Realms");
-        return;
+        return false;
     }
     if (m_realm->is_in_transaction()) {
         if (force)
             throw InvalidTransactionException("Cannot create asynchronous query while in a write transaction");
-        return;
+        return false;
     }
     if (m_update_policy == UpdatePolicy::Never) {
         if (force)
             throw std::logic_error("Cannot create asynchronous query for snapshotted Results.");
-        return;
+        return false;
     }
     if (!force) {
         // Don't do implicit background updates if we can't actually deliver them
         if (!m_realm->can_deliver_notifications())
-            return;
+            return false;
         // Don't do implicit background updates if there isn't actually anything
         // that needs to be run.
         if (!m_query.get_table() && m_descriptor_ordering.is_empty())
-            return;
+            return false;
+    }
+    return true;
+}
+
+void Results::prepare_async(ForCallback force)
+{
+    if (m_notifier) {
+        return;
+    }
+    if (!can_prepare_async(force)) {
+        return;
     }
 
     m_wants_background_updates = true;
@@ -739,10 +749,42 @@ void Results::prepare_async(ForCallback force)
     _impl::RealmCoordinator::register_notifier(m_notifier);
 }
 
-NotificationToken Results::add_notification_callback(CollectionChangeCallback cb) &
+NotificationToken Results::add_notification_callback(CollectionChangeCallback cb, NotificationPriority priority) &
 {
     prepare_async(ForCallback{true});
-    return {m_notifier, m_notifier->add_callback(std::move(cb))};
+    return {m_notifier, m_notifier->add_callback(std::move(cb), priority)};
+}
+
+NotificationToken Results::add_aggregate_callback(size_t column, AggregateCallback callback) &
+{
+    validate_read();
+    // Results for a table which doesn't exist have no values to aggregate
+    if (!m_table)
+        return {};
+    if (column >= m_table->get_column_count())
+        throw OutOfBoundsIndexException{column, m_table->get_column_count()};
+    switch (m_table->get_column_type(column)) {
+        case type_Timestamp: case type_Double: case type_Float: case type_Int: break;
+        default: throw UnsupportedColumnTypeException{column, m_table.get(), "aggregate"};
+    }
+    can_prepare_async(ForCallback{true});
+
+    auto it = std::find_if(m_aggregate_notifiers.begin(), m_aggregate_notifiers.end(), [&](auto& notifier) {
+        return notifier && notifier->column() == column;
+    });
+    if (it == m_aggregate_notifiers.end()) {
+        m_aggregate_notifiers.emplace_back();
+        m_aggregate_notifiers.back() = std::make_shared<_impl::AggregateNotifier>(*this, column);
+        _impl::RealmCoordinator::register_notifier(m_aggregate_notifiers.back());
+        it = m_aggregate_notifiers.end() - 1;
+    }
+
+    // The callback is owned by the notifier, so it can't outlive it
+    auto& notifier = *it;
+    auto fn = [notifier = notifier.get(), callback = std::move(callback)](CollectionChangeSet const&, std::exception_ptr err) {
+        callback(notifier->aggregates(), err);
+    };
+    return {notifier, notifier->add_callback(std::move(fn))};
 }
 
 bool Results::is_in_table_order() const
@@ -32,6 +32,18 @@ namespace _impl {
     class CollectionNotifier;
 }
 
+// How urgently a notification callback wants to be called. A notifier runs at
+// the highest priority of its callbacks: higher-priority notifiers are run
+// first, and only high-priority ones are always brought fully up to date when
+// the background work misses Realm::Config::notifier_deadline. The others may
+// instead be left to catch up on a later pass, with the changes from the
+// versions they skipped merged into a single notification.
+enum class NotificationPriority {
+    low,
+    normal,
+    high,
+};
+
 // A token which keeps an asynchronous query alive
 struct NotificationToken {
     NotificationToken() = default;
@@ -0,0 +1,91 @@
+////////////////////////////////////////////////////////////////////////////
+//
+// Copyright 2016 Realm Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+////////////////////////////////////////////////////////////////////////////
+
+#ifndef REALM_AGGREGATE_NOTIFIER_HPP
+#define REALM_AGGREGATE_NOTIFIER_HPP
+
+#include "collection_notifier.hpp"
+#include "results.hpp"
+
+#include <realm/group_shared.hpp>
+
+namespace realm {
+namespace _impl {
+// Keeps the min, max, sum and average of one column of a Results up to date on
+// the background worker thread.
+//
+// The values of the column for each matching row are kept in row order. For
+// queries on a top-level table which can't be affected by changes to other
+// tables, they're updated from each transaction's changes by re-evaluating the
+// query for just the inserted and modified rows, and min and max are only
+// recalculated (from the kept values) when the current extreme is removed.
+// Other queries are rerun whenever the table changes.
+class AggregateNotifier : public CollectionNotifier {
+public:
+    AggregateNotifier(Results& target, size_t column);
+    ~AggregateNotifier();
+
+    size_t column() const noexcept { return m_column; }
+
+    // The aggregates from the most recent delivery
+    // Can only be called on the target thread
+    Results::Aggregates const& aggregates() const noexcept { return m_delivered; }
+
+    class Values;
+
+private:
+    const size_t m_column;
+
+    // The source Query, in handover form iff m_sg is null
+    std::unique_ptr<SharedGroup::Handover<Query>> m_query_handover;
+    std::unique_ptr<Query> m_query;
+    DescriptorOrdering::HandoverPatch m_ordering_handover;
+    DescriptorOrdering m_descriptor_ordering;
+
+    std::unique_ptr<Values> m_values;
+    // Whether the values can be updated from the changes to the table rather
+    // than by rerunning the query
+    bool m_incremental = false;
+    // Whether m_values is up to date with the table version m_last_seen_version
+    bool m_have_values = false;
+    util::Optional<uint_fast64_t> m_last_seen_version;
+    TransactionChangeInfo* m_info = nullptr;
+
+    // Calculated in run(), handed over in do_prepare_handover() and then
+    // copied to m_delivered when delivering
+    bool m_changed = false;
+    Results::Aggregates m_aggregates;
+    Results::Aggregates m_aggregates_to_deliver;
+    Results::Aggregates m_delivered;
+
+    bool can_update_incrementally() const;
+
+    void run() override;
+    void do_prepare_handover(SharedGroup&) override;
+    bool do_add_required_change_info(TransactionChangeInfo& info) override;
+    bool prepare_to_deliver() override;
+
+    void release_data() noexcept override;
+    void do_attach_to(SharedGroup& sg) override;
+    void do_detach_from(SharedGroup& sg) override;
+};
+
+} // namespace _impl
+} // namespace realm
+
+#endif // REALM_AGGREGATE_NOTIFIER_HPP
@@ -23,10 +23,18 @@
 
 #include <realm/util/optional.hpp>
 
+#include <functional>
 #include <unordered_map>
 
 namespace realm {
 namespace _impl {
+// Checks a block of rows for modifications with a single call: `rows` holds
+// `count` row indices in ascending order, and `modified[i]` is set to whether
+// `rows[i]` was modified. Because the rows are ordered the checker can walk
+// its modification sets forward once per block rather than looking up every
+// row separately through a std::function call.
+using BatchModificationChecker = std::function<void (size_t const* rows, size_t count, bool* modified)>;
+
 class CollectionChangeBuilder : public CollectionChangeSet {
 public:
     CollectionChangeBuilder(CollectionChangeBuilder const&) = default;
@@ -48,6 +56,22 @@ public:
                                              std::vector<size_t> const& new_rows,
                                              std::function<bool (size_t)> row_did_change,
                                              util::Optional<IndexSet> const& move_candidates = util::none);
+    static CollectionChangeBuilder calculate(std::vector<size_t> const& old_rows,
+                                             std::vector<size_t> const& new_rows,
+                                             BatchModificationChecker rows_did_change,
+                                             util::Optional<IndexSet> const& move_candidates = util::none);
+
+    // Equivalent to calculate() for the case where the non-deleted entries of
+    // old_rows and all of new_rows are sorted by row index and there were no
+    // row moves, i.e. unsorted results from a table where rows were only
+    // inserted, deleted or modified. The diff is then a single linear merge
+    // which doesn't need to copy or sort either list.
+    static CollectionChangeBuilder calculate_sorted(std::vector<size_t> const& old_rows,
+                                                    std::vector<size_t> const& new_rows,
+                                                    std::function<bool (size_t)> row_did_change);
+    static CollectionChangeBuilder calculate_sorted(std::vector<size_t> const& old_rows,
+                                                    std::vector<size_t> const& new_rows,
+                                                    BatchModificationChecker rows_did_change);
 
     // generic operations {
     CollectionChangeSet finalize() &&;
@@ -72,6 +96,10 @@ public:
     void swap(size_t ndx_1, size_t ndx_2, bool track_moves=true);
 
     void parse_complete();
+
+    // The index after these changes of the row which was at `old_ndx` before
+    // them, or npos if it was deleted. Requires that moves were tracked.
+    size_t new_index_of(size_t old_ndx) const;
     // }
 
     void insert_column(size_t ndx);
@@ -20,18 +20,23 @@
 #define REALM_BACKGROUND_COLLECTION_HPP
 
 #include "impl/collection_change_builder.hpp"
+#include "impl/notifier_metrics.hpp"
 
 #include <realm/util/assert.hpp>
 #include <realm/version_id.hpp>
 
 #include <array>
 #include <atomic>
+#include <chrono>
 #include <exception>
 #include <functional>
+#include <memory>
 #include <mutex>
+#include <string>
 #include <unordered_map>
 
 namespace realm {
+class Group;
 class Realm;
 class SharedGroup;
 class Table;
@@ -46,6 +51,41 @@ struct ListChangeInfo {
     CollectionChangeBuilder* changes;
 };
 
+struct TransactionChangeInfo;
+
+// The set of rows in each table which either were modified or link to a
+// modified row within DeepChangeCache::max_depth links, built by walking
+// backlinks out from the modified rows. It's built the first time it's needed
+// and is then shared by every notifier using the same TransactionChangeInfo,
+// which may be on different threads, so that each of them can check a row with
+// a single lookup rather than searching its outgoing links.
+class DeepChangeCache {
+public:
+    // Matches the depth DeepChangeChecker searches to
+    static constexpr size_t max_depth = 3;
+
+    DeepChangeCache() = default;
+    // Change info is only copied around while it's being gathered, before
+    // anything has been cached, so copies start out empty
+    DeepChangeCache(DeepChangeCache const&) { }
+    DeepChangeCache& operator=(DeepChangeCache const&) { return *this; }
+
+    // Build the cache if this is the first call for this transaction
+    void build(TransactionChangeInfo const& info, Group const& group);
+
+    bool reaches_modification(size_t table_ndx, size_t row_ndx) const noexcept
+    {
+        return table_ndx < m_rows.size() && row_ndx < m_rows[table_ndx].size()
+            && m_rows[table_ndx][row_ndx];
+    }
+
+private:
+    std::once_flag m_built;
+    std::vector<std::vector<bool>> m_rows;
+
+    void do_build(TransactionChangeInfo const& info, Group const& group);
+};
+
 struct TransactionChangeInfo {
     std::vector<bool> table_modifications_needed;
     std::vector<bool> table_moves_needed;
@@ -55,6 +95,21 @@ struct TransactionChangeInfo {
     std::vector<size_t> table_indices;
     bool track_all;
     bool schema_changed;
+    // The number of notifiers using this info which follow links to check for
+    // modifications. The shared cache is only worth building for more than one.
+    size_t deep_change_checkers = 0;
+    mutable DeepChangeCache deep_change_cache;
+};
+
+struct ResultsEvaluation;
+
+// State shared by the notifiers attached to one of the coordinator's notifier
+// shards so that equivalent notifiers can share work. Only used by the thread
+// currently running that shard.
+struct NotifierShardState {
+    // Query evaluations shared by equivalent ResultsNotifiers, keyed by a
+    // description of the table, query and ordering
+    std::unordered_map<std::string, std::weak_ptr<ResultsEvaluation>> results;
 };
 
 class DeepChangeChecker {
@@ -118,7 +173,8 @@ public:
     // Add a callback to be called each time the collection changes
     // This can only be called from the target collection's thread
     // Returns a token which can be passed to remove_callback()
-    uint64_t add_callback(CollectionChangeCallback callback);
+    uint64_t add_callback(CollectionChangeCallback callback,
+                          NotificationPriority priority = NotificationPriority::normal);
     // Remove a previously added token. The token is no longer valid after
     // calling this function and must not be used again. This function can be
     // called from any thread.
@@ -167,12 +223,16 @@ public:
     bool has_run() const noexcept { return m_has_run; }
 
     // Attach the handed-over query to `sg`. Must not be already attached to a SharedGroup.
+    // `shard_state` is the state shared with other notifiers run on `sg`, if any.
     // precondition: RealmCoordinator::m_notifier_mutex is locked
-    void attach_to(SharedGroup& sg);
+    void attach_to(SharedGroup& sg, NotifierShardState* shard_state = nullptr);
     // Create a new query handover object and stop using the previously attached
     // SharedGroup
     // precondition: RealmCoordinator::m_notifier_mutex is locked
     void detach();
+    // The SharedGroup this notifier is currently attached to, if any
+    // precondition: RealmCoordinator::m_notifier_mutex is locked
+    SharedGroup* attached_shared_group() const noexcept { return m_sg; }
 
     // Set `info` as the new ChangeInfo that will be populated by the next
     // transaction advance, and register all required information in it
@@ -182,6 +242,27 @@ public:
     // precondition: RealmCoordinator::m_notifier_mutex is unlocked
     virtual void run() = 0;
 
+    // Called instead of run() when the coordinator has missed its deadline for
+    // the current version, to skip this version and instead pick up its
+    // changes on the next run. Returns false if the notifier can't be deferred
+    // and so must be run now.
+    // precondition: RealmCoordinator::m_notifier_mutex is unlocked
+    virtual bool defer() { return false; }
+
+    // The highest priority of the registered callbacks. May be stale.
+    NotificationPriority priority() const noexcept { return m_priority; }
+
+    // A moving average of how long run() takes, or zero if it's never been
+    // run. Only used on the worker thread.
+    std::chrono::nanoseconds estimated_run_cost() const noexcept { return m_run_cost; }
+    void record_run_cost(std::chrono::nanoseconds cost) noexcept;
+
+    // Notifiers with the same non-empty key can share work with each other,
+    // but only with those attached to the same shard, so new notifiers are
+    // placed on the shard which already runs one with their key. Only used on
+    // the worker thread.
+    virtual std::string const& shard_affinity_key() const noexcept;
+
     // precondition: RealmCoordinator::m_notifier_mutex is locked
     void prepare_handover();
 
@@ -189,26 +270,64 @@ public:
     class Handle;
 
     bool have_callbacks() const noexcept { return m_have_callbacks; }
+
+    // The timings of each stage this notifier has been through, or null if
+    // metrics were never enabled while it was running
+    NotifierTimings const* timings() const noexcept { return m_timings.load(std::memory_order_acquire); }
+    // The object type of the table this notifier observes
+    std::string const& object_type() const noexcept { return m_object_type; }
+
 protected:
+    // Changesets are produced once by add_changes() and shared by every
+    // callback which should see them; they are never modified after that.
+    using SharedChanges = std::shared_ptr<CollectionChangeBuilder const>;
+
     void add_changes(CollectionChangeBuilder change);
+    // Add a changeset which may also have been added to other notifiers. It
+    // must not be modified afterwards.
+    void add_changes(SharedChanges change);
+    // Add changesets for just the callbacks with the given tokens, for
+    // notifiers whose callbacks each observe something different. Tokens
+    // which have since been removed are skipped.
+    void add_changes(std::vector<std::pair<uint64_t, SharedChanges>> changes);
     void set_table(Table const& table);
     std::unique_lock<std::mutex> lock_target();
     SharedGroup& source_shared_group();
+    NotifierShardState* shard_state() const noexcept { return m_shard_state; }
 
     std::function<bool (size_t)> get_modification_checker(TransactionChangeInfo const&, Table const&);
+    // The same check for callers which can supply their rows in ascending
+    // order, e.g. when diffing, a block at a time
+    BatchModificationChecker get_batch_modification_checker(TransactionChangeInfo const&, Table const&);
+    // The modifications to the given table if a row of it can only be modified
+    // by changes to that row itself, or null if links from it to other tables
+    // also have to be checked. Lets notifiers look up just the modified rows
+    // rather than checking every row they contain.
+    IndexSet const* get_direct_modifications(TransactionChangeInfo const&, Table const&);
 
 private:
+    friend class NotifierStageTimer;
+
     virtual void do_attach_to(SharedGroup&) = 0;
     virtual void do_detach_from(SharedGroup&) = 0;
     virtual void do_prepare_handover(SharedGroup&) = 0;
     virtual bool do_add_required_change_info(TransactionChangeInfo&) = 0;
     virtual bool prepare_to_deliver() { return true; }
+    // Called by remove_callback() after the callback has been removed, on
+    // whichever thread removed it
+    virtual void did_remove_callback(uint64_t) { }
 
     mutable std::mutex m_realm_mutex;
     std::shared_ptr<Realm> m_realm;
 
     VersionID m_sg_version;
     SharedGroup* m_sg = nullptr;
+    NotifierShardState* m_shard_state = nullptr;
+
+    const std::shared_ptr<NotifierMetrics> m_metrics;
+    // Allocated the first time a stage is timed
+    std::atomic<NotifierTimings*> m_timings{nullptr};
+    std::string m_object_type;
 
     bool m_has_run = false;
     bool m_error = false;
@@ -216,39 +335,65 @@ private:
 
     struct Callback {
         CollectionChangeCallback fn;
-        CollectionChangeBuilder accumulated_changes;
-        CollectionChangeSet changes_to_deliver;
+        // Changesets added since the last delivery, merged in package_for_delivery()
+        std::vector<SharedChanges> pending_changes;
+        // Null if there is nothing to deliver. Shared by every callback which
+        // had the same pending changesets.
+        std::shared_ptr<CollectionChangeSet const> changes_to_deliver;
         uint64_t token;
         bool initial_delivered;
         bool skip_next;
+        NotificationPriority priority;
     };
 
     // Currently registered callbacks and a mutex which must always be held
     // while doing anything with them or m_callback_index
+    // Callbacks are kept in registration order. Removing one leaves a
+    // tombstone (a token of removed_token) in place rather than shifting the
+    // later callbacks, and the tombstones are compacted away once they make up
+    // half of the vector and no delivery is in progress.
     std::mutex m_callback_mutex;
     std::vector<Callback> m_callbacks;
+    size_t m_removed_callback_count = 0;
+
+    // Tokens are a slot in m_callback_slots in the low 32 bits and that slot's
+    // generation in the high 32 bits. The slot records where the callback
+    // currently is in m_callbacks, and its generation is bumped when the
+    // callback is removed so that the token no longer matches if the slot is
+    // reused.
+    struct CallbackSlot {
+        uint32_t generation;
+        uint32_t index;
+    };
+    std::vector<CallbackSlot> m_callback_slots;
+    std::vector<uint32_t> m_free_callback_slots;
+    static constexpr uint64_t removed_token = uint64_t(-1);
 
     // Cached value for if m_callbacks is empty, needed to avoid deadlocks in
     // run() due to lock-order inversion between m_callback_mutex and m_target_mutex
     // It's okay if this value is stale as at worst it'll result in us doing
     // some extra work.
     std::atomic<bool> m_have_callbacks = {false};
+    // Cached highest priority of the registered callbacks, read by the worker
+    // thread without taking m_callback_mutex
+    std::atomic<NotificationPriority> m_priority = {NotificationPriority::low};
+
+    std::chrono::nanoseconds m_run_cost{0};
 
     // Iteration variable for looping over callbacks
-    // remove_callback() updates this when needed
     size_t m_callback_index = -1;
-    // The number of callbacks which were present when the notifier was packaged
-    // for delivery which are still present.
-    // Updated by packaged_for_delivery and removd_callback(), and used in
-    // for_each_callback() to avoid calling callbacks registered during delivery.
+    // The number of entries in m_callbacks when the notifier was packaged for
+    // delivery. Set by package_for_delivery() and used in for_each_callback()
+    // to avoid calling callbacks registered during delivery. Only changes
+    // when compacting removes tombstones from before it.
     size_t m_callback_count = -1;
 
-    uint64_t m_next_token = 0;
-
     template<typename Fn>
     void for_each_callback(Fn&& fn);
 
     std::vector<Callback>::iterator find_callback(uint64_t token);
+    void compact_callbacks();
+    void update_priority();
 };
 
 // A smart pointer to a CollectionNotifier that unregisters the notifier when
@@ -295,6 +440,22 @@ public:
     }
 };
 
+// Times one stage of the notification pipeline for a notifier, recording it
+// when destroyed. Does nothing unless the coordinator's metrics are enabled.
+class NotifierStageTimer {
+public:
+    NotifierStageTimer(CollectionNotifier& notifier, NotifierStage stage);
+    ~NotifierStageTimer();
+
+    NotifierStageTimer(NotifierStageTimer const&) = delete;
+    NotifierStageTimer& operator=(NotifierStageTimer const&) = delete;
+
+private:
+    CollectionNotifier* m_notifier = nullptr;
+    NotifierStage m_stage;
+    NotifierMetrics::Clock::time_point m_start;
+};
+
 // A package of CollectionNotifiers for a single Realm instance which is passed
 // around to the various places which need to actually trigger the notifications
 class NotifierPackage {
@@ -329,6 +490,7 @@ private:
     std::vector<std::shared_ptr<CollectionNotifier>> m_notifiers;
 
     RealmCoordinator* m_coordinator = nullptr;
+    std::shared_ptr<NotifierMetrics> m_metrics;
     std::exception_ptr m_error;
 };
 
@@ -347,6 +509,10 @@ size_t find_container_column(Table& table, size_t row_ndx, T const& expected, in
     REALM_UNREACHABLE();
 }
 
+// Whether the rows of the table which a query matches can only change when
+// those rows themselves are inserted or modified. Queries on tables with links
+// in either direction can follow them, so changes to the linked tables matter.
+bool table_is_unlinked(Table const& table);
 
 } // namespace _impl
 } // namespace realm
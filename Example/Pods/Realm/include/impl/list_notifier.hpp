@@ -42,6 +42,20 @@ private:
     // The actual change, calculated in run() and delivered in prepare_handover()
     CollectionChangeBuilder m_change;
     TransactionChangeInfo* m_info;
+    // The LinkList column in the origin table which holds the list. Columns
+    // can be inserted or moved while advancing, so it's only current after
+    // update_column_index()
+    size_t m_col_ndx = npos;
+
+    // Update m_col_ndx to the version the notifier has advanced to. Returns
+    // false if the change info no longer has an entry for this list.
+    bool update_column_index();
+    // Add the positions in the list of the given modified target rows. The
+    // rows' backlinks tell which of them are in the list, and those are then
+    // searched for individually or, if there are many, in one pass over it
+    void add_modified_targets(IndexSet const& modifications);
+    // Check each element of the list for modifications, including via links
+    void check_all_rows();
 
     void run() override;
 
@@ -0,0 +1,159 @@
+////////////////////////////////////////////////////////////////////////////
+//
+// Copyright 2016 Realm Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+////////////////////////////////////////////////////////////////////////////
+
+#ifndef REALM_NOTIFIER_METRICS_HPP
+#define REALM_NOTIFIER_METRICS_HPP
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace realm {
+namespace _impl {
+
+// A histogram of durations which any number of threads can record into
+// without locking. Buckets are HDR-style: each power of two is split into
+// eight linear sub-buckets, so values are reported to within 12.5%. Anything
+// over about 68 seconds is counted in the last bucket.
+class LatencyHistogram {
+public:
+    using Duration = std::chrono::nanoseconds;
+
+    static constexpr size_t sub_bucket_bits = 3;
+    static constexpr size_t max_exponent = 36;
+    static constexpr size_t bucket_count = (max_exponent - sub_bucket_bits + 1) << sub_bucket_bits;
+
+    struct Snapshot {
+        uint64_t count = 0;
+        Duration min{0};
+        Duration max{0};
+        Duration total{0};
+        std::vector<uint64_t> buckets;
+
+        Duration mean() const noexcept;
+        // The value which `percentile` percent of the recorded values are at
+        // or below, e.g. percentile(99.9)
+        Duration percentile(double percentile) const noexcept;
+    };
+
+    LatencyHistogram() noexcept;
+    LatencyHistogram(LatencyHistogram const&) = delete;
+    LatencyHistogram& operator=(LatencyHistogram const&) = delete;
+
+    void record(Duration duration) noexcept;
+    // Not an atomic snapshot: values recorded concurrently may be partially
+    // included, but the count always matches the buckets
+    Snapshot snapshot() const;
+    void reset() noexcept;
+
+    static size_t bucket_for(uint64_t value) noexcept;
+    static uint64_t highest_value_in(size_t bucket) noexcept;
+
+private:
+    std::array<std::atomic<uint64_t>, bucket_count> m_buckets;
+    std::atomic<uint64_t> m_total;
+    std::atomic<uint64_t> m_min;
+    std::atomic<uint64_t> m_max;
+};
+
+// The stages of the notification pipeline which are timed for each notifier
+enum class NotifierStage {
+    // CollectionNotifier::run() on the worker thread
+    run,
+    // The part of run() spent calculating the changeset
+    calculate_changes,
+    // CollectionNotifier::prepare_handover() on the worker thread
+    prepare_handover,
+    // Handing the new results over to the target collection
+    deliver,
+    // Calling the registered callbacks
+    callbacks,
+};
+constexpr size_t notifier_stage_count = 5;
+const char* notifier_stage_name(NotifierStage stage) noexcept;
+
+struct NotifierTimings {
+    std::array<LatencyHistogram, notifier_stage_count> stages;
+
+    LatencyHistogram& operator[](NotifierStage stage) noexcept { return stages[size_t(stage)]; }
+    LatencyHistogram const& operator[](NotifierStage stage) const noexcept { return stages[size_t(stage)]; }
+};
+
+// Instrumentation for a RealmCoordinator's notification pipeline, shared with
+// all of its notifiers. Nothing is recorded until it's enabled, and traces are
+// only recorded between start_tracing() and stop_tracing().
+class NotifierMetrics {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    bool is_enabled() const noexcept { return m_enabled.load(std::memory_order_relaxed); }
+    void set_enabled(bool enabled) noexcept { m_enabled.store(enabled, std::memory_order_relaxed); }
+
+    // The timings of every notifier combined
+    NotifierTimings& totals() noexcept { return m_totals; }
+    // The time from a write on this process committing to the callbacks for
+    // it being called, recorded once for each Realm which gets callbacks
+    LatencyHistogram& commit_to_callback() noexcept { return m_commit_to_callback; }
+
+    // Record that a local write produced `version`
+    void did_commit(uint64_t version);
+    // Record that callbacks were called for `version`, measuring from the
+    // most recent local commit which it includes
+    void did_call_callbacks(uint64_t version);
+
+    // Record every timed stage as a Chrome trace event ("chrome://tracing")
+    // until stop_tracing() is called, which returns the JSON for the trace
+    void start_tracing();
+    std::string stop_tracing();
+    bool is_tracing() const noexcept { return m_tracing.load(std::memory_order_relaxed); }
+    void add_trace_event(NotifierStage stage, std::string const& object_type,
+                         Clock::time_point start, Clock::time_point end);
+
+private:
+    std::atomic<bool> m_enabled{false};
+    std::atomic<bool> m_tracing{false};
+    NotifierTimings m_totals;
+    LatencyHistogram m_commit_to_callback;
+
+    struct Commit {
+        uint64_t version;
+        Clock::time_point time;
+    };
+    struct TraceEvent {
+        NotifierStage stage;
+        std::string object_type;
+        uint64_t thread;
+        Clock::time_point start;
+        Clock::time_point end;
+    };
+
+    std::mutex m_mutex;
+    // The most recent local commits, oldest first
+    std::vector<Commit> m_commits;
+    std::vector<TraceEvent> m_trace_events;
+    Clock::time_point m_trace_start;
+};
+
+} // namespace _impl
+} // namespace realm
+
+#endif // REALM_NOTIFIER_METRICS_HPP
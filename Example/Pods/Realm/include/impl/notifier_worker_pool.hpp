@@ -0,0 +1,68 @@
+////////////////////////////////////////////////////////////////////////////
+//
+// Copyright 2016 Realm Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+////////////////////////////////////////////////////////////////////////////
+
+#ifndef REALM_NOTIFIER_WORKER_POOL_HPP
+#define REALM_NOTIFIER_WORKER_POOL_HPP
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace realm {
+namespace _impl {
+
+// A set of threads which run the notifier shards of a single coordinator.
+// Threads are started the first time they're needed and then kept until the
+// pool is destroyed, so each pass over the notifiers only has to wake them
+// rather than create them.
+class NotifierWorkerPool {
+public:
+    ~NotifierWorkerPool();
+
+    // Call `fn` with each index in [0, count) and wait for all of the calls to
+    // return. Index 0 is run on the calling thread and index i on the pool's
+    // i'th thread, so a given index is always run on the same thread. `fn`
+    // must not throw.
+    void run(size_t count, std::function<void(size_t)> const& fn);
+
+private:
+    void worker_main(size_t index);
+
+    // Held for the duration of run() so that passes never overlap
+    std::mutex m_run_mutex;
+
+    std::mutex m_mutex;
+    std::condition_variable m_work_cv;
+    std::condition_variable m_done_cv;
+    std::vector<std::thread> m_threads;
+
+    // The pass the workers are currently running, identified by m_generation
+    std::function<void(size_t)> const* m_fn = nullptr;
+    size_t m_count = 0;
+    size_t m_pending = 0;
+    uint64_t m_generation = 0;
+    bool m_stopping = false;
+};
+
+} // namespace _impl
+} // namespace realm
+
+#endif // REALM_NOTIFIER_WORKER_POOL_HPP
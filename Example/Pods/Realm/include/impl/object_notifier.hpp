@@ -21,21 +21,73 @@
 
 #include "impl/collection_notifier.hpp"
 
-#include <realm/group_shared.hpp>
+#include <realm/row.hpp>
+#include <realm/table.hpp>
+#include <realm/util/optional.hpp>
+#include <realm/version_id.hpp>
+
+#include <mutex>
+#include <unordered_map>
 
 namespace realm {
 namespace _impl {
+// Delivers the changes to the observed rows of one table to the callbacks of
+// the Objects observing them from one Realm. Every such Object adds its
+// callbacks to the same notifier, which the coordinator runs and hands over
+// once for all of them, and which looks each transaction's changes to the
+// table up once for all of the observed rows.
+//
+// Rows are tracked by their index rather than with Row accessors, so that
+// they're just integers to hand over between SharedGroups and the notifier's
+// SharedGroup doesn't have to update an accessor for every observed object
+// when it advances. The indexes are instead updated from the table's changes.
 class ObjectNotifier : public CollectionNotifier {
 public:
-    ObjectNotifier(Row const& row, std::shared_ptr<Realm> realm);
+    ObjectNotifier(Table const& table, std::shared_ptr<Realm> realm);
+
+    // Add a callback for the given row, which must be from the Realm's current
+    // version, moving from `callback` if it's added. Returns none instead if
+    // the observed rows are no longer at that version or the notifier has
+    // been unregistered, and so a new notifier is needed for the row.
+    // This can only be called from the Realm's thread.
+    util::Optional<uint64_t> add_callback(Row const& row, CollectionChangeCallback& callback,
+                                          NotificationPriority priority);
 
 private:
-    std::unique_ptr<Row> m_row;
-    std::unique_ptr<SharedGroup::Handover<Row>> m_handover;
+    // The table, which is only set while attached to a SharedGroup, and its
+    // index, which is only up to date while not, or npos once it's deleted
+    TableRef m_table;
+    size_t m_table_ndx;
+
+    // The tokens of the callbacks for each observed row, and the row of each
+    // token. Only used by the worker thread.
+    std::unordered_multimap<size_t, uint64_t> m_rows;
+    std::unordered_map<uint64_t, size_t> m_row_for_token;
+
+    // Guards the following, which are used by both the Realm's thread and the
+    // worker thread
+    std::mutex m_new_rows_mutex;
+    // Callbacks added and removed since the notifier last ran
+    std::vector<std::pair<size_t, uint64_t>> m_new_rows;
+    std::vector<uint64_t> m_removed_tokens;
+    // The version which the rows of new callbacks have to be at, along with
+    // the table's index at that version, so that they can be updated along
+    // with the existing ones the next time the notifier runs
+    VersionID m_new_rows_version;
+    size_t m_new_rows_table_ndx;
+    // The notifier unregisters itself once its last callback is removed
+    size_t m_callback_count = 0;
+
+    // The change for each callback with any, calculated in run() and delivered
+    // in prepare_handover()
+    std::vector<std::pair<uint64_t, SharedChanges>> m_changes;
+    SharedChanges m_deletion;
+    TransactionChangeInfo* m_info = nullptr;
 
-    // The actual change, calculated in run() and delivered in prepare_handover()
-    CollectionChangeBuilder m_change;
-    TransactionChangeInfo* m_info;
+    void add_row(size_t row_ndx, uint64_t token);
+    void remove_token(uint64_t token);
+    void delete_all_rows();
+    void update(CollectionChangeBuilder const& changes, std::vector<std::pair<size_t, uint64_t>>& new_rows);
 
     void run() override;
 
@@ -46,6 +98,7 @@ private:
 
     void release_data() noexcept override;
     bool do_add_required_change_info(TransactionChangeInfo& info) override;
+    void did_remove_callback(uint64_t token) override;
 };
 }
 }
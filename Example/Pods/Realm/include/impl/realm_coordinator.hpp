@@ -20,10 +20,12 @@
 #define REALM_COORDINATOR_HPP
 
 #include "shared_realm.hpp"
+#include "impl/notifier_metrics.hpp"
 
 #include <realm/version_id.hpp>
 
 #include <condition_variable>
+#include <map>
 #include <mutex>
 
 namespace realm {
@@ -32,11 +34,15 @@ class Schema;
 class SharedGroup;
 class StringData;
 class SyncSession;
+class Table;
 
 namespace _impl {
 class CollectionNotifier;
 class ExternalCommitHelper;
+class NotifierWorkerPool;
+class ObjectNotifier;
 class WeakRealmNotifier;
+struct NotifierShardState;
 
 namespace partial_sync {
 class WorkQueue;
@@ -132,6 +138,12 @@ public:
 
     static void register_notifier(std::shared_ptr<CollectionNotifier> notifier);
 
+    // Get the notifier which callbacks for rows of the given table observed
+    // from `realm` are added to, creating and registering one if there isn't
+    // one yet or if the current one is `stale` and can't take any more.
+    static std::shared_ptr<ObjectNotifier> get_object_notifier(std::shared_ptr<Realm> const& realm, Table const& table,
+                                                               ObjectNotifier const* stale = nullptr);
+
     // Advance the Realm to the most recent transaction version which all async
     // work is complete for
     void advance_to_ready(Realm& realm);
@@ -158,6 +170,18 @@ public:
     template<typename Pred>
     std::unique_lock<std::mutex> wait_for_notifiers(Pred&& wait_predicate);
 
+    // Instrumentation for the async notification pipeline. Nothing is recorded
+    // until it's enabled with notifier_metrics()->set_enabled(true).
+    std::shared_ptr<_impl::NotifierMetrics> const& notifier_metrics() const noexcept { return m_notifier_metrics; }
+
+    struct NotifierStatistics {
+        std::string object_type;
+        std::array<_impl::LatencyHistogram::Snapshot, _impl::notifier_stage_count> stages;
+    };
+    // The timings of each live notifier which has recorded any, ordered by the
+    // total time spent in run() so that the most expensive come first
+    std::vector<NotifierStatistics> get_notifier_statistics();
+
 #if REALM_ENABLE_SYNC
     // A work queue that can be used to perform background work related to partial sync.
     _impl::partial_sync::WorkQueue& partial_sync_work_queue();
@@ -183,10 +207,26 @@ private:
     std::vector<std::shared_ptr<_impl::CollectionNotifier>> m_notifiers;
     VersionID m_notifier_skip_version = {0, 0};
 
-    // SharedGroup used for actually running async notifiers
-    // Will have a read transaction iff m_notifiers is non-empty
-    std::unique_ptr<Replication> m_notifier_history;
-    std::unique_ptr<SharedGroup> m_notifier_sg;
+    // The ObjectNotifier for each Realm and table which has observed rows,
+    // keyed by the table's index
+    std::mutex m_object_notifier_mutex;
+    std::map<std::pair<Realm const*, size_t>, std::weak_ptr<_impl::ObjectNotifier>> m_object_notifiers;
+
+    // SharedGroups used for actually running async notifiers, up to
+    // Config::max_notifier_threads of them. Each notifier stays attached to the
+    // shard it was first attached to, and the shards are run concurrently.
+    // Each will have a read transaction iff a notifier in m_notifiers is
+    // attached to it
+    struct NotifierShard {
+        std::unique_ptr<Replication> history;
+        std::unique_ptr<SharedGroup> sg;
+        // Heap-allocated as notifiers hold on to a pointer to it
+        std::unique_ptr<_impl::NotifierShardState> state;
+    };
+    std::vector<NotifierShard> m_notifier_shards;
+    // Threads which run every shard but the first, kept across runs. Declared
+    // after the shards so that it's destroyed first
+    std::unique_ptr<_impl::NotifierWorkerPool> m_notifier_workers;
 
     // SharedGroup used to advance notifiers in m_new_notifiers to the main shared
     // group's transaction version
@@ -195,6 +235,8 @@ private:
     std::unique_ptr<SharedGroup> m_advancer_sg;
     std::exception_ptr m_async_error;
 
+    const std::shared_ptr<_impl::NotifierMetrics> m_notifier_metrics = std::make_shared<_impl::NotifierMetrics>();
+
     std::unique_ptr<_impl::ExternalCommitHelper> m_notifier;
     std::function<void(VersionID, VersionID)> m_transaction_callback;
 
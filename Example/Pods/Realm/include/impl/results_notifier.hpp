@@ -26,6 +26,32 @@
 
 namespace realm {
 namespace _impl {
+// The most recent evaluation of a query on a notifier shard, shared by all of
+// the ResultsNotifiers on that shard with the same table, query and ordering.
+// The query is run once per transaction for all of them, and the changes are
+// calculated once for all of them which last saw the same rows. Owned by those
+// notifiers and only used by the thread running the shard.
+//
+// The results and changes are shared with the notifiers rather than copied to
+// each of them, and are never modified once published. A notifier which needs
+// a private copy takes one, and the last user of each moves it instead.
+struct ResultsEvaluation {
+    // Incremented each time the query is run, starting from 1
+    uint64_t generation = 0;
+    // The table version the query was last run at
+    uint_fast64_t table_version = -1;
+
+    // The results of the most recent run, kept only until the notifiers hand
+    // over so that advancing the shard doesn't have to update them
+    std::shared_ptr<TableView> tv;
+    std::shared_ptr<std::vector<size_t>> rows;
+
+    // The changes from the rows of the previous generation, for notifiers
+    // advanced from `changes_source_version`, or null if not calculated yet
+    std::shared_ptr<CollectionChangeBuilder const> changes;
+    VersionID changes_source_version;
+};
+
 class ResultsNotifier : public CollectionNotifier {
 public:
     ResultsNotifier(Results& target);
@@ -55,18 +81,57 @@ private:
     // rerunning the query when there's no chance of it changing.
     uint_fast64_t m_last_seen_version = -1;
 
-    // The rows from the previous run of the query, for calculating diffs
-    std::vector<size_t> m_previous_rows;
-
-    // The changeset calculated during run() and delivered in do_prepare_handover()
+    // The rows from the previous run of the query, for calculating diffs.
+    // Can be shared with equivalent notifiers through m_evaluation, so use
+    // previous_rows() to modify them.
+    std::shared_ptr<std::vector<size_t>> m_previous_rows = std::make_shared<std::vector<size_t>>();
+    // Whether m_previous_rows were the results as of the last transaction, and
+    // not from before some which were skipped for lack of anything to update
+    bool m_previous_rows_current = false;
+
+    // Whether the query only depends on which rows of its table match, so
+    // that the rows can be updated from the previous ones by re-evaluating
+    // just the inserted and modified rows
+    bool m_incremental = false;
+
+    // The changeset calculated during run() and delivered in do_prepare_handover(),
+    // or the one shared through m_evaluation if m_shared_changes is set
     CollectionChangeBuilder m_changes;
+    std::shared_ptr<CollectionChangeBuilder const> m_shared_changes;
     TransactionChangeInfo* m_info = nullptr;
 
+    // Set when one or more versions were skipped by defer() since the last
+    // run. m_previous_rows has been updated to the current row indices, and
+    // m_deferred_modifications holds the sorted indices of the rows which were
+    // modified in the skipped versions.
+    bool m_deferred = false;
+    std::vector<size_t> m_deferred_modifications;
+
+    // The evaluation shared with equivalent notifiers on the same shard, if
+    // any, and the generation of it which m_previous_rows came from
+    std::shared_ptr<ResultsEvaluation> m_evaluation;
+    uint64_t m_evaluation_generation = 0;
+    // The results of m_evaluation used in place of m_tv until handover
+    std::shared_ptr<TableView> m_shared_tv;
+    // Identifies the evaluations this notifier can share; set along with the
+    // query as it can only change with the schema. Empty if it can't share.
+    std::string m_evaluation_key;
+
     bool need_to_run();
-    void calculate_changes();
+    bool can_update_incrementally() const;
+    // Set `rows` to the rows the query matches now from the previous rows and
+    // the table's changes. Returns false if the query has to be rerun instead.
+    bool update_rows_incrementally(std::vector<size_t>& rows);
+    void join_evaluation();
+    bool reuse_evaluation();
+    void share_changes(uint64_t previous_generation);
+    void calculate_changes(std::vector<size_t> const& next_rows);
+    std::vector<size_t>& previous_rows();
+    std::string const& shard_affinity_key() const noexcept override { return m_evaluation_key; }
     void deliver(SharedGroup&) override;
 
     void run() override;
+    bool defer() override;
     void do_prepare_handover(SharedGroup&) override;
     bool do_add_required_change_info(TransactionChangeInfo& info) override;
     bool prepare_to_deliver() override;
@@ -20,6 +20,7 @@
 #define REALM_INDEX_SET_HPP
 
 #include <cstddef>
+#include <cstdint>
 #include <initializer_list>
 #include <iterator>
 #include <type_traits>
@@ -92,6 +93,11 @@ struct ChunkedRangeVector {
         size_t begin;
         size_t end;
         size_t count;
+        // For chunks of many short ranges, bit i is set if begin + i is in
+        // the chunk, so that lookups within it can count bits rather than walk
+        // the ranges. Empty otherwise, and dropped when a range is modified in
+        // place until the chunk is rebuilt.
+        std::vector<uint64_t> bits;
     };
     std::vector<Chunk> m_data;
 
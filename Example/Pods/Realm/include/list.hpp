@@ -117,7 +117,8 @@ public:
 
     bool operator==(List const& rgt) const noexcept;
 
-    NotificationToken add_notification_callback(CollectionChangeCallback cb) &;
+    NotificationToken add_notification_callback(CollectionChangeCallback cb,
+                                                NotificationPriority priority = NotificationPriority::normal) &;
 
     template<typename Context>
     auto get(Context&, size_t row_ndx) const;
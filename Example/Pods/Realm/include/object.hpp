@@ -28,10 +28,6 @@ class ObjectSchema;
 struct Property;
 using RowExpr = BasicRowExpr<Table>;
 
-namespace _impl {
-    class ObjectNotifier;
-}
-
 class Object {
 public:
     Object();
@@ -51,7 +47,8 @@ public:
 
     bool is_valid() const { return m_row.is_attached(); }
 
-    NotificationToken add_notification_callback(CollectionChangeCallback callback) &;
+    NotificationToken add_notification_callback(CollectionChangeCallback callback,
+                                                NotificationPriority priority = NotificationPriority::normal) &;
 
     void ensure_user_in_everyone_role();
     void ensure_private_role_exists_for_user();
@@ -104,8 +101,6 @@ private:
     std::shared_ptr<Realm> m_realm;
     const ObjectSchema *m_object_schema;
     Row m_row;
-    _impl::CollectionNotifier::Handle<_impl::ObjectNotifier> m_notifier;
-
 
     template<typename ValueType, typename ContextType>
     void set_property_value_impl(ContextType& ctx, const Property &property,
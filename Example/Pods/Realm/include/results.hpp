@@ -27,14 +27,15 @@
 #include "property.hpp"
 #include "shared_realm.hpp"
 
+#include <realm/mixed.hpp>
 #include <realm/table_view.hpp>
 #include <realm/util/optional.hpp>
 
 namespace realm {
-class Mixed;
 class ObjectSchema;
 
 namespace _impl {
+    class AggregateNotifier;
     class ResultsNotifier;
 }
 
@@ -144,6 +145,29 @@ public:
     util::Optional<double> average(size_t column=0);
     util::Optional<Mixed> sum(size_t column=0);
 
+    // The min/max/average/sum of a column, as reported by add_aggregate_callback()
+    // `count` is the number of non-null values. Like the functions above, all
+    // but sum are none when there are no values, and sum and average are
+    // always none for timestamp columns.
+    struct Aggregates {
+        size_t count = 0;
+        util::Optional<Mixed> min;
+        util::Optional<Mixed> max;
+        util::Optional<Mixed> sum;
+        util::Optional<double> average;
+    };
+    using AggregateCallback = std::function<void (Aggregates const&, std::exception_ptr)>;
+
+    // Calculate the aggregates of the given column on the background worker
+    // thread and keep them up to date as the Realm changes, calling the
+    // callback with the new values each time they change. The initial values
+    // are delivered asynchronously, like the initial collection notification.
+    // Callbacks for the same column of this Results share the work, which
+    // stops when this Results is destroyed.
+    // Throws UnsupportedColumnTypeException for a non-numeric, non-timestamp column
+    // Throws OutOfBoundsIndexException for an out-of-bounds column
+    NotificationToken add_aggregate_callback(size_t column, AggregateCallback callback) &;
+
     enum class Mode {
         Empty, // Backed by nothing (for missing tables)
         Table, // Backed directly by a Table
@@ -210,7 +234,8 @@ public:
     // and then rerun after each commit (if needed) and redelivered if it changed
     template<typename Func>
     NotificationToken async(Func&& target);
-    NotificationToken add_notification_callback(CollectionChangeCallback cb) &;
+    NotificationToken add_notification_callback(CollectionChangeCallback cb,
+                                                NotificationPriority priority = NotificationPriority::normal) &;
 
     bool wants_background_updates() const { return m_wants_background_updates; }
 
@@ -256,6 +281,7 @@ private:
     DescriptorOrdering m_descriptor_ordering;
 
     _impl::CollectionNotifier::Handle<_impl::ResultsNotifier> m_notifier;
+    std::vector<_impl::CollectionNotifier::Handle<_impl::AggregateNotifier>> m_aggregate_notifiers;
 
     Mode m_mode = Mode::Empty;
     UpdatePolicy m_update_policy = UpdatePolicy::Auto;
@@ -269,6 +295,7 @@ private:
 
     using ForCallback = util::TaggedBool<class ForCallback>;
     void prepare_async(ForCallback);
+    bool can_prepare_async(ForCallback);
 
     template<typename T>
     util::Optional<T> try_get(size_t);
@@ -29,6 +29,7 @@
 #include <realm/sync/client.hpp>
 #endif
 
+#include <chrono>
 #include <memory>
 
 namespace realm {
@@ -242,6 +243,19 @@ public:
         // speeds up tests that don't need notifications.
         bool automatic_change_notifications = true;
 
+        // The maximum number of threads used to run async notifiers for this
+        // file. Notifiers are spread over this many SharedGroups which each
+        // hold their own read transaction, so values above 1 trade memory and
+        // file space for lower latency when there are many notifiers.
+        size_t max_notifier_threads = 1;
+
+        // How long the async notifiers for this file may spend on a version
+        // before falling behind. Once this has passed and there's a newer
+        // version to process, notifiers whose callbacks aren't high priority
+        // stop calculating changes for the old version and are brought up to
+        // date on the next pass instead. Zero disables the deadline.
+        std::chrono::milliseconds notifier_deadline{0};
+
         // The identifier of the abstract execution context in which this Realm will be used.
         // If unset, the current thread's identifier will be used to identify the execution context.
         util::Optional<AbstractExecutionContextID> execution_context;
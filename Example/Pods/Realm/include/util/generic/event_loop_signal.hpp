@@ -0,0 +1,185 @@
+////////////////////////////////////////////////////////////////////////////
+//
+// Copyright 2016 Realm Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+////////////////////////////////////////////////////////////////////////////
+
+#include <atomic>
+#include <cerrno>
+#include <memory>
+#include <mutex>
+#include <system_error>
+#include <vector>
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <sys/eventfd.h>
+#endif
+
+namespace realm {
+namespace util {
+// Without a platform run loop to attach to, each thread which creates signals
+// gets a GenericEventLoop. Notifying a signal from any thread queues it on the
+// loop of the thread which created it and makes get_fd() readable; the owning
+// thread's own loop (e.g. a server's epoll loop) polls that fd and calls
+// run_pending(). A signal which is notified again before it has run stays
+// queued once, so a burst of notifications results in a single callback.
+class GenericEventLoop {
+public:
+    struct Pending {
+        virtual ~Pending() = default;
+        virtual void run() = 0;
+    };
+
+    // The loop for the calling thread, created on first use
+    static std::shared_ptr<GenericEventLoop> get_current()
+    {
+        static thread_local std::shared_ptr<GenericEventLoop> loop;
+        if (!loop)
+            loop = std::make_shared<GenericEventLoop>();
+        return loop;
+    }
+
+    GenericEventLoop()
+    {
+#if defined(__linux__)
+        m_read_fd = m_write_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (m_read_fd == -1)
+            throw std::system_error(errno, std::system_category());
+#else
+        int fds[2];
+        if (pipe(fds) == -1)
+            throw std::system_error(errno, std::system_category());
+        m_read_fd = fds[0];
+        m_write_fd = fds[1];
+        fcntl(m_read_fd, F_SETFL, O_NONBLOCK);
+        fcntl(m_write_fd, F_SETFL, O_NONBLOCK);
+#endif
+    }
+
+    ~GenericEventLoop()
+    {
+        ::close(m_read_fd);
+        if (m_write_fd != m_read_fd)
+            ::close(m_write_fd);
+    }
+
+    GenericEventLoop(GenericEventLoop const&) = delete;
+    GenericEventLoop& operator=(GenericEventLoop const&) = delete;
+
+    // Readable whenever run_pending() has work to do
+    int get_fd() const noexcept { return m_read_fd; }
+
+    // Must be called on the thread which owns the loop
+    void run_pending()
+    {
+        std::vector<std::shared_ptr<Pending>> pending;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            pending.swap(m_pending);
+            clear_fd();
+        }
+        for (auto& item : pending)
+            item->run();
+    }
+
+    void enqueue(std::shared_ptr<Pending> item)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_pending.push_back(std::move(item));
+        if (m_pending.size() == 1)
+            wake_fd();
+    }
+
+private:
+    std::mutex m_mutex;
+    std::vector<std::shared_ptr<Pending>> m_pending;
+    int m_read_fd = -1;
+    int m_write_fd = -1;
+
+    void wake_fd()
+    {
+#if defined(__linux__)
+        uint64_t value = 1;
+#else
+        char value = 0;
+#endif
+        ssize_t ret;
+        do {
+            ret = write(m_write_fd, &value, sizeof value);
+        } while (ret == -1 && errno == EINTR);
+    }
+
+    void clear_fd()
+    {
+        char buff[64];
+        ssize_t ret;
+        do {
+            ret = read(m_read_fd, buff, sizeof buff);
+        } while (ret > 0 || (ret == -1 && errno == EINTR));
+    }
+};
+
+template<typename Callback>
+class EventLoopSignal {
+public:
+    EventLoopSignal(Callback&& callback)
+    : m_loop(GenericEventLoop::get_current())
+    , m_state(std::make_shared<State>(std::move(callback)))
+    {
+    }
+
+    ~EventLoopSignal()
+    {
+        // The state may still be queued on the loop; make sure it doesn't run
+        m_state->invalidated = true;
+    }
+
+    EventLoopSignal(EventLoopSignal&&) = delete;
+    EventLoopSignal& operator=(EventLoopSignal&&) = delete;
+    EventLoopSignal(EventLoopSignal const&) = delete;
+    EventLoopSignal& operator=(EventLoopSignal const&) = delete;
+
+    void notify()
+    {
+        if (!m_state->queued.exchange(true, std::memory_order_acq_rel))
+            m_loop->enqueue(m_state);
+    }
+
+private:
+    struct State : GenericEventLoop::Pending {
+        Callback callback;
+        std::atomic<bool> queued{false};
+        std::atomic<bool> invalidated{false};
+
+        State(Callback&& callback) : callback(std::move(callback)) { }
+
+        void run() override
+        {
+            // Clear before invoking so that a notify() from inside the
+            // callback, or from another thread while it runs, queues it again
+            queued.exchange(false, std::memory_order_acq_rel);
+            if (!invalidated)
+                callback();
+        }
+    };
+
+    std::shared_ptr<GenericEventLoop> m_loop;
+    std::shared_ptr<State> m_state;
+};
+} // namespace util
+} // namespace realm
@@ -10,45 +10,179 @@
 #define Allocator_hpp
 
 #include <RxFoundation/Memory.hpp>
+#include <atomic>
+#include <cstddef>
+#include <string.h>
 
 namespace Rx {
+    /// Base of the allocator family. The base class itself is the system allocator
+    /// (Allocator::getDefault()); PoolAllocator and ArenaAllocator override the byte-level
+    /// entry points. Sizes are passed back on deallocation, as with STL allocators.
     class Allocator {
     public:
-        static Allocator &Default;
+        struct Statistics {
+            UInt64 allocations;
+            UInt64 deallocations;
+            /// Bytes handed out and not yet returned.
+            UInt64 bytesInUse;
+            /// Bytes obtained from the system, including slab and block slack.
+            UInt64 bytesReserved;
+        };
         
+        /// The system allocator. A function-local static, so it is usable from other
+        /// translation units' static initializers and destructors.
+        static Allocator &getDefault() RX_NOEXCEPT;
+    
     public:
+        virtual void *allocateBytes(size_t size, size_t alignment = alignof(std::max_align_t)) RX_NOEXCEPT;
+        /// size and alignment must match the allocateBytes call.
+        virtual void deallocateBytes(void *ptr, size_t size, size_t alignment = alignof(std::max_align_t)) RX_NOEXCEPT;
+        /// The system allocator keeps no counters and reports zeros.
+        virtual Statistics getStatistics() const RX_NOEXCEPT;
+        
+        /// Zero-filled, like calloc.
         template <typename T>
         T *allocate(size_t count) {
-            T *ptr = reinterpret_cast<T *>(
-#if DEPLOYMENT_TARGET_MACOSX
-                    malloc_zone_calloc((malloc_zone_t *)this, 1, count * sizeof(T))
-#elif DEPLOYMENT_TARGET_ANDROID
-            calloc(count, sizeof(T))
-#endif
-            );
+            T *ptr = reinterpret_cast<T *>(allocateBytes(count * sizeof(T), alignof(T)));
+            if (ptr) {
+                memset((void *)ptr, 0, count * sizeof(T));
+            }
             return ptr;
         }
         
         template <typename T>
-        void deallocate(T *ptr) {
+        void deallocate(T *ptr, size_t count) {
             if (ptr == nullptr) {
                 return;
             }
-#if DEPLOYMENT_TARGET_MACOSX
-            malloc_make_purgeable((void *)ptr);
-            malloc_zone_free((malloc_zone_t *)this, (void *)ptr);
-#elif DEPLOYMENT_TARGET_ANDROID
-            free(ptr);
-#endif
+            deallocateBytes((void *)ptr, count * sizeof(T), alignof(T));
         }
-        
-    private:
+    
+    protected:
         Allocator();
-        ~Allocator();
+        virtual ~Allocator();
+    private:
         Allocator(const Allocator &);
         Allocator(Allocator &&);
+    };
+    
+    namespace detail {
+        struct PoolThreadCache;
+        struct PoolSizeClass;
+        struct LivePools;
+    }
+    
+    /// Size-class slab allocator for blocks up to MaxPooledSize; larger requests go to
+    /// the system. Each thread keeps a small magazine of free blocks per size class and
+    /// only takes the pool's lock to refill or drain it. Thread safe. Blocks must not be
+    /// used after the pool is destroyed. Statistics fold in per-thread counts whenever a
+    /// magazine touches the pool, so they can lag slightly behind.
+    class PoolAllocator : public Allocator {
+    public:
+        static constexpr const size_t MaxPooledSize = 4096;
+        static constexpr const size_t NumSizeClasses = 28;
+        static constexpr const size_t SlabSize = 64 * 1024;
+        
+        PoolAllocator() RX_NOEXCEPT;
+        virtual ~PoolAllocator();
+        
+        void *allocateBytes(size_t size, size_t alignment = alignof(std::max_align_t)) RX_NOEXCEPT override;
+        void deallocateBytes(void *ptr, size_t size, size_t alignment = alignof(std::max_align_t)) RX_NOEXCEPT override;
+        Statistics getStatistics() const RX_NOEXCEPT override;
+    
+    private:
+        friend struct detail::PoolThreadCache;
+        friend struct detail::LivePools;
+        
+        void *_refill(size_t sizeClass, void **magazine, UInt32 &count) RX_NOEXCEPT;
+        void _drain(size_t sizeClass, void **blocks, UInt32 count) RX_NOEXCEPT;
+        void _flushCounters(UInt64 allocations, UInt64 deallocations, Int64 bytesInUse) RX_NOEXCEPT;
+        
+        const UInt64 _identifier;
+        detail::PoolSizeClass *_classes;
+        std::atomic<UInt64> _allocations;
+        std::atomic<UInt64> _deallocations;
+        std::atomic<Int64> _bytesInUse;
+        std::atomic<UInt64> _bytesReserved;
+    };
+    
+    /// Bump-pointer allocator for request-scoped work: allocation is a pointer bump,
+    /// deallocateBytes only updates the counters, and reset() releases everything at
+    /// once while keeping the first block for reuse. Not thread safe.
+    class ArenaAllocator : public Allocator {
+    public:
+        explicit ArenaAllocator(size_t blockSize = 64 * 1024) RX_NOEXCEPT;
+        virtual ~ArenaAllocator();
+        
+        void *allocateBytes(size_t size, size_t alignment = alignof(std::max_align_t)) RX_NOEXCEPT override;
+        void deallocateBytes(void *ptr, size_t size, size_t alignment = alignof(std::max_align_t)) RX_NOEXCEPT override;
+        Statistics getStatistics() const RX_NOEXCEPT override;
+        
+        void reset() RX_NOEXCEPT;
+    
+    private:
+        struct Block {
+            Block *next;
+            size_t size;
+        };
+        
+        void *_allocateSlow(size_t size, size_t alignment) RX_NOEXCEPT;
+        
+        const size_t _blockSize;
+        Block *_blocks;
+        UInt8 *_current;
+        UInt8 *_end;
+        Statistics _statistics;
+    };
+    
+    /// Adapts an Rx::Allocator to the STL allocator requirements, e.g.
+    /// Array<T, StlAllocator<T>> or std::basic_string<char, std::char_traits<char>, StlAllocator<char>>.
+    template <typename T>
+    class StlAllocator {
+    public:
+        typedef T value_type;
+        typedef T *pointer;
+        typedef const T *const_pointer;
+        typedef T &reference;
+        typedef const T &const_reference;
+        typedef size_t size_type;
+        typedef ptrdiff_t difference_type;
+        
+        template <typename U>
+        struct rebind {
+            typedef StlAllocator<U> other;
+        };
+        
+        StlAllocator() RX_NOEXCEPT : _allocator(&Allocator::getDefault()) {}
+        StlAllocator(Allocator &allocator) RX_NOEXCEPT : _allocator(&allocator) {}
+        
+        template <typename U>
+        StlAllocator(const StlAllocator<U> &other) RX_NOEXCEPT : _allocator(other.getAllocator()) {}
+        
+        T *allocate(size_t count) {
+            return static_cast<T *>(_allocator->allocateBytes(count * sizeof(T), alignof(T)));
+        }
+        
+        void deallocate(T *ptr, size_t count) RX_NOEXCEPT {
+            _allocator->deallocateBytes(ptr, count * sizeof(T), alignof(T));
+        }
+        
+        Allocator *getAllocator() const RX_NOEXCEPT {
+            return _allocator;
+        }
+        
+        template <typename U>
+        bool operator==(const StlAllocator<U> &rhs) const RX_NOEXCEPT {
+            return _allocator == rhs.getAllocator();
+        }
+        
+        template <typename U>
+        bool operator!=(const StlAllocator<U> &rhs) const RX_NOEXCEPT {
+            return _allocator != rhs.getAllocator();
+        }
+    
     private:
-        static Allocator _Default;
+        Allocator *_allocator;
     };
 }
 
@@ -18,133 +18,197 @@
 #include <typeinfo>
 #include <string>
 #include <cassert>
+#include <functional>
+#include <new>
 
 
 namespace Rx {
+    /// Holds a single value of any copyable type.
+    ///
+    /// Trivially copyable values no larger than InlineSize are stored inline, so
+    /// holding an integer, a pointer or a small POD struct never allocates; other
+    /// values are stored on the heap. The held type is dispatched through a static
+    /// table of functions per type rather than virtual functions, and copying,
+    /// moving or clearing an inline value is just copying its bytes.
+    ///
+    /// An Any does no locking of its own and is only as thread-safe as an int:
+    /// a value shared between threads must be guarded by the caller or kept in
+    /// an AtomicAny.
     class Any {
         template<typename T>
         using decay = typename std::decay<T>::type;
         
         template<typename T>
         using none = typename std::enable_if<!std::is_same<Any, T>::value>::type;
+    
+    public:
+        static constexpr size_t InlineSize = 3 * sizeof(void *);
+    
+    private:
+        static constexpr size_t InlineAlignment = alignof(void *);
         
-        mutable SpinLock _lock;
+        template<typename T>
+        using isInline = std::integral_constant<bool, std::is_trivially_copyable<T>::value &&
+                                                      sizeof(T) <= InlineSize &&
+                                                      alignof(T) <= InlineAlignment>;
         
-        struct base {
-        public:
-            virtual ~base() { }
-            virtual bool is(TypeInfo::id) const = 0;
-            virtual base *copy() const = 0;
-            virtual TypeInfo::id typeID() const = 0;
-            virtual bool compare(const base *rhs) const = 0;
-        } *p = nullptr;
+        template<typename T, typename = void>
+        struct hasLess : std::false_type {};
+        
+        template<typename T>
+        struct hasLess<T, decltype(void(std::declval<const T &>() < std::declval<const T &>()))> : std::true_type {};
+        
+        /// Orders two held values the way their own operator< does, so that
+        /// ordering agrees with ==, or by address for types without one.
+        template<typename T>
+        static bool lessThan(const T &lhs, const T &rhs, std::true_type) { return lhs < rhs; }
         
         template<typename T>
-        struct data : base, std::tuple<T> {
-            using std::tuple<T>::tuple;
+        static bool lessThan(const T &lhs, const T &rhs, std::false_type) { return std::less<const T *>()(&lhs, &rhs); }
+        
+        union Storage {
+            alignas(InlineAlignment) unsigned char buffer[InlineSize];
+            void *pointer;
+        };
+        
+        /// The operations on one held type, shared by every Any holding it. copy
+        /// and destroy are null for inline types, whose bytes are simply copied.
+        struct Operations {
+            TypeInfo::id (*typeID)();
+            void (*copy)(Storage &dst, const Storage &src);
+            void (*destroy)(Storage &storage);
+            bool (*equal)(const Storage &lhs, const Storage &rhs);
+            bool (*less)(const Storage &lhs, const Storage &rhs);
+        };
+        
+        template<typename T, bool = isInline<T>::value>
+        struct Model {
+            static T *get(Storage &storage) { return reinterpret_cast<T *>(storage.buffer); }
+            static const T *get(const Storage &storage) { return reinterpret_cast<const T *>(storage.buffer); }
             
-            T       &get()      & { return std::get<0>(*this); }
-            T const &get() const& { return std::get<0>(*this); }
+            template<typename... Args>
+            static void create(Storage &storage, Args &&...args) { new (storage.buffer) T(std::forward<Args>(args)...); }
             
-            bool is(TypeInfo::id i) const override { return i == typeID(); }
-            base *copy()  const override { return new data{get()}; }
-            bool compare(const base *rhs) const override {
-                return (get() == reinterpret_cast<const data<T> *>(rhs)->get());
-            }
+            static bool equal(const Storage &lhs, const Storage &rhs) { return *get(lhs) == *get(rhs); }
+            static bool less(const Storage &lhs, const Storage &rhs) { return lessThan(*get(lhs), *get(rhs), hasLess<T>()); }
             
-            TypeInfo::id typeID() const override { return TypeInfo::ID<T>(); }
+            static const Operations operations;
         };
         
         template<typename T>
-        T &stat() { return static_cast<data<T>&>(*p).get(); }
+        struct Model<T, false> {
+            static T *get(Storage &storage) { return static_cast<T *>(storage.pointer); }
+            static const T *get(const Storage &storage) { return static_cast<const T *>(storage.pointer); }
+            
+            template<typename... Args>
+            static void create(Storage &storage, Args &&...args) { storage.pointer = new T(std::forward<Args>(args)...); }
+            
+            static void copy(Storage &dst, const Storage &src) { create(dst, *get(src)); }
+            static void destroy(Storage &storage) { delete get(storage); }
+            static bool equal(const Storage &lhs, const Storage &rhs) { return *get(lhs) == *get(rhs); }
+            static bool less(const Storage &lhs, const Storage &rhs) { return lessThan(*get(lhs), *get(rhs), hasLess<T>()); }
+            
+            static const Operations operations;
+        };
+        
+        const Operations *_ops = nullptr;
+        Storage _storage;
         
         template<typename T>
-        T const &stat() const { return static_cast<data<T> const&>(*p).get(); }
+        T &stat() { return *Model<T>::get(_storage); }
         
         template<typename T>
-        T &dyn() { return dynamic_cast<data<T>&>(*p).get(); }
+        T const &stat() const { return *Model<T>::get(_storage); }
         
         template<typename T>
-        T const &dyn() const { return dynamic_cast<data<T> const&>(*p).get(); }
+        T &dyn() { if (!is<T>()) throw std::bad_cast(); return stat<T>(); }
         
+        template<typename T>
+        T const &dyn() const { if (!is<T>()) throw std::bad_cast(); return stat<T>(); }
+    
     public:
-        Any() : p(nullptr) { }
-        ~Any() {
-            LockGuard<decltype(_lock)> lock(_lock);
-            if (p) {
-                delete p;
-                p = nullptr;
-            }
-        }
+        Any() RX_NOEXCEPT { }
+        ~Any() { clear(); }
         
-        Any(Any &&s) { LockGuard<decltype(s._lock)> lock(s._lock); p = s.p; s.p = nullptr; }
-        Any(const Any &s) {
-            LockGuard<decltype(s._lock)> lock(s._lock);
-            if (s.p) {
-                p = s.p->copy();
+        /// Moving never allocates: a heap value's pointer is taken over and an
+        /// inline value is trivially copyable.
+        Any(Any &&s) RX_NOEXCEPT : _ops(s._ops), _storage(s._storage) { s._ops = nullptr; }
+        Any(const Any &s) : _ops(s._ops) {
+            if (!_ops) {
+                return;
+            }
+            if (_ops->copy) {
+                _ops->copy(_storage, s._storage);
             } else {
-                p = nullptr;
+                _storage = s._storage;
             }
         }
         
         template<typename T, typename U = decay<T>, typename = none<U>>
-        Any(T &&x) : p(new data<U>{std::forward<T>(x)}) { }
+        Any(T &&x) : _ops(&Model<U>::operations) { Model<U>::create(_storage, std::forward<T>(x)); }
         
-        Any(decltype(nullptr) &&x) : p(nullptr) { }
+        Any(decltype(nullptr) &&x) RX_NOEXCEPT { }
         
-        Any &operator=(Any s) {
-            LockGuard<decltype(_lock)> lock(_lock);
-            LockGuard<decltype(s._lock)> slock(s._lock);
+        Any &operator=(Any s) RX_NOEXCEPT {
             swap(*this, s);
             return *this;
         }
         
         bool operator==(const Any &value) const RX_NOEXCEPT {
-            LockGuard<decltype(_lock)> lock(_lock);
-            LockGuard<decltype(value._lock)> slock(value._lock);
-            if (p == nullptr && value.p == nullptr) {
-                return true;
+            if (_ops == nullptr || value._ops == nullptr) {
+                return _ops == value._ops;
             }
-            if (p != nullptr && value.p != nullptr) {
-                bool result = (p->typeID() == value.p->typeID() && (p->compare(value.p)));
-                return result;
-            }
-            return false;
+            return _ops->typeID() == value._ops->typeID() && _ops->equal(_storage, value._storage);
         }
         
         bool operator!=(const Any &value) const RX_NOEXCEPT {
             return !(*this == value);
         }
         
+        /// A strict weak ordering for using Any as a key: empty values first, then
+        /// by held type, then by the held type's operator< or, for types without
+        /// one, by the identity of the held values.
         bool operator<(const Any &value) const RX_NOEXCEPT {
-            LockGuard<decltype(_lock)> lock(_lock);
-            LockGuard<decltype(value._lock)> slock(value._lock);
-            return p < value.p;
+            if (_ops == nullptr || value._ops == nullptr) {
+                return _ops == nullptr && value._ops != nullptr;
+            }
+            TypeInfo::id lhsType = _ops->typeID(), rhsType = value._ops->typeID();
+            if (lhsType != rhsType) {
+                return lhsType < rhsType;
+            }
+            return _ops->less(_storage, value._storage);
+        }
+        
+        friend void swap(Any &s, Any &r) RX_NOEXCEPT {
+            std::swap(s._ops, r._ops);
+            std::swap(s._storage, r._storage);
         }
-            
-        friend void swap(Any &s, Any &r) { std::swap(s.p, r.p); }
         
-        void clear() { LockGuard<decltype(_lock)> lock(_lock); delete p; p = nullptr; }
+        void clear() RX_NOEXCEPT {
+            if (_ops && _ops->destroy) {
+                _ops->destroy(_storage);
+            }
+            _ops = nullptr;
+        }
         
-        bool empty() const { LockGuard<decltype(_lock)> lock(_lock); return p == nullptr; }
+        bool empty() const RX_NOEXCEPT { return _ops == nullptr; }
         
         template<typename T>
-        bool is() const {
-            LockGuard<decltype(_lock)> lock(_lock);
-            return p ? p->is(TypeInfo::ID<T>()) : false;
+        bool is() const RX_NOEXCEPT {
+            return _ops ? _ops->typeID() == TypeInfo::ID<T>() : false;
         }
         
         template<typename T>
         const T* isKindOf() const {
-            if (p && p->is(TypeInfo::ID<T>())) {
+            if (is<T>()) {
                 return &_<T>();
             }
             return nullptr;
         }
         
-        template<typename T> operator T     &&()     && { LockGuard<decltype(_lock)> lock(_lock); return std::move(_<T>()); }
-        template<typename T> operator T      &()      & { LockGuard<decltype(_lock)> lock(_lock); return _<T>(); }
-        template<typename T> operator T const&() const& { LockGuard<decltype(_lock)> lock(_lock); return _<T>(); }
+        template<typename T> operator T     &&()     && { return std::move(_<T>()); }
+        template<typename T> operator T      &()      & { return _<T>(); }
+        template<typename T> operator T const&() const& { return _<T>(); }
     private:
         template<typename T> T      &&_()     && { return std::move(stat<T>()); }
         template<typename T> T       &_()      & { return stat<T>(); }
@@ -154,6 +218,54 @@ namespace Rx {
         template<typename T> T       &cast()      & { return dyn<T>(); }
         template<typename T> T const &cast() const& { return dyn<T>(); }
     };
+    
+    template<typename T, bool Inline>
+    const Any::Operations Any::Model<T, Inline>::operations = {
+        &TypeInfo::ID<T>, nullptr, nullptr, &Model::equal, &Model::less
+    };
+    
+    template<typename T>
+    const Any::Operations Any::Model<T, false>::operations = {
+        &TypeInfo::ID<T>, &Model::copy, &Model::destroy, &Model::equal, &Model::less
+    };
+    
+    /// An Any which can be loaded and stored from several threads at once, for
+    /// the rare value which is actually shared. Values are copied in and out
+    /// under a SpinLock, and a replaced value is destroyed after it's released.
+    class AtomicAny : public NotCopyableInterface {
+        mutable SpinLock _lock;
+        Any _value;
+    
+    public:
+        AtomicAny() RX_NOEXCEPT { }
+        AtomicAny(Any value) RX_NOEXCEPT : _value(std::move(value)) { }
+        
+        Any load() const {
+            LockGuard<decltype(_lock)> lock(_lock);
+            return _value;
+        }
+        
+        void store(Any value) RX_NOEXCEPT { exchange(std::move(value)); }
+        
+        Any exchange(Any value) RX_NOEXCEPT {
+            LockGuard<decltype(_lock)> lock(_lock);
+            swap(_value, value);
+            return value;
+        }
+        
+        void clear() RX_NOEXCEPT { store(nullptr); }
+        
+        bool empty() const RX_NOEXCEPT {
+            LockGuard<decltype(_lock)> lock(_lock);
+            return _value.empty();
+        }
+        
+        template<typename T>
+        bool is() const RX_NOEXCEPT {
+            LockGuard<decltype(_lock)> lock(_lock);
+            return _value.is<T>();
+        }
+    };
 }
-            
+
 #endif /* Any_hpp */
@@ -11,6 +11,7 @@
 
 #include <vector>
 #include <RxFoundation/CollectionContainer.hpp>
+#include <RxFoundation/Allocator.hpp>
 #include <RxFoundation/SharedPointer.hpp>
 #include <RxFoundation/String.hpp>
 #include <RxFoundation/RxObject.hpp>
@@ -18,10 +19,12 @@
 
 namespace Rx {
     
-    template <typename T>
-    class Array : public virtual Object, public CollectionContainer<std::vector, T, std::allocator<T>> {
+    /// AllocatorTy defaults to std::allocator<T> (see the declaration in String.hpp);
+    /// pass StlAllocator<T> to place the storage in a PoolAllocator or ArenaAllocator.
+    template <typename T, typename AllocatorTy>
+    class Array : public virtual Object, public CollectionContainer<std::vector, T, AllocatorTy> {
     public:
-        using base = CollectionContainer<std::vector, T, std::allocator<T>>;
+        using base = CollectionContainer<std::vector, T, AllocatorTy>;
         using StorageType = typename base::StorageType;
         
         using value_type = typename base::value_type;
@@ -48,6 +51,9 @@ namespace Rx {
         Array(StorageType &&value) RX_NOEXCEPT : base(value) {
         }
         
+        explicit Array(const AllocatorTy &allocator) RX_NOEXCEPT : base(StorageType(allocator)) {
+        }
+        
         ~Array() RX_NOEXCEPT {
         }
         
@@ -28,7 +28,13 @@
 
 #endif
 
+#include <atomic>
 #include <mutex>
+#include <cstdio>
+
+#ifndef RX_ENABLE_LOCK_STATISTICS
+#define RX_ENABLE_LOCK_STATISTICS 0
+#endif
 
 namespace Rx {
     class LockingInterface : public virtual NotCopyableInterface {
@@ -73,13 +79,46 @@ namespace Rx {
         T *_lockImpl;
     };
     
+    /// Spins with exponential pause backoff, then parks (futex on Linux/Android,
+    /// an address-keyed condition variable table elsewhere). The lock itself is one
+    /// word unless RX_ENABLE_LOCK_STATISTICS is set, which adds per-lock counters.
     class SpinLock : public LockingInterface {
     public:
+        struct Statistics {
+            UInt64 acquisitions;
+            UInt64 contendedAcquisitions;
+            UInt64 spinIterations;
+            UInt64 parkNanoseconds;
+        };
+        
+        SpinLock() RX_NOEXCEPT;
+        explicit SpinLock(const char *name) RX_NOEXCEPT;
+        ~SpinLock();
+        
         bool tryLock() override;
         void lock() override;
         void unlock() override;
+        
+        /// All zero unless built with RX_ENABLE_LOCK_STATISTICS.
+        Statistics getStatistics() const RX_NOEXCEPT;
+        
+        /// Writes the counters of every live SpinLock that has been contended.
+        static void dumpStatistics(FILE *output = stderr) RX_NOEXCEPT;
     protected:
-        std::atomic_flag locked = ATOMIC_FLAG_INIT;
+        void _lockSlow() RX_NOEXCEPT;
+        
+        // 0: unlocked, 1: locked, 2: locked and a waiter may be parked.
+        std::atomic<UInt32> _state;
+#if RX_ENABLE_LOCK_STATISTICS
+        friend struct SpinLockRegistry;
+        const char *_name;
+        std::atomic<UInt64> _acquisitions;
+        std::atomic<UInt64> _contendedAcquisitions;
+        std::atomic<UInt64> _spinIterations;
+        std::atomic<UInt64> _parkNanoseconds;
+        SpinLock *_previous;
+        SpinLock *_next;
+#endif
     };
     
     class MutexLock : public LockingInterface {
@@ -132,6 +171,11 @@ namespace Rx {
     static_assert(std::is_nothrow_default_constructible<ConditionVariable>::value,
                   "the default constructor for Rx::ConditionVariable must be nothrow");
     
+    /// Reader-writer lock with writer preference. The state is one packed word
+    /// (writer bit, pending writer count, reader count), so uncontended lockRead/
+    /// unlockRead and lockWrite/unlockWrite are a single atomic RMW each. Threads
+    /// that have to wait park on _condition; unlockers only take _mutex when
+    /// somebody is parked.
     class ReadWriteLock : public NotCopyableInterface {
     public:
         ReadWriteLock() RX_NOEXCEPT;
@@ -149,11 +193,13 @@ namespace Rx {
         bool isReading() const RX_NOEXCEPT;
         
     private:
+        void _park(bool forWrite) RX_NOEXCEPT;
+        void _wakeParked() RX_NOEXCEPT;
+        
         mutable MutexLock _mutex;
         ConditionVariable _condition;
-        Int64 _reader;
-        Int64 _writer;
-        Int64 _pending;
+        std::atomic<UInt64> _state;
+        std::atomic<Int32> _parked;
     };
     
     class Semaphore {
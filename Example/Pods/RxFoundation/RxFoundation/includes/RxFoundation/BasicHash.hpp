@@ -14,6 +14,10 @@
 #include <RxFoundation/BasicHashTypeInfo.hpp>
 #include <RxFoundation/DebugEpochBase.hpp>
 #include <RxFoundation/type_traits.hpp>
+#include <cstring>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 namespace Rx {
     
@@ -39,6 +43,87 @@ namespace Rx {
             KeyTy &getFirst() { return std::pair<KeyTy, ValueTy>::first; }
             KeyTy &getSecond() { return std::pair<KeyTy, ValueTy>::second; }
         };
+        
+        /// One control byte per bucket. A full bucket stores the low 7 bits of its
+        /// key's hash, so a lookup only compares keys whose control byte matches.
+        /// Sentinel pads the control array of tables smaller than one group.
+        namespace BasicHashControl {
+            constexpr const Int8 Empty = -128;
+            constexpr const Int8 Tombstone = -2;
+            constexpr const Int8 Sentinel = -1;
+            
+            static inline Int8 fromHash(UInt64 hash) {
+                return (Int8)(hash & 0x7f);
+            }
+        }
+        
+#if defined(__SSE2__)
+        /// 16 control bytes tested per instruction.
+        class BasicHashGroup {
+        public:
+            typedef UInt32 MaskType;
+            static constexpr const size_t Width = 16;
+            
+            explicit BasicHashGroup(const Int8 *position) :
+            _control(_mm_loadu_si128(reinterpret_cast<const __m128i *>(position))) {
+            }
+            
+            MaskType match(Int8 value) const {
+                return (MaskType)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(value), _control));
+            }
+            
+            MaskType matchEmpty() const {
+                return match(BasicHashControl::Empty);
+            }
+            
+            MaskType matchTombstone() const {
+                return match(BasicHashControl::Tombstone);
+            }
+            
+            static size_t lowestIndex(MaskType mask) {
+                return __builtin_ctz(mask);
+            }
+        private:
+            __m128i _control;
+        };
+#else
+        /// Portable fallback testing 8 control bytes per 64-bit word (used on ARM).
+        /// match() may report a false positive next to a real match; callers compare
+        /// keys anyway. matchEmpty()/matchTombstone() are exact.
+        class BasicHashGroup {
+        public:
+            typedef UInt64 MaskType;
+            static constexpr const size_t Width = 8;
+            
+            explicit BasicHashGroup(const Int8 *position) {
+                memcpy(&_control, position, sizeof(_control));
+#if defined(__BIG_ENDIAN__)
+                _control = __builtin_bswap64(_control);
+#endif
+            }
+            
+            MaskType match(Int8 value) const {
+                const UInt64 x = _control ^ (lsbs * (UInt8)value);
+                return (x - lsbs) & ~x & msbs;
+            }
+            
+            MaskType matchEmpty() const {
+                return (_control & (~_control << 6)) & msbs;
+            }
+            
+            MaskType matchTombstone() const {
+                return (_control & (~_control << 7) & (_control << 6)) & msbs;
+            }
+            
+            static size_t lowestIndex(MaskType mask) {
+                return __builtin_ctzll(mask) >> 3;
+            }
+        private:
+            static constexpr const UInt64 lsbs = 0x0101010101010101ULL;
+            static constexpr const UInt64 msbs = 0x8080808080808080ULL;
+            UInt64 _control;
+        };
+#endif
     }
     
     
@@ -113,7 +198,7 @@ namespace Rx {
             return _begin != RHS._begin;
         }
         
-        inline BasicHashTableIterator &operator++() const {
+        inline BasicHashTableIterator &operator++() {
             assert(isHandleInSync() && "invalid iterator access!");
             if (shouldReverseIterate<KeyTy>()) {
                 --_begin;
@@ -248,12 +333,13 @@ namespace Rx {
                 }
                 assert(numEntries == 0 && "Node count imbalance!");
             }
+            resetControlBytes();
             setNumEntries(0);
             setNumTombstones(0);
         }
         
         size_type count(const KeyTy &val) const {
-            BucketTy *bucket;
+            const BucketTy *bucket;
             return lookupBucketFor(val, bucket) ? 1 : 0;
         }
         
@@ -319,7 +405,7 @@ namespace Rx {
                 return std::make_pair(makeIterator(theBucket, getBucketsEnd(), *this, true), false); // Already in map.
             
             // Otherwise, insert the new element.
-            theBucket = InsertIntoBucket(std::move(kv.first),
+            theBucket = insertIntoBucket(std::move(kv.first),
                                          std::move(kv.second),
                                          val,
                                          theBucket);
@@ -340,8 +426,9 @@ namespace Rx {
             if (!lookupBucketFor(val, theBucket))
                 return false; // not in map.
             
-            theBucket->getValue().~ValueT();
+            theBucket->getValue().~ValueTy();
             theBucket->getKey() = getTombstoneKey();
+            setControlByte(theBucket, detail::BasicHashControl::Tombstone);
             decrementNumEntries();
             incrementNumTombstones();
             return true;
@@ -349,8 +436,9 @@ namespace Rx {
         
         void erase(iterator I) {
             BucketTy *theBucket = &*I;
-            theBucket->getValue().~ValueT();
+            theBucket->getValue().~ValueTy();
             theBucket->getKey() = getTombstoneKey();
+            setControlByte(theBucket, detail::BasicHashControl::Tombstone);
             decrementNumEntries();
             incrementNumTombstones();
         }
@@ -421,6 +509,13 @@ namespace Rx {
             for (BucketTy *B = getBuckets(), *E = getBucketsEnd(); B != E; ++B) {
                 ::new (&B->getKey()) KeyTy(emptyKey);
             }
+            resetControlBytes();
+        }
+        
+        /// Size of the control byte array the derived table must provide next to
+        /// its buckets: one byte per bucket, padded to at least one full group.
+        static size_type getNumControlBytes(size_type numBuckets) {
+            return numBuckets < detail::BasicHashGroup::Width ? detail::BasicHashGroup::Width : numBuckets;
         }
         
         size_type getMinBucketToReserveForEntries(size_type numEntries) {
@@ -444,6 +539,7 @@ namespace Rx {
                     bool foundValue = lookupBucketFor(B->getKey(), destBucket);
                     (void)foundValue;
                     assert(!foundValue && "Key already in new map?");
+                    setControlByte(destBucket, detail::BasicHashControl::fromHash(getMixedHashValue(B->getKey())));
                     destBucket->getKey() = std::move(B->getKey());
                     ::new (&destBucket->getValue()) ValueTy(std::move(B->getValue()));
                     incrementNumEntries();
@@ -461,6 +557,9 @@ namespace Rx {
             
             setNumEntries(other.getNumEntries());
             setNumTombstones(other.getNumTombstones());
+            if (getNumBuckets()) {
+                memcpy(getControlBytes(), other.getControlBytes(), getNumControlBytes(getNumBuckets()));
+            }
             
             if (isPodLike<KeyTy>::value && isPodLike<ValueTy>::value) {
                 memcpy(getBuckets(), other.getBuckets(),
@@ -486,6 +585,13 @@ namespace Rx {
             return BasicHashInfoType::getHashValue(val);
         }
         
+        /// The key info hash is only required to be unique, so spread it before
+        /// splitting it into a group index and a control byte.
+        template<typename LookupKeyTy>
+        static UInt64 getMixedHashValue(const LookupKeyTy &val) {
+            return mixHashValue(getHashValue(val));
+        }
+        
         static const KeyTy getEmptyKey() {
             return BasicHashInfoType::getEmptyKey();
         }
@@ -563,6 +669,27 @@ namespace Rx {
             return getBuckets() + getNumBuckets();
         }
         
+        const Int8 *getControlBytes() const {
+            return static_cast<const DerivedType *>(this)->getControlBytes();
+        }
+        Int8 *getControlBytes() {
+            return static_cast<DerivedType *>(this)->getControlBytes();
+        }
+        
+        void setControlByte(const BucketTy *bucket, Int8 value) {
+            getControlBytes()[bucket - getBuckets()] = value;
+        }
+        
+        void resetControlBytes() {
+            const size_type numBuckets = getNumBuckets();
+            if (numBuckets == 0) {
+                return;
+            }
+            Int8 *control = getControlBytes();
+            memset(control, detail::BasicHashControl::Empty, numBuckets);
+            memset(control + numBuckets, detail::BasicHashControl::Sentinel, getNumControlBytes(numBuckets) - numBuckets);
+        }
+        
         void grow(UInteger atLeast) {
             static_cast<DerivedType *>(this)->grow(atLeast);
         }
@@ -621,16 +748,20 @@ namespace Rx {
             }
             assert(bucket);
             incrementNumEntries();
-            const KeyTy emptyKey = getEmptyKey();
-            if (!BasicHashInfoType::isEqual(bucket->getKey(), emptyKey)) {
+            if (getControlBytes()[bucket - getBuckets()] == detail::BasicHashControl::Tombstone) {
                 decrementNumTombstones();
             }
+            setControlByte(bucket, detail::BasicHashControl::fromHash(getMixedHashValue(lookup)));
             return bucket;
         }
         
+        /// Probes whole groups of control bytes: keys are only compared where the
+        /// stored 7 bit hash matches, and the first group holding an empty bucket
+        /// ends the search. Groups are visited in triangular order.
         template <typename LookupKeyTy>
         bool lookupBucketFor(const LookupKeyTy &value,
                              const BucketTy *&foundBucket) const {
+            typedef detail::BasicHashGroup Group;
             const BucketTy *bucketsPtr = getBuckets();
             const size_type numBuckets = getNumBuckets();
             if (numBuckets == 0) {
@@ -638,30 +769,37 @@ namespace Rx {
                 return false;
             }
             
-            const BucketTy *foundTombstone = nullptr;
-            const KeyTy emptyKey = getEmptyKey();
-            const KeyTy tombstonKey = getTombstoneKey();
-            assert(!BasicHashInfoType::isEqual(value, emptyKey) &&
-                   !BasicHashInfoType::isEqual(value, tombstonKey) &&
+            assert(!BasicHashInfoType::isEqual(value, getEmptyKey()) &&
+                   !BasicHashInfoType::isEqual(value, getTombstoneKey()) &&
                    "Empty/Tombston value shouldn't be inserted into map");
-            size_type bucketIndex = getHashValue(value) & (numBuckets - 1);
+            const Int8 *control = getControlBytes();
+            const BucketTy *foundTombstone = nullptr;
+            const UInt64 hash = getMixedHashValue(value);
+            const Int8 controlByte = detail::BasicHashControl::fromHash(hash);
+            const size_type groupMask = getNumControlBytes(numBuckets) / Group::Width - 1;
+            size_type groupIndex = (hash >> 7) & groupMask;
             size_type probeAmt = 1;
             while (1) {
-                const BucketTy *currentBucket = bucketsPtr + bucketIndex;
-                if (BasicHashInfoType::isEqual(value, currentBucket->getKey())) {
-                    foundBucket = currentBucket;
-                    return true;
+                const size_type groupOffset = groupIndex * Group::Width;
+                const Group group(control + groupOffset);
+                for (auto mask = group.match(controlByte); mask; mask &= mask - 1) {
+                    const BucketTy *currentBucket = bucketsPtr + groupOffset + Group::lowestIndex(mask);
+                    if (BasicHashInfoType::isEqual(value, currentBucket->getKey())) {
+                        foundBucket = currentBucket;
+                        return true;
+                    }
                 }
-                if (BasicHashInfoType::isEqual(emptyKey, currentBucket->getKey())) {
-                    foundBucket = foundTombstone ? foundTombstone : currentBucket;
-                    return false;
+                if (!foundTombstone) {
+                    if (auto mask = group.matchTombstone()) {
+                        foundTombstone = bucketsPtr + groupOffset + Group::lowestIndex(mask);
+                    }
                 }
-                if (BasicHashInfoType::isEqual(tombstonKey, currentBucket->getKey()) &&
-                    !foundTombstone) {
-                    foundTombstone = currentBucket;
+                if (auto mask = group.matchEmpty()) {
+                    foundBucket = foundTombstone ? foundTombstone : bucketsPtr + groupOffset + Group::lowestIndex(mask);
+                    return false;
                 }
-                bucketIndex += probeAmt++;
-                bucketIndex &= (numBuckets - 1);
+                groupIndex += probeAmt++;
+                groupIndex &= groupMask;
             }
         }
         
@@ -26,6 +26,15 @@ namespace Rx {
     
     constexpr const auto HASHFACTOR = 2654435761UL;
     
+    /// Fibonacci hashing folded onto itself: the multiply carries every input bit
+    /// up into the high half, and folding the high half down makes the low bits
+    /// (control byte, bucket index) depend on the whole key. One multiply rather
+    /// than a full finalizer, because it sits on every lookup's critical path.
+    static inline UInt64 mixHashValue(UInt64 key) {
+        key *= 0x9E3779B97F4A7C15ULL;
+        return key ^ (key >> 32);
+    }
+    
     template <typename T>
     struct BasicHashInfoHelper {
         template <typename U>
@@ -61,9 +70,9 @@ namespace Rx {
     
     template <typename T>
     struct BasicHashInfoHelper<T *> {
+        /// The address itself: BasicHashTable mixes every hash exactly once.
         static inline HashCode getHashValue(const T *key) {
-            return (unsigned((uintptr_t)key) >> 4) ^
-            (unsigned((uintptr_t)key) >> 9);
+            return (HashCode)(uintptr_t)key;
         }
         
         static inline bool isEqual(const T *lhs, const T *rhs) {
@@ -80,7 +89,7 @@ namespace Rx {
             return nullptr;
         }
         
-        static inline T *getTombstone() {
+        static inline T *getTombstoneKey() {
             uintptr_t val = static_cast<uintptr_t>(-1);
             return reinterpret_cast<T *>(val);
         }
@@ -97,7 +106,7 @@ namespace Rx {
     template <>
     struct BasicHashInfo<char> {
         static inline char getEmptyKey() { return ~0; }
-        static inline char getTombstonKey() { return ~0 - 1; }
+        static inline char getTombstoneKey() { return ~0 - 1; }
         static UInt64 getHashValue(const char &val) { return BasicHashInfoHelper<decltype(val)>::getHashValue(val); }
         static bool isEqual(const char &lhs, const char &rhs) {
             return lhs == rhs;
@@ -319,6 +328,25 @@ namespace Rx {
             return lhs == rhs;
         }
     };
+    
+    template <>
+    struct BasicHashInfo<InternedString> {
+        static inline InternedString getEmptyKey() {
+            return InternedString(reinterpret_cast<const detail::InternedStringEntry *>(~static_cast<uintptr_t>(0)));
+        }
+        
+        static inline InternedString getTombstoneKey() {
+            return InternedString(reinterpret_cast<const detail::InternedStringEntry *>(~static_cast<uintptr_t>(1)));
+        }
+        
+        static UInt64 getHashValue(const InternedString &val) {
+            return (UInt64)val.hash();
+        }
+        
+        static bool isEqual(const InternedString &lhs, const InternedString &rhs) {
+            return lhs == rhs;
+        }
+    };
 }
 
 #endif /* BasicHashTypeInfo_h */
@@ -11,9 +11,15 @@
 
 #include <RxFoundation/String.hpp>
 #include <RxFoundation/Array.hpp>
+#include <mutex>
 
 namespace Rx {
     void getBacktrace(void **stack, int *size);
+    
+    /// The symbol for a return address as "image 0xaddress symbol + offset", with
+    /// C++ names demangled. Each address is only looked up once: the results are
+    /// cached for the life of the process.
+    String getSymbolForAddress(const void *address) RX_NOEXCEPT;
 }
 
 namespace Rx {
@@ -21,12 +27,17 @@ namespace Rx {
     public:
         CallStackArray(void **stack, UInt32 frames);
         ~CallStackArray();
+        
+        /// The symbolicated frames. The symbols are only looked up the first time
+        /// they're needed, so a CallStackArray which is never printed stays cheap.
+        const Array<String> &getSymbols() const;
         const String getDescription() const;
         
     private:
         UInt32 _frames;
         std::unique_ptr<void *, void(*)(void *)> _stack;
-        ArrayPtr<String> _infoFrames;
+        mutable std::once_flag _infoFramesOnce;
+        mutable ArrayPtr<String> _infoFrames;
     };
     
     typedef SharedPtr<const CallStackArray> CallStackArrayRef;
@@ -12,15 +12,34 @@
 #include <RxFoundation/RxObject.hpp>
 #include <RxFoundation/Bitfield.hpp>
 
+#include <functional>
+#include <vector>
+
 namespace Rx {
     class Data;
     using DataParamRef = Data *;
     using DataPtr = SharedPtr<Data>;
     using DataRef = SharedRef<Data>;
     
+    namespace detail {
+        struct DataChunk;
+    }
+    
     class Data : public Object {
+    public:
+        enum class StorageMode {
+            /// One malloc'd buffer, grown in place.
+            Contiguous,
+            /// A read-only file mapping, see mapFile().
+            Mapped,
+            /// A list of chunks shared between copies. Appending never moves existing bytes.
+            Chunked,
+        };
+        
     public:
         Data() RX_NOEXCEPT;
+        /// Empty data using the given storage. Mapped data is created with mapFile().
+        explicit Data(StorageMode mode) RX_NOEXCEPT;
         // FreeWhenDone = true, ptr will be deep copy and free when done
         // FreeWhenDone = false, ptr will be use directly
         Data(uint8_t *bytes, Index length, bool needCopy, bool freeWhenDone = true) RX_NOEXCEPT;
@@ -29,8 +48,14 @@ namespace Rx {
         virtual ~Data() RX_NOEXCEPT;
         
     public:
+        /// Chunked data spanning more than one chunk is coalesced into Contiguous storage first.
+        const uint8_t *getBytePtr() RX_NOEXCEPT;
+        /// Never modifies the storage, so it is safe to call from several threads. Returns
+        /// nullptr when the bytes span more than one chunk; use getBytes() or
+        /// enumerateByteRanges() to read those.
         const uint8_t *getBytePtr() const RX_NOEXCEPT;
-        uint8_t *getMutableBytePtr() const RX_NOEXCEPT;
+        /// Always switches to Contiguous storage; mapped bytes are copied out.
+        uint8_t *getMutableBytePtr() RX_NOEXCEPT;
         
         const Index getLength() const RX_NOEXCEPT;
         Index getLength() RX_NOEXCEPT;
@@ -39,6 +64,14 @@ namespace Rx {
         Index getCapacity() RX_NOEXCEPT;
         void setLength(Index length) RX_NOEXCEPT;
         
+        StorageMode getStorageMode() const RX_NOEXCEPT;
+        
+        /// Copies range into buffer without making mapped or chunked storage contiguous.
+        void getBytes(Range range, uint8_t *buffer) const RX_NOEXCEPT;
+        
+        /// Visits the bytes in storage order, one contiguous range at a time. Set stop to end early.
+        void enumerateByteRanges(const std::function<void (const uint8_t *bytes, Range range, bool &stop)> &block) const RX_NOEXCEPT;
+        
     public:
         void appendData(const uint8_t *bytes, Index length) RX_NOEXCEPT;
         void appendData(const DataRef data) RX_NOEXCEPT;
@@ -49,22 +82,34 @@ namespace Rx {
     public:
         bool writeToFile(String path, bool automatically) RX_NOEXCEPT;
         
+        /// Replaces the contents with a read-only mapping of path. Returns false and leaves the data empty if the file cannot be mapped.
+        bool mapFile(String path) RX_NOEXCEPT;
+        
     public:
         bool operator==(const Data &rhs) const RX_NOEXCEPT;
         virtual String copyDescription() const RX_NOEXCEPT override;
         virtual HashCode hash() const RX_NOEXCEPT override;
         
     private:
+        using ChunkPtr = SharedPtr<detail::DataChunk, ESPMode::ThreadSafe>;
+        
         void __setCapacity(Index capacity) RX_NOEXCEPT;
         void __setLength(Index length) RX_NOEXCEPT;
         
         /* Allocates new block of data with at least numNewValues more bytes than the current length. If clear is true, the new bytes up to at least the new length with be zeroed. */
         void __dataGrow(Data &data, Index numNewValues, bool clear) RX_NOEXCEPT;
         
+        /* Copies mapped or chunked storage into a malloc'd buffer and switches to Contiguous. */
+        void __makeContiguous() RX_NOEXCEPT;
+        void __appendChunked(const uint8_t *bytes, Index length) RX_NOEXCEPT;
+        void __releaseStorage() RX_NOEXCEPT;
+        
         Bitfield _flags;
         Index _length;
         Index _capacity;
         UInt8 *_bytes;
+        StorageMode _storageMode;
+        std::vector<ChunkPtr> _chunks;
     };
 }
 
@@ -10,6 +10,7 @@
 #define Dictionary_hpp
 
 #include <RxFoundation/BasicHash.hpp>
+#include <RxFoundation/Allocator.hpp>
 #include <map>
 
 namespace Rx {
@@ -23,23 +24,24 @@ namespace Rx {
         friend class BasicHashTable<Dictionary, KeyTy, ValueTy, KeyInfoTy, BucketTy>;
         typedef typename BaseTy::size_type size_type;
     public:
-        explicit Dictionary(size_type initialReserve = 0) {
+        /// The bucket array comes from allocator, which must outlive the dictionary.
+        explicit Dictionary(size_type initialReserve = 0, Allocator &allocator = Allocator::getDefault()) : _allocator(&allocator) {
             init(initialReserve);
         }
         
-        Dictionary(const Dictionary &other) : BaseTy() {
+        Dictionary(const Dictionary &other) : BaseTy(), _allocator(other._allocator) {
             init(0);
             copyFrom(other);
         }
         
-        Dictionary(Dictionary &&other) : BaseTy() {
+        Dictionary(Dictionary &&other) : BaseTy(), _allocator(other._allocator) {
             init(0);
             swap(other);
         }
         
         ~Dictionary() {
             this->destroyAll();
-            operator delete(_buckets);
+            _deallocateBuckets(_buckets, _numBuckets);
             _buckets = nullptr;
         }
         
@@ -50,6 +52,7 @@ namespace Rx {
             std::swap(_numEntries, other._numEntries);
             std::swap(_numTombstones, other._numTombstones);
             std::swap(_numBuckets, other._numBuckets);
+            std::swap(_allocator, other._allocator);
         }
         
         Dictionary &operator=(const Dictionary &other) {
@@ -59,9 +62,9 @@ namespace Rx {
             return *this;
         }
         
-        Dictionary &operator=(const Dictionary &&other) {
+        Dictionary &operator=(Dictionary &&other) {
             this->destroyAll();
-            operator delete(_buckets);
+            _deallocateBuckets(_buckets, _numBuckets);
             init(0);
             swap(other);
             return *this;
@@ -69,7 +72,7 @@ namespace Rx {
         
         void copyFrom(const Dictionary &other) {
             this->destroyAll();
-            operator delete(_buckets);
+            _deallocateBuckets(_buckets, _numBuckets);
             if (_allocatedBuckets(other._numBuckets)) {
                 this->BaseTy::copyFrom(other);
             } else {
@@ -98,7 +101,7 @@ namespace Rx {
                 return;
             }
             this->moveFromOldBuckets(oldBuckets, oldBuckets + oldNumBuckets);
-            operator delete(oldBuckets);
+            _deallocateBuckets(oldBuckets, oldNumBuckets);
         }
         
         void shrink_and_clear() {
@@ -112,7 +115,7 @@ namespace Rx {
                 this->BaseTy::initEmpty();
                 return;
             }
-            operator delete(_buckets);
+            _deallocateBuckets(_buckets, _numBuckets);
             init(newNumBuckets);
         }
     private:
@@ -141,16 +144,33 @@ namespace Rx {
             return _numBuckets;
         }
         
+        Int8 *getControlBytes() const {
+            // The control bytes live in the same allocation, right after the buckets.
+            return reinterpret_cast<Int8 *>(_buckets + _numBuckets);
+        }
+        
         bool _allocatedBuckets(size_type num) {
             _numBuckets = num;
             if (_numBuckets == 0) {
                 _buckets = nullptr;
                 return false;
             }
-            _buckets = static_cast<BucketTy*>(operator new(sizeof(BucketTy) * _numBuckets));
+            _buckets = static_cast<BucketTy*>(_allocator->allocateBytes(_getAllocationSize(_numBuckets), alignof(BucketTy)));
+            assert(_buckets);
             return true;
         }
         
+        void _deallocateBuckets(BucketTy *buckets, size_type num) {
+            if (buckets) {
+                _allocator->deallocateBytes(buckets, _getAllocationSize(num), alignof(BucketTy));
+            }
+        }
+        
+        static size_t _getAllocationSize(size_type num) {
+            return sizeof(BucketTy) * num + BaseTy::getNumControlBytes(num);
+        }
+        
+        Allocator *_allocator;
         BucketTy *_buckets;
         size_type _numEntries;
         size_type _numTombstones;
@@ -184,6 +204,7 @@ namespace Rx {
         };
         
         AlignedCharArrayUnion<BucketTy[InlineBuckets], LargeRep> _storage;
+        Int8 _inlineControl[InlineBuckets < detail::BasicHashGroup::Width ? detail::BasicHashGroup::Width : InlineBuckets];
     public:
         explicit SmallDictionary(size_type numInitBuckets = 0) {
             init(numInitBuckets);
@@ -220,7 +241,7 @@ namespace Rx {
             if (_small && rhs._small) {
                 for (size_type i = 0, e = InlineBuckets; i != e; ++i) {
                     BucketTy *lhsb = &getInlineBuckets()[i],
-                    *rhsb = rhs.getInlineBuckets()[i];
+                    *rhsb = &rhs.getInlineBuckets()[i];
                     bool hasLHSValue = (!KeyInfoTy::isEqual(lhsb->getKey(), emptyKey) &&
                                         !KeyInfoTy::isEqual(lhsb->getKey(), tombstoneKey));
                     bool hasRHSValue = (!KeyInfoTy::isEqual(rhsb->getKey(), emptyKey) &&
@@ -238,6 +259,7 @@ namespace Rx {
                         rhsb->getValue().~ValueTy();
                     }
                 }
+                std::swap(_inlineControl, rhs._inlineControl);
                 return;
             }
             if (!_small && !rhs._small) {
@@ -262,6 +284,7 @@ namespace Rx {
                 }
             }
             
+            memcpy(largeSide._inlineControl, smallSide._inlineControl, sizeof(_inlineControl));
             smallSide._small = false;
             new (smallSide.getLargeRep()) LargeRep(std::move(tmpRep));
         }
@@ -355,7 +378,7 @@ namespace Rx {
                 }
             }
             if ((_small && newNumBuckets <= InlineBuckets) ||
-                (!_small && newNumBuckets == getLargeRep()->numBuckets)) {
+                (!_small && newNumBuckets == getLargeRep()->_numBuckets)) {
                 this->BaseTy::initEmpty();
                 return;
             }
@@ -418,6 +441,18 @@ namespace Rx {
             return _small ? InlineBuckets : getLargeRep()->_numBuckets;
         }
         
+        const Int8 *getControlBytes() const {
+            if (_small) {
+                return _inlineControl;
+            }
+            // Large tables keep their control bytes right after the buckets.
+            return reinterpret_cast<const Int8 *>(getLargeRep()->_buckets + getLargeRep()->_numBuckets);
+        }
+        
+        Int8 *getControlBytes() {
+            return const_cast<Int8 *>(const_cast<const SmallDictionary *>(this)->getControlBytes());
+        }
+        
         void deallocateBuckets() {
             if (_small) {
                 return;
@@ -430,7 +465,7 @@ namespace Rx {
         LargeRep allocateBuckets(size_type Num) {
             assert(Num > InlineBuckets && "Must allocate more buckets than are inline");
             LargeRep Rep = {
-                static_cast<BucketTy*>(operator new(sizeof(BucketTy) * Num)), Num
+                static_cast<BucketTy*>(operator new(sizeof(BucketTy) * Num + BaseTy::getNumControlBytes(Num))), Num
             };
             return Rep;
         }
@@ -11,11 +11,17 @@
 
 #include <RxFoundation/String.hpp>
 #include <RxFoundation/Array.hpp>
+#include <mutex>
 
 namespace Rx {
+    class CallStackArray;
+    
     class Exception {
     public:
         Exception(const String &name, const String reason) RX_NOEXCEPT;
+        /// Copies the captured frames but not the symbols or description, which
+        /// the copy looks up again if it's asked for them.
+        Exception(const Exception &exception) RX_NOEXCEPT;
         virtual ~Exception() RX_NOEXCEPT;
         virtual const char* what() const RX_NOEXCEPT;
     public:
@@ -24,10 +30,23 @@ namespace Rx {
         const Array<String> getCallStackSymbols() const;
         const String copyDescription() const;
     private:
+        static constexpr int MaxCallStackFrames = 33;
+        
+        const CallStackArray &getCallStack() const;
         
         const String &_name;
         const String _reason;
-        ArrayPtr<String> _callStackSymbols;
+        
+        /// The return addresses captured when the exception was created. They're
+        /// only turned into a CallStackArray and symbolicated if asked for.
+        void *_callStack[MaxCallStackFrames];
+        UInt32 _callStackFrames;
+        /// Filled in on first use, which may be on several threads at once when the
+        /// exception is shared through an exception_ptr.
+        mutable std::once_flag _callStackOnce;
+        mutable ArrayPtr<String> _callStackSymbols;
+        mutable std::once_flag _descriptionOnce;
+        mutable String _description;
     };
 }
 
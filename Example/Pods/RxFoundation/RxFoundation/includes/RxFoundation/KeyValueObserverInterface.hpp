@@ -15,7 +15,6 @@
 #include <RxFoundation/Any.hpp>
 #include <RxFoundation/OrderedSet.hpp>
 #include <RxFoundation/Exception.hpp>
-#include <map>
 #include <set>
 
 namespace Rx {
@@ -87,12 +86,18 @@ namespace Rx {
         virtual ~KeyValueObserverInterface() RX_NOEXCEPT;
         
         void addObserver(KeyValueObserverInterfaceParamRef observer, const String &key, Integer notifyKind, Any context) RX_NOEXCEPT;
+        void addObserver(KeyValueObserverInterfaceParamRef observer, const InternedString &key, Integer notifyKind, Any context) RX_NOEXCEPT;
         void removeObserver(KeyValueObserverInterfaceParamRef observer, const String &key) RX_NOEXCEPT;
+        void removeObserver(KeyValueObserverInterfaceParamRef observer, const InternedString &key) RX_NOEXCEPT;
         
         void willChangeValueForKey(const String &key) const RX_NOEXCEPT;
         void didChangeValueForKey(const String &key) const RX_NOEXCEPT;
+        /// Observers are registered by interned key, so these find them by identity without
+        /// hashing or comparing the key's bytes. Prefer them for keys changed often.
+        void willChangeValueForKey(const InternedString &key) const RX_NOEXCEPT;
+        void didChangeValueForKey(const InternedString &key) const RX_NOEXCEPT;
         
-        void *getObserversInfo() const RX_NOEXCEPT { return (void *)&_observersInfo.get(); }
+        void *getObserversInfo() const RX_NOEXCEPT { return (void *)_registry.load(std::memory_order_acquire); }
         
         virtual std::set<String> keyPathsForValuesAffectingValueForKey​​(const String &key) const RX_NOEXCEPT;
         virtual void receiveObserverNotify(const String &keyPath,
@@ -102,8 +107,10 @@ namespace Rx {
         }
     private:
         
-        void _willChangeValueForKey(const String &key, Change::Kind kind = Change::Kind::New) const RX_NOEXCEPT;
-        void _didChangeValueForKey(const String &key, Change::Kind kind = Change::Kind::New, bool doCall = true) const RX_NOEXCEPT;
+        template <typename KeyTy>
+        void _willChangeValueForKey(const KeyTy &key, Change::Kind kind = Change::Kind::New) const RX_NOEXCEPT;
+        template <typename KeyTy>
+        void _didChangeValueForKey(const KeyTy &key, Change::Kind kind = Change::Kind::New, bool doCall = true) const RX_NOEXCEPT;
         
         enum class KVOCallState {
             Default,
@@ -192,9 +199,75 @@ namespace Rx {
         };
         
         typedef SharedRef<KVOPair> KVOPairRef;
-        SharedRef<std::map<const String, OrderedSetRef<KVOPairRef>>> _observersInfo;
         
-        Array<KVOPairRef> _getObservers(const String &key, KeyValueObserverInterfaceParamRef object, Change::Kind notifyKind) const RX_NOEXCEPT;
+        /// The observers of one key. Slots are only ever appended: a snapshot reads the first
+        /// count slots it was published with, so the writer constructs new ones past that
+        /// instead of copying the block, and every snapshot of the key shares it.
+        class ObserverSlots : public NotCopyableInterface {
+        public:
+            explicit ObserverSlots(UInt32 capacity) RX_NOEXCEPT;
+            ~ObserverSlots() RX_NOEXCEPT;
+            
+            const KVOPairRef &operator[](UInt32 idx) const RX_NOEXCEPT { return _slots[idx]; }
+            UInt32 getCapacity() const RX_NOEXCEPT { return _capacity; }
+            UInt32 getUsed() const RX_NOEXCEPT { return _used; }
+            // Writer only, and only while getUsed() < getCapacity().
+            void append(const KVOPairRef &observer) RX_NOEXCEPT;
+            
+        private:
+            KVOPairRef *_slots;
+            UInt32 _capacity;
+            UInt32 _used;
+        };
+        
+        /// Every observer: an open addressing table from interned key identity to that key's
+        /// bucket. A published bucket is never modified; add/removeObserver build a new one
+        /// for the key they change under _observerLock and swap it in, so notifications read
+        /// without locking or allocating and writers never copy the rest of the table.
+        struct ObserverRegistry : public NotCopyableInterface {
+            struct Bucket {
+                InternedString key;
+                SharedPtr<ObserverSlots> slots;
+                UInt32 count;
+                // Writer-side bookkeeping, only touched under _observerLock.
+                UInt32 numDisabled;
+                
+                /// Moves the enabled observers to a new block with room for as many again.
+                void compact() RX_NOEXCEPT;
+            };
+            
+            explicit ObserverRegistry(size_t numBuckets) RX_NOEXCEPT;
+            
+            const Bucket *find(const InternedString &key) const RX_NOEXCEPT;
+            /// Hashes key once and compares bytes only on a hash match.
+            const Bucket *find(const String &key) const RX_NOEXCEPT;
+            /// The slot holding key, or the empty slot it would be inserted in.
+            std::atomic<Bucket *> &slotFor(const InternedString &key) RX_NOEXCEPT;
+            
+            const size_t numBuckets;
+            std::unique_ptr<std::atomic<Bucket *>[]> buckets;
+            // Writer-side bookkeeping: keys are never removed, a key without observers keeps an empty bucket.
+            UInt32 numKeys;
+        };
+        
+        class RegistryReader;
+        
+        void _replaceBucket(std::atomic<ObserverRegistry::Bucket *> &slot, ObserverRegistry::Bucket *bucket) RX_NOEXCEPT;
+        bool _advanceRegistryEpoch() const RX_NOEXCEPT;
+        void _reclaimRegistries() const RX_NOEXCEPT;
+        void _willChange(const ObserverRegistry::Bucket &bucket) const RX_NOEXCEPT;
+        void _didChange(const ObserverRegistry::Bucket &bucket, Change::Kind kind, bool doCall) const RX_NOEXCEPT;
+        
+        std::atomic<ObserverRegistry *> _registry;
+        // Readers are counted under the epoch they started in, which is the current one or the
+        // one before it. Replaced tables and buckets are tagged with the epoch they were retired
+        // in and freed once the epoch is two past that, when every reader that could still see
+        // them has left, however many newer readers there are.
+        mutable std::atomic<UInt64> _registryEpoch;
+        mutable std::atomic<Int32> _registryReaders[2];
+        mutable std::atomic<bool> _hasRetiredRegistries;
+        mutable std::vector<std::pair<UInt64, ObserverRegistry *>> _retiredRegistries;
+        mutable std::vector<std::pair<UInt64, ObserverRegistry::Bucket *>> _retiredBuckets;
         
 #pragma mark - Private LockingInterface
         class NamedMutexLock : public MutexLock {
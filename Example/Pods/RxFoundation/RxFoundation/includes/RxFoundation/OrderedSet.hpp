@@ -16,10 +16,22 @@
 #include <RxFoundation/CopyDescriptionChecker.hpp>
 #include <RxFoundation/HashChecker.hpp>
 #include <algorithm>
+#include <new>
+#include <vector>
 
 namespace Rx {
+    /// Set which keeps its elements in insertion order.
+    ///
+    /// Elements live in an array of slots indexed by a HashIndex, so contains,
+    /// find and erase are O(1) on average. Erasing an element destroys it and
+    /// leaves its slot behind as a tombstone; tombstones are compacted away in a
+    /// single pass once they make up half of the slots, which keeps erase O(1)
+    /// amortized. operator[] compacts any tombstones left by earlier erasures
+    /// before indexing, so it is O(1) amortized too; that invalidates iterators
+    /// taken since those erasures, as any other compaction does.
     template <typename T>
     class OrderedSet : public virtual Object {
+        class Slot;
     public:
         typedef T value_type;
         typedef ptrdiff_t difference_type;
@@ -35,7 +47,7 @@ namespace Rx {
             friend class OrderedSet<value_type>;
             static constexpr const Index BeginIndex = 0;
             static constexpr const Index EndIndex = -1;
-            __iterator(const OrderedSet<value_type> &orderedSet, const Index index) RX_NOEXCEPT :
+            __iterator(const OrderedSet<value_type> &orderedSet, const size_type index) RX_NOEXCEPT :
             _orderedSet(orderedSet),
             _index(index) {
             }
@@ -46,43 +58,31 @@ namespace Rx {
             }
             
         public:
-            __iterator operator++() const RX_NOEXCEPT {
-                if (_index == EndIndex) {
-                    return *this;
-                } else if (_index + 1 == _orderedSet.size()) {
-                    return __iterator(_orderedSet, EndIndex);
-                }
-                return __iterator(_orderedSet, _index++);
+            __iterator operator++(int) RX_NOEXCEPT {
+                __iterator result = *this;
+                ++(*this);
+                return result;
             }
             
-            __iterator operator--() const {
-                if (_index == BeginIndex) {
-                    return *this;
-                } else if (_index == EndIndex && _orderedSet.size()) {
-                    return __iterator(_orderedSet, _orderedSet.size() - 1);
-                }
-                return __iterator(_orderedSet, _index--);
+            __iterator operator--(int) RX_NOEXCEPT {
+                __iterator result = *this;
+                --(*this);
+                return result;
             }
             
             __iterator &operator++() RX_NOEXCEPT {
-                if (_index == EndIndex) {
-                    return *this;
-                } else if (_index + 1 == _orderedSet.size()) {
-                    _index = EndIndex;
+                if (_index == (size_type)EndIndex) {
                     return *this;
                 }
-                _index++;
+                _index = _orderedSet._nextPosition(_index + 1);
                 return *this;
             }
             
             __iterator &operator--() RX_NOEXCEPT {
-                if (_index == BeginIndex) {
-                    return *this;
-                } else if (_index == EndIndex && _orderedSet.size()) {
-                    _index == _orderedSet.size() - 1;
-                    return *this;
+                const auto position = _orderedSet._previousPosition(_index == (size_type)EndIndex ? _orderedSet._slots.size() : _index);
+                if (position != NotFound) {
+                    _index = position;
                 }
-                _index--;
                 return *this;
             }
             
@@ -99,7 +99,7 @@ namespace Rx {
             
             const ValueTy &operator*() const RX_NOEXCEPT {
                 RxCheck((bool)(*this));
-                return _orderedSet._array[_index];
+                return _orderedSet._slots[_index].value();
             }
             
             const ValueTy *operator->() const {
@@ -110,11 +110,10 @@ namespace Rx {
             }
             
             operator bool() const RX_NOEXCEPT {
-                if (_index == EndIndex) {
+                if (_index == (size_type)EndIndex) {
                     return false;
                 }
-                auto size = _orderedSet.size();
-                return size && size > _index;
+                return _index < _orderedSet._slots.size() && !_orderedSet._slots[_index].isErased();
             }
         private:
             
@@ -133,15 +132,15 @@ namespace Rx {
         using const_iterator = __iterator<const value_type>;
         
         OrderedSet() RX_NOEXCEPT {}
-        OrderedSet(const OrderedSet &value) RX_NOEXCEPT : _array(value._array), _set(value._set) {}
-        OrderedSet(OrderedSet &&value) RX_NOEXCEPT : _array(std::move(value._array)), _set(std::move(value._set)) {}
+        OrderedSet(const OrderedSet &value) RX_NOEXCEPT : _slots(value._slots), _index(value._index), _numErased(value._numErased), _head(value._head) {}
+        OrderedSet(OrderedSet &&value) RX_NOEXCEPT : _slots(std::move(value._slots)), _index(std::move(value._index)), _numErased(value._numErased), _head(value._head) {
+            value._slots.clear();
+            value._numErased = 0;
+            value._head = 0;
+        }
         OrderedSet(std::initializer_list<value_type> __il) RX_NOEXCEPT {
             for (const auto &element : __il) {
-                if (_set.contains(element)) {
-                    continue;
-                }
-                _set.addObject(element);
-                _array.addObject(element);
+                _addObject(element);
             }
             size();
         }
@@ -149,7 +148,7 @@ namespace Rx {
         
         const_iterator begin() const RX_NOEXCEPT {
             if (size()) {
-                return const_iterator(*this, const_iterator::BeginIndex);
+                return const_iterator(*this, _head);
             }
             return end();
         }
@@ -159,14 +158,13 @@ namespace Rx {
         
         void addObject(const value_type &value) RX_NOEXCEPT {
             size();
-            _array.addObject(value);
-            _set.addObject(value);
+            _addObject(value);
             size();
         }
         
         virtual void addObjects(const_iterator start, const_iterator end) RX_NOEXCEPT {
-            if (!(start._orderedSet == end._orderedSet) ||
-                start._orderedSet == *this) {
+            if (&start._orderedSet != &end._orderedSet ||
+                &start._orderedSet == this) {
                 return;
             }
             auto startPosition = start._getPosition();
@@ -174,28 +172,25 @@ namespace Rx {
             if (startPosition == endPosition) {
                 return;
             }
-            auto cnt = size();
-            if (startPosition >= cnt) {
+            if (startPosition == NotFound) {
                 return;
             }
-            if (endPosition != const_iterator::EndIndex &&
+            if (endPosition != NotFound &&
                 endPosition < startPosition) {
                 return;
             }
-            auto &targetOrderedSet = start._orderedSet;
-            auto array_begin_it = targetOrderedSet._array.begin() + startPosition;
-            auto array_end_it = endPosition == const_iterator::EndIndex ? targetOrderedSet._array.end() : array_begin_it + endPosition;
-            _array.addObjects(_array.end(), array_begin_it, array_end_it);
-            for (auto it = array_begin_it; it != array_end_it; it++) {
-                _set.addObject(*it);
+            for (auto it = start; it != end; ++it) {
+                _addObject(*it);
             }
             size();
         }
         
         void erase(const value_type &value) RX_NOEXCEPT {
             size();
-            _array.erase(value);
-            _set.erase(value);
+            auto it = _find(value);
+            if (it != _index.end()) {
+                _eraseEntry(it);
+            }
             size();
         }
         
@@ -203,15 +198,12 @@ namespace Rx {
             if (!it) {
                 return;
             }
-            auto &value = *it;
-            typename decltype(_array)::iterator _it = _array.begin() + it._getPosition();
-            _array.erase(_it);
-            _set.erase(value);
+            _eraseEntry(_find(*it));
         }
         
         size_type size() const RX_NOEXCEPT {
-            auto size = _array.size();
-            RxCheck(size == _set.size());
+            auto size = _slots.size() - _numErased;
+            RxCheck(size == _index.size());
             return size;
         }
         
@@ -220,61 +212,55 @@ namespace Rx {
         }
         
         virtual const_reference front() const RX_NOEXCEPT {
-            return _array.front();
+            return _slots[_head].value();
         }
         
         virtual const_reference back() const RX_NOEXCEPT {
-            return _array.back();
+            return _slots.back().value();
         }
         
         virtual void pop_back() RX_NOEXCEPT {
-            auto ref = back();
-            _array.pop_back();
-            _set.erase(ref);
+            _eraseEntry(_find(back()));
             size();
         }
         
-        virtual const value_type *data() const RX_NOEXCEPT {
-            return _array.data();
-        }
-        
         OrderedSet &operator=(const OrderedSet &value) RX_NOEXCEPT {
-            _array = value._array;
-            _set = value._set;
+            _slots = value._slots;
+            _index = value._index;
+            _numErased = value._numErased;
+            _head = value._head;
             return *this;
         }
         
         virtual bool contains(const_reference element) const RX_NOEXCEPT {
-            return std::find(_set.begin(), _set.end(), element) != _set.end();
+            return _find(element) != _index.end();
         }
         
         virtual const_iterator find(const_reference element) const RX_NOEXCEPT {
-            auto it = std::find(_set.begin(), _set.end(), element);
-            if (it == _set.end()) {
+            auto it = _find(element);
+            if (it == _index.end()) {
                 // not found
                 return end();
             }
-            auto arrayIt = std::find(_array.begin(), _array.end(), *it);
-            RxCheck(arrayIt != _array.end());
-            auto index = arrayIt - _array.begin();
-            return const_iterator(*this, index);
+            return const_iterator(*this, it->getKey().position);
         }
         
         template <typename Predicate>
         const_iterator find(Predicate predicate) const RX_NOEXCEPT {
-            auto it = _set.find(predicate);
-            if (it == _set.end()) {
-                // not found
-                return end();
+            for (auto it = begin(), end = this->end(); it != end; ++it) {
+                if (predicate(*it)) {
+                    return it;
+                }
             }
-            auto arrayIt = _array.find(*it);
-            RxCheck(arrayIt != _array.end());
-            auto index = arrayIt - _array.begin();
-            return const_iterator(*this, index);
+            // not found
+            return end();
         }
         
         virtual const_reference operator[](size_t idx) const RX_NOEXCEPT {
-            return _array[idx];
+            if (_numErased != 0) {
+                _compact();
+            }
+            return _slots[idx].value();
         }
         
         bool operator==(const OrderedSet &value) const RX_NOEXCEPT {
@@ -284,19 +270,167 @@ namespace Rx {
             if (size() != value.size()) {
                 return false;
             }
-            return _array == value._array && _set == value._set;
+            return std::equal(begin(), end(), value.begin());
         }
         
         virtual String copyDescription() const RX_NOEXCEPT {
-            return _array.copyDescription();
+            String description = "(";
+            for (auto it = begin(), end = this->end(); it != end; ++it) {
+                if (it._index != _head) {
+                    description += ",\n";
+                }
+                description += Rx::copyDescription(*it);
+            }
+            description += ")";
+            return description;
         }
         
         virtual HashCode hash() const RX_NOEXCEPT {
-            return Rx::hash(_array);
+            return size();
         }
     private:
-        Array<T> _array;
-        Set<T> _set;
+        /// One element of _slots. Erasing destroys the value straight away and
+        /// leaves the slot as a tombstone until the next compaction.
+        class Slot {
+        public:
+            explicit Slot(const value_type &value) RX_NOEXCEPT : _erased(false) {
+                ::new (&_value) value_type(value);
+            }
+            
+            Slot(const Slot &slot) RX_NOEXCEPT : _erased(slot._erased) {
+                if (!_erased) {
+                    ::new (&_value) value_type(slot._value);
+                }
+            }
+            
+            Slot(Slot &&slot) RX_NOEXCEPT : _erased(slot._erased) {
+                if (!_erased) {
+                    ::new (&_value) value_type(std::move(slot._value));
+                }
+            }
+            
+            ~Slot() RX_NOEXCEPT {
+                if (!_erased) {
+                    _value.~value_type();
+                }
+            }
+            
+            Slot &operator=(const Slot &) = delete;
+            
+            bool isErased() const RX_NOEXCEPT {
+                return _erased;
+            }
+            
+            const value_type &value() const RX_NOEXCEPT {
+                return _value;
+            }
+            
+            void erase() RX_NOEXCEPT {
+                _value.~value_type();
+                _erased = true;
+            }
+        private:
+            union {
+                value_type _value;
+            };
+            bool _erased;
+        };
+        
+        /// The elements a Lookup compares against, addressed by slot position.
+        struct Elements {
+            const Slot *slots;
+            
+            const value_type &operator[](UInt32 position) const RX_NOEXCEPT {
+                return slots[position].value();
+            }
+        };
+        
+        typedef detail::HashIndexInfo<T> IndexInfo;
+        typedef detail::HashIndex<T> IndexType;
+        
+        typename IndexType::const_iterator _find(const value_type &value) const RX_NOEXCEPT {
+            return _index.find_as(IndexInfo::lookup(Elements{_slots.data()}, value));
+        }
+        
+        typename IndexType::iterator _find(const value_type &value) RX_NOEXCEPT {
+            return _index.find_as(IndexInfo::lookup(Elements{_slots.data()}, value));
+        }
+        
+        /// The first slot at or after position which holds an element.
+        size_type _nextPosition(size_type position) const RX_NOEXCEPT {
+            while (position < _slots.size() && _slots[position].isErased()) {
+                position++;
+            }
+            return position < _slots.size() ? position : (size_type)const_iterator::EndIndex;
+        }
+        
+        /// The last slot before position which holds an element.
+        size_type _previousPosition(size_type position) const RX_NOEXCEPT {
+            while (position > 0) {
+                if (!_slots[--position].isErased()) {
+                    return position;
+                }
+            }
+            return NotFound;
+        }
+        
+        void _addObject(const value_type &value) RX_NOEXCEPT {
+            const auto lookup = IndexInfo::lookup(Elements{_slots.data()}, value);
+            const detail::HashIndexKey key = {(UInt32)_slots.size(), lookup.hash};
+            if (_index.insert_as(std::make_pair(key, detail::HashIndexValue()), lookup).second) {
+                _slots.emplace_back(value);
+            }
+        }
+        
+        void _eraseEntry(typename IndexType::iterator it) RX_NOEXCEPT {
+            const size_type position = it->getKey().position;
+            _index.erase(it);
+            _slots[position].erase();
+            _numErased++;
+            if (position == _head) {
+                _head = _nextPosition(position);
+            }
+            // Trailing tombstones are dropped straight away, which keeps back() and
+            // pop_back() O(1).
+            while (!_slots.empty() && _slots.back().isErased()) {
+                _slots.pop_back();
+                _numErased--;
+            }
+            if (_slots.empty()) {
+                _head = 0;
+            } else if (_numErased * 2 >= _slots.size()) {
+                _compact();
+            }
+        }
+        
+        /// Drop every tombstone, renumbering the index from the buckets themselves
+        /// rather than looking each element up again. Leaves the elements and
+        /// their order as they were, which is why operator[] can do it.
+        void _compact() const RX_NOEXCEPT {
+            std::vector<UInt32> positions(_slots.size());
+            std::vector<Slot> slots;
+            slots.reserve(_slots.size() - _numErased);
+            for (size_type position = 0; position < _slots.size(); position++) {
+                if (!_slots[position].isErased()) {
+                    positions[position] = (UInt32)slots.size();
+                    slots.push_back(std::move(_slots[position]));
+                }
+            }
+            for (auto &bucket : _index) {
+                bucket.getKey().position = positions[bucket.getKey().position];
+            }
+            _slots.swap(slots);
+            _numErased = 0;
+            _head = 0;
+        }
+        
+        // _index maps each element to its slot, and _slots keeps insertion order.
+        // Mutable for _compact().
+        mutable std::vector<Slot> _slots;
+        mutable IndexType _index;
+        mutable size_type _numErased = 0;
+        // The first slot holding an element, or 0 when there are none.
+        mutable size_type _head = 0;
     };
     
     template <typename T>
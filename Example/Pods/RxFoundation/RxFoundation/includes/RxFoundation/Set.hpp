@@ -14,7 +14,13 @@
 #include <RxFoundation/RxObject.hpp>
 #include <RxFoundation/String.hpp>
 #include <RxFoundation/CopyDescriptionChecker.hpp>
+#include <RxFoundation/BasicHashTypeInfo.hpp>
+#include <RxFoundation/Dictionary.hpp>
+#include <RxFoundation/HashChecker.hpp>
+#include <algorithm>
 #include <set>
+#include <type_traits>
+#include <vector>
 
 namespace Rx {
     template <typename __ElementType>
@@ -88,8 +94,7 @@ namespace Rx {
         }
         
         virtual bool erase(const __ElementType &element) {
-            auto it = std::find(begin(), end(), element);
-            return erase(it) != end();
+            return _storage.erase(element) != 0;
         }
         
         virtual void clear() {
@@ -106,11 +111,11 @@ namespace Rx {
         
         template <typename T>
         bool contains(const T &element) const {
-            return std::find(begin(), end(), element) != end();
+            return _contains(element, std::is_constructible<__ElementType, const T &>());
         }
         
         virtual bool contains(const __ElementType &element) const {
-            return std::find(begin(), end(), element) != end();
+            return _storage.find(element) != end();
         }
         
         template <typename Predicate>
@@ -130,6 +135,18 @@ namespace Rx {
         virtual const_iterator operator[](const key_type &__k) const {
             return _storage.find(__k);
         }
+        
+    private:
+        template <typename T>
+        bool _contains(const T &element, std::true_type) const {
+            return _storage.find(__ElementType(element)) != end();
+        }
+        
+        /* Elements which are only comparable with T have to be compared one by one. */
+        template <typename T>
+        bool _contains(const T &element, std::false_type) const {
+            return std::find(begin(), end(), element) != end();
+        }
     };
     
     template <typename T>
@@ -197,6 +214,301 @@ namespace Rx {
     template <typename T>
     using SetPtr = SharedPtr<Set<T>>;
     
+    template <typename T>
+    struct BasicHashSetInfo {
+        static inline UInt64 getHashValue(const T &value) {
+            return (UInt64)Rx::hash(value);
+        }
+        
+        static inline bool isEqual(const T &lhs, const T &rhs) {
+            return lhs == rhs;
+        }
+    };
+    
+    template <typename T, ESPMode Mode>
+    struct BasicHashSetInfo<SharedRef<T, Mode>> {
+        static inline UInt64 getHashValue(const SharedRef<T, Mode> &value) {
+            return BasicHashInfoHelper<const T *>::getHashValue(&value.get());
+        }
+        
+        static inline bool isEqual(const SharedRef<T, Mode> &lhs, const SharedRef<T, Mode> &rhs) {
+            return lhs == rhs;
+        }
+    };
+    
+    template <typename T, ESPMode Mode>
+    struct BasicHashSetInfo<SharedPtr<T, Mode>> {
+        static inline UInt64 getHashValue(const SharedPtr<T, Mode> &value) {
+            return BasicHashInfoHelper<const T *>::getHashValue(value.get());
+        }
+        
+        static inline bool isEqual(const SharedPtr<T, Mode> &lhs, const SharedPtr<T, Mode> &rhs) {
+            return lhs == rhs;
+        }
+    };
+    
+    namespace detail {
+        /// Key of a Dictionary indexing elements which live in a separate array: the
+        /// element's position in that array and the hash it was inserted with, so the
+        /// table can grow without looking at the elements, and elements such as
+        /// SharedRef never need empty or tombstone values of their own.
+        struct HashIndexKey {
+            UInt32 position;
+            UInt32 hash;
+            
+            bool operator==(const HashIndexKey &rhs) const RX_NOEXCEPT {
+                return position == rhs.position && hash == rhs.hash;
+            }
+        };
+        
+        struct HashIndexValue {
+        };
+        
+        /// BasicHashInfo of a HashIndex. Elements are found with a Lookup, which
+        /// carries the value and the array to compare the indexed positions against;
+        /// ElementsTy is anything with an operator[] taking a position.
+        template <typename T, typename InfoTy = BasicHashSetInfo<T>>
+        struct HashIndexInfo {
+            template <typename ElementsTy>
+            struct Lookup {
+                ElementsTy elements;
+                const T &value;
+                UInt32 hash;
+            };
+            
+            template <typename ElementsTy>
+            static inline Lookup<ElementsTy> lookup(ElementsTy elements, const T &value) {
+                const UInt64 hash = InfoTy::getHashValue(value);
+                return {elements, value, (UInt32)(hash ^ (hash >> 32))};
+            }
+            
+            /// A Lookup only refers to its value, which must outlive it.
+            template <typename ElementsTy>
+            static void lookup(ElementsTy elements, const T &&value) = delete;
+            
+            static inline HashIndexKey getEmptyKey() {
+                return {~0U, ~0U};
+            }
+            
+            static inline HashIndexKey getTombstoneKey() {
+                return {~0U - 1, ~0U};
+            }
+            
+            static inline UInt64 getHashValue(const HashIndexKey &key) {
+                return key.hash;
+            }
+            
+            template <typename ElementsTy>
+            static inline UInt64 getHashValue(const Lookup<ElementsTy> &lookup) {
+                return lookup.hash;
+            }
+            
+            static inline bool isEqual(const HashIndexKey &lhs, const HashIndexKey &rhs) {
+                return lhs == rhs;
+            }
+            
+            template <typename ElementsTy>
+            static inline bool isEqual(const Lookup<ElementsTy> &lhs, const HashIndexKey &rhs) {
+                return lhs.hash == rhs.hash && rhs.position < getTombstoneKey().position &&
+                InfoTy::isEqual(lhs.elements[rhs.position], lhs.value);
+            }
+        };
+            
+        template <typename T, typename InfoTy = BasicHashSetInfo<T>>
+        using HashIndex = Dictionary<HashIndexKey, HashIndexValue, HashIndexInfo<T, InfoTy>>;
+    }
+    
+    /// Unordered set backed by a dense element array and a HashIndex over it.
+    /// contains/erase/operator[] are O(1) on average; erase moves the last element
+    /// into the hole, so iteration order is not stable across removals.
+    template <typename T, typename InfoTy = BasicHashSetInfo<T>>
+    class HashSet : public virtual Object {
+        typedef std::vector<T> StorageType;
+        typedef detail::HashIndexInfo<T, InfoTy> IndexInfo;
+        typedef detail::HashIndex<T, InfoTy> IndexType;
+        typedef UInt32 position_type;
+    public:
+        typedef T key_type;
+        typedef T value_type;
+        typedef size_t size_type;
+        typedef const value_type &const_reference;
+        typedef typename StorageType::const_iterator const_iterator;
+        typedef const_iterator iterator;
+        
+        HashSet() RX_NOEXCEPT {
+        }
+        
+        HashSet(std::initializer_list<value_type> __il) RX_NOEXCEPT {
+            addObjects(__il.begin(), __il.end());
+        }
+        
+        HashSet(const HashSet &value) RX_NOEXCEPT : _storage(value._storage), _index(value._index) {
+        }
+        
+        HashSet(HashSet &&value) RX_NOEXCEPT : _storage(std::move(value._storage)), _index(std::move(value._index)) {
+        }
+        
+        ~HashSet() RX_NOEXCEPT {
+        }
+        
+        HashSet &operator=(const HashSet &copy) RX_NOEXCEPT {
+            _storage = copy._storage;
+            _index = copy._index;
+            return *this;
+        }
+        
+        size_type size() const RX_NOEXCEPT {
+            return _storage.size();
+        }
+        
+        bool isEmpty() const RX_NOEXCEPT {
+            return size() == 0;
+        }
+        
+        const_iterator begin() const RX_NOEXCEPT {
+            return _storage.begin();
+        }
+        
+        const_iterator end() const RX_NOEXCEPT {
+            return _storage.end();
+        }
+        
+        void reserve(size_type numEntries) RX_NOEXCEPT {
+            _storage.reserve(numEntries);
+            _index.reserve(numEntries);
+        }
+        
+        iterator erase(const_iterator it) RX_NOEXCEPT {
+            const auto position = it - begin();
+            _erasePosition((position_type)position);
+            return begin() + position;
+        }
+        
+        iterator erase(const_iterator __first, const_iterator __last) RX_NOEXCEPT {
+            // Erasing back to front keeps every not-yet-erased position in place,
+            // since each hole is filled from the tail of the storage.
+            const auto first = __first - begin();
+            for (auto position = __last - begin(); position > first; position--) {
+                _erasePosition((position_type)(position - 1));
+            }
+            return begin() + first;
+        }
+        
+        bool erase(const T &element) RX_NOEXCEPT {
+            const auto it = _find(element);
+            if (it == _index.end()) {
+                return false;
+            }
+            _erasePosition(it->getKey().position);
+            return true;
+        }
+        
+        void clear() RX_NOEXCEPT {
+            _storage.clear();
+            _index.clear();
+        }
+        
+        void addObject(const T &element) RX_NOEXCEPT {
+            // The element is indexed at the position it's about to be stored at, so
+            // finding and inserting it takes a single probe.
+            const auto lookup = IndexInfo::lookup(_storage.data(), element);
+            const detail::HashIndexKey key = {(position_type)_storage.size(), lookup.hash};
+            if (_index.insert_as(std::make_pair(key, detail::HashIndexValue()), lookup).second) {
+                _storage.push_back(element);
+            }
+        }
+        
+        template <typename InputIterator>
+        void addObjects(InputIterator start, InputIterator end) RX_NOEXCEPT {
+            for (; start != end; ++start) {
+                addObject(*start);
+            }
+        }
+        
+        bool contains(const T &element) const RX_NOEXCEPT {
+            return _find(element) != _index.end();
+        }
+        
+        template <typename Predicate>
+        const_iterator find(Predicate predicate) const RX_NOEXCEPT {
+            return std::find_if(begin(), end(), predicate);
+        }
+        
+        const_iterator operator[](const key_type &__k) const RX_NOEXCEPT {
+            const auto it = _find(__k);
+            if (it == _index.end()) {
+                return end();
+            }
+            return begin() + it->getKey().position;
+        }
+        
+        bool operator==(const HashSet &rhs) const RX_NOEXCEPT {
+            if (this == &rhs) {
+                return true;
+            }
+            if (size() != rhs.size()) {
+                return false;
+            }
+            for (const auto &element : _storage) {
+                if (!rhs.contains(element)) {
+                    return false;
+                }
+            }
+            return true;
+        }
+        
+        virtual String copyDescription() const RX_NOEXCEPT {
+            const Integer cnt = size();
+            Integer idx = 0;
+            String description = "(";
+            for (auto it = begin(), end = this->end(); it != end; ++it, idx++) {
+                auto desc = Rx::copyDescription(*it);
+                if (idx + 1 == cnt) {
+                    description += desc;
+                } else {
+                    description += desc + ", ";
+                }
+            }
+            description += ")";
+            return description;
+        }
+        
+        virtual HashCode hash() const RX_NOEXCEPT {
+            return size();
+        }
+    private:
+        typename IndexType::const_iterator _find(const T &element) const RX_NOEXCEPT {
+            return _index.find_as(IndexInfo::lookup(_storage.data(), element));
+        }
+        
+        typename IndexType::iterator _find(const T &element) RX_NOEXCEPT {
+            return _index.find_as(IndexInfo::lookup(_storage.data(), element));
+        }
+        
+        void _erasePosition(position_type position) RX_NOEXCEPT {
+            const position_type last = (position_type)(_storage.size() - 1);
+            // Both buckets are found while their elements are still in place, as
+            // erasing from the index never moves the other buckets.
+            auto erased = _find(_storage[position]);
+            auto moved = _find(_storage[last]);
+            _index.erase(erased);
+            if (position != last) {
+                _storage[position] = std::move(_storage[last]);
+                moved->getKey().position = position;
+            }
+            _storage.pop_back();
+        }
+        
+        StorageType _storage;
+        IndexType _index;
+    };
+    
+    template <typename T>
+    using HashSetRef = SharedRef<HashSet<T>>;
+    
+    template <typename T>
+    using HashSetPtr = SharedPtr<HashSet<T>>;
+    
     template <typename __ElementType>
     class CollectionContainer3<std::multiset, __ElementType, std::less> {
     private:
@@ -264,7 +576,7 @@ namespace Rx {
         }
         
         virtual bool erase(const __ElementType &element) {
-            return erase(std::find(begin(), end(), element), end()) != end();
+            return _storage.erase(element) != 0;
         }
         
         virtual void clear() {
@@ -277,11 +589,11 @@ namespace Rx {
         
         template <typename T>
         bool contains(const T &element) const {
-            return std::find(begin(), end(), element) != end();
+            return _contains(element, std::is_constructible<__ElementType, const T &>());
         }
         
         virtual bool contains(const __ElementType &element) const {
-            return std::find(begin(), end(), element) != end();
+            return _storage.find(element) != end();
         }
         
         template <typename Predicate>
@@ -301,6 +613,18 @@ namespace Rx {
         virtual const_iterator operator[](const key_type &__k) const {
             return _storage.find(__k);
         }
+        
+    private:
+        template <typename T>
+        bool _contains(const T &element, std::true_type) const {
+            return _storage.find(__ElementType(element)) != end();
+        }
+        
+        /* Elements which are only comparable with T have to be compared one by one. */
+        template <typename T>
+        bool _contains(const T &element, std::false_type) const {
+            return std::find(begin(), end(), element) != end();
+        }
     };
     
     template <typename T>
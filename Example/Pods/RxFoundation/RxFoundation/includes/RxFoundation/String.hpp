@@ -19,7 +19,7 @@
 
 namespace Rx {
     
-    template <typename T>
+    template <typename T, typename AllocatorTy = std::allocator<T>>
     class Array;
     
     class String : public virtual Object, public std::string {
@@ -87,6 +87,52 @@ namespace Rx {
     using StringRef = SharedRef<String>;
     using StringPtr = SharedRef<const String>;
     
+    template <typename T>
+    struct BasicHashInfo;
+    
+    namespace detail {
+        struct InternedStringEntry {
+            const String value;
+            const HashCode hash;
+            const UInt32 identifier;
+        };
+    }
+    
+    /// Handle to the process-wide unique copy of a string. Equal strings intern to the
+    /// same entry, so ==, < and hash() never touch the bytes, and the hash is computed
+    /// once when the string is first interned. Entries are never freed: intern key paths
+    /// and other bounded vocabularies, not arbitrary user data.
+    class InternedString {
+    public:
+        /// An invalid handle, see isValid().
+        InternedString() RX_NOEXCEPT : _entry(nullptr) {}
+        explicit InternedString(const String &value) RX_NOEXCEPT;
+        
+        /// The handle for value if it has been interned before, otherwise an invalid handle.
+        static InternedString lookup(const String &value) RX_NOEXCEPT;
+        
+        bool isValid() const RX_NOEXCEPT { return _entry != nullptr; }
+        const String &getString() const RX_NOEXCEPT { return _entry->value; }
+        /// Dense, assigned in interning order starting at 0.
+        UInt32 getIdentifier() const RX_NOEXCEPT { return _entry->identifier; }
+        HashCode hash() const RX_NOEXCEPT { return _entry->hash; }
+        
+        bool operator==(const InternedString &rhs) const RX_NOEXCEPT { return _entry == rhs._entry; }
+        bool operator!=(const InternedString &rhs) const RX_NOEXCEPT { return _entry != rhs._entry; }
+        /// Orders by identifier, not lexicographically.
+        bool operator<(const InternedString &rhs) const RX_NOEXCEPT {
+            return (_entry ? (Int64)_entry->identifier : -1) < (rhs._entry ? (Int64)rhs._entry->identifier : -1);
+        }
+        
+    private:
+        template <typename T>
+        friend struct BasicHashInfo;
+        
+        explicit InternedString(const detail::InternedStringEntry *entry) RX_NOEXCEPT : _entry(entry) {}
+        
+        const detail::InternedStringEntry *_entry;
+    };
+    
     class RxString {
     public:
         enum Encoding : Index {
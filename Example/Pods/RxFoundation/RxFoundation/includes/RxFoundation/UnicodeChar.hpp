@@ -51,6 +51,27 @@ namespace Rx {
         static RX_INLINE_VISIBILITY UTF32Char getLongCharacterForSurrogatePair(UnicodeChar surrogateHigh, UnicodeChar surrogateLow) RX_NOEXCEPT {
             return (UTF32Char)((((unsigned long)surrogateHigh - 0xD800UL) << 10) + ((unsigned long)surrogateLow - 0xDC00UL) + 0x0010000UL);
         }
+        
+        static constexpr const UInteger NotFound = ~(UInteger)0;
+        
+        // Bulk operations over whole buffers. These work on 16 bytes or 8 UTF-16
+        // units per step with SSE2 or NEON, and only drop to a character at a
+        // time for the non-ASCII parts of the text.
+        
+        static bool isASCII(const UTF8Char *bytes, UInteger length) RX_NOEXCEPT;
+        static bool isValidUTF8(const UTF8Char *bytes, UInteger length) RX_NOEXCEPT;
+        
+        /// Returns the number of units written to characters, which must have room
+        /// for length units, or NotFound if bytes isn't valid UTF-8.
+        static UInteger convertUTF8ToUTF16(const UTF8Char *bytes, UInteger length, UTF16Char *characters) RX_NOEXCEPT;
+        /// Returns the number of bytes written to bytes, which must have room for
+        /// 3 * length bytes, or NotFound if characters has an unpaired surrogate.
+        static UInteger convertUTF16ToUTF8(const UTF16Char *characters, UInteger length, UTF8Char *bytes) RX_NOEXCEPT;
+        
+        /// The index of the first of characters which is a member of charset, or
+        /// NotFound. For the whitespace, newline and decimal digit sets, ASCII
+        /// characters are classified 8 at a time without looking at the bitmaps.
+        static UInteger findFirstMemberOf(uint32_t charset, const UTF16Char *characters, UInteger length) RX_NOEXCEPT;
     public:
         UnicodeChar(UTF16Char character) : _character(character) {}
     public:
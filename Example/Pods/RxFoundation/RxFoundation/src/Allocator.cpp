@@ -7,17 +7,437 @@
 //
 
 #include <RxFoundation/Allocator.hpp>
+#include <RxFoundation/Atomic.hpp>
+#include <RxFoundation/CrashReporter.hpp>
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <vector>
 
 using namespace Rx;
 
 namespace Rx {
     namespace detail {
+        static const constexpr UInt32 MagazineCapacity = 32;
+        
+        static const constexpr size_t PoolSizeClassSizes[PoolAllocator::NumSizeClasses] = {
+            16, 32, 48, 64, 80, 96, 112, 128,
+            160, 192, 224, 256, 320, 384, 448, 512,
+            640, 768, 896, 1024, 1280, 1536, 1792, 2048,
+            2560, 3072, 3584, 4096
+        };
+        
+        /* 16 byte steps up to 128, then four classes per power of two up to MaxPooledSize. */
+        RX_INLINE size_t poolSizeClassFor(size_t size) RX_NOEXCEPT {
+            if (size <= 128) {
+                return size == 0 ? 0 : (size - 1) >> 4;
+            }
+            const size_t value = size - 1;
+            const size_t power = (sizeof(unsigned long) * 8 - 1) - __builtin_clzl((unsigned long)value);
+            return 8 + (power - 7) * 4 + ((value >> (power - 2)) & 3);
+        }
+        
+        RX_INLINE bool isPoolable(size_t size, size_t alignment) RX_NOEXCEPT {
+            return size <= PoolAllocator::MaxPooledSize && alignment <= 16;
+        }
+        
+        struct PoolSizeClass {
+            SpinLock lock;
+            void *freeList = nullptr;
+            UInt8 *current = nullptr;
+            UInt8 *end = nullptr;
+            std::vector<void *> slabs;
+        };
+        
+        struct PoolMagazine {
+            UInt32 count;
+            void *blocks[MagazineCapacity];
+        };
+        
+        /* Pools alive right now, so a thread exiting late can tell whether its cached blocks still have a home. */
+        struct LivePools {
+            static MutexLock &lock() RX_NOEXCEPT {
+                static MutexLock *lock = new MutexLock();
+                return *lock;
+            }
+            
+            static std::vector<PoolAllocator *> &pools() RX_NOEXCEPT {
+                static std::vector<PoolAllocator *> *pools = new std::vector<PoolAllocator *>();
+                return *pools;
+            }
+            
+            static PoolAllocator *find(UInt64 identifier, PoolAllocator *pool) RX_NOEXCEPT;
+        };
+        
+        struct PoolThreadCache;
+        
+        /* Plain pointer so the hot path is a single TLS load. __thread rather than thread_local,
+           which Apple clang only supports when targeting iOS 9 and later. */
+        static __thread PoolThreadCache *ThreadCache = nullptr;
         
+        struct PoolThreadCache {
+            struct Entry {
+                UInt64 identifier;
+                PoolAllocator *pool;
+                UInt64 allocations;
+                UInt64 deallocations;
+                Int64 bytesInUse;
+                PoolMagazine magazines[PoolAllocator::NumSizeClasses];
+            };
+            
+            static const constexpr size_t NumEntries = 4;
+            
+            PoolThreadCache() RX_NOEXCEPT : lastUsed(0), nextVictim(0) {
+                for (auto &entry : entries) {
+                    entry.identifier = 0;
+                    entry.pool = nullptr;
+                }
+            }
+            
+            ~PoolThreadCache() {
+                ThreadCache = nullptr;
+                for (auto &entry : entries) {
+                    release(entry);
+                }
+            }
+            
+            Entry &entryFor(PoolAllocator *pool) RX_NOEXCEPT {
+                if (entries[lastUsed].identifier == pool->_identifier) {
+                    return entries[lastUsed];
+                }
+                for (size_t idx = 0; idx < NumEntries; ++idx) {
+                    if (entries[idx].identifier == pool->_identifier) {
+                        lastUsed = idx;
+                        return entries[idx];
+                    }
+                }
+                Entry *target = nullptr;
+                for (auto &entry : entries) {
+                    if (entry.identifier == 0) {
+                        target = &entry;
+                        break;
+                    }
+                }
+                if (target == nullptr) {
+                    target = &entries[nextVictim];
+                    nextVictim = (nextVictim + 1) % NumEntries;
+                    release(*target);
+                }
+                lastUsed = target - entries;
+                target->identifier = pool->_identifier;
+                target->pool = pool;
+                target->allocations = 0;
+                target->deallocations = 0;
+                target->bytesInUse = 0;
+                for (auto &magazine : target->magazines) {
+                    magazine.count = 0;
+                }
+                return *target;
+            }
+            
+            /* Hands cached blocks and counts back to the pool, or drops them if the pool is gone. */
+            void release(Entry &entry) RX_NOEXCEPT {
+                if (entry.identifier == 0) {
+                    return;
+                }
+                LockGuard<MutexLock> lock(LivePools::lock());
+                if (auto pool = LivePools::find(entry.identifier, entry.pool)) {
+                    for (size_t sizeClass = 0; sizeClass < PoolAllocator::NumSizeClasses; ++sizeClass) {
+                        auto &magazine = entry.magazines[sizeClass];
+                        if (magazine.count) {
+                            pool->_drain(sizeClass, magazine.blocks, magazine.count);
+                        }
+                    }
+                    pool->_flushCounters(entry.allocations, entry.deallocations, entry.bytesInUse);
+                }
+                entry.identifier = 0;
+                entry.pool = nullptr;
+            }
+            
+            Entry entries[NumEntries];
+            size_t lastUsed;
+            size_t nextVictim;
+        };
+        
+        PoolAllocator *LivePools::find(UInt64 identifier, PoolAllocator *pool) RX_NOEXCEPT {
+            auto &live = pools();
+            if (std::find(live.begin(), live.end(), pool) != live.end() && pool->_identifier == identifier) {
+                return pool;
+            }
+            return nullptr;
+        }
+        
+        /* Owns each thread's cache, and its destructor runs the thread-exit drain. A pool used
+           from another key's destructor after that just gets a new cache, which pthreads then
+           destroys on its next pass over the keys. */
+        static pthread_key_t threadCacheKey() RX_NOEXCEPT {
+            static const pthread_key_t key = [] {
+                pthread_key_t key;
+                pthread_key_create(&key, [](void *cache) {
+                    delete static_cast<PoolThreadCache *>(cache);
+                });
+                return key;
+            }();
+            return key;
+        }
+        
+        static PoolThreadCache &threadCache() RX_NOEXCEPT {
+            if (ThreadCache == nullptr) {
+                // Heap allocated so threads that never touch a pool pay nothing for the magazines.
+                ThreadCache = new PoolThreadCache();
+                pthread_setspecific(threadCacheKey(), ThreadCache);
+            }
+            return *ThreadCache;
+        }
+        
+        static std::atomic<UInt64> NextPoolIdentifier(1);
     }
 }
 
-Allocator Rx::Allocator::_Default;
-Allocator &Rx::Allocator::Default = Rx::Allocator::_Default;
+Allocator &Allocator::getDefault() RX_NOEXCEPT {
+    static Allocator *allocator = new Allocator();
+    return *allocator;
+}
 
 Allocator::Allocator() {}
 Allocator::~Allocator() {}
+
+void *Allocator::allocateBytes(size_t size, size_t alignment) RX_NOEXCEPT {
+    if (alignment <= alignof(std::max_align_t)) {
+        return malloc(size);
+    }
+    void *ptr = nullptr;
+    if (posix_memalign(&ptr, alignment, size) != 0) {
+        return nullptr;
+    }
+    return ptr;
+}
+
+void Allocator::deallocateBytes(void *ptr, size_t size, size_t alignment) RX_NOEXCEPT {
+    free(ptr);
+}
+
+Allocator::Statistics Allocator::getStatistics() const RX_NOEXCEPT {
+    return Statistics{0, 0, 0, 0};
+}
+
+#pragma mark - PoolAllocator
+
+PoolAllocator::PoolAllocator() RX_NOEXCEPT :
+_identifier(detail::NextPoolIdentifier.fetch_add(1)),
+_classes(new detail::PoolSizeClass[NumSizeClasses]),
+_allocations(0),
+_deallocations(0),
+_bytesInUse(0),
+_bytesReserved(0) {
+    LockGuard<MutexLock> lock(detail::LivePools::lock());
+    detail::LivePools::pools().push_back(this);
+}
+
+PoolAllocator::~PoolAllocator() {
+    {
+        LockGuard<MutexLock> lock(detail::LivePools::lock());
+        auto &live = detail::LivePools::pools();
+        live.erase(std::find(live.begin(), live.end(), this));
+    }
+    // Only this thread's cache can be reached here, and only if it exists: creating one
+    // now could happen during thread or process teardown, after the cache was destroyed.
+    // Other threads' entries for this pool are dropped by LivePools::find when released.
+    if (auto cache = detail::ThreadCache) {
+        for (auto &entry : cache->entries) {
+            if (entry.identifier == _identifier) {
+                entry.identifier = 0;
+                entry.pool = nullptr;
+            }
+        }
+    }
+    for (size_t sizeClass = 0; sizeClass < NumSizeClasses; ++sizeClass) {
+        for (auto slab : _classes[sizeClass].slabs) {
+            free(slab);
+        }
+    }
+    delete [] _classes;
+}
+
+void *PoolAllocator::allocateBytes(size_t size, size_t alignment) RX_NOEXCEPT {
+    if (!detail::isPoolable(size, alignment)) {
+        _allocations.fetch_add(1, std::memory_order_relaxed);
+        _bytesInUse.fetch_add(size, std::memory_order_relaxed);
+        _bytesReserved.fetch_add(size, std::memory_order_relaxed);
+        return Allocator::allocateBytes(size, alignment);
+    }
+    const size_t sizeClass = detail::poolSizeClassFor(size);
+    auto &entry = detail::threadCache().entryFor(this);
+    entry.allocations++;
+    entry.bytesInUse += size;
+    auto &magazine = entry.magazines[sizeClass];
+    if (magazine.count) {
+        return magazine.blocks[--magazine.count];
+    }
+    _flushCounters(entry.allocations, entry.deallocations, entry.bytesInUse);
+    entry.allocations = 0;
+    entry.deallocations = 0;
+    entry.bytesInUse = 0;
+    return _refill(sizeClass, magazine.blocks, magazine.count);
+}
+
+void PoolAllocator::deallocateBytes(void *ptr, size_t size, size_t alignment) RX_NOEXCEPT {
+    if (ptr == nullptr) {
+        return;
+    }
+    if (!detail::isPoolable(size, alignment)) {
+        _deallocations.fetch_add(1, std::memory_order_relaxed);
+        _bytesInUse.fetch_sub(size, std::memory_order_relaxed);
+        _bytesReserved.fetch_sub(size, std::memory_order_relaxed);
+        Allocator::deallocateBytes(ptr, size, alignment);
+        return;
+    }
+    const size_t sizeClass = detail::poolSizeClassFor(size);
+    auto &entry = detail::threadCache().entryFor(this);
+    entry.deallocations++;
+    entry.bytesInUse -= size;
+    auto &magazine = entry.magazines[sizeClass];
+    if (magazine.count == detail::MagazineCapacity) {
+        // Keep half so alternating alloc/free at the boundary does not bounce on the lock.
+        const UInt32 half = detail::MagazineCapacity / 2;
+        _drain(sizeClass, magazine.blocks + half, half);
+        magazine.count = half;
+        _flushCounters(entry.allocations, entry.deallocations, entry.bytesInUse);
+        entry.allocations = 0;
+        entry.deallocations = 0;
+        entry.bytesInUse = 0;
+    }
+    magazine.blocks[magazine.count++] = ptr;
+}
+
+Allocator::Statistics PoolAllocator::getStatistics() const RX_NOEXCEPT {
+    const Int64 bytesInUse = _bytesInUse.load(std::memory_order_relaxed);
+    return Statistics{
+        _allocations.load(std::memory_order_relaxed),
+        _deallocations.load(std::memory_order_relaxed),
+        bytesInUse < 0 ? 0 : (UInt64)bytesInUse,
+        _bytesReserved.load(std::memory_order_relaxed)
+    };
+}
+
+/* Fills half a magazine from the free list, carving a new slab when it runs dry, and returns one more block. */
+void *PoolAllocator::_refill(size_t sizeClass, void **magazine, UInt32 &count) RX_NOEXCEPT {
+    auto &pool = _classes[sizeClass];
+    const size_t blockSize = detail::PoolSizeClassSizes[sizeClass];
+    const UInt32 wanted = detail::MagazineCapacity / 2 + 1;
+    LockGuard<SpinLock> lock(pool.lock);
+    while (count < wanted) {
+        void *block = pool.freeList;
+        if (block) {
+            pool.freeList = *reinterpret_cast<void **>(block);
+        } else {
+            if (pool.current + blockSize > pool.end) {
+                void *slab = malloc(SlabSize);
+                if (slab == nullptr) {
+                    CrashReporter::HALT(String("Rx::PoolAllocator failed to allocate a %lu byte slab", 0, (unsigned long)SlabSize));
+                }
+                pool.slabs.push_back(slab);
+                pool.current = static_cast<UInt8 *>(slab);
+                pool.end = pool.current + SlabSize;
+                _bytesReserved.fetch_add(SlabSize, std::memory_order_relaxed);
+            }
+            block = pool.current;
+            pool.current += blockSize;
+        }
+        magazine[count++] = block;
+    }
+    return magazine[--count];
+}
+
+void PoolAllocator::_drain(size_t sizeClass, void **blocks, UInt32 count) RX_NOEXCEPT {
+    auto &pool = _classes[sizeClass];
+    LockGuard<SpinLock> lock(pool.lock);
+    for (UInt32 idx = 0; idx < count; ++idx) {
+        *reinterpret_cast<void **>(blocks[idx]) = pool.freeList;
+        pool.freeList = blocks[idx];
+    }
+}
+
+void PoolAllocator::_flushCounters(UInt64 allocations, UInt64 deallocations, Int64 bytesInUse) RX_NOEXCEPT {
+    _allocations.fetch_add(allocations, std::memory_order_relaxed);
+    _deallocations.fetch_add(deallocations, std::memory_order_relaxed);
+    _bytesInUse.fetch_add(bytesInUse, std::memory_order_relaxed);
+}
+
+#pragma mark - ArenaAllocator
+
+ArenaAllocator::ArenaAllocator(size_t blockSize) RX_NOEXCEPT :
+_blockSize(std::max<size_t>(blockSize, 256)),
+_blocks(nullptr),
+_current(nullptr),
+_end(nullptr),
+_statistics{0, 0, 0, 0} {
+}
+
+ArenaAllocator::~ArenaAllocator() {
+    while (_blocks) {
+        Block *next = _blocks->next;
+        free(_blocks);
+        _blocks = next;
+    }
+}
+
+void *ArenaAllocator::allocateBytes(size_t size, size_t alignment) RX_NOEXCEPT {
+    const uintptr_t current = (reinterpret_cast<uintptr_t>(_current) + alignment - 1) & ~(uintptr_t)(alignment - 1);
+    if (_current && current + size <= reinterpret_cast<uintptr_t>(_end)) {
+        _current = reinterpret_cast<UInt8 *>(current + size);
+        _statistics.allocations++;
+        _statistics.bytesInUse += size;
+        return reinterpret_cast<void *>(current);
+    }
+    return _allocateSlow(size, alignment);
+}
+
+void *ArenaAllocator::_allocateSlow(size_t size, size_t alignment) RX_NOEXCEPT {
+    const size_t blockSize = std::max(_blockSize, sizeof(Block) + size + alignment);
+    Block *block = static_cast<Block *>(malloc(blockSize));
+    if (block == nullptr) {
+        CrashReporter::HALT(String("Rx::ArenaAllocator failed to allocate a %lu byte block", 0, (unsigned long)blockSize));
+    }
+    block->next = _blocks;
+    block->size = blockSize;
+    _blocks = block;
+    _current = reinterpret_cast<UInt8 *>(block + 1);
+    _end = reinterpret_cast<UInt8 *>(block) + blockSize;
+    _statistics.bytesReserved += blockSize;
+    return allocateBytes(size, alignment);
+}
+
+void ArenaAllocator::deallocateBytes(void *ptr, size_t size, size_t alignment) RX_NOEXCEPT {
+    if (ptr == nullptr) {
+        return;
+    }
+    _statistics.deallocations++;
+    _statistics.bytesInUse -= size;
+    // Freeing the most recent allocation gives its space back, which covers
+    // the usual grow-by-reallocate pattern of vectors and strings.
+    if (static_cast<UInt8 *>(ptr) + size == _current) {
+        _current = static_cast<UInt8 *>(ptr);
+    }
+}
+
+Allocator::Statistics ArenaAllocator::getStatistics() const RX_NOEXCEPT {
+    return _statistics;
+}
+
+void ArenaAllocator::reset() RX_NOEXCEPT {
+    if (_blocks == nullptr) {
+        return;
+    }
+    // Keep the oldest block, it is the only one guaranteed to be of the nominal size.
+    while (_blocks->next) {
+        Block *next = _blocks->next;
+        _statistics.bytesReserved -= _blocks->size;
+        free(_blocks);
+        _blocks = next;
+    }
+    _current = reinterpret_cast<UInt8 *>(_blocks + 1);
+    _end = reinterpret_cast<UInt8 *>(_blocks) + _blocks->size;
+    _statistics.bytesInUse = 0;
+}
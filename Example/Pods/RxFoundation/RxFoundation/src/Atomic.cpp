@@ -16,22 +16,235 @@
 #include <pthread.h>
 #endif
 
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include <chrono>
 #include <thread>
 
 using namespace Rx;
 
+namespace {
+    constexpr const UInt32 SpinLockUnlocked = 0;
+    constexpr const UInt32 SpinLockLocked = 1;
+    constexpr const UInt32 SpinLockParked = 2;
+    constexpr const UInt32 SpinLockMaxBackoff = 64;
+    constexpr const Integer SpinLockSpinRounds = 12;
+    
+    RX_INLINE void cpuRelax() RX_NOEXCEPT {
+#if defined(__i386__) || defined(__x86_64__)
+        __builtin_ia32_pause();
+#elif defined(__arm__) || defined(__arm64__) || defined(__aarch64__)
+        __asm__ __volatile__("yield");
+#endif
+    }
+    
+    bool shouldSpin() RX_NOEXCEPT {
+        // Spinning on a single core only delays the holder.
+        static const bool multicore = std::thread::hardware_concurrency() != 1;
+        return multicore;
+    }
+    
+#if defined(__linux__)
+    void parkWhile(std::atomic<UInt32> *address, UInt32 value) RX_NOEXCEPT {
+        syscall(SYS_futex, reinterpret_cast<UInt32 *>(address), FUTEX_WAIT_PRIVATE, value, nullptr, nullptr, 0);
+    }
+    
+    void unparkOne(std::atomic<UInt32> *address) RX_NOEXCEPT {
+        syscall(SYS_futex, reinterpret_cast<UInt32 *>(address), FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+    }
+#else
+    // There is no public futex on Darwin, so waiters share a fixed table of
+    // condition variables keyed by the lock address.
+    struct ParkingBucket {
+        MutexLock mutex;
+        ConditionVariable condition;
+    };
+    
+    constexpr const size_t ParkingBucketCount = 64;
+    
+    ParkingBucket &parkingBucketFor(const void *address) RX_NOEXCEPT {
+        // Never destroyed: locks may still be released while static destructors run.
+        static ParkingBucket *buckets = new ParkingBucket[ParkingBucketCount];
+        const uintptr_t hash = (reinterpret_cast<uintptr_t>(address) >> 3) * 2654435761UL;
+        return buckets[(hash >> 16) % ParkingBucketCount];
+    }
+    
+    void parkWhile(std::atomic<UInt32> *address, UInt32 value) RX_NOEXCEPT {
+        auto &bucket = parkingBucketFor(address);
+        LockGuard<MutexLock> lock(bucket.mutex);
+        if (address->load(std::memory_order_relaxed) == value) {
+            bucket.condition.wait(lock);
+        }
+    }
+    
+    void unparkOne(std::atomic<UInt32> *address) RX_NOEXCEPT {
+        // Buckets are shared between locks, so every waiter re-checks its own word.
+        auto &bucket = parkingBucketFor(address);
+        LockGuard<MutexLock> lock(bucket.mutex);
+        bucket.condition.notifyAll();
+    }
+#endif
+}
+
+#if RX_ENABLE_LOCK_STATISTICS
+namespace Rx {
+    struct SpinLockRegistry {
+        static MutexLock &mutex() RX_NOEXCEPT {
+            static MutexLock *mutex = new MutexLock();
+            return *mutex;
+        }
+        
+        static SpinLock *&head() RX_NOEXCEPT {
+            static SpinLock *head = nullptr;
+            return head;
+        }
+        
+        static void insert(SpinLock *lock) RX_NOEXCEPT {
+            LockGuard<MutexLock> guard(mutex());
+            lock->_previous = nullptr;
+            lock->_next = head();
+            if (head()) {
+                head()->_previous = lock;
+            }
+            head() = lock;
+        }
+        
+        static void remove(SpinLock *lock) RX_NOEXCEPT {
+            LockGuard<MutexLock> guard(mutex());
+            if (lock->_previous) {
+                lock->_previous->_next = lock->_next;
+            } else {
+                head() = lock->_next;
+            }
+            if (lock->_next) {
+                lock->_next->_previous = lock->_previous;
+            }
+        }
+    };
+}
+#endif
+
+SpinLock::SpinLock() RX_NOEXCEPT : SpinLock(nullptr) {
+}
+
+SpinLock::SpinLock(const char *name) RX_NOEXCEPT : _state(SpinLockUnlocked)
+#if RX_ENABLE_LOCK_STATISTICS
+, _name(name), _acquisitions(0), _contendedAcquisitions(0), _spinIterations(0), _parkNanoseconds(0)
+#endif
+{
+#if RX_ENABLE_LOCK_STATISTICS
+    SpinLockRegistry::insert(this);
+#endif
+}
+
+SpinLock::~SpinLock() {
+#if RX_ENABLE_LOCK_STATISTICS
+    SpinLockRegistry::remove(this);
+#endif
+}
+
 void SpinLock::lock() {
-    while (locked.test_and_set(std::memory_order_acquire)) {
-        ;
+    UInt32 expected = SpinLockUnlocked;
+    if (!_state.compare_exchange_strong(expected, SpinLockLocked, std::memory_order_acquire, std::memory_order_relaxed)) {
+        _lockSlow();
+    }
+#if RX_ENABLE_LOCK_STATISTICS
+    _acquisitions.fetch_add(1, std::memory_order_relaxed);
+#endif
+}
+
+void SpinLock::_lockSlow() RX_NOEXCEPT {
+    UInt64 spins = 0;
+    if (shouldSpin()) {
+        UInt32 backoff = 1;
+        for (Integer round = 0; round < SpinLockSpinRounds; ++round) {
+            for (UInt32 i = 0; i < backoff; ++i) {
+                cpuRelax();
+            }
+            spins += backoff;
+            backoff = backoff < SpinLockMaxBackoff ? backoff << 1 : backoff;
+            UInt32 expected = SpinLockUnlocked;
+            if (_state.load(std::memory_order_relaxed) == SpinLockUnlocked &&
+                _state.compare_exchange_weak(expected, SpinLockLocked, std::memory_order_acquire, std::memory_order_relaxed)) {
+#if RX_ENABLE_LOCK_STATISTICS
+                _contendedAcquisitions.fetch_add(1, std::memory_order_relaxed);
+                _spinIterations.fetch_add(spins, std::memory_order_relaxed);
+#endif
+                return;
+            }
+        }
     }
+    
+#if RX_ENABLE_LOCK_STATISTICS
+    const auto parkStart = std::chrono::steady_clock::now();
+#endif
+    // Taking the lock as Parked is conservative: unlock() may wake a waiter
+    // that is no longer there, but never misses one that is.
+    UInt32 state = _state.exchange(SpinLockParked, std::memory_order_acquire);
+    while (state != SpinLockUnlocked) {
+        parkWhile(&_state, SpinLockParked);
+        state = _state.exchange(SpinLockParked, std::memory_order_acquire);
+    }
+#if RX_ENABLE_LOCK_STATISTICS
+    const auto parked = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - parkStart);
+    _contendedAcquisitions.fetch_add(1, std::memory_order_relaxed);
+    _spinIterations.fetch_add(spins, std::memory_order_relaxed);
+    _parkNanoseconds.fetch_add(parked.count(), std::memory_order_relaxed);
+#else
+    (void)spins;
+#endif
 }
 
 bool SpinLock::tryLock(void) {
-    return locked.test_and_set(std::memory_order_acquire);
+    UInt32 expected = SpinLockUnlocked;
+    if (!_state.compare_exchange_strong(expected, SpinLockLocked, std::memory_order_acquire, std::memory_order_relaxed)) {
+        return false;
+    }
+#if RX_ENABLE_LOCK_STATISTICS
+    _acquisitions.fetch_add(1, std::memory_order_relaxed);
+#endif
+    return true;
 }
 
 void SpinLock::unlock(void) {
-    locked.clear(std::memory_order_release);
+    if (_state.exchange(SpinLockUnlocked, std::memory_order_release) == SpinLockParked) {
+        unparkOne(&_state);
+    }
+}
+
+SpinLock::Statistics SpinLock::getStatistics() const RX_NOEXCEPT {
+    Statistics statistics = {0, 0, 0, 0};
+#if RX_ENABLE_LOCK_STATISTICS
+    statistics.acquisitions = _acquisitions.load(std::memory_order_relaxed);
+    statistics.contendedAcquisitions = _contendedAcquisitions.load(std::memory_order_relaxed);
+    statistics.spinIterations = _spinIterations.load(std::memory_order_relaxed);
+    statistics.parkNanoseconds = _parkNanoseconds.load(std::memory_order_relaxed);
+#endif
+    return statistics;
+}
+
+void SpinLock::dumpStatistics(FILE *output) RX_NOEXCEPT {
+#if RX_ENABLE_LOCK_STATISTICS
+    LockGuard<MutexLock> guard(SpinLockRegistry::mutex());
+    for (SpinLock *lock = SpinLockRegistry::head(); lock; lock = lock->_next) {
+        const auto statistics = lock->getStatistics();
+        if (statistics.contendedAcquisitions == 0) {
+            continue;
+        }
+        fprintf(output, "SpinLock %s<%p>: %llu acquisitions, %llu contended, %llu spins, %.3f ms parked\n",
+                lock->_name ? lock->_name : "", lock,
+                (unsigned long long)statistics.acquisitions,
+                (unsigned long long)statistics.contendedAcquisitions,
+                (unsigned long long)statistics.spinIterations,
+                statistics.parkNanoseconds / 1e6);
+    }
+#else
+    fprintf(output, "SpinLock statistics are disabled, build with RX_ENABLE_LOCK_STATISTICS=1\n");
+#endif
 }
 
 MutexLock::MutexLock() RX_NOEXCEPT {
@@ -73,72 +286,128 @@ void ConditionVariable::notifyOne() RX_NOEXCEPT {
     pthread_cond_signal(&_condition);
 }
 
-ReadWriteLock::ReadWriteLock() RX_NOEXCEPT : _reader(0), _writer(0), _pending(0) {
+namespace {
+    constexpr const UInt64 ReadWriteLockWriter = 1ULL << 63;
+    constexpr const UInt64 ReadWriteLockPendingUnit = 1ULL << 32;
+    constexpr const UInt64 ReadWriteLockPendingMask = ~ReadWriteLockWriter & ~(ReadWriteLockPendingUnit - 1);
+    constexpr const UInt64 ReadWriteLockReaderMask = ReadWriteLockPendingUnit - 1;
+    constexpr const Integer ReadWriteLockSpinCount = 64;
+    
+    RX_INLINE bool canRead(UInt64 state) RX_NOEXCEPT {
+        // Pending writers block new readers, which keeps writers from starving.
+        return (state & (ReadWriteLockWriter | ReadWriteLockPendingMask)) == 0;
+    }
+    
+    RX_INLINE bool canWrite(UInt64 state) RX_NOEXCEPT {
+        return (state & (ReadWriteLockWriter | ReadWriteLockReaderMask)) == 0;
+    }
+}
+
+ReadWriteLock::ReadWriteLock() RX_NOEXCEPT : _state(0), _parked(0) {
 }
 
 ReadWriteLock::~ReadWriteLock() {
 }
 
 void ReadWriteLock::lockRead() RX_NOEXCEPT {
-    LockGuard<decltype(_mutex)> lock(_mutex);
-    while (_writer > 0 || _pending > 0) {
-        _condition.wait(lock);
+    UInt64 state = _state.load(std::memory_order_relaxed);
+    for (Integer spin = 0; ; ++spin) {
+        if (canRead(state)) {
+            if (_state.compare_exchange_weak(state, state + 1, std::memory_order_acquire, std::memory_order_relaxed)) {
+                return;
+            }
+            continue;
+        }
+        if (spin >= ReadWriteLockSpinCount) {
+            _park(false);
+            spin = 0;
+        }
+        state = _state.load(std::memory_order_relaxed);
     }
-    ++_reader;
 }
 
 void ReadWriteLock::unlockRead() RX_NOEXCEPT {
-    LockGuard<decltype(_mutex)> lock(_mutex);
-    assert(_reader > 0 && "unlockRead when there is no reader!");
-    --_reader;
-    if (_reader == 0) {
-        _condition.notifyAll();
+    UInt64 state = _state.fetch_sub(1, std::memory_order_seq_cst);
+    assert((state & ReadWriteLockReaderMask) > 0 && "unlockRead when there is no reader!");
+    if ((state & ReadWriteLockReaderMask) == 1 && _parked.load(std::memory_order_seq_cst) > 0) {
+        _wakeParked();
     }
 }
 
 bool ReadWriteLock::tryLockRead() RX_NOEXCEPT {
-    LockGuard<decltype(_mutex)> lock(_mutex);
-    while (_writer > 0 || _pending > 0) {
-        return false;
+    UInt64 state = _state.load(std::memory_order_relaxed);
+    while (canRead(state)) {
+        if (_state.compare_exchange_weak(state, state + 1, std::memory_order_acquire, std::memory_order_relaxed)) {
+            return true;
+        }
     }
-    ++_reader;
-    return true;
+    return false;
 }
 
 void ReadWriteLock::lockWrite() RX_NOEXCEPT {
-    LockGuard<decltype(_mutex)> lock(_mutex);
-    ++_pending;
-    while (_writer > 0 || _reader > 0) {
-        _condition.wait(lock);
+    UInt64 state = 0;
+    if (_state.compare_exchange_strong(state, ReadWriteLockWriter, std::memory_order_acquire, std::memory_order_relaxed)) {
+        return;
+    }
+    state = _state.fetch_add(ReadWriteLockPendingUnit, std::memory_order_relaxed) + ReadWriteLockPendingUnit;
+    for (Integer spin = 0; ; ++spin) {
+        if (canWrite(state)) {
+            if (_state.compare_exchange_weak(state, (state - ReadWriteLockPendingUnit) | ReadWriteLockWriter,
+                                             std::memory_order_acquire, std::memory_order_relaxed)) {
+                return;
+            }
+            continue;
+        }
+        if (spin >= ReadWriteLockSpinCount) {
+            _park(true);
+            spin = 0;
+        }
+        state = _state.load(std::memory_order_relaxed);
     }
-    --_pending;
-    ++_writer;
 }
 
 void ReadWriteLock::unlockWrite() RX_NOEXCEPT {
-    LockGuard<decltype(_mutex)> lock(_mutex);
-    assert(_writer > 0 && "unlock write when there is no writer!");
-    --_writer;
-    _condition.notifyAll();
+    UInt64 state __unused = _state.fetch_and(~ReadWriteLockWriter, std::memory_order_seq_cst);
+    assert((state & ReadWriteLockWriter) && "unlock write when there is no writer!");
+    if (_parked.load(std::memory_order_seq_cst) > 0) {
+        _wakeParked();
+    }
 }
 
 bool ReadWriteLock::tryLockWrite() RX_NOEXCEPT {
-    LockGuard<decltype(_mutex)> lock(_mutex);
-    while (_writer > 0 || _reader > 0) {
-        return false;
+    UInt64 state = _state.load(std::memory_order_relaxed);
+    while (canWrite(state)) {
+        if (_state.compare_exchange_weak(state, state | ReadWriteLockWriter, std::memory_order_acquire, std::memory_order_relaxed)) {
+            return true;
+        }
     }
-    ++_writer;
-    return true;
+    return false;
 }
 
 bool ReadWriteLock::isReading() const RX_NOEXCEPT {
-    LockGuard<decltype(_mutex)> lock(_mutex);
-    return _reader > 0;
+    return (_state.load(std::memory_order_relaxed) & ReadWriteLockReaderMask) > 0;
 }
 
 bool ReadWriteLock::isWriting() const RX_NOEXCEPT {
+    return (_state.load(std::memory_order_relaxed) & ReadWriteLockWriter) != 0;
+}
+
+void ReadWriteLock::_park(bool forWrite) RX_NOEXCEPT {
     LockGuard<decltype(_mutex)> lock(_mutex);
-    return _writer > 0;
+    // Publishing _parked before re-checking the state pairs with the unlockers,
+    // which change the state before reading _parked: one side always sees the other.
+    _parked.fetch_add(1, std::memory_order_seq_cst);
+    UInt64 state = _state.load(std::memory_order_seq_cst);
+    while (forWrite ? !canWrite(state) : !canRead(state)) {
+        _condition.wait(lock);
+        state = _state.load(std::memory_order_seq_cst);
+    }
+    _parked.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void ReadWriteLock::_wakeParked() RX_NOEXCEPT {
+    LockGuard<decltype(_mutex)> lock(_mutex);
+    _condition.notifyAll();
 }
 
 Semaphore::Semaphore(Integer value) {
@@ -12,7 +12,6 @@
 #elif DEPLOYMENT_TARGET_ANDROID
 
 #include <unwind.h>
-#include <dlfcn.h>
 
 namespace {
     struct BacktraceState {
@@ -38,36 +37,92 @@ namespace {
         _Unwind_Backtrace(unwindCallback, &state);
         return state.current - buffer;
     }
-
-    static char **backtrace_symbols(void* const*buffer, int frames) {
-        Rx::String content;
-        for (size_t idx = 0; idx < frames; ++idx) {
-            const void *addr = buffer[idx];
-            const char *symbol = "";
-
-            Dl_info info;
-            if (dladdr(addr, &info) && info.dli_sname) {
-                symbol = info.dli_sname;
-            }
-            content.appendFormat("\t#  %ld: %s\n", 0, idx, symbol);
-        }
-        void *ptr = calloc(1, content.size());
-        memcpy(ptr, reinterpret_cast<const void *>(content.data()), content.size());
-        return reinterpret_cast<char **>(ptr);
-    }
 }
 
 #endif
 
+#include <RxFoundation/Atomic.hpp>
+
 #include <cstdlib>
+#include <cstring>
 #include <cxxabi.h>
+#include <dlfcn.h>
+#include <unordered_map>
 
 using namespace Rx;
 
+namespace {
+    static String symbolicate(const void *address) RX_NOEXCEPT {
+        const char *image = "???";
+        const char *symbol = nullptr;
+        uintptr_t offset = 0;
+        
+        Dl_info info;
+        if (dladdr(address, &info)) {
+            if (info.dli_fname) {
+                const char *slash = strrchr(info.dli_fname, '/');
+                image = slash ? slash + 1 : info.dli_fname;
+            }
+            if (info.dli_sname) {
+                symbol = info.dli_sname;
+                offset = reinterpret_cast<uintptr_t>(address) - reinterpret_cast<uintptr_t>(info.dli_saddr);
+            } else if (info.dli_fbase) {
+                offset = reinterpret_cast<uintptr_t>(address) - reinterpret_cast<uintptr_t>(info.dli_fbase);
+            }
+        }
+        
+        if (!symbol) {
+            return String("%-35s 0x%016lx %s + %lu", 0, image, (unsigned long)address, image, (unsigned long)offset);
+        }
+        
+        int status = -1;
+        std::unique_ptr<char, void(*)(void*)> demangled {
+            __cxxabiv1::__cxa_demangle(symbol, NULL, NULL, &status),
+            std::free
+        };
+        return String("%-35s 0x%016lx %s + %lu", 0, image, (unsigned long)address,
+                      status == 0 ? demangled.get() : symbol, (unsigned long)offset);
+    }
+    
+    /// Symbols by return address, shared by every call stack in the process.
+    /// Code addresses don't change once loaded, so entries are never evicted.
+    class SymbolCache {
+    public:
+        static SymbolCache &shared() RX_NOEXCEPT {
+            static SymbolCache *cache = new SymbolCache();
+            return *cache;
+        }
+        
+        String find(const void *address) RX_NOEXCEPT {
+            {
+                LockGuard<SpinLock> lock(_lock);
+                auto it = _symbols.find(address);
+                if (it != _symbols.end()) {
+                    return it->second;
+                }
+            }
+            // Look the symbol up without holding the lock, as dladdr can be slow
+            String symbol = symbolicate(address);
+            LockGuard<SpinLock> lock(_lock);
+            return _symbols.emplace(address, symbol).first->second;
+        }
+        
+    private:
+        SymbolCache() RX_NOEXCEPT : _lock("SymbolCache") {}
+        
+        SpinLock _lock;
+        std::unordered_map<const void *, String> _symbols;
+    };
+}
+
 namespace Rx {
     void getBacktrace(void **stack, int *size) {
         *size = backtrace(stack, *size);
     }
+    
+    String getSymbolForAddress(const void *address) RX_NOEXCEPT {
+        return SymbolCache::shared().find(address);
+    }
 }
 
 namespace {
@@ -87,103 +142,37 @@ namespace {
 }
 
 CallStackArray::CallStackArray(void **stack, UInt32 frames) :
+_frames(frames),
 _stack(nullptr, std::free),
-_infoFrames(nullptr),
-_frames(frames) {
+_infoFrames(nullptr) {
     _stack = {
         (void **)calloc(1, sizeof(void *) * frames),
         std::free
     };
     
     __builtin_memcpy(_stack.get(), stack, sizeof(void *) * frames);
-    
-    std::unique_ptr<char *, void(*)(void *)> infoFrames = {
-        backtrace_symbols(_stack.get(), _frames),
-        std::free
-    };
-    
-    
-    Array<String> demangledStrings;
-    
-    for (int i = 0; i < _frames; i++) {
-        char *begin_name = 0, *end_name = 0, *begin_offset = 0, *end_offset = 0;
-        String target;
-        
-        char *pp = 0;
-        UInt32 spaceCount = 0;
-        char *ifName = infoFrames.get()[i];
-        auto ifLength = strlen(ifName);
-        for (char *p = ifName; *p; ++p) {
-            if (isspace(*p) && (pp && !isspace(*pp))) {
-                spaceCount++;
-            } else if (*p == '+' && *(p + 1) == ' ') {
-                end_name = p - 1;
-                begin_offset = p + 1;
-            }
-            pp = p;
-            if (spaceCount == 3 && *(p) == ' ') {
-                begin_name = p + 1;
-            }
-        }
-        if (begin_offset) {
-            end_offset = ifName + ifLength;
-        }
-        
-        if (begin_name && end_name &&
-            begin_name < end_name &&
-            begin_offset && end_offset &&
-            begin_name < begin_offset) {
-            char end_name_char = *end_name;
-            char begin_offset_char = *begin_offset;
-            char end_offset_char = *end_offset;
-            *end_name++ = '\0';
-            *begin_offset++ = '\0';
-            *end_offset = '\0';
-            
-            int status = -1;
-            std::unique_ptr<char, void(*)(void*)> result {
-                __cxxabiv1::__cxa_demangle(begin_name, NULL, NULL, &status),
-                std::free
-            };
-            
-            if (status == 0) {
-                target.append(ifName, begin_name - ifName);
-                target.append(result.get());
-                target.append(1, end_name_char);
-                target.append(1, '+');
-                target.append(1, ' ');
-                target.append(begin_offset);
-            } else {
-                *end_name-- = end_name_char;
-                *end_offset = end_offset_char;
-                *begin_offset-- = begin_offset_char;
-                target.append(ifName);
-            }
-        } else {
-            target.append(ifName);
-        }
-        demangledStrings.addObject(target);
-    }
-    
-    _infoFrames = MakeShareable<Array<String>>(demangledStrings);
     formatBacktrace(*this, _stack.get(), _frames);
 }
 
 CallStackArray::~CallStackArray() {
 }
 
+const Array<String> &CallStackArray::getSymbols() const {
+    std::call_once(_infoFramesOnce, [this] {
+        Array<String> symbols;
+        for (UInt32 idx = 0; idx < _frames; ++idx) {
+            symbols.addObject(String("%-4d%s", 0, idx, getSymbolForAddress(_stack.get()[idx]).c_str()));
+        }
+        _infoFrames = MakeShareable<Array<String>>(symbols);
+    });
+    return *_infoFrames;
+}
+
 const String CallStackArray::getDescription() const {
     String description;
-    if (_infoFrames) {
-        for (UInteger idx = 0; idx < _frames; ++idx) {
-            description.append((*_infoFrames)[idx]);
-            description.append("\n");
-        }
-    } else {
-        for (auto &symbol : *this) {
-            description.append(symbol);
-            description.append("\n");
-        }
+    for (auto &symbol : getSymbols()) {
+        description.append(symbol);
+        description.append("\n");
     }
     return description;
 }
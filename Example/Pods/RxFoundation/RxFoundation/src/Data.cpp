@@ -11,6 +11,10 @@
 #include <RxFoundation/CrashReporter.hpp>
 
 #include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <fstream>
 #include <algorithm>
 
@@ -20,7 +24,8 @@ namespace Rx {
     namespace detail {
 #if DEPLOYMENT_TARGET_ANDROID
         RX_INLINE_VISIBILITY int flsl(long value) {
-            return __builtin_ffs(value);
+            // fls: 1-based index of the most significant set bit, 0 for 0.
+            return value == 0 ? 0 : (int)(sizeof(long) * 8) - __builtin_clzl((unsigned long)value);
         }
 #endif
 #if __LP64__
@@ -37,10 +42,37 @@ namespace Rx {
         static const constexpr UInt32 LowThreshold = (1ULL << 20);
         static const constexpr UInt32 HighThreshold = (1ULL << 29);
 #endif
+        /* Chunked storage starts small and doubles up to MaximumChunkSize, so one append never copies more than it adds. */
+        static const constexpr Index MinimumChunkSize = 4096;
+        static const constexpr Index MaximumChunkSize = (1L << 20);
+        
         enum Flags {
             DontDeallocate = 0x10,
         };
         
+        /* A chunk is only written while a single Data holds it, and only past `used`, so shared chunks are effectively immutable. */
+        struct DataChunk {
+            DataChunk(UInt8 *bytes, Index capacity, Index used, bool mapped) RX_NOEXCEPT :
+            bytes(bytes),
+            capacity(capacity),
+            used(used),
+            mapped(mapped) {
+            }
+            
+            ~DataChunk() RX_NOEXCEPT {
+                if (mapped) {
+                    munmap(bytes, capacity);
+                } else {
+                    free(bytes);
+                }
+            }
+            
+            UInt8 *bytes;
+            Index capacity;
+            Index used;
+            bool mapped;
+        };
+        
         static Index roundUpCapacity(Index capacity) {
             if (capacity < 16) {
                 return 16;
@@ -89,10 +121,19 @@ namespace Rx {
 Data::Data() RX_NOEXCEPT : Data(nullptr, detail::roundUpCapacity(1), false, true) {
 }
 
+Data::Data(StorageMode mode) RX_NOEXCEPT : Data() {
+    RxCheck(mode != StorageMode::Mapped);
+    if (mode == StorageMode::Chunked) {
+        __releaseStorage();
+        _storageMode = StorageMode::Chunked;
+    }
+}
+
 Data::Data(uint8_t *bytes, Index length, bool copy, bool freeWhenDone) RX_NOEXCEPT :
 _bytes(nullptr),
 _length(0),
-_capacity(0) {
+_capacity(0),
+_storageMode(StorageMode::Contiguous) {
     if (!copy && bytes) {
         _bytes = bytes;
         __setLength(length);
@@ -110,35 +151,125 @@ _capacity(0) {
     }
 }
 
-Data::Data(const Data &value) RX_NOEXCEPT {
-    appendData(value);
+Data::Data(const Data &value) RX_NOEXCEPT :
+_length(0),
+_capacity(0),
+_bytes(nullptr),
+_storageMode(value._storageMode) {
+    if (_storageMode == StorageMode::Contiguous) {
+        appendData(value);
+    } else {
+        // Shared chunks are never written again, so a copy only takes references.
+        _chunks = value._chunks;
+        _length = value._length;
+        _capacity = value._capacity;
+    }
 }
 
 Data::Data(Data &&value) RX_NOEXCEPT :
-_bytes(std::move(value._bytes)),
-_length(std::move(value._length)),
-_capacity(std::move(value._capacity)) {
+_flags(value._flags),
+_length(value._length),
+_capacity(value._capacity),
+_bytes(value._bytes),
+_storageMode(value._storageMode),
+_chunks(std::move(value._chunks)) {
+    value._flags.reset();
+    value._bytes = nullptr;
+    value._chunks.clear();
+    value._storageMode = StorageMode::Contiguous;
+    value.__setLength(0);
+    value.__setCapacity(0);
 }
 
 Data::~Data() RX_NOEXCEPT {
-    if (!(_flags.to_ulong() & detail::Flags::DontDeallocate)) {
+    __releaseStorage();
+}
+
+void Data::__releaseStorage() RX_NOEXCEPT {
+    if (_storageMode == StorageMode::Contiguous && !(_flags.to_ulong() & detail::Flags::DontDeallocate)) {
         if (_bytes) {
             free(_bytes);
-            _bytes = nullptr;
         }
-        __setLength(0);
-        __setCapacity(0);
     }
+    _flags &= ~std::bitset<32>(detail::Flags::DontDeallocate);
+    _bytes = nullptr;
+    _chunks.clear();
+    _storageMode = StorageMode::Contiguous;
+    __setLength(0);
+    __setCapacity(0);
+}
+
+const uint8_t *Data::getBytePtr() RX_NOEXCEPT {
+    if (_storageMode != StorageMode::Contiguous && 1 < _chunks.size()) {
+        // Callers expect one buffer; coalescing does not change the logical contents.
+        __makeContiguous();
+    }
+    return static_cast<const Data *>(this)->getBytePtr();
 }
 
 const uint8_t *Data::getBytePtr() const RX_NOEXCEPT {
-    return _bytes;
+    if (_storageMode == StorageMode::Contiguous) {
+        return _bytes;
+    }
+    if (_chunks.size() == 1) {
+        return _chunks.front()->bytes;
+    }
+    // Empty, or split over several chunks, which only the non-const overload may coalesce.
+    return nullptr;
 }
 
-uint8_t *Data::getMutableBytePtr() const RX_NOEXCEPT {
+uint8_t *Data::getMutableBytePtr() RX_NOEXCEPT {
+    __makeContiguous();
     return _bytes;
 }
 
+Data::StorageMode Data::getStorageMode() const RX_NOEXCEPT {
+    return _storageMode;
+}
+
+void Data::getBytes(Range range, uint8_t *buffer) const RX_NOEXCEPT {
+    detail::validateRange(*this, range, __PRETTY_FUNCTION__);
+    if (_storageMode == StorageMode::Contiguous) {
+        memmove(buffer, _bytes + range.location, range.length);
+        return;
+    }
+    Index end = range.location + range.length;
+    Index offset = 0;
+    for (auto &chunk : _chunks) {
+        Index chunkEnd = offset + chunk->used;
+        if (range.location < chunkEnd && offset < end) {
+            Index from = std::max(range.location, offset);
+            Index to = std::min(end, chunkEnd);
+            memcpy(buffer + (from - range.location), chunk->bytes + (from - offset), to - from);
+        }
+        if (end <= chunkEnd) {
+            break;
+        }
+        offset = chunkEnd;
+    }
+}
+
+void Data::enumerateByteRanges(const std::function<void (const uint8_t *bytes, Range range, bool &stop)> &block) const RX_NOEXCEPT {
+    bool stop = false;
+    if (_storageMode == StorageMode::Contiguous) {
+        if (0 < _length) {
+            block(_bytes, Range(0, _length), stop);
+        }
+        return;
+    }
+    Index offset = 0;
+    for (auto &chunk : _chunks) {
+        if (chunk->used == 0) {
+            continue;
+        }
+        block(chunk->bytes, Range(offset, chunk->used), stop);
+        if (stop) {
+            break;
+        }
+        offset += chunk->used;
+    }
+}
+
 const Index Data::getLength() const RX_NOEXCEPT {
     return _length;
 }
@@ -156,10 +287,15 @@ Index Data::getCapacity() RX_NOEXCEPT {
 }
 
 void Data::setLength(Index length) RX_NOEXCEPT {
+    __makeContiguous();
     __setLength(length);
 }
 
 void Data::appendData(const uint8_t *bytes, Index length) RX_NOEXCEPT {
+    if (_storageMode != StorageMode::Contiguous) {
+        __appendChunked(bytes, length);
+        return;
+    }
     replaceBytes(Range(getLength(), 0), bytes, length);
 }
 
@@ -168,7 +304,83 @@ void Data::appendData(const DataRef data) RX_NOEXCEPT {
 }
 
 void Data::appendData(const Data &data) RX_NOEXCEPT {
-    appendData(data.getBytePtr(), data.getLength());
+    if (data._storageMode == StorageMode::Contiguous) {
+        appendData(data.getBytePtr(), data.getLength());
+        return;
+    }
+    if (_storageMode == StorageMode::Contiguous) {
+        data.enumerateByteRanges([this](const uint8_t *bytes, Range range, bool &stop) {
+            appendData(bytes, range.length);
+        });
+        return;
+    }
+    // Both sides are chunked or mapped: share the chunks instead of copying their bytes.
+    // Copying the list first keeps self-append well defined.
+    std::vector<ChunkPtr> chunks(data._chunks);
+    _storageMode = StorageMode::Chunked;
+    for (auto &chunk : chunks) {
+        _chunks.push_back(chunk);
+        __setLength(_length + chunk->used);
+        __setCapacity(_capacity + chunk->capacity);
+    }
+}
+
+void Data::__appendChunked(const uint8_t *bytes, Index length) RX_NOEXCEPT {
+    RxCheck(0 <= length);
+    if (length <= 0) {
+        return;
+    }
+    if (_length + length > detail::DataMaxSize) {
+        detail::handleOutOfMemory(*this, _length + length);
+    }
+    // Appending to a mapping keeps it as the first chunk.
+    _storageMode = StorageMode::Chunked;
+    if (!_chunks.empty()) {
+        auto &tail = _chunks.back();
+        if (!tail->mapped && tail.isUnique()) {
+            Index count = std::min(length, tail->capacity - tail->used);
+            if (0 < count) {
+                memcpy(tail->bytes + tail->used, bytes, count);
+                tail->used += count;
+                bytes += count;
+                length -= count;
+                __setLength(_length + count);
+            }
+        }
+    }
+    if (0 < length) {
+        Index previous = _chunks.empty() ? 0 : _chunks.back()->capacity;
+        Index capacity = std::max(length, std::min(std::max(previous * 2, detail::MinimumChunkSize), detail::MaximumChunkSize));
+        UInt8 *storage = (UInt8 *)detail::dataAllocate(capacity, false);
+        if (storage == nullptr) {
+            detail::handleOutOfMemory(*this, capacity);
+        }
+        memcpy(storage, bytes, length);
+        _chunks.push_back(ChunkPtr(new detail::DataChunk(storage, capacity, length, false)));
+        __setLength(_length + length);
+        __setCapacity(_capacity + capacity);
+    }
+}
+
+void Data::__makeContiguous() RX_NOEXCEPT {
+    if (_storageMode == StorageMode::Contiguous) {
+        return;
+    }
+    Index length = getLength();
+    Index capacity = std::max(length, detail::roundUpCapacity(length));
+    UInt8 *bytes = (UInt8 *)detail::dataAllocate(capacity, false);
+    if (bytes == nullptr) {
+        detail::handleOutOfMemory(*this, capacity);
+    }
+    Index offset = 0;
+    for (auto &chunk : _chunks) {
+        memcpy(bytes + offset, chunk->bytes, chunk->used);
+        offset += chunk->used;
+    }
+    __releaseStorage();
+    _bytes = bytes;
+    __setLength(length);
+    __setCapacity(capacity);
 }
 
 void Data::__setCapacity(Index capacity) RX_NOEXCEPT {
@@ -183,6 +395,17 @@ void Data::replaceBytes(Range range, const uint8_t *newBytes, Index newLength) R
     detail::validateRange(*this, range, __PRETTY_FUNCTION__);
     RxCheck(0 <= newLength);
     
+    // newBytes may point into our own chunks, keep them alive until the copy is done.
+    std::vector<ChunkPtr> retained;
+    if (_storageMode != StorageMode::Contiguous) {
+        if (range.location == getLength() && range.length == 0) {
+            __appendChunked(newBytes, newLength);
+            return;
+        }
+        retained = _chunks;
+        __makeContiguous();
+    }
+    
     Index len = getLength();
     if (len < 0 || range.length < 0 || newLength < 0) {
         CrashReporter::HALT();
@@ -236,33 +459,91 @@ bool Data::writeToFile(String path, bool automatically) RX_NOEXCEPT {
     return false;
 }
 
+bool Data::mapFile(String path) RX_NOEXCEPT {
+    __releaseStorage();
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode) || (UInt64)info.st_size > (UInt64)detail::DataMaxSize) {
+        close(fd);
+        return false;
+    }
+    Index length = (Index)info.st_size;
+    if (0 < length) {
+        void *bytes = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (bytes == MAP_FAILED) {
+            close(fd);
+            return false;
+        }
+        _chunks.push_back(ChunkPtr(new detail::DataChunk((UInt8 *)bytes, length, length, true)));
+    }
+    close(fd);
+    _storageMode = StorageMode::Mapped;
+    __setLength(length);
+    __setCapacity(length);
+    return true;
+}
+
 bool Data::operator==(const Data &rhs) const RX_NOEXCEPT {
     auto length = getLength();
     if (length != rhs.getLength()) {
         return false;
     }
-    auto *ptr0 = getBytePtr();
-    auto *ptr1 = rhs.getBytePtr();
-    return 0 == __builtin_memcmp(ptr0, ptr1, length);
+    if (_storageMode == StorageMode::Contiguous && rhs._storageMode == StorageMode::Contiguous) {
+        auto *ptr0 = getBytePtr();
+        auto *ptr1 = rhs.getBytePtr();
+        return 0 == __builtin_memcmp(ptr0, ptr1, length);
+    }
+    // Walk both range lists in step instead of coalescing either side.
+    std::vector<std::pair<const uint8_t *, Index>> ranges;
+    rhs.enumerateByteRanges([&ranges](const uint8_t *bytes, Range range, bool &stop) {
+        ranges.emplace_back(bytes, range.length);
+    });
+    auto other = ranges.begin();
+    Index otherOffset = 0;
+    bool equal = true;
+    enumerateByteRanges([&](const uint8_t *bytes, Range range, bool &stop) {
+        Index offset = 0;
+        while (offset < range.length) {
+            Index count = std::min(range.length - offset, other->second - otherOffset);
+            if (0 != __builtin_memcmp(bytes + offset, other->first + otherOffset, count)) {
+                equal = false;
+                stop = true;
+                return;
+            }
+            offset += count;
+            otherOffset += count;
+            if (otherOffset == other->second) {
+                ++other;
+                otherOffset = 0;
+            }
+        }
+    });
+    return equal;
 }
 
 String Data::copyDescription() const RX_NOEXCEPT {
     String result;
     Index idx;
     Index len;
-    const uint8_t *bytes = nullptr;
+    uint8_t bytes[24];
     len = getLength();
-    bytes = getBytePtr();
     result.appendFormat("<Rx::Data %p>{length = %lu, capacity = %lu, bytes = 0x", 0, this, (unsigned long)len, (unsigned long)getCapacity());
     if (24 < len) {
+        // Only the head and tail are printed; copy them out rather than coalescing chunked storage.
+        getBytes(Range(0, 16), bytes);
+        getBytes(Range(len - 8, 8), bytes + 16);
         for (idx = 0; idx < 16; idx += 4) {
             result.appendFormat("%02x%02x%02x%02x", 0, bytes[idx], bytes[idx + 1], bytes[idx + 2], bytes[idx + 3]);
         }
         result += " ... ";
-        for (idx = len - 8; idx < len; idx += 4) {
+        for (idx = 16; idx < 24; idx += 4) {
             result.appendFormat("%02x%02x%02x%02x", 0, bytes[idx], bytes[idx + 1], bytes[idx + 2], bytes[idx + 3]);
         }
     } else {
+        getBytes(Range(0, len), bytes);
         for (idx = 0; idx < len; idx++) {
             result.appendFormat("%02x", 0, bytes[idx]);
         }
@@ -272,7 +553,13 @@ String Data::copyDescription() const RX_NOEXCEPT {
 }
 
 HashCode Data::hash() const RX_NOEXCEPT {
-    return Rx::hash(getBytePtr(), std::min<decltype(_length)>(80, getLength()));
+    Index length = std::min<decltype(_length)>(80, getLength());
+    if (_storageMode == StorageMode::Contiguous) {
+        return Rx::hash(getBytePtr(), length);
+    }
+    uint8_t bytes[80];
+    getBytes(Range(0, length), bytes);
+    return Rx::hash(bytes, length);
 }
 
 /* Allocates new block of data with at least numNewValues more bytes than the current length. If clear is true, the new bytes up to at least the new length with be zeroed. */
@@ -13,29 +13,50 @@ using namespace Rx;
 
 Exception::Exception(const String &name, const String reason) RX_NOEXCEPT :
 _name(name),
-_reason(reason) {
-    static const int framesToShow = 31;
-    static const int framesToSkip = 2;
-    void *samples[framesToShow + framesToSkip];
-    int frames = framesToShow + framesToSkip;
-    getBacktrace(samples, &frames);
-    _callStackSymbols = MakeShareable<CallStackArray>(samples, frames);
+_reason(reason),
+_callStackFrames(0) {
+    int frames = MaxCallStackFrames;
+    getBacktrace(_callStack, &frames);
+    _callStackFrames = frames;
+}
+
+Exception::Exception(const Exception &exception) RX_NOEXCEPT :
+_name(exception._name),
+_reason(exception._reason),
+_callStackFrames(exception._callStackFrames) {
+    __builtin_memcpy(_callStack, exception._callStack, sizeof(void *) * _callStackFrames);
 }
 
 Exception::~Exception() RX_NOEXCEPT {
 }
 
 const char *Exception::what() const RX_NOEXCEPT {
-    return copyDescription().c_str();
+    // Building the description allocates, which mustn't escape from what().
+    // A failed attempt leaves the flag unset, so the next call tries again.
+    try {
+        std::call_once(_descriptionOnce, [this] {
+            _description = copyDescription();
+        });
+        return _description.c_str();
+    } catch (...) {
+        return "Rx::Exception (description unavailable)";
+    }
+}
+
+const CallStackArray &Exception::getCallStack() const {
+    std::call_once(_callStackOnce, [this] {
+        _callStackSymbols = MakeShareable<CallStackArray>(const_cast<void **>(_callStack), _callStackFrames);
+    });
+    return static_cast<const CallStackArray &>(*_callStackSymbols);
 }
 
 const String Exception::copyDescription() const {
     String description;
-    String callStackSymbolsDescription = StaticCastSharedPtr<CallStackArray>(_callStackSymbols)->getDescription();
+    String callStackSymbolsDescription = getCallStack().getDescription();
     description = String("<%s> - %s\n%s", 0, getName().c_str(), getReason().c_str(), callStackSymbolsDescription.c_str());
     return description;
 }
 
 const Array<String> Exception::getCallStackSymbols() const {
-    return *StaticCastSharedPtr<CallStackArray>(_callStackSymbols);
+    return getCallStack().getSymbols();
 }
@@ -9,6 +9,7 @@
 #include <RxFoundation/KeyValueObserverInterface.hpp>
 #include <RxFoundation/SharedPointer.hpp>
 #include <cassert>
+#include <algorithm>
 
 using namespace Rx;
 
@@ -30,117 +31,324 @@ void KeyValueCodingInterface::setValueForUndefinedKey(const String &keyPath, Any
     throw Exception(Rx::KeyValueCodingInterface::ExceptionName, String("set value for undefined key: %s\n", 0, keyPath.c_str()));
 }
 
+class KeyValueObserverInterface::RegistryReader {
+public:
+    RegistryReader(const KeyValueObserverInterface &owner) RX_NOEXCEPT : _owner(owner) {
+        // Count ourselves under the current epoch before loading: whatever a writer replaces
+        // after that is retired in our epoch or a later one, and the epoch can't move two past
+        // ours while we're counted. If it moved while we were counting ourselves, our count
+        // may be under an epoch that is already done with, so count again under the new one.
+        while (1) {
+            _epoch = _owner._registryEpoch.load();
+            _owner._registryReaders[_epoch & 1].fetch_add(1);
+            if (_owner._registryEpoch.load() == _epoch) {
+                break;
+            }
+            _leave();
+        }
+        _registry = _owner._registry.load();
+    }
+    
+    ~RegistryReader() RX_NOEXCEPT {
+        _leave();
+    }
+    
+    const ObserverRegistry *get() const RX_NOEXCEPT { return _registry; }
+    
+private:
+    void _leave() RX_NOEXCEPT {
+        // The last reader of an epoch the registry has moved on from may let it move on again.
+        if (_owner._registryReaders[_epoch & 1].fetch_sub(1) == 1 &&
+            _owner._hasRetiredRegistries.load() &&
+            _owner._registryEpoch.load() != _epoch) {
+            _owner._reclaimRegistries();
+        }
+    }
+    
+    const KeyValueObserverInterface &_owner;
+    const ObserverRegistry *_registry;
+    UInt64 _epoch;
+};
+
+KeyValueObserverInterface::ObserverSlots::ObserverSlots(UInt32 capacity) RX_NOEXCEPT :
+_slots(static_cast<KVOPairRef *>(::operator new(sizeof(KVOPairRef) * capacity))),
+_capacity(capacity),
+_used(0) {
+}
+
+KeyValueObserverInterface::ObserverSlots::~ObserverSlots() RX_NOEXCEPT {
+    for (UInt32 idx = 0; idx < _used; ++idx) {
+        _slots[idx].~KVOPairRef();
+    }
+    ::operator delete(_slots);
+}
+
+void KeyValueObserverInterface::ObserverSlots::append(const KVOPairRef &observer) RX_NOEXCEPT {
+    assert(_used < _capacity);
+    ::new (&_slots[_used]) KVOPairRef(observer);
+    _used++;
+}
+
+KeyValueObserverInterface::ObserverRegistry::ObserverRegistry(size_t numBuckets) RX_NOEXCEPT :
+numBuckets(numBuckets),
+buckets(new std::atomic<Bucket *>[numBuckets]()),
+numKeys(0) {
+}
+
+const KeyValueObserverInterface::ObserverRegistry::Bucket *KeyValueObserverInterface::ObserverRegistry::find(const InternedString &key) const RX_NOEXCEPT {
+    const size_t mask = numBuckets - 1;
+    size_t bucketIndex = mixHashValue((UInt64)key.hash()) & mask;
+    while (1) {
+        const Bucket *bucket = buckets[bucketIndex].load();
+        if (bucket == nullptr || bucket->key == key) {
+            return bucket;
+        }
+        bucketIndex = (bucketIndex + 1) & mask;
+    }
+}
+
+const KeyValueObserverInterface::ObserverRegistry::Bucket *KeyValueObserverInterface::ObserverRegistry::find(const String &key) const RX_NOEXCEPT {
+    const HashCode hash = key.hash();
+    const size_t mask = numBuckets - 1;
+    size_t bucketIndex = mixHashValue((UInt64)hash) & mask;
+    while (1) {
+        const Bucket *bucket = buckets[bucketIndex].load();
+        if (bucket == nullptr || (bucket->key.hash() == hash && bucket->key.getString() == key)) {
+            return bucket;
+        }
+        bucketIndex = (bucketIndex + 1) & mask;
+    }
+}
+
+std::atomic<KeyValueObserverInterface::ObserverRegistry::Bucket *> &KeyValueObserverInterface::ObserverRegistry::slotFor(const InternedString &key) RX_NOEXCEPT {
+    const size_t mask = numBuckets - 1;
+    size_t bucketIndex = mixHashValue((UInt64)key.hash()) & mask;
+    while (1) {
+        const Bucket *bucket = buckets[bucketIndex].load(std::memory_order_relaxed);
+        if (bucket == nullptr || bucket->key == key) {
+            return buckets[bucketIndex];
+        }
+        bucketIndex = (bucketIndex + 1) & mask;
+    }
+}
+
 KeyValueObserverInterface::KeyValueObserverInterface() RX_NOEXCEPT :
-_observersInfo(new std::map<const String, OrderedSetRef<KVOPairRef>>()),
+_registry(nullptr),
+_registryEpoch(0),
+_registryReaders(),
+_hasRetiredRegistries(false),
 _observerLock("KeyValueObserverInterface") {
 }
 
 KeyValueObserverInterface::~KeyValueObserverInterface() RX_NOEXCEPT {
     LockGuard<decltype(this->_observerLock)> lock(this->_observerLock);
-    if (_observersInfo->size()) {
-        for (auto &observerInfo : _observersInfo.get()) {
-            for (auto &observer : *observerInfo.second) {
-                assert(observer->getKVOCallState() == KVOCallState::Default);
+    if (auto registry = _registry.load()) {
+        for (size_t bucketIndex = 0; bucketIndex < registry->numBuckets; ++bucketIndex) {
+            if (auto bucket = registry->buckets[bucketIndex].load()) {
+                for (UInt32 idx = 0; idx < bucket->count; ++idx) {
+                    assert((*bucket->slots)[idx]->getKVOCallState() == KVOCallState::Default);
+                }
+                delete bucket;
             }
         }
+        delete registry;
     }
+    _reclaimRegistries();
 }
 
 std::set<String> KeyValueObserverInterface::keyPathsForValuesAffectingValueForKey​​(const String &key) const RX_NOEXCEPT {
     return std::set<String>();
 }
 
+void KeyValueObserverInterface::ObserverRegistry::Bucket::compact() RX_NOEXCEPT {
+    SharedPtr<ObserverSlots> enabled = MakeShareable<ObserverSlots>(std::max<UInt32>(4, (count - numDisabled) * 2));
+    for (UInt32 idx = 0; idx < count; ++idx) {
+        auto &observer = (*slots)[idx];
+        if (observer->isEnabled()) {
+            enabled->append(observer);
+        }
+    }
+    slots = enabled;
+    count = enabled->getUsed();
+    numDisabled = 0;
+}
+
+/* Publishes bucket in slot. The bucket it replaces may still be read by a notification, so
+   it is retired until no reader is left that could have seen it. Only one key's bucket is
+   ever rebuilt: adding n observers costs O(n) overall however many keys there are. */
+void KeyValueObserverInterface::_replaceBucket(std::atomic<ObserverRegistry::Bucket *> &slot, ObserverRegistry::Bucket *bucket) RX_NOEXCEPT {
+    ObserverRegistry::Bucket *previous = slot.exchange(bucket);
+    if (previous == nullptr) {
+        return;
+    }
+    // Readers that could have loaded previous counted themselves before the exchange, so
+    // under this epoch or an earlier one.
+    _retiredBuckets.emplace_back(_registryEpoch.load(), previous);
+    _hasRetiredRegistries.store(true);
+}
+
+/* Moves to the next epoch once the readers of the previous one have left, so that readers
+   are only ever counted under the current epoch or the one before it. Called with the lock
+   held. */
+bool KeyValueObserverInterface::_advanceRegistryEpoch() const RX_NOEXCEPT {
+    const UInt64 epoch = _registryEpoch.load();
+    if (_registryReaders[(epoch + 1) & 1].load() != 0) {
+        return false;
+    }
+    _registryEpoch.store(epoch + 1);
+    return true;
+}
+
+void KeyValueObserverInterface::_reclaimRegistries() const RX_NOEXCEPT {
+    LockGuard<decltype(this->_observerLock)> lock(this->_observerLock);
+    if (_retiredRegistries.empty() && _retiredBuckets.empty()) {
+        return;
+    }
+    for (int step = 0; step < 2 && _advanceRegistryEpoch(); ++step) {
+    }
+    const UInt64 epoch = _registryEpoch.load();
+    auto reclaim = [epoch](auto &retired) {
+        auto kept = std::partition(retired.begin(), retired.end(), [epoch](const auto &entry) {
+            return entry.first + 2 > epoch;
+        });
+        for (auto it = kept; it != retired.end(); ++it) {
+            delete it->second;
+        }
+        retired.erase(kept, retired.end());
+    };
+    // Retired tables share their buckets with the current one, so only the table goes.
+    reclaim(_retiredRegistries);
+    reclaim(_retiredBuckets);
+    _hasRetiredRegistries.store(!_retiredRegistries.empty() || !_retiredBuckets.empty());
+}
+
 void KeyValueObserverInterface::addObserver(KeyValueObserverInterfaceParamRef observer,
                                             const String &key,
                                             Integer notifyKind,
                                             Any context) RX_NOEXCEPT {
+    addObserver(observer, InternedString(key), notifyKind, context);
+}
+
+void KeyValueObserverInterface::addObserver(KeyValueObserverInterfaceParamRef observer,
+                                            const InternedString &key,
+                                            Integer notifyKind,
+                                            Any context) RX_NOEXCEPT {
     LockGuard<decltype(this->_observerLock)> lock(this->_observerLock);
-    auto it = _observersInfo->find(key);
-    if (it == _observersInfo->end()) {
-        _observersInfo->insert({key, MakeShareable<OrderedSet<KVOPairRef>>()});
-        it = _observersInfo->find(key);
-    }
     removeObserver(observer, key);
     KVOPairRef kvoPair = MakeShareable<KVOPair>(observer, (Change::Kind)notifyKind, context);
     kvoPair->setEnabled(true);
-    it->second->addObject(kvoPair);
+    ObserverRegistry *registry = _registry.load();
+    if (registry == nullptr || (registry->numKeys + 1) * 2 > registry->numBuckets) {
+        // Grow the table; the buckets themselves move over as they are.
+        auto grown = new ObserverRegistry(registry ? registry->numBuckets * 2 : 8);
+        if (registry) {
+            for (size_t bucketIndex = 0; bucketIndex < registry->numBuckets; ++bucketIndex) {
+                if (auto bucket = registry->buckets[bucketIndex].load(std::memory_order_relaxed)) {
+                    grown->slotFor(bucket->key).store(bucket, std::memory_order_relaxed);
+                }
+            }
+            grown->numKeys = registry->numKeys;
+        }
+        ObserverRegistry *previous = _registry.exchange(grown);
+        if (previous) {
+            _retiredRegistries.emplace_back(_registryEpoch.load(), previous);
+            _hasRetiredRegistries.store(true);
+        }
+        registry = grown;
+    }
+    auto &slot = registry->slotFor(key);
+    const ObserverRegistry::Bucket *existing = slot.load(std::memory_order_relaxed);
+    ObserverRegistry::Bucket *bucket;
+    if (existing == nullptr) {
+        bucket = new ObserverRegistry::Bucket{key, MakeShareable<ObserverSlots>(4), 0, 0};
+        registry->numKeys++;
+    } else {
+        // The slots are appended to in place when this bucket is their newest user and they
+        // have room, and reallocated at twice the size otherwise.
+        bucket = new ObserverRegistry::Bucket(*existing);
+        if (bucket->slots->getUsed() != bucket->count || bucket->slots->getUsed() == bucket->slots->getCapacity()) {
+            bucket->compact();
+        }
+    }
+    bucket->slots->append(kvoPair);
+    bucket->count++;
+    _replaceBucket(slot, bucket);
+    _reclaimRegistries();
     _willChangeValueForKey(key, Change::Kind::Initialize);
     _didChangeValueForKey(key, Change::Kind::Initialize, (Change::Kind::Initialize == (notifyKind & Change::Kind::Initialize)));
 }
 
 void KeyValueObserverInterface::removeObserver(KeyValueObserverInterfaceParamRef observer, const String &key) RX_NOEXCEPT {
-    decltype(this->_observersInfo)::value_type::iterator it;
+    // A key that was never interned has never been observed.
+    const InternedString internedKey = InternedString::lookup(key);
+    if (internedKey.isValid()) {
+        removeObserver(observer, internedKey);
+    }
+}
+
+void KeyValueObserverInterface::removeObserver(KeyValueObserverInterfaceParamRef observer, const InternedString &key) RX_NOEXCEPT {
     LockGuard<decltype(this->_observerLock)> lock(this->_observerLock);
-    it = _observersInfo->find(key);
-    if (it == _observersInfo->end()) {
+    ObserverRegistry *registry = _registry.load();
+    if (registry == nullptr) {
         return;
     }
-    KVOPairRef target = MakeShareable<KVOPair>(observer, Change::Kind::All, nullptr);
-    auto targetPosition = it->second->find([&](const KVOPairRef value) {
-        bool result = (*value == *target);
-        return result;
-    });
-    if (targetPosition != it->second->end()) {
-        (*targetPosition)->setEnabled(false);
-        it->second->erase(targetPosition);
-        if (it->second->isEmpty()) {
-            _observersInfo->erase(it);
-        }
+    auto &slot = registry->slotFor(key);
+    ObserverRegistry::Bucket *bucket = slot.load(std::memory_order_relaxed);
+    if (bucket == nullptr) {
+        return;
     }
-}
-
-Array<KeyValueObserverInterface::KVOPairRef> KeyValueObserverInterface::_getObservers(const String &key, KeyValueObserverInterfaceParamRef object, Change::Kind notifyKind) const RX_NOEXCEPT {
-    decltype(this->_observersInfo)::value_type::iterator it;
-    {
-        LockGuard<decltype(this->_observerLock)> lock(this->_observerLock);
-        it = _observersInfo->find(key);
-        if (it == _observersInfo->end()) {
-            return {};
+    // Disable in place; the slot is dropped once disabled slots outnumber enabled ones.
+    for (UInt32 idx = 0; idx < bucket->count; ++idx) {
+        auto &value = (*bucket->slots)[idx];
+        if (value->getObserver() == observer && value->isEnabled()) {
+            value->setEnabled(false);
+            bucket->numDisabled++;
+            break;
         }
     }
-    
-    Array<KVOPairRef> matched;
-    
-    std::copy_if(it->second->begin(), it->second->end(), std::back_inserter(matched), [&](const KVOPairRef value) -> bool {
-        if (object != nullptr) {
-            if (value->getObserver() != object) {
-                return false;
-            }
-        }
-        return value->isEnabled() && (value->getNotifyKind() | notifyKind) != Change::Kind::Invalid;
-    });
-    
-    if (!matched.isEmpty()) {
-        Array<Index> indexes;
-        for (auto idx = it->second->begin(), end = it->second->end(); idx != end; ++idx) {
-            
-        }
+    const UInt32 numEnabled = bucket->count - bucket->numDisabled;
+    if (bucket->numDisabled != 0 && (numEnabled == 0 || numEnabled < bucket->numDisabled)) {
+        // The key keeps its (possibly empty) bucket: open addressing can't just clear it.
+        auto compacted = new ObserverRegistry::Bucket(*bucket);
+        compacted->compact();
+        _replaceBucket(slot, compacted);
+        _reclaimRegistries();
     }
-    
-    return matched;
 }
 
 void KeyValueObserverInterface::willChangeValueForKey(const String &key) const RX_NOEXCEPT {
     _willChangeValueForKey(key);
 }
 
-void KeyValueObserverInterface::_willChangeValueForKey(const String &key, Change::Kind kind) const RX_NOEXCEPT {
-    {
-        LockGuard<decltype(this->_observerLock)> lock(this->_observerLock);
-        if (_observersInfo->size() == 0) {
-            return;
-        }
+void KeyValueObserverInterface::willChangeValueForKey(const InternedString &key) const RX_NOEXCEPT {
+    _willChangeValueForKey(key);
+}
+
+template <typename KeyTy>
+void KeyValueObserverInterface::_willChangeValueForKey(const KeyTy &key, Change::Kind kind) const RX_NOEXCEPT {
+    if (_registry.load(std::memory_order_acquire) == nullptr) {
+        return;
     }
-    Array<KeyValueObserverInterface::KVOPairRef> observers = _getObservers(key, nullptr, kind);
-    if (!observers.isEmpty()) {
-        for (auto observer : observers) {
-            auto object __unused = observer->getObserver();
-            auto context = observer->getContext();
-            auto KVOState __unused = observer->getKVOCallState();
-            observer->setKVOCallState(KeyValueObserverInterface::KVOCallState::WillChange);
-            if (observer->getNotifyKind() & Change::Kind::Old) {
-                observer->_change._oldValue = getValueForKey(key);
-            }
+    RegistryReader reader(*this);
+    auto registry = reader.get();
+    if (registry == nullptr) {
+        return;
+    }
+    if (auto bucket = registry->find(key)) {
+        _willChange(*bucket);
+    }
+}
+
+void KeyValueObserverInterface::_willChange(const ObserverRegistry::Bucket &bucket) const RX_NOEXCEPT {
+    const String &key = bucket.key.getString();
+    for (UInt32 idx = 0; idx < bucket.count; ++idx) {
+        const KVOPairRef &observer = (*bucket.slots)[idx];
+        if (!observer->isEnabled()) {
+            continue;
+        }
+        observer->setKVOCallState(KeyValueObserverInterface::KVOCallState::WillChange);
+        if (observer->getNotifyKind() & Change::Kind::Old) {
+            observer->_change._oldValue = getValueForKey(key);
         }
     }
 }
@@ -149,6 +357,10 @@ void KeyValueObserverInterface::didChangeValueForKey(const String &key) const RX
     _didChangeValueForKey(key);
 }
 
+void KeyValueObserverInterface::didChangeValueForKey(const InternedString &key) const RX_NOEXCEPT {
+    _didChangeValueForKey(key);
+}
+
 namespace Rx {
     namespace detail {
         String _KVOChangeKind(KeyValueObserverInterface::Change::Kind kind) {
@@ -174,48 +386,31 @@ namespace Rx {
     }
 }
 
-void KeyValueObserverInterface::_didChangeValueForKey(const String &key, Change::Kind kind, bool doCall) const RX_NOEXCEPT {
-    {
-        LockGuard<decltype(this->_observerLock)> lock(this->_observerLock);
-        if (_observersInfo->size() == 0) {
-            return;
+void KeyValueObserverInterface::_didChange(const ObserverRegistry::Bucket &bucket, Change::Kind kind, bool doCall) const RX_NOEXCEPT {
+    const String &key = bucket.key.getString();
+    auto thisRef = ConstCastSharedRef<KeyValueObserverInterface>(this->asShared());
+    for (UInt32 idx = 0; idx < bucket.count; ++idx) {
+        const KVOPairRef &observer = (*bucket.slots)[idx];
+        if (!observer->isEnabled()) {
+            continue;
         }
-    }
-    Array<KeyValueObserverInterface::KVOPairRef> observers = _getObservers(key, nullptr, kind);
-    const std::set<String> &keyPaths = this->keyPathsForValuesAffectingValueForKey​​(key);
-    if (!observers.isEmpty()) {
-//        Log("observers: %s", 0, observers.copyDescription().c_str());
-        auto thisRef = ConstCastSharedRef<KeyValueObserverInterface>(this->asShared());
-        for (auto &observer : observers) {
-            KeyValueObserverInterfaceParamRef &object = observer->getObserver();
-            Any &context = observer->getContext();
-            observer->setKVOCallState(KeyValueObserverInterface::KVOCallState::DidChange);
-            if (observer->getNotifyKind() & Change::Kind::New ||
-                !observer->isInitialized()) {
-                observer->_change._newValue = getValueForKey(key);
-            }
-            
-            if (observer->getNotifyKind() & Change::Kind::Initialize) {
-                if (!observer->isInitialized()) {
-                    observer->_change._kind = Change::Kind::Initialize;
-                    observer->setInitialized();
-                    detail::_LogKVO(key, &observer->_change, this, doCall, observer->isEnabled());
-                    if (doCall) {
-                        if (observer->isEnabled()) {
-                            RxCheck(observer->_change.getKind() != KeyValueObserverInterface::Change::Kind::Invalid);
-                            object->receiveObserverNotify(key, thisRef, context, observer->getChange());
-                        }
-                    }
-                } else {
-                    observer->_change._kind = (Change::Kind)kind;
-                    detail::_LogKVO(key, &observer->_change, this, doCall, observer->isEnabled());
-                    if (observer->_change._newValue != observer->_change._oldValue) {
-                        if (doCall) {
-                            if (observer->isEnabled()) {
-                                RxCheck(observer->_change.getKind() != KeyValueObserverInterface::Change::Kind::Invalid);
-                                object->receiveObserverNotify(key, thisRef, context, observer->getChange());
-                            }
-                        }
+        KeyValueObserverInterfaceParamRef &object = observer->getObserver();
+        Any &context = observer->getContext();
+        observer->setKVOCallState(KeyValueObserverInterface::KVOCallState::DidChange);
+        if (observer->getNotifyKind() & Change::Kind::New ||
+            !observer->isInitialized()) {
+            observer->_change._newValue = getValueForKey(key);
+        }
+        
+        if (observer->getNotifyKind() & Change::Kind::Initialize) {
+            if (!observer->isInitialized()) {
+                observer->_change._kind = Change::Kind::Initialize;
+                observer->setInitialized();
+                detail::_LogKVO(key, &observer->_change, this, doCall, observer->isEnabled());
+                if (doCall) {
+                    if (observer->isEnabled()) {
+                        RxCheck(observer->_change.getKind() != KeyValueObserverInterface::Change::Kind::Invalid);
+                        object->receiveObserverNotify(key, thisRef, context, observer->getChange());
                     }
                 }
             } else {
@@ -230,9 +425,40 @@ void KeyValueObserverInterface::_didChangeValueForKey(const String &key, Change:
                     }
                 }
             }
-            
-            observer->setKVOCallState(KeyValueObserverInterface::KVOCallState::Default);
-            observer->_change._oldValue = observer->_change._newValue; // update last new value to old value
+        } else {
+            observer->_change._kind = (Change::Kind)kind;
+            detail::_LogKVO(key, &observer->_change, this, doCall, observer->isEnabled());
+            if (observer->_change._newValue != observer->_change._oldValue) {
+                if (doCall) {
+                    if (observer->isEnabled()) {
+                        RxCheck(observer->_change.getKind() != KeyValueObserverInterface::Change::Kind::Invalid);
+                        object->receiveObserverNotify(key, thisRef, context, observer->getChange());
+                    }
+                }
+            }
+        }
+        
+        observer->setKVOCallState(KeyValueObserverInterface::KVOCallState::Default);
+        observer->_change._oldValue = observer->_change._newValue; // update last new value to old value
+    }
+}
+
+namespace {
+    RX_INLINE const String &getKeyString(const String &key) RX_NOEXCEPT { return key; }
+    RX_INLINE const String &getKeyString(const InternedString &key) RX_NOEXCEPT { return key.getString(); }
+}
+
+template <typename KeyTy>
+void KeyValueObserverInterface::_didChangeValueForKey(const KeyTy &key, Change::Kind kind, bool doCall) const RX_NOEXCEPT {
+    if (_registry.load(std::memory_order_acquire) == nullptr) {
+        return;
+    }
+    const std::set<String> &keyPaths = this->keyPathsForValuesAffectingValueForKey​​(getKeyString(key));
+    {
+        RegistryReader reader(*this);
+        auto registry = reader.get();
+        if (auto bucket = registry ? registry->find(key) : nullptr) {
+            _didChange(*bucket, kind, doCall);
         }
     }
     
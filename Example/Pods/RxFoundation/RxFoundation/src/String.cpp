@@ -8,7 +8,13 @@
 
 #include <RxFoundation/String.hpp>
 #include <RxFoundation/Array.hpp>
+#include <RxFoundation/Atomic.hpp>
+#include <RxFoundation/Set.hpp>
 #include <cstdarg>
+#include <cstring>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 using namespace Rx;
 
@@ -62,28 +68,69 @@ bool String::operator==(const value_type *value) const RX_NOEXCEPT {
     return 0 == compare(value);
 }
 
+namespace Rx {
+    namespace detail {
+        /* The first occurrence of needle in [haystack, end), or nullptr. With SSE2, the first and
+           last bytes of the needle are compared against 16 candidate positions at once and only
+           the positions where both match are compared in full; the rest of the time memchr does
+           the scanning. Unlike strstr, this doesn't stop at an embedded NUL. */
+        static const char *findBytes(const char *haystack, const char *end, const char *needle, size_t needleLength) RX_NOEXCEPT {
+            if (needleLength == 0 || (size_t)(end - haystack) < needleLength) {
+                return nullptr;
+            }
+            const char *last = end - needleLength;
+#if defined(__SSE2__)
+            if (needleLength > 1) {
+                const __m128i first = _mm_set1_epi8(needle[0]);
+                const __m128i lastByte = _mm_set1_epi8(needle[needleLength - 1]);
+                while (last - haystack >= 15) {
+                    const __m128i starts = _mm_loadu_si128(reinterpret_cast<const __m128i *>(haystack));
+                    const __m128i ends = _mm_loadu_si128(reinterpret_cast<const __m128i *>(haystack + needleLength - 1));
+                    UInt32 mask = (UInt32)_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(starts, first),
+                                                                         _mm_cmpeq_epi8(ends, lastByte)));
+                    while (mask) {
+                        const char *candidate = haystack + __builtin_ctz(mask);
+                        if (memcmp(candidate + 1, needle + 1, needleLength - 2) == 0) {
+                            return candidate;
+                        }
+                        mask &= mask - 1;
+                    }
+                    haystack += 16;
+                }
+            }
+#endif
+            while (haystack <= last) {
+                haystack = static_cast<const char *>(memchr(haystack, needle[0], last - haystack + 1));
+                if (haystack == nullptr) {
+                    return nullptr;
+                }
+                if (memcmp(haystack + 1, needle + 1, needleLength - 1) == 0) {
+                    return haystack;
+                }
+                ++haystack;
+            }
+            return nullptr;
+        }
+    }
+}
+
 Array<Range> String::findResults(const String &separator, Range range) const RX_NOEXCEPT {
     Array<Range> ranges;
     if (range.location + range.length > length()) {
         return ranges;
     }
     auto separatorLength = separator.length();
-    if (range.length < separatorLength) {
+    if (range.length < separatorLength || separatorLength == 0) {
         return ranges;
     }
-    auto base = c_str();
+    auto base = data();
     auto current = base + range.location;
-    auto find = separator.c_str();
-    do {
-        auto result = strstr(current, find);
-        if (result != nullptr) {
-            Range range(result - base, separatorLength);
-            ranges.addObject(range);
-            current += range.location + range.length; // skip separator
-        } else {
-            break;
-        }
-    } while (1);
+    auto end = current + range.length;
+    auto find = separator.data();
+    while (auto result = detail::findBytes(current, end, find, separatorLength)) {
+        ranges.addObject(Range(result - base, separatorLength));
+        current = result + separatorLength; // skip separator
+    }
     return ranges;
 }
 
@@ -97,15 +144,14 @@ Array<String> String::componetsSeparatedByString(const String &separator) const
     Index startIndex = 0;
     Index numChars = 0;
     Array<String> array;
-    Range lastRange = ranges[count - 1];
-    array.reserve(count + (lastRange.location + lastRange.length < length ? 1 : 0));
+    array.reserve(count + 1);
     for (const Range &currentRange : ranges) {
         numChars = currentRange.location - startIndex;
         const String subString = substr(startIndex, numChars);
         array.addObject(subString);
         startIndex = currentRange.location + currentRange.length;
     }
-    const String subString = substr(startIndex, length - numChars);
+    const String subString = substr(startIndex, length - startIndex);
     array.addObject(subString);
     return array;
 }
@@ -116,9 +162,7 @@ bool String::hasPrefix(const String &value) const RX_NOEXCEPT {
     if (len < valueLen) {
         return false;
     }
-    return std::equal(begin(),
-                      begin() + valueLen,
-                      value.begin());
+    return memcmp(data(), value.data(), valueLen) == 0;
 }
 
 bool String::hasSuffix(const String &value) const RX_NOEXCEPT {
@@ -127,9 +171,7 @@ bool String::hasSuffix(const String &value) const RX_NOEXCEPT {
     if (len < valueLen) {
         return false;
     }
-    return std::equal(begin() + len - valueLen,
-                      end(),
-                      value.begin());
+    return memcmp(data() + len - valueLen, value.data(), valueLen) == 0;
 }
 
 String &String::appendFormat(const String &fmt, Integer reserved, ...) RX_NOEXCEPT {
@@ -149,11 +191,6 @@ namespace Rx {
     namespace detail {
         const UInt64 HashEverythingLimit = 96;
         
-#define HashNextFourUniChars(accessStart, accessEnd, pointer) \
-{result = result * 67503105 + (accessStart 0 accessEnd) * 16974593  + (accessStart 1 accessEnd) * 66049  + (accessStart 2 accessEnd) * 257 + (accessStart 3 accessEnd); pointer += 4;}
-        
-#define HashNextUniChar(accessStart, accessEnd, pointer) \
-{result = result * 257 + (accessStart 0 accessEnd); pointer++;}
         UniChar __CharToUniCharTable[256] = {
             0,   1,   2,   3,   4,   5,   6,   7,   8,   9,  10,  11,  12,  13,  14,  15,
             16,  17,  18,  19,  20,  21,  22,  23,  24,  25,  26,  27,  28,  29,  30,  31,
@@ -172,6 +209,94 @@ namespace Rx {
             224, 225, 226, 227, 228, 229, 230, 231, 232, 233, 234, 235, 236, 237, 238, 239,
             240, 241, 242, 243, 244, 245, 246, 247, 248, 249, 250, 251, 252, 253, 254, 255
         };
+        
+        static const constexpr HashCode HashFourMultiplier = 67503105;
+        static const constexpr HashCode HashFourMultiplier2 = HashFourMultiplier * HashFourMultiplier;
+        static const constexpr HashCode HashFourMultiplier3 = HashFourMultiplier2 * HashFourMultiplier;
+        static const constexpr HashCode HashFourMultiplier4 = HashFourMultiplier3 * HashFourMultiplier;
+        
+        /* bytes[0] * 257^3 + bytes[1] * 257^2 + bytes[2] * 257 + bytes[3]. The original macro computed the
+           first term in int, which wraps for bytes >= 0x7f and was then sign extended; keep those values by
+           wrapping explicitly in 32 bits. The rest is in Horner form: x * 257 is a shift and an add. */
+        RX_INLINE HashCode hashFourBytes(const uint8_t *bytes) RX_NOEXCEPT {
+            const HashCode high = (HashCode)(Int64)(Int32)((UInt32)bytes[0] * 16974593U);
+            HashCode lane = bytes[1];
+            lane = (lane << 8) + lane + bytes[2];
+            lane = (lane << 8) + lane + bytes[3];
+            return high + lane;
+        }
+        
+        /* Same value as four consecutive four-byte steps, but the four lanes are independent
+           and only meet in the final multiply-add, so they overlap in the pipeline.
+           __CharToUniCharTable is the identity on bytes, so lanes read the bytes directly. */
+        RX_INLINE HashCode hashSixteenBytes(HashCode result, const uint8_t *bytes) RX_NOEXCEPT {
+            const HashCode lane0 = hashFourBytes(bytes);
+            const HashCode lane1 = hashFourBytes(bytes + 4);
+            const HashCode lane2 = hashFourBytes(bytes + 8);
+            const HashCode lane3 = hashFourBytes(bytes + 12);
+            return result * HashFourMultiplier4 + lane0 * HashFourMultiplier3 + lane1 * HashFourMultiplier2 + lane2 * HashFourMultiplier + lane3;
+        }
+        
+        static HashCode hashBytes(HashCode result, const uint8_t *contents, const uint8_t *end) RX_NOEXCEPT {
+            while (contents + 16 <= end) {
+                result = hashSixteenBytes(result, contents);
+                contents += 16;
+            }
+            while (contents + 4 <= end) {
+                result = result * HashFourMultiplier + hashFourBytes(contents);
+                contents += 4;
+            }
+            while (contents < end) {
+                result = result * 257 + *contents++;
+            }
+            return result;
+        }
+        
+        struct InternedStringTableInfo {
+            static inline UInt64 getHashValue(const InternedStringEntry *entry) {
+                return (UInt64)entry->hash;
+            }
+            
+            static inline bool isEqual(const InternedStringEntry *lhs, const InternedStringEntry *rhs) {
+                return lhs->hash == rhs->hash && lhs->value == rhs->value;
+            }
+        };
+        
+        /* Entries are leaked on purpose: handles hold raw pointers and may outlive static destruction. */
+        class InternedStringTable {
+        public:
+            static InternedStringTable &shared() RX_NOEXCEPT {
+                static InternedStringTable *table = new InternedStringTable();
+                return *table;
+            }
+            
+            const InternedStringEntry *find(const String &value, bool insert) RX_NOEXCEPT {
+                const InternedStringEntry probe{value, value.hash(), 0};
+                const InternedStringEntry *probeEntry = &probe;
+                LockGuard<SpinLock> lock(_lock);
+                const auto lookup = IndexInfo::lookup(_entries.data(), probeEntry);
+                const auto it = _index.find_as(lookup);
+                if (it != _index.end()) {
+                    return _entries[it->getKey().position];
+                }
+                if (!insert) {
+                    return nullptr;
+                }
+                const UInt32 identifier = (UInt32)_entries.size();
+                _entries.push_back(new InternedStringEntry{value, probe.hash, identifier});
+                _index.insert(std::make_pair(HashIndexKey{identifier, lookup.hash}, HashIndexValue()));
+                return _entries.back();
+            }
+            
+        private:
+            typedef HashIndexInfo<const InternedStringEntry *, InternedStringTableInfo> IndexInfo;
+            
+            InternedStringTable() RX_NOEXCEPT : _lock("InternedStringTable") {}
+            
+            SpinLock _lock;
+            std::vector<const InternedStringEntry *> _entries;
+            HashIndex<const InternedStringEntry *, InternedStringTableInfo> _index;
+        };
     }
 }
 
@@ -180,25 +305,25 @@ HashCode String::hash() const RX_NOEXCEPT {
     HashCode len = length();
     HashCode result = len;
     if (len <= Rx::detail::HashEverythingLimit) {
-        const uint8_t *end4 = cContents + (len & ~3);
-        const uint8_t *end = cContents + len;
-        while (cContents < end4) HashNextFourUniChars(detail::__CharToUniCharTable[cContents[, ]], cContents); 	// First count in fours
-        while (cContents < end) HashNextUniChar(detail::__CharToUniCharTable[cContents[, ]], cContents);		// Then for the last <4 chars, count in ones...
+        result = detail::hashBytes(result, cContents, cContents + len);
     } else {
-        const uint8_t *contents, *end;
-        contents = cContents;
-        end = contents + 32;
-        while (contents < end) HashNextFourUniChars(detail::__CharToUniCharTable[contents[, ]], contents);
-        contents = cContents + (len >> 1) - 16;
-        end = contents + 32;
-        while (contents < end) HashNextFourUniChars(detail::__CharToUniCharTable[contents[, ]], contents);
-        end = cContents + len;
-        contents = end - 32;
-        while (contents < end) HashNextFourUniChars(detail::__CharToUniCharTable[contents[, ]], contents);
+        // Long strings hash the first, middle and last 32 bytes only.
+        const uint8_t *contents = cContents + (len >> 1) - 16;
+        result = detail::hashBytes(result, cContents, cContents + 32);
+        result = detail::hashBytes(result, contents, contents + 32);
+        result = detail::hashBytes(result, cContents + len - 32, cContents + len);
     }
     return result + (result << (len & 31));
 }
 
+InternedString::InternedString(const String &value) RX_NOEXCEPT :
+_entry(detail::InternedStringTable::shared().find(value, true)) {
+}
+
+InternedString InternedString::lookup(const String &value) RX_NOEXCEPT {
+    return InternedString(detail::InternedStringTable::shared().find(value, false));
+}
+
 Integer String::getIntegerValue() const RX_NOEXCEPT {
 #if __LP64__ || (TARGET_OS_EMBEDDED && !TARGET_OS_IPHONE) || TARGET_OS_WIN32 || NS_BUILD_32_LIKE_64
     return getLongValue();
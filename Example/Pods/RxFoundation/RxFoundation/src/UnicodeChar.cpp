@@ -21,6 +21,14 @@
 #include <mach-o/ldsyms.h>
 #endif
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+#include <cstring>
+
 using namespace Rx;
 
 namespace Rx {
@@ -214,7 +222,7 @@ namespace Rx {
             
             NumberOfBitmaps = headerSize / (sizeof(uint32_t) * 2);
             
-            array = Allocator::Default.allocate<BitmapData>(NumberOfBitmaps);
+            array = Allocator::getDefault().allocate<BitmapData>(NumberOfBitmaps);
             
             for (idx = 0;idx < (int)NumberOfBitmaps;idx++) {
                 bitmap = (uint8_t *)bitmapBase + SwapInt32BigToHost(*((uint32_t *)bytes)); bytes = (uint8_t *)bytes + sizeof(uint32_t);
@@ -226,7 +234,7 @@ namespace Rx {
                 
                 
 //                array[idx]._planes = (const uint8_t **)RSAllocatorAllocate(RSAllocatorSystemDefault, sizeof(const void *) * numPlanes);
-                array[idx]._planes = (const uint8_t **)(Allocator::Default.allocate<uint8_t *>(numPlanes));
+                array[idx]._planes = (const uint8_t **)(Allocator::getDefault().allocate<uint8_t *>(numPlanes));
                 array[idx]._numPlanes = numPlanes;
                 
                 currentPlane = 0;
@@ -321,3 +329,300 @@ bool UnicodeChar::isMemberOf(uint32_t charset) const RX_NOEXCEPT {
 void UnicodeChar::addCharacterToBitmap(uint8_t *bitmap) const RX_NOEXCEPT {
     bitmap[(_character) >> BitShiftForByte] |= (((uint32_t)1) << (_character & BitShiftForMask));
 }
+
+namespace Rx {
+    namespace detail {
+        // Blocks of 16 bytes or 8 UTF-16 units. The masks returned by
+        // unitsInRange() have 1 << UnitMaskShift bits per unit.
+#if defined(__SSE2__)
+        static constexpr const int UnitMaskShift = 1;
+        
+        RX_INLINE_VISIBILITY bool isASCIIBlock(const UTF8Char *bytes) RX_NOEXCEPT {
+            return _mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(bytes))) == 0;
+        }
+        
+        RX_INLINE_VISIBILITY void widenASCIIBlock(const UTF8Char *bytes, UTF16Char *characters) RX_NOEXCEPT {
+            const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(bytes));
+            const __m128i zero = _mm_setzero_si128();
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(characters), _mm_unpacklo_epi8(block, zero));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(characters + 8), _mm_unpackhi_epi8(block, zero));
+        }
+        
+        RX_INLINE_VISIBILITY bool isASCIIUnits(const UTF16Char *characters) RX_NOEXCEPT {
+            const __m128i units = _mm_loadu_si128(reinterpret_cast<const __m128i *>(characters));
+            const __m128i high = _mm_and_si128(units, _mm_set1_epi16((short)0xFF80));
+            return _mm_movemask_epi8(_mm_cmpeq_epi16(high, _mm_setzero_si128())) == 0xFFFF;
+        }
+        
+        RX_INLINE_VISIBILITY void narrowASCIIUnits(const UTF16Char *characters, UTF8Char *bytes) RX_NOEXCEPT {
+            const __m128i units = _mm_loadu_si128(reinterpret_cast<const __m128i *>(characters));
+            _mm_storel_epi64(reinterpret_cast<__m128i *>(bytes), _mm_packus_epi16(units, units));
+        }
+        
+        // Only valid for ASCII units, as the comparisons are signed
+        RX_INLINE_VISIBILITY UInt64 unitsInRange(const UTF16Char *characters, UTF16Char low, UTF16Char high) RX_NOEXCEPT {
+            const __m128i units = _mm_loadu_si128(reinterpret_cast<const __m128i *>(characters));
+            const __m128i inRange = _mm_and_si128(_mm_cmpgt_epi16(units, _mm_set1_epi16((short)(low - 1))),
+                                                  _mm_cmplt_epi16(units, _mm_set1_epi16((short)(high + 1))));
+            return (UInt64)_mm_movemask_epi8(inRange);
+        }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+        static constexpr const int UnitMaskShift = 3;
+        
+        RX_INLINE_VISIBILITY bool isASCIIBlock(const UTF8Char *bytes) RX_NOEXCEPT {
+            return vmaxvq_u8(vld1q_u8(bytes)) < 0x80;
+        }
+        
+        RX_INLINE_VISIBILITY void widenASCIIBlock(const UTF8Char *bytes, UTF16Char *characters) RX_NOEXCEPT {
+            const uint8x16_t block = vld1q_u8(bytes);
+            vst1q_u16(characters, vmovl_u8(vget_low_u8(block)));
+            vst1q_u16(characters + 8, vmovl_high_u8(block));
+        }
+        
+        RX_INLINE_VISIBILITY bool isASCIIUnits(const UTF16Char *characters) RX_NOEXCEPT {
+            return vmaxvq_u16(vld1q_u16(characters)) < 0x80;
+        }
+        
+        RX_INLINE_VISIBILITY void narrowASCIIUnits(const UTF16Char *characters, UTF8Char *bytes) RX_NOEXCEPT {
+            vst1_u8(bytes, vmovn_u16(vld1q_u16(characters)));
+        }
+        
+        RX_INLINE_VISIBILITY UInt64 unitsInRange(const UTF16Char *characters, UTF16Char low, UTF16Char high) RX_NOEXCEPT {
+            const uint16x8_t units = vld1q_u16(characters);
+            const uint16x8_t inRange = vandq_u16(vcgeq_u16(units, vdupq_n_u16(low)), vcleq_u16(units, vdupq_n_u16(high)));
+            return vget_lane_u64(vreinterpret_u64_u8(vmovn_u16(inRange)), 0);
+        }
+#else
+        // Portable fallback working a 64-bit word at a time where it can
+        static constexpr const int UnitMaskShift = 0;
+        
+        RX_INLINE_VISIBILITY bool isASCIIBlock(const UTF8Char *bytes) RX_NOEXCEPT {
+            UInt64 words[2];
+            memcpy(words, bytes, sizeof(words));
+            return ((words[0] | words[1]) & 0x8080808080808080ULL) == 0;
+        }
+        
+        RX_INLINE_VISIBILITY void widenASCIIBlock(const UTF8Char *bytes, UTF16Char *characters) RX_NOEXCEPT {
+            for (int idx = 0; idx < 16; ++idx) {
+                characters[idx] = bytes[idx];
+            }
+        }
+        
+        RX_INLINE_VISIBILITY bool isASCIIUnits(const UTF16Char *characters) RX_NOEXCEPT {
+            UInt64 words[2];
+            memcpy(words, characters, sizeof(words));
+            return ((words[0] | words[1]) & 0xFF80FF80FF80FF80ULL) == 0;
+        }
+        
+        RX_INLINE_VISIBILITY void narrowASCIIUnits(const UTF16Char *characters, UTF8Char *bytes) RX_NOEXCEPT {
+            for (int idx = 0; idx < 8; ++idx) {
+                bytes[idx] = (UTF8Char)characters[idx];
+            }
+        }
+        
+        RX_INLINE_VISIBILITY UInt64 unitsInRange(const UTF16Char *characters, UTF16Char low, UTF16Char high) RX_NOEXCEPT {
+            UInt64 mask = 0;
+            for (int idx = 0; idx < 8; ++idx) {
+                mask |= (UInt64)(characters[idx] >= low && characters[idx] <= high) << idx;
+            }
+            return mask;
+        }
+#endif
+        
+        // Decodes the sequence at the start of bytes, returning its length, or 0
+        // if it's truncated, overlong, a surrogate or out of range
+        static UInteger decodeUTF8(const UTF8Char *bytes, const UTF8Char *end, UTF32Char *character) RX_NOEXCEPT {
+            const UTF8Char lead = bytes[0];
+            if (lead < 0x80) {
+                *character = lead;
+                return 1;
+            }
+            
+            UInteger length;
+            UTF32Char value, minimum;
+            if ((lead & 0xE0) == 0xC0) {
+                length = 2; value = lead & 0x1F; minimum = 0x80;
+            } else if ((lead & 0xF0) == 0xE0) {
+                length = 3; value = lead & 0x0F; minimum = 0x800;
+            } else if ((lead & 0xF8) == 0xF0) {
+                length = 4; value = lead & 0x07; minimum = 0x10000;
+            } else {
+                return 0;
+            }
+            if ((UInteger)(end - bytes) < length) {
+                return 0;
+            }
+            
+            for (UInteger idx = 1; idx < length; ++idx) {
+                if ((bytes[idx] & 0xC0) != 0x80) {
+                    return 0;
+                }
+                value = (value << 6) | (bytes[idx] & 0x3F);
+            }
+            if (value < minimum || value > 0x10FFFF || (value >= 0xD800 && value <= 0xDFFF)) {
+                return 0;
+            }
+            *character = value;
+            return length;
+        }
+        
+        // The ASCII members of the sets findFirstMemberOf() classifies in bulk,
+        // as up to two ranges each
+        struct ASCIIRanges {
+            UTF16Char low1, high1, low2, high2;
+        };
+        
+        static bool getASCIIRanges(uint32_t charset, ASCIIRanges *ranges) RX_NOEXCEPT {
+            switch (charset) {
+                case UnicodeChar::WhitespaceCharacterSet:
+                    *ranges = {0x09, 0x09, 0x20, 0x20};
+                    return true;
+                case UnicodeChar::WhitespaceAndNewlineCharacterSet:
+                    *ranges = {0x09, 0x0D, 0x20, 0x20};
+                    return true;
+                case UnicodeChar::NewlineCharacterSet:
+                    *ranges = {0x0A, 0x0D, 0x01, 0x00};
+                    return true;
+                case UnicodeChar::DecimalDigitCharacterSet:
+                    // Digits come from the bitmaps in isMemberOf(), so only take
+                    // the bulk path when it would find them there too
+                    if (nullptr == BitmapDataArray) LoadBitmapData();
+                    if (nullptr == BitmapDataArray) {
+                        return false;
+                    }
+                    *ranges = {0x30, 0x39, 0x01, 0x00};
+                    return true;
+                default:
+                    return false;
+            }
+        }
+    }
+}
+
+bool UnicodeChar::isASCII(const UTF8Char *bytes, UInteger length) RX_NOEXCEPT {
+    UInteger idx = 0;
+    for (; idx + 16 <= length; idx += 16) {
+        if (!detail::isASCIIBlock(bytes + idx)) {
+            return false;
+        }
+    }
+    for (; idx < length; ++idx) {
+        if (bytes[idx] >= 0x80) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool UnicodeChar::isValidUTF8(const UTF8Char *bytes, UInteger length) RX_NOEXCEPT {
+    const UTF8Char *end = bytes + length;
+    while (bytes < end) {
+        if (*bytes < 0x80 && end - bytes >= 16 && detail::isASCIIBlock(bytes)) {
+            bytes += 16;
+            continue;
+        }
+        UTF32Char character;
+        UInteger sequenceLength = detail::decodeUTF8(bytes, end, &character);
+        if (!sequenceLength) {
+            return false;
+        }
+        bytes += sequenceLength;
+    }
+    return true;
+}
+
+UInteger UnicodeChar::convertUTF8ToUTF16(const UTF8Char *bytes, UInteger length, UTF16Char *characters) RX_NOEXCEPT {
+    const UTF8Char *end = bytes + length;
+    UTF16Char *output = characters;
+    while (bytes < end) {
+        if (*bytes < 0x80 && end - bytes >= 16 && detail::isASCIIBlock(bytes)) {
+            detail::widenASCIIBlock(bytes, output);
+            bytes += 16;
+            output += 16;
+            continue;
+        }
+        UTF32Char character;
+        UInteger sequenceLength = detail::decodeUTF8(bytes, end, &character);
+        if (!sequenceLength) {
+            return NotFound;
+        }
+        bytes += sequenceLength;
+        if (character >= 0x10000) {
+            character -= 0x10000;
+            *output++ = (UTF16Char)(0xD800 + (character >> 10));
+            *output++ = (UTF16Char)(0xDC00 + (character & 0x3FF));
+        } else {
+            *output++ = (UTF16Char)character;
+        }
+    }
+    return output - characters;
+}
+
+UInteger UnicodeChar::convertUTF16ToUTF8(const UTF16Char *characters, UInteger length, UTF8Char *bytes) RX_NOEXCEPT {
+    UTF8Char *output = bytes;
+    UInteger idx = 0;
+    while (idx < length) {
+        if (characters[idx] < 0x80 && idx + 8 <= length && detail::isASCIIUnits(characters + idx)) {
+            detail::narrowASCIIUnits(characters + idx, output);
+            idx += 8;
+            output += 8;
+            continue;
+        }
+        
+        UnicodeChar character(characters[idx++]);
+        UTF32Char value = character;
+        if (character.isSurrogateHighCharacter()) {
+            if (idx == length || !UnicodeChar(characters[idx]).isSurrogateLowCharacter()) {
+                return NotFound;
+            }
+            value = getLongCharacterForSurrogatePair(character, UnicodeChar(characters[idx++]));
+        } else if (character.isSurrogateLowCharacter()) {
+            return NotFound;
+        }
+        
+        if (value < 0x80) {
+            *output++ = (UTF8Char)value;
+        } else if (value < 0x800) {
+            *output++ = (UTF8Char)(0xC0 | (value >> 6));
+            *output++ = (UTF8Char)(0x80 | (value & 0x3F));
+        } else if (value < 0x10000) {
+            *output++ = (UTF8Char)(0xE0 | (value >> 12));
+            *output++ = (UTF8Char)(0x80 | ((value >> 6) & 0x3F));
+            *output++ = (UTF8Char)(0x80 | (value & 0x3F));
+        } else {
+            *output++ = (UTF8Char)(0xF0 | (value >> 18));
+            *output++ = (UTF8Char)(0x80 | ((value >> 12) & 0x3F));
+            *output++ = (UTF8Char)(0x80 | ((value >> 6) & 0x3F));
+            *output++ = (UTF8Char)(0x80 | (value & 0x3F));
+        }
+    }
+    return output - bytes;
+}
+
+UInteger UnicodeChar::findFirstMemberOf(uint32_t charset, const UTF16Char *characters, UInteger length) RX_NOEXCEPT {
+    UInteger idx = 0;
+    detail::ASCIIRanges ranges;
+    if (detail::getASCIIRanges(charset, &ranges)) {
+        for (; idx + 8 <= length; idx += 8) {
+            if (!detail::isASCIIUnits(characters + idx)) {
+                for (UInteger unit = idx; unit < idx + 8; ++unit) {
+                    if (UnicodeChar(characters[unit]).isMemberOf(charset)) {
+                        return unit;
+                    }
+                }
+                continue;
+            }
+            UInt64 mask = detail::unitsInRange(characters + idx, ranges.low1, ranges.high1) |
+                          detail::unitsInRange(characters + idx, ranges.low2, ranges.high2);
+            if (mask) {
+                return idx + (__builtin_ctzll(mask) >> detail::UnitMaskShift);
+            }
+        }
+    }
+    for (; idx < length; ++idx) {
+        if (UnicodeChar(characters[idx]).isMemberOf(charset)) {
+            return idx;
+        }
+    }
+    return NotFound;
+}
@@ -0,0 +1,158 @@
+//
+//  AggregateNotifierTests.mm
+//  CrashRealmTests
+//
+//  Copyright (c) 2019 retval. All rights reserved.
+//
+
+#include "ObjectStoreTestSupport.hpp"
+
+#include "results.hpp"
+
+#include <realm/table.hpp>
+
+#include <random>
+
+@import XCTest;
+
+namespace {
+    using namespace ObjectStoreTestSupport;
+
+    constexpr size_t AggregateTestValueColumn = 0;
+    constexpr size_t AggregateTestCountColumn = 1;
+    constexpr size_t AggregateTestTransactions = 100;
+
+    realm::Schema aggregateTestSchema() {
+        return realm::Schema{
+            {"object", {
+                {"value", realm::PropertyType::Double},
+                {"count", realm::PropertyType::Int},
+            }},
+        };
+    }
+
+    bool sameValue(const realm::util::Optional<realm::Mixed> &a, const realm::util::Optional<realm::Mixed> &b) {
+        if (!a || !b) {
+            return !a == !b;
+        }
+        if (a->get_type() != b->get_type()) {
+            return false;
+        }
+        switch (a->get_type()) {
+            case realm::type_Int: return a->get_int() == b->get_int();
+            case realm::type_Float: return a->get_float() == b->get_float();
+            case realm::type_Double: return a->get_double() == b->get_double();
+            default: return false;
+        }
+    }
+
+    bool sameAggregates(const realm::Results::Aggregates &a, const realm::Results::Aggregates &b) {
+        return a.count == b.count && sameValue(a.min, b.min) && sameValue(a.max, b.max)
+            && sameValue(a.sum, b.sum) && a.average == b.average;
+    }
+
+    /// Aggregates of column calculated from scratch by a new notifier.
+    realm::Results::Aggregates recalculate(realm::SharedRealm &realm, realm::Query query, size_t column) {
+        realm::Results results(realm, std::move(query));
+        realm::Results::Aggregates aggregates;
+        auto token = results.add_aggregate_callback(column, [&](auto const &values, std::exception_ptr) {
+            aggregates = values;
+        });
+        advanceAndNotify(*realm);
+        return aggregates;
+    }
+
+    /// Values far apart in magnitude, so that removing the large ones by
+    /// subtraction would leave their rounding error in a floating point sum.
+    double makeValue(std::mt19937 &rng) {
+        std::uniform_int_distribution<int> kind(0, 3);
+        std::uniform_real_distribution<double> small(-1.0, 1.0);
+        return kind(rng) == 0 ? 1e16 + small(rng) * 1e3 : small(rng);
+    }
+
+    /// One transaction of inserts, deletes and modifications, some of which
+    /// move rows in and out of the query.
+    void mutate(realm::Table &table, std::mt19937 &rng) {
+        std::uniform_int_distribution<int64_t> count(0, 20);
+        mutateRows(table, rng, [&](size_t row, bool) {
+            table.set_double(AggregateTestValueColumn, row, makeValue(rng));
+            table.set_int(AggregateTestCountColumn, row, count(rng));
+        });
+    }
+}
+
+@interface AggregateNotifierTests : XCTestCase
+
+@end
+
+@implementation AggregateNotifierTests
+
+- (void)testIncrementalAggregatesMatchRecalculation
+{
+    auto realm = openRealm(aggregateTestSchema());
+    auto table = tableFor(*realm, "object");
+    auto query = table->where().greater_equal(AggregateTestCountColumn, 10);
+
+    std::mt19937 rng(42);
+    realm->begin_transaction();
+    for (int i = 0; i < 20; ++i) {
+        mutate(*table, rng);
+    }
+    realm->commit_transaction();
+
+    realm::Results results(realm, query);
+    realm::Results::Aggregates values, counts;
+    auto valuesToken = results.add_aggregate_callback(AggregateTestValueColumn, [&](auto const &aggregates, std::exception_ptr) {
+        values = aggregates;
+    });
+    auto countsToken = results.add_aggregate_callback(AggregateTestCountColumn, [&](auto const &aggregates, std::exception_ptr) {
+        counts = aggregates;
+    });
+    advanceAndNotify(*realm);
+
+    for (size_t i = 0; i < AggregateTestTransactions; ++i) {
+        realm->begin_transaction();
+        mutate(*table, rng);
+        realm->commit_transaction();
+        advanceAndNotify(*realm);
+
+        XCTAssertTrue(sameAggregates(values, recalculate(realm, query, AggregateTestValueColumn)), @"transaction %zu", i);
+        XCTAssertTrue(sameAggregates(counts, recalculate(realm, query, AggregateTestCountColumn)), @"transaction %zu", i);
+    }
+}
+
+- (void)testRemovingLargeValuesLeavesExactSum
+{
+    auto realm = openRealm(aggregateTestSchema());
+    auto table = tableFor(*realm, "object");
+
+    realm->begin_transaction();
+    for (size_t i = 0; i < 8; ++i) {
+        size_t row = table->add_empty_row();
+        table->set_double(AggregateTestValueColumn, row, i % 2 ? 0.1 : 1e17);
+    }
+    realm->commit_transaction();
+
+    realm::Results results(realm, *table);
+    realm::Results::Aggregates values;
+    auto token = results.add_aggregate_callback(AggregateTestValueColumn, [&](auto const &aggregates, std::exception_ptr) {
+        values = aggregates;
+    });
+    advanceAndNotify(*realm);
+
+    // Remove the large values, which were added to the sum first
+    realm->begin_transaction();
+    for (size_t i = 8; i-- > 0;) {
+        if (i % 2 == 0) {
+            table->move_last_over(i);
+        }
+    }
+    realm->commit_transaction();
+    advanceAndNotify(*realm);
+
+    XCTAssertEqual(values.count, 4U);
+    XCTAssertTrue(sameAggregates(values, recalculate(realm, table->where(), AggregateTestValueColumn)));
+    XCTAssertEqualWithAccuracy(values.sum->get_double(), 0.4, 1e-15);
+}
+
+@end
@@ -0,0 +1,138 @@
+//
+//  AllocatorBenchmarkTests.mm
+//  CrashRealmTests
+//
+//  Copyright (c) 2019 retval. All rights reserved.
+//
+
+#include <RxFoundation/Allocator.hpp>
+
+#include <algorithm>
+#include <random>
+#include <thread>
+#include <vector>
+
+@import XCTest;
+
+namespace {
+    constexpr size_t AllocatorBenchmarkIterations = 1000000;
+    constexpr size_t AllocatorBenchmarkLiveBlocks = 4096;
+    constexpr size_t AllocatorBenchmarkThreads = 4;
+
+    /// Sizes skewed towards small blocks, as the notifier and container code asks for.
+    std::vector<size_t> makeSizes(size_t count) {
+        std::mt19937 rng(42);
+        std::geometric_distribution<size_t> small(1.0 / 48);
+        std::vector<size_t> sizes(count);
+        for (auto &size : sizes) {
+            size = std::min(8 + small(rng), size_t(Rx::PoolAllocator::MaxPooledSize));
+        }
+        return sizes;
+    }
+
+    /// Keeps a window of live blocks and replaces one per iteration, so every
+    /// iteration is one allocation and one deallocation of a different size.
+    void churn(Rx::Allocator &allocator, const std::vector<size_t> &sizes, size_t iterations) {
+        std::vector<void *> blocks(AllocatorBenchmarkLiveBlocks, nullptr);
+        std::vector<size_t> blockSizes(AllocatorBenchmarkLiveBlocks, 0);
+        for (size_t i = 0; i < iterations; ++i) {
+            const size_t slot = i % AllocatorBenchmarkLiveBlocks;
+            if (blocks[slot]) {
+                allocator.deallocateBytes(blocks[slot], blockSizes[slot]);
+            }
+            blockSizes[slot] = sizes[i % sizes.size()];
+            blocks[slot] = allocator.allocateBytes(blockSizes[slot]);
+            *static_cast<char *>(blocks[slot]) = (char)i;
+        }
+        for (size_t slot = 0; slot < AllocatorBenchmarkLiveBlocks; ++slot) {
+            if (blocks[slot]) {
+                allocator.deallocateBytes(blocks[slot], blockSizes[slot]);
+            }
+        }
+    }
+
+    /// Returns the bytes still in use once the threads are gone. Their magazines
+    /// hand back blocks and counts on thread exit, so this must be zero.
+    size_t churnConcurrently(Rx::Allocator &allocator, const std::vector<size_t> &sizes, size_t iterations) {
+        std::vector<std::thread> threads;
+        for (size_t t = 0; t < AllocatorBenchmarkThreads; ++t) {
+            threads.emplace_back([&] {
+                churn(allocator, sizes, iterations);
+            });
+        }
+        for (auto &thread : threads) {
+            thread.join();
+        }
+        const auto statistics = allocator.getStatistics();
+        return statistics.bytesInUse;
+    }
+
+    /// The arena frees nothing until reset, so it gets the allocation half of the pattern.
+    void fillArena(Rx::ArenaAllocator &arena, const std::vector<size_t> &sizes, size_t iterations) {
+        for (size_t i = 0; i < iterations; ++i) {
+            *static_cast<char *>(arena.allocateBytes(sizes[i % sizes.size()])) = (char)i;
+            if (i % AllocatorBenchmarkLiveBlocks == AllocatorBenchmarkLiveBlocks - 1) {
+                arena.reset();
+            }
+        }
+        arena.reset();
+    }
+}
+
+@interface AllocatorBenchmarkTests : XCTestCase
+
+@end
+
+@implementation AllocatorBenchmarkTests
+
+- (void)testPoolChurnPerformance
+{
+    std::vector<size_t> input = makeSizes(AllocatorBenchmarkLiveBlocks * 4);
+    const std::vector<size_t> *sizes = &input;
+    [self measureBlock:^{
+        Rx::PoolAllocator pool;
+        churn(pool, *sizes, AllocatorBenchmarkIterations);
+    }];
+}
+
+- (void)testSystemChurnReference
+{
+    std::vector<size_t> input = makeSizes(AllocatorBenchmarkLiveBlocks * 4);
+    const std::vector<size_t> *sizes = &input;
+    [self measureBlock:^{
+        churn(Rx::Allocator::getDefault(), *sizes, AllocatorBenchmarkIterations);
+    }];
+}
+
+- (void)testPoolConcurrentChurnPerformance
+{
+    std::vector<size_t> input = makeSizes(AllocatorBenchmarkLiveBlocks * 4);
+    const std::vector<size_t> *sizes = &input;
+    [self measureBlock:^{
+        Rx::PoolAllocator pool;
+        XCTAssertEqual(churnConcurrently(pool, *sizes, AllocatorBenchmarkIterations / AllocatorBenchmarkThreads), 0U);
+    }];
+}
+
+- (void)testSystemConcurrentChurnReference
+{
+    std::vector<size_t> input = makeSizes(AllocatorBenchmarkLiveBlocks * 4);
+    const std::vector<size_t> *sizes = &input;
+    [self measureBlock:^{
+        // The system allocator keeps no counters, so this only times the work.
+        XCTAssertEqual(churnConcurrently(Rx::Allocator::getDefault(), *sizes, AllocatorBenchmarkIterations / AllocatorBenchmarkThreads), 0U);
+    }];
+}
+
+- (void)testArenaFillPerformance
+{
+    std::vector<size_t> input = makeSizes(AllocatorBenchmarkLiveBlocks * 4);
+    const std::vector<size_t> *sizes = &input;
+    [self measureBlock:^{
+        Rx::ArenaAllocator arena;
+        fillArena(arena, *sizes, AllocatorBenchmarkIterations);
+        XCTAssertEqual(arena.getStatistics().bytesInUse, 0U);
+    }];
+}
+
+@end
@@ -0,0 +1,135 @@
+//
+//  AnyBenchmarkTests.mm
+//  CrashRealmTests
+//
+//  Copyright (c) 2019 retval. All rights reserved.
+//
+
+#include <RxFoundation/Any.hpp>
+
+#include <string>
+#include <vector>
+
+// std::any needs C++17, which this file alone is built with (see its compiler
+// flags in the project). Only the pointer form of std::any_cast is used below:
+// the throwing forms need bad_any_cast from the iOS 12 runtime.
+#if __cplusplus >= 201703L && __has_include(<any>)
+#include <any>
+#define ANY_BENCHMARK_HAS_STD_ANY 1
+#else
+#define ANY_BENCHMARK_HAS_STD_ANY 0
+#endif
+
+@import XCTest;
+
+namespace {
+    constexpr size_t AnyBenchmarkIterations = 1000000;
+    constexpr size_t AnyBenchmarkLiveValues = 1024;
+
+    struct RxAnyAdapter {
+        using Value = Rx::Any;
+        template <typename T>
+        static const T *get(const Value &value) { return value.isKindOf<T>(); }
+    };
+
+#if ANY_BENCHMARK_HAS_STD_ANY
+    /// The standard library's any, as a reference point for the numbers above.
+    struct StdAnyAdapter {
+        using Value = std::any;
+        template <typename T>
+        static const T *get(const Value &value) { return std::any_cast<T>(&value); }
+    };
+#endif
+
+    /// Stores, copies and reads back a value per iteration, the pattern of a
+    /// KVO change carrying its old and new values. Returns the sum of what was
+    /// read so that none of it can be skipped.
+    template <typename Adapter, typename T, typename Read>
+    size_t storeCopyRead(const std::vector<T> &inputs, size_t iterations, Read read) {
+        using Value = typename Adapter::Value;
+        std::vector<Value> values(AnyBenchmarkLiveValues);
+        size_t total = 0;
+        for (size_t i = 0; i < iterations; ++i) {
+            const size_t slot = i % AnyBenchmarkLiveValues;
+            values[slot] = Value(inputs[i % inputs.size()]);
+            Value copy = values[slot];
+            if (const T *value = Adapter::template get<T>(copy)) {
+                total += read(*value);
+            }
+        }
+        return total;
+    }
+
+    std::vector<Rx::Int64> makeIntegers() {
+        std::vector<Rx::Int64> integers(AnyBenchmarkLiveValues);
+        for (size_t i = 0; i < integers.size(); ++i) integers[i] = (Rx::Int64)(i * 2654435761U);
+        return integers;
+    }
+
+    /// Too long for a small string buffer, so both kinds of any hold them on the heap.
+    std::vector<std::string> makeStrings() {
+        std::vector<std::string> strings(AnyBenchmarkLiveValues);
+        for (size_t i = 0; i < strings.size(); ++i) strings[i] = "key.path.for.value." + std::to_string(i) + ".which.is.long";
+        return strings;
+    }
+
+    size_t readInteger(const Rx::Int64 &value) { return (size_t)value; }
+    size_t readString(const std::string &value) { return value.size(); }
+
+    template <typename T>
+    size_t expectedTotal(const std::vector<T> &inputs, size_t iterations, size_t (*read)(const T &)) {
+        size_t total = 0;
+        for (size_t i = 0; i < iterations; ++i) total += read(inputs[i % inputs.size()]);
+        return total;
+    }
+}
+
+@interface AnyBenchmarkTests : XCTestCase
+
+@end
+
+@implementation AnyBenchmarkTests
+
+- (void)testInlineValuePerformance
+{
+    std::vector<Rx::Int64> input = makeIntegers();
+    const std::vector<Rx::Int64> *integers = &input;
+    const size_t expected = expectedTotal(input, AnyBenchmarkIterations, readInteger);
+    [self measureBlock:^{
+        XCTAssertEqual(storeCopyRead<RxAnyAdapter>(*integers, AnyBenchmarkIterations, readInteger), expected);
+    }];
+}
+
+- (void)testHeapValuePerformance
+{
+    std::vector<std::string> input = makeStrings();
+    const std::vector<std::string> *strings = &input;
+    const size_t expected = expectedTotal(input, AnyBenchmarkIterations, readString);
+    [self measureBlock:^{
+        XCTAssertEqual(storeCopyRead<RxAnyAdapter>(*strings, AnyBenchmarkIterations, readString), expected);
+    }];
+}
+
+#if ANY_BENCHMARK_HAS_STD_ANY
+- (void)testInlineValueStdAnyReference
+{
+    std::vector<Rx::Int64> input = makeIntegers();
+    const std::vector<Rx::Int64> *integers = &input;
+    const size_t expected = expectedTotal(input, AnyBenchmarkIterations, readInteger);
+    [self measureBlock:^{
+        XCTAssertEqual(storeCopyRead<StdAnyAdapter>(*integers, AnyBenchmarkIterations, readInteger), expected);
+    }];
+}
+
+- (void)testHeapValueStdAnyReference
+{
+    std::vector<std::string> input = makeStrings();
+    const std::vector<std::string> *strings = &input;
+    const size_t expected = expectedTotal(input, AnyBenchmarkIterations, readString);
+    [self measureBlock:^{
+        XCTAssertEqual(storeCopyRead<StdAnyAdapter>(*strings, AnyBenchmarkIterations, readString), expected);
+    }];
+}
+#endif
+
+@end
@@ -0,0 +1,182 @@
+//
+//  CallbackTokenTests.mm
+//  CrashRealmTests
+//
+//  Copyright (c) 2019 retval. All rights reserved.
+//
+
+#include "ObjectStoreTestSupport.hpp"
+
+#include <functional>
+#include <map>
+
+@import XCTest;
+
+namespace {
+    using namespace ObjectStoreTestSupport;
+
+    constexpr size_t CallbackTestCount = 64;
+    constexpr size_t CallbackTestRounds = 50;
+
+    /// Callbacks on one Results which record the order they're called in.
+    class CallbackRecorder {
+    public:
+        explicit CallbackRecorder(realm::Results &results) : _results(results) { }
+
+        /// Adds a callback and returns its id, which takeCalled() reports in
+        /// the order the callbacks are called.
+        size_t add() {
+            size_t id = _nextId++;
+            _tokens[id] = _results.add_notification_callback([this, id](realm::CollectionChangeSet const &, std::exception_ptr) {
+                _called.push_back(id);
+                auto action = _actions.find(id);
+                if (action != _actions.end()) {
+                    action->second();
+                }
+            });
+            return id;
+        }
+
+        void remove(size_t id) { _tokens.erase(id); }
+
+        /// Something for a callback to do when it's called.
+        void onCall(size_t id, std::function<void()> action) { _actions[id] = std::move(action); }
+
+        /// The ids of the registered callbacks, in registration order.
+        std::vector<size_t> registered() const {
+            std::vector<size_t> ids;
+            for (auto &token : _tokens) {
+                ids.push_back(token.first);
+            }
+            return ids;
+        }
+
+        /// The callbacks called since the last call of this.
+        std::vector<size_t> takeCalled() {
+            std::vector<size_t> called;
+            called.swap(_called);
+            return called;
+        }
+
+    private:
+        realm::Results &_results;
+        std::map<size_t, realm::NotificationToken> _tokens;
+        std::map<size_t, std::function<void()>> _actions;
+        std::vector<size_t> _called;
+        size_t _nextId = 0;
+    };
+
+    /// Commits a new object, so that every callback on the table has changes
+    /// to be called with.
+    void addObject(realm::SharedRealm &realm, realm::Table &table, int64_t &nextId) {
+        realm->begin_transaction();
+        size_t row = table.add_empty_row();
+        table.set_int(ObjectTestIdColumn, row, nextId++);
+        realm->commit_transaction();
+    }
+}
+
+@interface CallbackTokenTests : XCTestCase
+
+@end
+
+@implementation CallbackTokenTests
+
+- (void)testCallbacksAreCalledInRegistrationOrderAfterRemovals
+{
+    auto realm = openRealm(objectTestSchema());
+    auto table = tableFor(*realm, "object");
+    int64_t nextId = 0;
+
+    realm::Results results(realm, *table);
+    CallbackRecorder recorder(results);
+    for (size_t i = 0; i < CallbackTestCount; ++i) {
+        recorder.add();
+    }
+    advanceAndNotify(*realm);
+    XCTAssertTrue(recorder.takeCalled() == recorder.registered());
+
+    // Remove enough for the removed callbacks to be compacted away, then reuse their tokens
+    for (size_t i = 0; i < CallbackTestCount; ++i) {
+        if (i % 3) {
+            recorder.remove(i);
+        }
+    }
+    for (size_t i = 0; i < CallbackTestCount / 4; ++i) {
+        recorder.add();
+    }
+    addObject(realm, *table, nextId);
+    advanceAndNotify(*realm);
+    XCTAssertTrue(recorder.takeCalled() == recorder.registered());
+}
+
+- (void)testRemovingAndAddingCallbacksDuringDelivery
+{
+    auto realm = openRealm(objectTestSchema());
+    auto table = tableFor(*realm, "object");
+    int64_t nextId = 0;
+
+    realm::Results results(realm, *table);
+    CallbackRecorder recorder(results);
+    size_t first = recorder.add();
+    size_t second = recorder.add();
+    size_t third = recorder.add();
+    size_t fourth = recorder.add();
+    advanceAndNotify(*realm);
+    recorder.takeCalled();
+
+    // The first callback removes itself and the third, and the second adds
+    // one which isn't called until the next delivery
+    size_t added = 0;
+    recorder.onCall(first, [&] {
+        recorder.remove(first);
+        recorder.remove(third);
+    });
+    recorder.onCall(second, [&] {
+        if (!added) {
+            added = recorder.add();
+        }
+    });
+    addObject(realm, *table, nextId);
+    advanceAndNotify(*realm);
+    XCTAssertTrue(recorder.takeCalled() == (std::vector<size_t>{first, second, fourth}));
+
+    addObject(realm, *table, nextId);
+    advanceAndNotify(*realm);
+    XCTAssertTrue(recorder.takeCalled() == (std::vector<size_t>{second, fourth, added}));
+}
+
+- (void)testRandomlyAddedAndRemovedCallbacks
+{
+    auto realm = openRealm(objectTestSchema());
+    auto table = tableFor(*realm, "object");
+    int64_t nextId = 0;
+    std::mt19937 rng(42);
+
+    realm::Results results(realm, *table);
+    CallbackRecorder recorder(results);
+    for (size_t i = 0; i < CallbackTestCount; ++i) {
+        recorder.add();
+    }
+    advanceAndNotify(*realm);
+    recorder.takeCalled();
+
+    for (size_t round = 0; round < CallbackTestRounds; ++round) {
+        std::uniform_int_distribution<size_t> changes(0, CallbackTestCount / 2);
+        for (size_t i = changes(rng); i > 0; --i) {
+            auto registered = recorder.registered();
+            if (!registered.empty()) {
+                recorder.remove(registered[std::uniform_int_distribution<size_t>(0, registered.size() - 1)(rng)]);
+            }
+        }
+        for (size_t i = changes(rng); i > 0; --i) {
+            recorder.add();
+        }
+        addObject(realm, *table, nextId);
+        advanceAndNotify(*realm);
+
+        XCTAssertTrue(recorder.takeCalled() == recorder.registered(), @"round %zu", round);
+    }
+}
+
+@end
@@ -0,0 +1,101 @@
+//
+//  DictionaryBenchmarkTests.mm
+//  CrashRealmTests
+//
+//  Copyright (c) 2019 retval. All rights reserved.
+//
+
+#include <RxFoundation/Dictionary.hpp>
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+@import XCTest;
+
+namespace {
+    // Large enough that the buckets no longer fit in cache, which is where the
+    // extra load of the control bytes shows up.
+    constexpr size_t DictionaryBenchmarkSize = 1000000;
+
+    struct DictionaryBenchmarkKeys {
+        std::vector<Rx::UInt64> keys;
+        std::vector<Rx::UInt64> shuffled;
+        std::vector<Rx::UInt64> misses;
+
+        explicit DictionaryBenchmarkKeys(size_t count) : keys(count), misses(count) {
+            std::mt19937_64 rng(42);
+            for (auto &key : keys) key = rng() >> 2;
+            for (auto &key : misses) key = (rng() >> 2) | (1ULL << 62);
+            shuffled = keys;
+            std::shuffle(shuffled.begin(), shuffled.end(), rng);
+        }
+    };
+
+    void fillDictionary(Rx::Dictionary<Rx::UInt64, Rx::UInt64> &dictionary, const std::vector<Rx::UInt64> &keys) {
+        for (auto key : keys) {
+            dictionary[key] = key;
+        }
+    }
+
+    Rx::UInt64 sumHits(const Rx::Dictionary<Rx::UInt64, Rx::UInt64> &dictionary, const std::vector<Rx::UInt64> &keys) {
+        Rx::UInt64 sum = 0;
+        for (auto key : keys) {
+            sum += dictionary.find(key)->second;
+        }
+        return sum;
+    }
+
+    size_t countMisses(const Rx::Dictionary<Rx::UInt64, Rx::UInt64> &dictionary, const std::vector<Rx::UInt64> &keys) {
+        size_t missed = 0;
+        for (auto key : keys) {
+            missed += dictionary.find(key) == dictionary.end();
+        }
+        return missed;
+    }
+}
+
+@interface DictionaryBenchmarkTests : XCTestCase
+
+@end
+
+@implementation DictionaryBenchmarkTests
+
+- (void)testInsertPerformance
+{
+    DictionaryBenchmarkKeys input(DictionaryBenchmarkSize);
+    const DictionaryBenchmarkKeys *keys = &input;
+    [self measureBlock:^{
+        Rx::Dictionary<Rx::UInt64, Rx::UInt64> dictionary;
+        fillDictionary(dictionary, keys->keys);
+        XCTAssertEqual(dictionary.size(), DictionaryBenchmarkSize);
+    }];
+}
+
+- (void)testFindHitPerformance
+{
+    DictionaryBenchmarkKeys input(DictionaryBenchmarkSize);
+    Rx::Dictionary<Rx::UInt64, Rx::UInt64> dictionary;
+    fillDictionary(dictionary, input.keys);
+    Rx::UInt64 expected = 0;
+    for (auto key : input.keys) expected += key;
+    const DictionaryBenchmarkKeys *keys = &input;
+    const Rx::Dictionary<Rx::UInt64, Rx::UInt64> *filled = &dictionary;
+    [self measureBlock:^{
+        XCTAssertEqual(sumHits(*filled, keys->shuffled), expected);
+    }];
+}
+
+- (void)testFindMissPerformance
+{
+    DictionaryBenchmarkKeys input(DictionaryBenchmarkSize);
+    Rx::Dictionary<Rx::UInt64, Rx::UInt64> dictionary;
+    fillDictionary(dictionary, input.keys);
+    const DictionaryBenchmarkKeys *keys = &input;
+    const Rx::Dictionary<Rx::UInt64, Rx::UInt64> *filled = &dictionary;
+    [self measureBlock:^{
+        XCTAssertEqual(countMisses(*filled, keys->misses), DictionaryBenchmarkSize);
+    }];
+}
+
+@end
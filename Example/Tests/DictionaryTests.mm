@@ -0,0 +1,174 @@
+//
+//  DictionaryTests.mm
+//  CrashRealmTests
+//
+//  Copyright (c) 2019 retval. All rights reserved.
+//
+
+#include <RxFoundation/Dictionary.hpp>
+#include <RxFoundation/String.hpp>
+
+#include <random>
+#include <string>
+#include <unordered_map>
+
+@import XCTest;
+
+namespace {
+    constexpr size_t DictionaryTestOperations = 20000;
+    // Enough keys for groups of control bytes to fill up and for keys to share
+    // the hash bits stored in them
+    constexpr Rx::UInt64 DictionaryTestKeys = 2048;
+
+    template <typename DictionaryTy>
+    bool sameContents(const DictionaryTy &dictionary, const std::unordered_map<Rx::UInt64, Rx::UInt64> &model) {
+        if (dictionary.size() != model.size()) {
+            return false;
+        }
+        size_t visited = 0;
+        for (const auto &entry : dictionary) {
+            auto it = model.find(entry.first);
+            if (it == model.end() || it->second != entry.second) {
+                return false;
+            }
+            ++visited;
+        }
+        return visited == model.size();
+    }
+
+    /// Random inserts, overwrites, erases and lookups, checked against
+    /// std::unordered_map after each one. Returns the number of mismatches.
+    template <typename DictionaryTy>
+    size_t runAgainstModel(DictionaryTy &dictionary, std::unordered_map<Rx::UInt64, Rx::UInt64> &model, std::mt19937_64 &rng, Rx::UInt64 keys) {
+        size_t mismatches = 0;
+        for (size_t i = 0; i < DictionaryTestOperations; ++i) {
+            // Spread over the whole range of keys, short of the empty and tombstone keys
+            const Rx::UInt64 key = (rng() % keys) * 0x9E3779B97F4A7C15ULL >> 1;
+            switch (rng() % 6) {
+                case 0:
+                case 1: {
+                    const Rx::UInt64 value = rng();
+                    dictionary[key] = value;
+                    model[key] = value;
+                    break;
+                }
+                case 2: {
+                    const bool inserted = dictionary.insert(std::make_pair(key, key)).second;
+                    mismatches += inserted != model.insert(std::make_pair(key, key)).second;
+                    break;
+                }
+                case 3:
+                    mismatches += dictionary.erase(key) != (model.erase(key) != 0);
+                    break;
+                case 4: {
+                    auto it = dictionary.find(key);
+                    const bool found = it != dictionary.end();
+                    if (found) {
+                        dictionary.erase(it);
+                    }
+                    mismatches += found != (model.erase(key) != 0);
+                    break;
+                }
+                case 5: {
+                    auto it = dictionary.find(key);
+                    auto expected = model.find(key);
+                    mismatches += (it != dictionary.end()) != (expected != model.end());
+                    mismatches += it != dictionary.end() && expected != model.end() && it->second != expected->second;
+                    break;
+                }
+            }
+            mismatches += dictionary.size() != model.size();
+            mismatches += dictionary.count(key) != model.count(key);
+        }
+        return mismatches;
+    }
+}
+
+@interface DictionaryTests : XCTestCase
+
+@end
+
+@implementation DictionaryTests
+
+- (void)testDictionaryAgreesWithUnorderedMap
+{
+    Rx::Dictionary<Rx::UInt64, Rx::UInt64> dictionary;
+    std::unordered_map<Rx::UInt64, Rx::UInt64> model;
+    std::mt19937_64 rng(42);
+
+    XCTAssertEqual(runAgainstModel(dictionary, model, rng, DictionaryTestKeys), 0U);
+    XCTAssertTrue(sameContents(dictionary, model));
+
+    // Erase most of it, leaving tombstones for the next inserts to reuse or rehash away
+    for (Rx::UInt64 i = 0; i < DictionaryTestKeys; i += 4) {
+        const Rx::UInt64 key = i * 0x9E3779B97F4A7C15ULL >> 1;
+        XCTAssertEqual(dictionary.erase(key), model.erase(key) != 0);
+    }
+    XCTAssertEqual(runAgainstModel(dictionary, model, rng, DictionaryTestKeys), 0U);
+    XCTAssertTrue(sameContents(dictionary, model));
+}
+
+- (void)testSmallDictionaryAgreesWithUnorderedMap
+{
+    // Few enough keys that it moves between its inline and heap buckets
+    Rx::SmallDictionary<Rx::UInt64, Rx::UInt64, 4> dictionary;
+    std::unordered_map<Rx::UInt64, Rx::UInt64> model;
+    std::mt19937_64 rng(7);
+
+    XCTAssertEqual(runAgainstModel(dictionary, model, rng, 6), 0U);
+    XCTAssertTrue(sameContents(dictionary, model));
+    XCTAssertEqual(runAgainstModel(dictionary, model, rng, 64), 0U);
+    XCTAssertTrue(sameContents(dictionary, model));
+}
+
+- (void)testCopyMoveAndSwap
+{
+    Rx::Dictionary<Rx::UInt64, Rx::UInt64> dictionary;
+    std::unordered_map<Rx::UInt64, Rx::UInt64> model;
+    std::mt19937_64 rng(3);
+    runAgainstModel(dictionary, model, rng, DictionaryTestKeys);
+
+    Rx::Dictionary<Rx::UInt64, Rx::UInt64> copy(dictionary);
+    XCTAssertTrue(sameContents(copy, model));
+
+    Rx::Dictionary<Rx::UInt64, Rx::UInt64> other;
+    other[1] = 1;
+    other.swap(copy);
+    XCTAssertTrue(sameContents(other, model));
+    XCTAssertEqual(copy.size(), 1U);
+    XCTAssertEqual(copy.find(1)->second, 1U);
+
+    Rx::Dictionary<Rx::UInt64, Rx::UInt64> moved(std::move(other));
+    XCTAssertTrue(sameContents(moved, model));
+    XCTAssertTrue(other.empty());
+
+    moved.clear();
+    XCTAssertTrue(moved.empty());
+    XCTAssertTrue(moved.find(model.begin()->first) == moved.end());
+}
+
+- (void)testInternedStringKeys
+{
+    Rx::Dictionary<Rx::InternedString, Rx::UInt64> dictionary;
+    std::unordered_map<std::string, Rx::UInt64> model;
+    std::mt19937_64 rng(11);
+
+    for (size_t i = 0; i < DictionaryTestOperations; ++i) {
+        const std::string key = "key.path." + std::to_string(rng() % 1024);
+        const Rx::InternedString interned(Rx::String(key.c_str()));
+        if (rng() % 3) {
+            dictionary[interned] = i;
+            model[key] = i;
+        }
+        else {
+            XCTAssertEqual(dictionary.erase(interned), model.erase(key) != 0);
+        }
+    }
+    XCTAssertEqual(dictionary.size(), model.size());
+    for (const auto &entry : model) {
+        auto it = dictionary.find(Rx::InternedString(Rx::String(entry.first.c_str())));
+        XCTAssertTrue(it != dictionary.end() && it->second == entry.second);
+    }
+}
+
+@end
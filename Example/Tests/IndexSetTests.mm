@@ -0,0 +1,174 @@
+//
+//  IndexSetTests.mm
+//  CrashRealmTests
+//
+//  Copyright (c) 2019 retval. All rights reserved.
+//
+
+#include "index_set.hpp"
+
+#include <random>
+#include <set>
+#include <vector>
+
+@import XCTest;
+
+namespace {
+    constexpr size_t IndexSetTestRounds = 100;
+    constexpr size_t IndexSetTestOperations = 40;
+
+    std::set<size_t> modelOf(const realm::IndexSet &set) {
+        return std::set<size_t>(set.as_indexes().begin(), set.as_indexes().end());
+    }
+
+    /// The model with every index at or after `index` moved back by `count`.
+    std::set<size_t> shiftedModel(const std::set<size_t> &model, size_t index, size_t count = 1) {
+        std::set<size_t> shifted;
+        for (size_t i : model) {
+            shifted.insert(i >= index ? i + count : i);
+        }
+        return shifted;
+    }
+
+    /// Checks the lookups against the model for indexes up to maxIndex.
+    /// Returns the number of mismatches.
+    size_t checkLookups(const realm::IndexSet &set, const std::set<size_t> &model, size_t maxIndex, std::mt19937 &rng) {
+        size_t mismatches = modelOf(set) != model;
+        mismatches += set.count() != model.size();
+        std::uniform_int_distribution<size_t> index(0, maxIndex);
+        for (size_t i = 0; i < 50; ++i) {
+            size_t a = index(rng), b = index(rng);
+            if (a > b) {
+                std::swap(a, b);
+            }
+            mismatches += set.contains(a) != (model.count(a) != 0);
+            mismatches += set.count(a, b) != (size_t)std::distance(model.lower_bound(a), model.lower_bound(b));
+
+            // shift() finds the a-th index which isn't in the set
+            size_t shifted = 0;
+            for (size_t skipped = 0; ; ++shifted) {
+                if (!model.count(shifted) && skipped++ == a) {
+                    break;
+                }
+            }
+            mismatches += set.shift(a) != shifted;
+            if (!model.count(a)) {
+                mismatches += set.unshift(a) != a - std::distance(model.begin(), model.lower_bound(a));
+            }
+        }
+        return mismatches;
+    }
+}
+
+@interface IndexSetTests : XCTestCase
+
+@end
+
+@implementation IndexSetTests
+
+- (void)testLookupsInDenseAndSparseSets
+{
+    std::mt19937 rng(42);
+    for (size_t round = 0; round < IndexSetTestRounds; ++round) {
+        // Every other index is a chunk's worth of one-index ranges in a few
+        // words of bits, and the others mix short and long ranges and gaps
+        const size_t size = 100 + rng() % 20000;
+        const size_t pattern = round % 4;
+        realm::IndexSet set;
+        std::set<size_t> model;
+        for (size_t i = 0; i < size; ++i) {
+            const bool in = pattern == 0 ? i % 2 == 0 : pattern == 1 ? rng() % 3 == 0 : pattern == 2 ? rng() % 50 == 0 : i % 300 < 200;
+            if (in) {
+                set.add(i);
+                model.insert(i);
+            }
+        }
+        XCTAssertEqual(checkLookups(set, model, size + 100, rng), 0U, @"round %zu", round);
+    }
+}
+
+- (void)testLookupsAfterModifications
+{
+    std::mt19937 rng(7);
+    for (size_t round = 0; round < IndexSetTestRounds; ++round) {
+        const size_t size = 100 + rng() % 5000;
+        std::uniform_int_distribution<size_t> index(0, size - 1);
+        realm::IndexSet set;
+        std::set<size_t> model;
+        for (size_t i = 0; i < size; i += 1 + round % 3) {
+            set.add(i);
+            model.insert(i);
+        }
+
+        // Both the operations which modify ranges in place and the ones which
+        // rebuild the whole set
+        for (size_t op = 0; op < IndexSetTestOperations; ++op) {
+            const size_t i = index(rng);
+            switch (rng() % 8) {
+                case 0:
+                    set.add(i);
+                    model.insert(i);
+                    break;
+                case 1:
+                    set.remove(i, 3);
+                    model.erase(model.lower_bound(i), model.lower_bound(i + 3));
+                    break;
+                case 2: {
+                    realm::IndexSet other;
+                    for (size_t j = 0; j < 200; ++j) {
+                        other.add(index(rng));
+                    }
+                    set.add(other);
+                    for (size_t j : other.as_indexes()) {
+                        model.insert(j);
+                    }
+                    break;
+                }
+                case 3: {
+                    realm::IndexSet other;
+                    for (size_t j = 0; j < 200; ++j) {
+                        other.add(index(rng));
+                    }
+                    set.remove(other);
+                    for (size_t j : other.as_indexes()) {
+                        model.erase(j);
+                    }
+                    break;
+                }
+                case 4:
+                    set.insert_at(i);
+                    model = shiftedModel(model, i);
+                    model.insert(i);
+                    break;
+                case 5: {
+                    set.erase_at(i);
+                    std::set<size_t> erased;
+                    for (size_t j : model) {
+                        if (j != i) {
+                            erased.insert(j > i ? j - 1 : j);
+                        }
+                    }
+                    model = erased;
+                    break;
+                }
+                case 6:
+                    set.shift_for_insert_at(i, 2);
+                    model = shiftedModel(model, i, 2);
+                    break;
+                case 7: {
+                    // Appending after the last index
+                    const size_t last = model.empty() ? 0 : *model.rbegin() + 1 + rng() % 3;
+                    set.add(last);
+                    model.insert(last);
+                    break;
+                }
+            }
+            XCTAssertEqual(checkLookups(set, model, size + 100, rng), 0U, @"round %zu, operation %zu", round, op);
+        }
+
+        realm::IndexSet copy(set);
+        XCTAssertEqual(checkLookups(copy, model, size + 100, rng), 0U, @"round %zu", round);
+    }
+}
+
+@end
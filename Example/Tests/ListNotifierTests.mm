@@ -0,0 +1,147 @@
+//
+//  ListNotifierTests.mm
+//  CrashRealmTests
+//
+//  Copyright (c) 2019 retval. All rights reserved.
+//
+
+#include "ObjectStoreTestSupport.hpp"
+
+#include "list.hpp"
+
+#include <realm/link_view.hpp>
+
+#include <algorithm>
+#include <numeric>
+
+@import XCTest;
+
+namespace {
+    using namespace ObjectStoreTestSupport;
+
+    constexpr size_t ListTestObjects = 200;
+    constexpr size_t ListTestRounds = 20;
+
+    /// objectTestSchema() plus an object with a list of them.
+    realm::Schema listTestSchema() {
+        realm::Schema schema = objectTestSchema();
+        std::vector<realm::ObjectSchema> types(schema.begin(), schema.end());
+        types.push_back({"origin", {
+            {"objects", realm::PropertyType::Object | realm::PropertyType::Array, "object"},
+        }});
+        return realm::Schema(std::move(types));
+    }
+
+    /// A list which holds most of the objects, some of them more than once,
+    /// in no particular order.
+    void fillList(realm::SharedRealm &realm, realm::Table &objects, realm::Table &origin, std::mt19937 &rng) {
+        realm->begin_transaction();
+        for (size_t i = 0; i < ListTestObjects; ++i) {
+            size_t row = objects.add_empty_row();
+            objects.set_int(ObjectTestIdColumn, row, i);
+        }
+        auto list = origin.get_linklist(0, origin.add_empty_row());
+        std::uniform_int_distribution<size_t> object(0, ListTestObjects - 1);
+        for (size_t i = 0; i < ListTestObjects * 2; ++i) {
+            list->add(object(rng));
+        }
+        realm->commit_transaction();
+    }
+
+    /// Modifies the given number of distinct objects, in or out of the list,
+    /// and returns the positions in the list the modifications should be
+    /// reported at.
+    std::vector<size_t> modifyObjects(realm::SharedRealm &realm, realm::Table &objects, realm::List &list, std::mt19937 &rng, size_t count) {
+        std::vector<size_t> rows(ListTestObjects);
+        std::iota(rows.begin(), rows.end(), 0);
+        std::shuffle(rows.begin(), rows.end(), rng);
+        rows.resize(count);
+
+        realm->begin_transaction();
+        for (size_t row : rows) {
+            objects.set_int(ObjectTestValueColumn, row, objects.get_int(ObjectTestValueColumn, row) + 1);
+        }
+        realm->commit_transaction();
+
+        std::vector<size_t> positions;
+        for (size_t pos = 0; pos < list.size(); ++pos) {
+            if (std::find(rows.begin(), rows.end(), list.get(pos).get_index()) != rows.end()) {
+                positions.push_back(pos);
+            }
+        }
+        return positions;
+    }
+}
+
+@interface ListNotifierTests : XCTestCase
+
+@end
+
+@implementation ListNotifierTests
+
+- (void)testModifiedObjectsAreReportedAtEveryPosition
+{
+    auto realm = openRealm(listTestSchema());
+    auto objects = tableFor(*realm, "object");
+    auto origin = tableFor(*realm, "origin");
+    std::mt19937 rng(42);
+    fillList(realm, *objects, *origin, rng);
+
+    realm::List list(realm, *origin, 0, 0);
+    realm::CollectionChangeSet changes;
+    auto token = list.add_notification_callback([&](realm::CollectionChangeSet const &c, std::exception_ptr) {
+        changes = c;
+    });
+    advanceAndNotify(*realm);
+
+    // A few modified objects are searched for in the list one at a time, and
+    // more are found with one pass over it
+    const size_t counts[] = {1, 3, 4, 5, 8, 30, 60};
+    for (size_t round = 0; round < ListTestRounds; ++round) {
+        for (size_t count : counts) {
+            auto expected = modifyObjects(realm, *objects, list, rng, count);
+            changes = {};
+            advanceAndNotify(*realm);
+
+            XCTAssertTrue(indexesOf(changes.modifications) == expected, @"round %zu, %zu objects", round, count);
+            XCTAssertTrue(changes.insertions.empty() && changes.deletions.empty(), @"round %zu, %zu objects", round, count);
+        }
+    }
+}
+
+- (void)testModifiedObjectsAfterListChanges
+{
+    auto realm = openRealm(listTestSchema());
+    auto objects = tableFor(*realm, "object");
+    auto origin = tableFor(*realm, "origin");
+    std::mt19937 rng(7);
+    fillList(realm, *objects, *origin, rng);
+
+    realm::List list(realm, *origin, 0, 0);
+    realm::CollectionChangeSet changes;
+    auto token = list.add_notification_callback([&](realm::CollectionChangeSet const &c, std::exception_ptr) {
+        changes = c;
+    });
+    advanceAndNotify(*realm);
+
+    // Shuffle the list and drop some of it, so that the positions found for
+    // the next modifications are the new ones
+    for (size_t round = 0; round < ListTestRounds; ++round) {
+        realm->begin_transaction();
+        auto lv = origin->get_linklist(0, 0);
+        for (size_t i = 0; i < 10; ++i) {
+            std::uniform_int_distribution<size_t> pos(0, lv->size() - 1);
+            lv->move(pos(rng), pos(rng));
+        }
+        lv->remove(std::uniform_int_distribution<size_t>(0, lv->size() - 1)(rng));
+        realm->commit_transaction();
+        advanceAndNotify(*realm);
+
+        auto expected = modifyObjects(realm, *objects, list, rng, round % 2 ? 2 : 40);
+        changes = {};
+        advanceAndNotify(*realm);
+        XCTAssertTrue(indexesOf(changes.modifications) == expected, @"round %zu", round);
+    }
+}
+
+@end
@@ -0,0 +1,112 @@
+//
+//  NotifierDeadlineTests.mm
+//  CrashRealmTests
+//
+//  Copyright (c) 2019 retval. All rights reserved.
+//
+
+#include "ObjectStoreTestSupport.hpp"
+
+#include <thread>
+
+@import XCTest;
+
+namespace {
+    using namespace ObjectStoreTestSupport;
+
+    constexpr size_t DeadlineTestRows = 20000;
+    constexpr size_t DeadlineTestPasses = 20;
+    constexpr std::chrono::milliseconds DeadlineTestDeadline(1);
+
+    /// Sorted queries of every priority over a large table, so that running
+    /// all of them takes longer than the deadline.
+    ObservedResultsList observeQueries(realm::SharedRealm &realm, realm::Table &table) {
+        ObservedResultsList observed;
+        const realm::NotificationPriority priorities[] = {realm::NotificationPriority::low, realm::NotificationPriority::normal, realm::NotificationPriority::high};
+        for (int64_t threshold = 0; threshold < 100; threshold += 10) {
+            realm::Results results(realm, table.where().greater_equal(ObjectTestValueColumn, threshold));
+            auto priority = priorities[observed.size() % 3];
+            observed.push_back(std::make_unique<ObservedResults>(results.sort({{"value", threshold % 20 == 0}}), priority));
+        }
+        return observed;
+    }
+
+    void fillTable(realm::SharedRealm &realm, realm::Table &table, std::mt19937 &rng, int64_t &nextId) {
+        realm->begin_transaction();
+        for (size_t i = 0; i < DeadlineTestRows; ++i) {
+            size_t row = table.add_empty_row();
+            table.set_int(ObjectTestIdColumn, row, nextId++);
+            table.set_int(ObjectTestValueColumn, row, std::uniform_int_distribution<int64_t>(0, 99)(rng));
+        }
+        realm->commit_transaction();
+    }
+}
+
+@interface NotifierDeadlineTests : XCTestCase
+
+@end
+
+@implementation NotifierDeadlineTests
+
+- (void)testDeadlineWithoutNewerVersionsRunsEveryNotifier
+{
+    auto realm = openRealm(objectTestSchema(), 1, DeadlineTestDeadline);
+    auto table = tableFor(*realm, "object");
+    std::mt19937 rng(42);
+    int64_t nextId = 0;
+    fillTable(realm, *table, rng, nextId);
+
+    auto observed = observeQueries(realm, *table);
+    advanceAndNotify(*realm);
+
+    // Nothing is committed while the notifiers run, so none of them are behind
+    for (size_t i = 0; i < DeadlineTestPasses; ++i) {
+        commitMutations(*realm, *table, rng, nextId);
+        advanceAndNotify(*realm);
+
+        XCTAssertTrue(mismatchedResults(observed).empty(), @"pass %zu", i);
+    }
+}
+
+- (void)testDeferredNotifiersCatchUp
+{
+    auto realm = openRealm(objectTestSchema(), 1, DeadlineTestDeadline);
+    auto table = tableFor(*realm, "object");
+    std::mt19937 rng(7);
+    int64_t nextId = 0;
+    fillTable(realm, *table, rng, nextId);
+
+    auto observed = observeQueries(realm, *table);
+    advanceAndNotify(*realm);
+
+    // Keep committing on another thread, so that there's always a newer
+    // version once the deadline has passed and the notifiers which aren't
+    // high priority can skip versions
+    std::atomic<bool> writing(true);
+    std::thread writer([config = realm->config(), &writing, &nextId] {
+        auto writerRealm = realm::Realm::get_shared_realm(config);
+        auto writerTable = tableFor(*writerRealm, "object");
+        std::mt19937 writerRng(3);
+        while (writing) {
+            commitMutations(*writerRealm, *writerTable, writerRng, nextId);
+        }
+    });
+
+    for (size_t i = 0; i < DeadlineTestPasses; ++i) {
+        advanceAndNotify(*realm);
+
+        // High-priority notifiers are never deferred
+        for (size_t j : mismatchedResults(observed)) {
+            XCTAssertTrue(observed[j]->callback.priority != realm::NotificationPriority::high, @"pass %zu, results %zu", i, j);
+        }
+    }
+    writing = false;
+    writer.join();
+
+    // Without a newer version to skip to, the deferred notifiers deliver the
+    // changes from every version they skipped
+    advanceAndNotify(*realm);
+    XCTAssertTrue(mismatchedResults(observed).empty());
+}
+
+@end
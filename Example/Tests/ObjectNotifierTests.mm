@@ -0,0 +1,228 @@
+//
+//  ObjectNotifierTests.mm
+//  CrashRealmTests
+//
+//  Copyright (c) 2019 retval. All rights reserved.
+//
+
+#include "ObjectStoreTestSupport.hpp"
+
+#include "object.hpp"
+
+#include <realm/table.hpp>
+
+#include <set>
+
+@import XCTest;
+
+namespace {
+    using namespace ObjectStoreTestSupport;
+
+    constexpr size_t ObjectTestRows = 300;
+    constexpr size_t ObjectTestObserved = 100;
+    constexpr size_t ObjectTestTransactions = 50;
+
+    /// An Object with a callback which records what it was called with.
+    struct ObservedObject {
+        realm::Object object;
+        int64_t id;
+        realm::NotificationToken token;
+        size_t calls = 0;
+        bool deleted = false;
+        bool modified = false;
+        bool valueModified = false;
+
+        ObservedObject(const realm::SharedRealm &realm, realm::Table &table, size_t row)
+        : object(realm, "object", row), id(table.get_int(ObjectTestIdColumn, row)) {
+            token = object.add_notification_callback([this](realm::CollectionChangeSet const &changes, std::exception_ptr) {
+                ++calls;
+                deleted |= !changes.deletions.empty();
+                modified |= !changes.modifications.empty();
+                valueModified |= changes.columns.size() > ObjectTestValueColumn && !changes.columns[ObjectTestValueColumn].empty();
+            });
+        }
+
+        void reset() {
+            calls = 0;
+            modified = valueModified = false;
+        }
+    };
+    using ObservedObjects = std::vector<std::unique_ptr<ObservedObject>>;
+
+    /// Ids which were deleted or had their value modified in a transaction.
+    struct ChangedIds {
+        std::set<int64_t> deleted;
+        std::set<int64_t> modified;
+    };
+
+    void fillTable(realm::SharedRealm &realm, realm::Table &table, int64_t &nextId) {
+        realm->begin_transaction();
+        for (size_t i = 0; i < ObjectTestRows; ++i) {
+            table.set_int(ObjectTestIdColumn, table.add_empty_row(), nextId++);
+        }
+        realm->commit_transaction();
+    }
+
+    /// Observes random rows, some of them more than once.
+    void observeObjects(ObservedObjects &objects, const realm::SharedRealm &realm, realm::Table &table, std::mt19937 &rng, size_t count) {
+        for (size_t i = 0; i < count; ++i) {
+            const size_t row = std::uniform_int_distribution<size_t>(0, table.size() - 1)(rng);
+            objects.push_back(std::make_unique<ObservedObject>(realm, table, row));
+        }
+    }
+
+    /// Deletes, modifies and inserts rows, with deletions moving the last row
+    /// over the deleted one.
+    ChangedIds commitChanges(realm::Realm &realm, realm::Table &table, std::mt19937 &rng, int64_t &nextId) {
+        ChangedIds changed;
+        realm.begin_transaction();
+        for (size_t i = 0; i < 10; ++i) {
+            const size_t row = std::uniform_int_distribution<size_t>(0, table.size() - 1)(rng);
+            const int64_t id = table.get_int(ObjectTestIdColumn, row);
+            switch (rng() % 3) {
+                case 0:
+                    table.move_last_over(row);
+                    changed.deleted.insert(id);
+                    changed.modified.erase(id);
+                    break;
+                case 1:
+                    table.set_int(ObjectTestValueColumn, row, table.get_int(ObjectTestValueColumn, row) + 1);
+                    changed.modified.insert(id);
+                    break;
+                case 2:
+                    table.set_int(ObjectTestIdColumn, table.add_empty_row(), nextId++);
+                    break;
+            }
+        }
+        realm.commit_transaction();
+        return changed;
+    }
+
+    /// The number of objects whose callbacks weren't called with exactly
+    /// their own changes. Objects deleted earlier must not be called at all.
+    size_t mismatchedObjects(ObservedObjects &objects, const ChangedIds &changed, bool initial = false) {
+        size_t mismatches = 0;
+        for (auto &object : objects) {
+            const bool deleted = changed.deleted.count(object->id) != 0;
+            const bool modified = changed.modified.count(object->id) != 0;
+            mismatches += object->calls != (initial || deleted || modified ? 1U : 0U);
+            mismatches += deleted && !object->deleted;
+            mismatches += object->modified != modified || object->valueModified != modified;
+            object->reset();
+        }
+        return mismatches;
+    }
+
+    size_t notifierCount(realm::Realm &realm) {
+        return realm::_impl::RealmCoordinator::get_existing_coordinator(realm.config().path)->get_notifier_statistics().size();
+    }
+}
+
+@interface ObjectNotifierTests : XCTestCase
+
+@end
+
+@implementation ObjectNotifierTests
+
+- (void)testEachObjectGetsItsOwnChanges
+{
+    auto realm = openRealm(objectTestSchema());
+    auto table = tableFor(*realm, "object");
+    std::mt19937 rng(42);
+    int64_t nextId = 0;
+    fillTable(realm, *table, nextId);
+
+    ObservedObjects objects;
+    observeObjects(objects, realm, *table, rng, ObjectTestObserved);
+    advanceAndNotify(*realm);
+    XCTAssertEqual(mismatchedObjects(objects, {}, true), 0U);
+
+    // The observed rows move as others are deleted, and stop being reported
+    // once they're deleted themselves
+    for (size_t i = 0; i < ObjectTestTransactions; ++i) {
+        auto changed = commitChanges(*realm, *table, rng, nextId);
+        advanceAndNotify(*realm);
+        XCTAssertEqual(mismatchedObjects(objects, changed), 0U, @"transaction %zu", i);
+    }
+}
+
+- (void)testObjectsObservedBeforeDelivery
+{
+    auto realm = openRealm(objectTestSchema());
+    auto table = tableFor(*realm, "object");
+    auto coordinator = realm::_impl::RealmCoordinator::get_existing_coordinator(realm->config().path);
+    std::mt19937 rng(7);
+    int64_t nextId = 0;
+    fillTable(realm, *table, nextId);
+
+    ObservedObjects objects;
+    observeObjects(objects, realm, *table, rng, ObjectTestObserved / 2);
+    advanceAndNotify(*realm);
+    mismatchedObjects(objects, {}, true);
+
+    // Objects observed after the notifier has moved on to the next version,
+    // but before it's delivered, still get the changes since their version
+    for (size_t i = 0; i < ObjectTestTransactions / 5; ++i) {
+        auto changed = commitChanges(*realm, *table, rng, nextId);
+        coordinator->on_change();
+
+        ObservedObjects added;
+        observeObjects(added, realm, *table, rng, 10);
+        advanceAndNotify(*realm);
+        XCTAssertEqual(mismatchedObjects(objects, changed), 0U, @"round %zu", i);
+        XCTAssertEqual(mismatchedObjects(added, changed, true), 0U, @"round %zu", i);
+
+        for (auto &object : added) {
+            objects.push_back(std::move(object));
+        }
+        changed = commitChanges(*realm, *table, rng, nextId);
+        advanceAndNotify(*realm);
+        XCTAssertEqual(mismatchedObjects(objects, changed), 0U, @"round %zu", i);
+    }
+}
+
+- (void)testObjectsShareNotifierUntilLastCallbackIsRemoved
+{
+    auto realm = openRealm(objectTestSchema());
+    auto table = tableFor(*realm, "object");
+    realm::_impl::RealmCoordinator::get_existing_coordinator(realm->config().path)->notifier_metrics()->set_enabled(true);
+    std::mt19937 rng(3);
+    int64_t nextId = 0;
+    fillTable(realm, *table, nextId);
+
+    ObservedObjects objects;
+    observeObjects(objects, realm, *table, rng, ObjectTestObserved);
+    advanceAndNotify(*realm);
+    mismatchedObjects(objects, {}, true);
+    XCTAssertEqual(notifierCount(*realm), 1U);
+
+    // Callbacks which are removed aren't called again, while the others on
+    // the same notifier carry on
+    ObservedObjects removed;
+    for (size_t i = 0; i < objects.size(); ) {
+        if (rng() % 2) {
+            objects[i]->token = {};
+            removed.push_back(std::move(objects[i]));
+            objects.erase(objects.begin() + i);
+        }
+        else {
+            ++i;
+        }
+    }
+    for (size_t i = 0; i < ObjectTestTransactions / 5; ++i) {
+        auto changed = commitChanges(*realm, *table, rng, nextId);
+        advanceAndNotify(*realm);
+        XCTAssertEqual(mismatchedObjects(objects, changed), 0U, @"transaction %zu", i);
+        XCTAssertEqual(mismatchedObjects(removed, {}), 0U, @"transaction %zu", i);
+        XCTAssertEqual(notifierCount(*realm), 1U, @"transaction %zu", i);
+    }
+
+    for (auto &object : objects) {
+        object->token = {};
+    }
+    commitChanges(*realm, *table, rng, nextId);
+    advanceAndNotify(*realm);
+    XCTAssertEqual(notifierCount(*realm), 0U);
+}
+
+@end
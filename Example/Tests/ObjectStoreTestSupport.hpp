@@ -0,0 +1,231 @@
+//
+//  ObjectStoreTestSupport.hpp
+//  CrashRealmTests
+//
+//  Copyright (c) 2019 retval. All rights reserved.
+//
+
+#ifndef ObjectStoreTestSupport_hpp
+#define ObjectStoreTestSupport_hpp
+
+#include "impl/realm_coordinator.hpp"
+#include "object_schema.hpp"
+#include "object_store.hpp"
+#include "property.hpp"
+#include "results.hpp"
+#include "schema.hpp"
+#include "shared_realm.hpp"
+
+#include <realm/table.hpp>
+
+#include <Foundation/Foundation.h>
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace ObjectStoreTestSupport {
+    /// An in-memory Realm with automatic change notifications turned off, so
+    /// that the notifiers only run when the test calls advanceAndNotify().
+    inline realm::SharedRealm openRealm(realm::Schema schema, size_t maxNotifierThreads = 1,
+                                        std::chrono::milliseconds notifierDeadline = std::chrono::milliseconds(0)) {
+        static std::atomic<unsigned> counter(0);
+        realm::Realm::Config config;
+        config.path = std::string(NSTemporaryDirectory().UTF8String) + "object-store-test-"
+            + std::to_string(getpid()) + "-" + std::to_string(counter++) + ".realm";
+        config.in_memory = true;
+        config.cache = false;
+        config.automatic_change_notifications = false;
+        config.max_notifier_threads = maxNotifierThreads;
+        config.notifier_deadline = notifierDeadline;
+        config.schema = std::move(schema);
+        config.schema_version = 0;
+        return realm::Realm::get_shared_realm(std::move(config));
+    }
+
+    /// Runs the notifiers for everything committed so far and delivers their
+    /// results on this thread.
+    inline void advanceAndNotify(realm::Realm &realm) {
+        realm::_impl::RealmCoordinator::get_existing_coordinator(realm.config().path)->on_change();
+        realm.notify();
+    }
+
+    inline realm::TableRef tableFor(realm::Realm &realm, const char *objectType) {
+        return realm::ObjectStore::table_for_object_type(realm.read_group(), objectType);
+    }
+
+    constexpr size_t ObjectTestIdColumn = 0;
+    constexpr size_t ObjectTestValueColumn = 1;
+
+    /// Objects with a unique id, which never changes, and a value which does.
+    inline realm::Schema objectTestSchema() {
+        return realm::Schema{
+            {"object", {
+                {"id", realm::PropertyType::Int},
+                {"value", realm::PropertyType::Int},
+            }},
+        };
+    }
+
+    /// Inserts, deletes and modifies a few rows of a table, calling
+    /// setValues(row, inserted) to fill in each inserted or modified row.
+    /// Must be called in a write transaction.
+    template <typename SetValues>
+    void mutateRows(realm::Table &table, std::mt19937 &rng, SetValues setValues, int changes = 10) {
+        std::uniform_int_distribution<int> action(0, 2);
+        for (int i = 0; i < changes; ++i) {
+            switch (table.size() ? action(rng) : 0) {
+                case 0:
+                    setValues(table.add_empty_row(), true);
+                    break;
+                case 1:
+                    table.move_last_over(std::uniform_int_distribution<size_t>(0, table.size() - 1)(rng));
+                    break;
+                case 2:
+                    setValues(std::uniform_int_distribution<size_t>(0, table.size() - 1)(rng), false);
+                    break;
+            }
+        }
+    }
+
+    /// mutateRows() for an objectTestSchema() table.
+    inline void mutateObjects(realm::Table &table, std::mt19937 &rng, int64_t &nextId, int changes = 10) {
+        std::uniform_int_distribution<int64_t> value(0, 99);
+        mutateRows(table, rng, [&](size_t row, bool inserted) {
+            if (inserted) {
+                table.set_int(ObjectTestIdColumn, row, nextId++);
+            }
+            table.set_int(ObjectTestValueColumn, row, value(rng));
+        }, changes);
+    }
+
+    /// mutateObjects() in a transaction of its own.
+    inline void commitMutations(realm::Realm &realm, realm::Table &table, std::mt19937 &rng, int64_t &nextId, int changes = 10) {
+        realm.begin_transaction();
+        mutateObjects(table, rng, nextId, changes);
+        realm.commit_transaction();
+    }
+
+    inline std::vector<size_t> indexesOf(const realm::IndexSet &set) {
+        std::vector<size_t> indexes;
+        for (size_t index : set.as_indexes()) {
+            indexes.push_back(index);
+        }
+        return indexes;
+    }
+
+    inline bool sameChanges(const realm::CollectionChangeSet &a, const realm::CollectionChangeSet &b) {
+        if (a.columns.size() != b.columns.size()) {
+            return false;
+        }
+        for (size_t i = 0; i < a.columns.size(); ++i) {
+            if (indexesOf(a.columns[i]) != indexesOf(b.columns[i])) {
+                return false;
+            }
+        }
+        return indexesOf(a.deletions) == indexesOf(b.deletions)
+            && indexesOf(a.insertions) == indexesOf(b.insertions)
+            && indexesOf(a.modifications) == indexesOf(b.modifications)
+            && indexesOf(a.modifications_new) == indexesOf(b.modifications_new)
+            && a.moves == b.moves;
+    }
+
+    /// The ids and values of the rows of an objectTestSchema() Results, kept
+    /// up to date only by applying the changesets delivered to a callback, so
+    /// that comparing it with the Results checks those changesets.
+    class ChangeMirror {
+    public:
+        explicit ChangeMirror(realm::Results &results) : _results(results) { }
+
+        /// Apply the changes delivered to a callback. The first delivery is
+        /// the initial one and copies the Results instead.
+        void apply(const realm::CollectionChangeSet &changes) {
+            ++_deliveries;
+            if (_deliveries == 1) {
+                for (size_t i = 0; i < _results.size(); ++i) {
+                    _rows.push_back(rowAt(i));
+                }
+                return;
+            }
+            std::vector<size_t> deletions = indexesOf(changes.deletions);
+            for (auto it = deletions.rbegin(); it != deletions.rend(); ++it) {
+                _rows.erase(_rows.begin() + *it);
+            }
+            for (size_t index : changes.insertions.as_indexes()) {
+                _rows.insert(_rows.begin() + index, rowAt(index));
+            }
+            for (size_t index : changes.modifications_new.as_indexes()) {
+                _rows[index].second = rowAt(index).second;
+            }
+        }
+
+        /// Whether the rows match the Results, in order.
+        bool matches() {
+            if (_rows.size() != _results.size()) {
+                return false;
+            }
+            for (size_t i = 0; i < _rows.size(); ++i) {
+                if (_rows[i] != rowAt(i)) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        size_t deliveries() const { return _deliveries; }
+
+    private:
+        realm::Results &_results;
+        std::vector<std::pair<int64_t, int64_t>> _rows;
+        size_t _deliveries = 0;
+
+        std::pair<int64_t, int64_t> rowAt(size_t index) {
+            auto row = _results.get(index);
+            return {row.get_int(ObjectTestIdColumn), row.get_int(ObjectTestValueColumn)};
+        }
+    };
+
+    /// A callback on a Results which keeps a ChangeMirror of it and the
+    /// changes it was last called with.
+    struct MirroredCallback {
+        ChangeMirror mirror;
+        realm::NotificationToken token;
+        realm::CollectionChangeSet changes;
+        realm::NotificationPriority priority;
+
+        explicit MirroredCallback(realm::Results &results, realm::NotificationPriority p = realm::NotificationPriority::normal)
+        : mirror(results), priority(p) {
+            token = results.add_notification_callback([this](realm::CollectionChangeSet const &c, std::exception_ptr) {
+                mirror.apply(c);
+                changes = c;
+            }, priority);
+        }
+    };
+
+    /// A Results with a MirroredCallback of its own.
+    struct ObservedResults {
+        realm::Results results;
+        MirroredCallback callback;
+
+        explicit ObservedResults(realm::Results r, realm::NotificationPriority priority = realm::NotificationPriority::normal)
+        : results(std::move(r)), callback(results, priority) { }
+    };
+
+    using ObservedResultsList = std::vector<std::unique_ptr<ObservedResults>>;
+
+    /// The indexes of the observed Results whose mirrors don't match them.
+    inline std::vector<size_t> mismatchedResults(const ObservedResultsList &observed) {
+        std::vector<size_t> mismatched;
+        for (size_t i = 0; i < observed.size(); ++i) {
+            if (!observed[i]->callback.mirror.matches()) {
+                mismatched.push_back(i);
+            }
+        }
+        return mismatched;
+    }
+}
+
+#endif /* ObjectStoreTestSupport_hpp */
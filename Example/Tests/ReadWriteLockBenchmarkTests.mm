@@ -0,0 +1,187 @@
+//
+//  ReadWriteLockBenchmarkTests.mm
+//  CrashRealmTests
+//
+//  Copyright (c) 2019 retval. All rights reserved.
+//
+
+#include <RxFoundation/Atomic.hpp>
+
+#include <pthread.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+@import XCTest;
+
+namespace {
+    constexpr size_t ReadWriteLockBenchmarkIterations = 1000000;
+    constexpr size_t ReadWriteLockBenchmarkReaders = 4;
+    constexpr size_t ReadWriteLockBenchmarkMaxReaders = 64;
+
+    struct RxReadWriteLockAdapter {
+        Rx::ReadWriteLock lock;
+        void lockRead() { lock.lockRead(); }
+        void unlockRead() { lock.unlockRead(); }
+        void lockWrite() { lock.lockWrite(); }
+        void unlockWrite() { lock.unlockWrite(); }
+    };
+
+    /// ReadWriteLock as it was before its atomic fast path, where every call
+    /// takes a mutex and waiters sleep on one condition variable. Kept as the
+    /// baseline for the thread count sweep.
+    class BaselineReadWriteLock {
+    public:
+        void lockRead() {
+            Rx::LockGuard<Rx::MutexLock> guard(_mutex);
+            while (_writer > 0 || _pending > 0) {
+                _condition.wait(guard);
+            }
+            ++_reader;
+        }
+
+        void unlockRead() {
+            Rx::LockGuard<Rx::MutexLock> guard(_mutex);
+            if (--_reader == 0) {
+                _condition.notifyAll();
+            }
+        }
+
+        void lockWrite() {
+            Rx::LockGuard<Rx::MutexLock> guard(_mutex);
+            ++_pending;
+            while (_writer > 0 || _reader > 0) {
+                _condition.wait(guard);
+            }
+            --_pending;
+            ++_writer;
+        }
+
+        void unlockWrite() {
+            Rx::LockGuard<Rx::MutexLock> guard(_mutex);
+            --_writer;
+            _condition.notifyAll();
+        }
+
+    private:
+        Rx::MutexLock _mutex;
+        Rx::ConditionVariable _condition;
+        Rx::Int64 _reader = 0;
+        Rx::Int64 _writer = 0;
+        Rx::Int64 _pending = 0;
+    };
+
+    /// The system lock, as a reference point for the numbers above.
+    struct PthreadReadWriteLockAdapter {
+        pthread_rwlock_t lock = PTHREAD_RWLOCK_INITIALIZER;
+        ~PthreadReadWriteLockAdapter() { pthread_rwlock_destroy(&lock); }
+        void lockRead() { pthread_rwlock_rdlock(&lock); }
+        void unlockRead() { pthread_rwlock_unlock(&lock); }
+        void lockWrite() { pthread_rwlock_wrlock(&lock); }
+        void unlockWrite() { pthread_rwlock_unlock(&lock); }
+    };
+
+    template <typename Lock>
+    void readUncontended(Lock &lock, size_t iterations) {
+        for (size_t i = 0; i < iterations; ++i) {
+            lock.lockRead();
+            lock.unlockRead();
+        }
+    }
+
+    /// Readers and one writer hammer the lock; the writer keeps two counters
+    /// equal while it holds the lock, so a reader seeing them differ means the
+    /// lock let a reader in during a write. Returns the number of such reads.
+    template <typename Lock>
+    size_t readMostlyContended(Lock &lock, size_t iterations, size_t readerCount = ReadWriteLockBenchmarkReaders) {
+        size_t first = 0, second = 0;
+        std::atomic<size_t> violations(0);
+        std::vector<std::thread> readers;
+        for (size_t r = 0; r < readerCount; ++r) {
+            readers.emplace_back([&] {
+                size_t seen = 0;
+                for (size_t i = 0; i < iterations; ++i) {
+                    lock.lockRead();
+                    seen += first != second;
+                    lock.unlockRead();
+                }
+                violations += seen;
+            });
+        }
+        for (size_t i = 0; i < iterations / 64; ++i) {
+            lock.lockWrite();
+            ++first;
+            ++second;
+            lock.unlockWrite();
+        }
+        for (auto &reader : readers) {
+            reader.join();
+        }
+        return violations + (first != second);
+    }
+
+    /// Runs readMostlyContended() with the reads split between readerCount
+    /// readers, returning how long it took and adding to violations.
+    template <typename Lock>
+    double contendedMilliseconds(size_t readerCount, size_t &violations) {
+        Lock lock;
+        auto start = std::chrono::steady_clock::now();
+        violations += readMostlyContended(lock, ReadWriteLockBenchmarkIterations / readerCount, readerCount);
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+}
+
+@interface ReadWriteLockBenchmarkTests : XCTestCase
+
+@end
+
+@implementation ReadWriteLockBenchmarkTests
+
+- (void)testUncontendedReadPerformance
+{
+    [self measureBlock:^{
+        RxReadWriteLockAdapter lock;
+        readUncontended(lock, ReadWriteLockBenchmarkIterations);
+    }];
+}
+
+- (void)testUncontendedReadPthreadReference
+{
+    [self measureBlock:^{
+        PthreadReadWriteLockAdapter lock;
+        readUncontended(lock, ReadWriteLockBenchmarkIterations);
+    }];
+}
+
+- (void)testReadMostlyContendedPerformance
+{
+    [self measureBlock:^{
+        RxReadWriteLockAdapter lock;
+        XCTAssertEqual(readMostlyContended(lock, ReadWriteLockBenchmarkIterations / 4), 0U);
+    }];
+}
+
+- (void)testReadMostlyContendedPthreadReference
+{
+    [self measureBlock:^{
+        PthreadReadWriteLockAdapter lock;
+        XCTAssertEqual(readMostlyContended(lock, ReadWriteLockBenchmarkIterations / 4), 0U);
+    }];
+}
+
+- (void)testReadMostlyContendedThreadSweep
+{
+    // The same total number of reads and writes at each thread count, so the
+    // times show how each lock scales as the readers are added
+    for (size_t readers = 1; readers <= ReadWriteLockBenchmarkMaxReaders; readers *= 2) {
+        size_t violations = 0;
+        const double rx = contendedMilliseconds<RxReadWriteLockAdapter>(readers, violations);
+        const double baseline = contendedMilliseconds<BaselineReadWriteLock>(readers, violations);
+        const double pthread = contendedMilliseconds<PthreadReadWriteLockAdapter>(readers, violations);
+        XCTAssertEqual(violations, 0U, @"%zu readers", readers);
+        NSLog(@"ReadWriteLock, %2zu readers: Rx %8.2f ms, baseline %8.2f ms, pthread %8.2f ms", readers, rx, baseline, pthread);
+    }
+}
+
+@end
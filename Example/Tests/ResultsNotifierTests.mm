@@ -0,0 +1,172 @@
+//
+//  ResultsNotifierTests.mm
+//  CrashRealmTests
+//
+//  Copyright (c) 2019 retval. All rights reserved.
+//
+
+#include "ObjectStoreTestSupport.hpp"
+
+#include <realm/table.hpp>
+
+#include <functional>
+
+@import XCTest;
+
+namespace {
+    using namespace ObjectStoreTestSupport;
+
+    constexpr size_t ResultsTestRows = 500;
+    constexpr size_t ResultsTestTransactions = 100;
+
+    /// The ids of the rows of the table which match, in table order, as an
+    /// unsorted query should return them.
+    std::vector<int64_t> expectedIds(realm::Table &table, std::function<bool(int64_t)> matches) {
+        std::vector<int64_t> ids;
+        for (size_t row = 0; row < table.size(); ++row) {
+            if (matches(table.get_int(ObjectTestValueColumn, row))) {
+                ids.push_back(table.get_int(ObjectTestIdColumn, row));
+            }
+        }
+        return ids;
+    }
+
+    std::vector<int64_t> idsOf(realm::Results &results) {
+        std::vector<int64_t> ids;
+        for (size_t i = 0; i < results.size(); ++i) {
+            ids.push_back(results.get(i).get_int(ObjectTestIdColumn));
+        }
+        return ids;
+    }
+
+    void fillTable(realm::SharedRealm &realm, realm::Table &table, std::mt19937 &rng, int64_t &nextId) {
+        realm->begin_transaction();
+        for (size_t i = 0; i < ResultsTestRows; ++i) {
+            size_t row = table.add_empty_row();
+            table.set_int(ObjectTestIdColumn, row, nextId++);
+            table.set_int(ObjectTestValueColumn, row, std::uniform_int_distribution<int64_t>(0, 99)(rng));
+        }
+        realm->commit_transaction();
+    }
+}
+
+@interface ResultsNotifierTests : XCTestCase
+
+@end
+
+@implementation ResultsNotifierTests
+
+- (void)testIncrementallyUpdatedResultsMatchQuery
+{
+    auto realm = openRealm(objectTestSchema());
+    auto table = tableFor(*realm, "object");
+    std::mt19937 rng(42);
+    int64_t nextId = 0;
+    fillTable(realm, *table, rng, nextId);
+
+    // Inserts, deletions and modifications move rows in and out of each query
+    ObservedResultsList observed;
+    observed.push_back(std::make_unique<ObservedResults>(realm::Results(realm, table->where().greater_equal(ObjectTestValueColumn, 50))));
+    observed.push_back(std::make_unique<ObservedResults>(realm::Results(realm, table->where().equal(ObjectTestValueColumn, 7))));
+    observed.push_back(std::make_unique<ObservedResults>(realm::Results(realm, table->where().between(ObjectTestValueColumn, 20, 30))));
+    const std::function<bool(int64_t)> matches[] = {
+        [](int64_t value) { return value >= 50; },
+        [](int64_t value) { return value == 7; },
+        [](int64_t value) { return value >= 20 && value <= 30; },
+    };
+    advanceAndNotify(*realm);
+
+    for (size_t i = 0; i < ResultsTestTransactions; ++i) {
+        commitMutations(*realm, *table, rng, nextId, 1 + i % 20);
+        advanceAndNotify(*realm);
+
+        XCTAssertTrue(mismatchedResults(observed).empty(), @"transaction %zu", i);
+        for (size_t j = 0; j < observed.size(); ++j) {
+            XCTAssertTrue(idsOf(observed[j]->results) == expectedIds(*table, matches[j]), @"transaction %zu, results %zu", i, j);
+        }
+    }
+}
+
+- (void)testIncrementallyUpdatedResultsSyncInWriteTransaction
+{
+    auto realm = openRealm(objectTestSchema());
+    auto table = tableFor(*realm, "object");
+    std::mt19937 rng(7);
+    int64_t nextId = 0;
+    fillTable(realm, *table, rng, nextId);
+
+    ObservedResults observed(realm::Results(realm, table->where().less(ObjectTestValueColumn, 40)));
+    auto matches = [](int64_t value) { return value < 40; };
+    advanceAndNotify(*realm);
+
+    // The delivered results have to rerun the query themselves when the
+    // table changes before the next notification
+    for (size_t i = 0; i < ResultsTestTransactions / 4; ++i) {
+        commitMutations(*realm, *table, rng, nextId);
+        advanceAndNotify(*realm);
+
+        realm->begin_transaction();
+        mutateObjects(*table, rng, nextId);
+        XCTAssertTrue(idsOf(observed.results) == expectedIds(*table, matches), @"transaction %zu", i);
+        realm->commit_transaction();
+        advanceAndNotify(*realm);
+        XCTAssertTrue(observed.callback.mirror.matches(), @"transaction %zu", i);
+    }
+}
+
+- (void)testSortedAndDistinctResultsRerunQuery
+{
+    auto realm = openRealm(objectTestSchema());
+    auto table = tableFor(*realm, "object");
+    std::mt19937 rng(3);
+    int64_t nextId = 0;
+    fillTable(realm, *table, rng, nextId);
+
+    realm::Results results(realm, table->where().greater(ObjectTestValueColumn, 10));
+    ObservedResultsList observed;
+    observed.push_back(std::make_unique<ObservedResults>(results.sort({{"value", true}})));
+    observed.push_back(std::make_unique<ObservedResults>(results.distinct({"value"})));
+    observed.push_back(std::make_unique<ObservedResults>(results));
+    advanceAndNotify(*realm);
+
+    for (size_t i = 0; i < ResultsTestTransactions; ++i) {
+        commitMutations(*realm, *table, rng, nextId);
+        advanceAndNotify(*realm);
+
+        XCTAssertTrue(mismatchedResults(observed).empty(), @"transaction %zu", i);
+        XCTAssertEqual(observed[0]->results.size(), observed[2]->results.size(), @"transaction %zu", i);
+    }
+}
+
+- (void)testResultsCatchUpAfterCallbacksAreReadded
+{
+    auto realm = openRealm(objectTestSchema());
+    auto table = tableFor(*realm, "object");
+    std::mt19937 rng(11);
+    int64_t nextId = 0;
+    fillTable(realm, *table, rng, nextId);
+
+    realm::Results results(realm, table->where().greater_equal(ObjectTestValueColumn, 25));
+    auto matches = [](int64_t value) { return value >= 25; };
+    auto callback = std::make_unique<MirroredCallback>(results);
+    advanceAndNotify(*realm);
+
+    // Transactions without a callback aren't needed to update the rows, so
+    // the first one after the callback is added again can't start from them
+    for (size_t round = 0; round < 10; ++round) {
+        callback.reset();
+        for (size_t i = 0; i < 3; ++i) {
+            commitMutations(*realm, *table, rng, nextId);
+            advanceAndNotify(*realm);
+        }
+        callback = std::make_unique<MirroredCallback>(results);
+        advanceAndNotify(*realm);
+        commitMutations(*realm, *table, rng, nextId);
+        advanceAndNotify(*realm);
+
+        XCTAssertTrue(callback->mirror.matches(), @"round %zu", round);
+        XCTAssertTrue(idsOf(results) == expectedIds(*table, matches), @"round %zu", round);
+    }
+}
+
+@end
@@ -0,0 +1,265 @@
+//
+//  SetTests.mm
+//  CrashRealmTests
+//
+//  Copyright (c) 2019 retval. All rights reserved.
+//
+
+#include <RxFoundation/OrderedSet.hpp>
+#include <RxFoundation/Set.hpp>
+
+#include <algorithm>
+#include <random>
+#include <unordered_set>
+#include <vector>
+
+@import XCTest;
+
+namespace {
+    constexpr size_t SetTestOperations = 20000;
+    // Small enough that values are often added twice or erased while present
+    constexpr Rx::UInt64 SetTestValues = 512;
+
+    /// OrderedSet's expected contents: unique values in insertion order.
+    class OrderedSetModel {
+    public:
+        void add(Rx::UInt64 value) {
+            if (!contains(value)) {
+                _values.push_back(value);
+            }
+        }
+
+        void erase(Rx::UInt64 value) {
+            auto it = std::find(_values.begin(), _values.end(), value);
+            if (it != _values.end()) {
+                _values.erase(it);
+            }
+        }
+
+        bool contains(Rx::UInt64 value) const {
+            return std::find(_values.begin(), _values.end(), value) != _values.end();
+        }
+
+        const std::vector<Rx::UInt64> &values() const { return _values; }
+        std::vector<Rx::UInt64> &values() { return _values; }
+
+    private:
+        std::vector<Rx::UInt64> _values;
+    };
+
+    std::vector<Rx::UInt64> orderedValues(const Rx::OrderedSet<Rx::UInt64> &set) {
+        return std::vector<Rx::UInt64>(set.begin(), set.end());
+    }
+
+    std::vector<Rx::UInt64> sortedValues(const Rx::HashSet<Rx::UInt64> &set) {
+        std::vector<Rx::UInt64> values(set.begin(), set.end());
+        std::sort(values.begin(), values.end());
+        return values;
+    }
+
+    std::vector<Rx::UInt64> sortedValues(const std::unordered_set<Rx::UInt64> &set) {
+        std::vector<Rx::UInt64> values(set.begin(), set.end());
+        std::sort(values.begin(), values.end());
+        return values;
+    }
+}
+
+@interface SetTests : XCTestCase
+
+@end
+
+@implementation SetTests
+
+- (void)testHashSetAgreesWithUnorderedSet
+{
+    Rx::HashSet<Rx::UInt64> set;
+    std::unordered_set<Rx::UInt64> model;
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<Rx::UInt64> value(0, SetTestValues - 1);
+
+    for (size_t i = 0; i < SetTestOperations; ++i) {
+        const Rx::UInt64 v = value(rng);
+        switch (rng() % 5) {
+            case 0:
+            case 1:
+                set.addObject(v);
+                model.insert(v);
+                break;
+            case 2:
+                XCTAssertEqual(set.erase(v), model.erase(v) != 0, @"operation %zu", i);
+                break;
+            case 3:
+                // Erasing by position fills the hole from the tail
+                if (!set.isEmpty()) {
+                    auto it = set.begin() + rng() % set.size();
+                    model.erase(*it);
+                    set.erase(it);
+                }
+                break;
+            case 4: {
+                auto it = set[v];
+                XCTAssertEqual(it != set.end(), model.count(v) != 0, @"operation %zu", i);
+                if (it != set.end()) {
+                    XCTAssertEqual(*it, v, @"operation %zu", i);
+                }
+                break;
+            }
+        }
+        XCTAssertEqual(set.size(), model.size(), @"operation %zu", i);
+        XCTAssertEqual(set.contains(v), model.count(v) != 0, @"operation %zu", i);
+    }
+    XCTAssertTrue(sortedValues(set) == sortedValues(model));
+
+    Rx::HashSet<Rx::UInt64> copy(set);
+    XCTAssertTrue(copy == set);
+    for (Rx::UInt64 v = 0; v < SetTestValues; ++v) {
+        XCTAssertEqual(copy.contains(v), model.count(v) != 0);
+    }
+}
+
+- (void)testHashSetEraseRange
+{
+    Rx::HashSet<Rx::UInt64> set;
+    for (Rx::UInt64 v = 0; v < SetTestValues; ++v) {
+        set.addObject(v);
+    }
+    std::vector<Rx::UInt64> erased(set.begin() + 100, set.begin() + 300);
+    set.erase(set.begin() + 100, set.begin() + 300);
+
+    XCTAssertEqual(set.size(), (size_t)SetTestValues - 200);
+    for (Rx::UInt64 v : erased) {
+        XCTAssertFalse(set.contains(v));
+    }
+    for (Rx::UInt64 v : set) {
+        XCTAssertTrue(set[v] != set.end() && *set[v] == v);
+    }
+}
+
+- (void)testOrderedSetAgreesWithModel
+{
+    Rx::OrderedSet<Rx::UInt64> set;
+    OrderedSetModel model;
+    std::mt19937 rng(7);
+    std::uniform_int_distribution<Rx::UInt64> value(0, SetTestValues - 1);
+
+    for (size_t i = 0; i < SetTestOperations; ++i) {
+        const Rx::UInt64 v = value(rng);
+        switch (rng() % 6) {
+            case 0:
+            case 1:
+                set.addObject(v);
+                model.add(v);
+                break;
+            case 2:
+                // Leaves tombstones, and compacts them once there are enough
+                set.erase(v);
+                model.erase(v);
+                break;
+            case 3:
+                if (!set.isEmpty()) {
+                    XCTAssertEqual(set.back(), model.values().back(), @"operation %zu", i);
+                    set.pop_back();
+                    model.values().pop_back();
+                }
+                break;
+            case 4:
+                if (!set.isEmpty()) {
+                    const size_t index = rng() % set.size();
+                    XCTAssertEqual(set[index], model.values()[index], @"operation %zu", i);
+                    XCTAssertEqual(set.front(), model.values().front(), @"operation %zu", i);
+                }
+                break;
+            case 5: {
+                auto it = set.find(v);
+                XCTAssertEqual((bool)it, model.contains(v), @"operation %zu", i);
+                if (it) {
+                    XCTAssertEqual(*it, v, @"operation %zu", i);
+                    set.erase(it);
+                    model.erase(v);
+                }
+                break;
+            }
+        }
+        XCTAssertEqual(set.size(), model.values().size(), @"operation %zu", i);
+        XCTAssertEqual(set.contains(v), model.contains(v), @"operation %zu", i);
+        if (i % 100 == 0) {
+            XCTAssertTrue(orderedValues(set) == model.values(), @"operation %zu", i);
+        }
+    }
+    XCTAssertTrue(orderedValues(set) == model.values());
+}
+
+- (void)testOrderedSetCopyAndMoveWithTombstones
+{
+    Rx::OrderedSet<Rx::UInt64> set;
+    OrderedSetModel model;
+    for (Rx::UInt64 v = 0; v < 64; ++v) {
+        set.addObject(v);
+        model.add(v);
+    }
+    // Fewer than half, so the tombstones are still there to be copied
+    for (Rx::UInt64 v = 0; v < 64; v += 3) {
+        set.erase(v);
+        model.erase(v);
+    }
+
+    Rx::OrderedSet<Rx::UInt64> copy(set);
+    XCTAssertTrue(copy == set);
+    XCTAssertTrue(orderedValues(copy) == model.values());
+
+    // Elements added after the tombstones go after the existing ones
+    copy.addObject(1000);
+    XCTAssertEqual(copy.back(), 1000U);
+    XCTAssertFalse(copy == set);
+
+    Rx::OrderedSet<Rx::UInt64> moved(std::move(copy));
+    XCTAssertTrue(copy.isEmpty());
+    model.add(1000);
+    XCTAssertTrue(orderedValues(moved) == model.values());
+    for (Rx::UInt64 v : model.values()) {
+        XCTAssertTrue(moved.contains(v));
+    }
+}
+
+- (void)testOrderedSetIndexingAfterErasures
+{
+    Rx::OrderedSet<Rx::UInt64> set;
+    OrderedSetModel model;
+    for (Rx::UInt64 v = 0; v < SetTestValues; ++v) {
+        set.addObject(v);
+        model.add(v);
+    }
+    std::mt19937 rng(3);
+    for (size_t round = 0; round < 8; ++round) {
+        // Too few erasures to compact, which leaves indexing the tombstones to compact
+        for (size_t i = 0; i < SetTestValues / 8 && !model.values().empty(); ++i) {
+            const Rx::UInt64 v = model.values()[rng() % model.values().size()];
+            set.erase(v);
+            model.erase(v);
+        }
+        for (size_t index = 0; index < model.values().size(); ++index) {
+            XCTAssertEqual(set[index], model.values()[index], @"round %zu, index %zu", round, index);
+        }
+        // Everything else still finds the elements where indexing left them
+        XCTAssertTrue(orderedValues(set) == model.values(), @"round %zu", round);
+        for (Rx::UInt64 v : model.values()) {
+            XCTAssertEqual(*set.find(v), v, @"round %zu", round);
+        }
+        set.addObject(SetTestValues + round);
+        model.add(SetTestValues + round);
+        XCTAssertEqual(set.back(), SetTestValues + round, @"round %zu", round);
+    }
+}
+
+- (void)testSetContainsConvertibleElements
+{
+    Rx::Set<Rx::UInt64> set;
+    for (Rx::UInt64 v = 0; v < SetTestValues; v += 2) {
+        set.addObject(v);
+    }
+    for (int v = 0; v < (int)SetTestValues; ++v) {
+        XCTAssertEqual(set.contains(v), v % 2 == 0);
+    }
+}
+
+@end
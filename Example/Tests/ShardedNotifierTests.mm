@@ -0,0 +1,115 @@
+//
+//  ShardedNotifierTests.mm
+//  CrashRealmTests
+//
+//  Copyright (c) 2019 retval. All rights reserved.
+//
+
+#include "ObjectStoreTestSupport.hpp"
+
+@import XCTest;
+
+namespace {
+    using namespace ObjectStoreTestSupport;
+
+    constexpr size_t ShardedTestShards = 4;
+    constexpr size_t ShardedTestTransactions = 50;
+
+    /// Queries of every kind, including some equivalent ones which are run
+    /// together on one shard.
+    ObservedResultsList observeQueries(realm::SharedRealm &realm, realm::Table &table) {
+        ObservedResultsList observed;
+        auto observe = [&](realm::Results results) {
+            observed.push_back(std::make_unique<ObservedResults>(std::move(results)));
+        };
+        observe(realm::Results(realm, table));
+        for (int64_t threshold : {0, 25, 50, 75, 50}) {
+            observe(realm::Results(realm, table.where().greater_equal(ObjectTestValueColumn, threshold)));
+        }
+        observe(realm::Results(realm, table.where().less(ObjectTestValueColumn, 10)).sort({{"value", true}}));
+        observe(realm::Results(realm, table.where()).sort({{"id", false}}));
+        observe(realm::Results(realm, table.where()).sort({{"id", false}}));
+        return observed;
+    }
+}
+
+@interface ShardedNotifierTests : XCTestCase
+
+@end
+
+@implementation ShardedNotifierTests
+
+- (void)testShardedNotifiersDeliverCorrectChanges
+{
+    auto realm = openRealm(objectTestSchema(), ShardedTestShards);
+    auto table = tableFor(*realm, "object");
+    std::mt19937 rng(42);
+    int64_t nextId = 0;
+
+    commitMutations(*realm, *table, rng, nextId, 100);
+
+    auto observed = observeQueries(realm, *table);
+    advanceAndNotify(*realm);
+
+    for (size_t i = 0; i < ShardedTestTransactions; ++i) {
+        commitMutations(*realm, *table, rng, nextId);
+
+        // New notifiers join the shards the existing ones are already on
+        if (i == ShardedTestTransactions / 2) {
+            auto more = observeQueries(realm, *table);
+            std::move(more.begin(), more.end(), std::back_inserter(observed));
+        }
+        advanceAndNotify(*realm);
+
+        XCTAssertTrue(mismatchedResults(observed).empty(), @"transaction %zu", i);
+    }
+}
+
+- (void)testRemovingNotifiersLeavesTheOthersOnTheirShards
+{
+    auto realm = openRealm(objectTestSchema(), ShardedTestShards);
+    auto table = tableFor(*realm, "object");
+    std::mt19937 rng(7);
+    int64_t nextId = 0;
+
+    auto observed = observeQueries(realm, *table);
+    advanceAndNotify(*realm);
+
+    for (size_t i = 0; i < ShardedTestTransactions; ++i) {
+        commitMutations(*realm, *table, rng, nextId);
+
+        // Remove every other notifier part way through, which leaves some
+        // shards with nothing to run
+        if (i == ShardedTestTransactions / 2) {
+            for (size_t j = observed.size(); j-- > 0;) {
+                if (j % 2) {
+                    observed.erase(observed.begin() + j);
+                }
+            }
+        }
+        advanceAndNotify(*realm);
+
+        XCTAssertTrue(mismatchedResults(observed).empty(), @"transaction %zu", i);
+    }
+}
+
+- (void)testMoreShardsThanNotifiers
+{
+    auto realm = openRealm(objectTestSchema(), ShardedTestShards * 2);
+    auto table = tableFor(*realm, "object");
+    std::mt19937 rng(3);
+    int64_t nextId = 0;
+
+    ObservedResults all(realm::Results(realm, *table));
+    advanceAndNotify(*realm);
+
+    for (size_t i = 0; i < ShardedTestTransactions; ++i) {
+        commitMutations(*realm, *table, rng, nextId);
+        advanceAndNotify(*realm);
+
+        XCTAssertTrue(all.callback.mirror.matches(), @"transaction %zu", i);
+    }
+    XCTAssertGreaterThan(all.callback.mirror.deliveries(), 1U);
+}
+
+@end
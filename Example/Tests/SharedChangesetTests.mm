@@ -0,0 +1,120 @@
+//
+//  SharedChangesetTests.mm
+//  CrashRealmTests
+//
+//  Copyright (c) 2019 retval. All rights reserved.
+//
+
+#include "ObjectStoreTestSupport.hpp"
+
+#include <memory>
+
+@import XCTest;
+
+namespace {
+    using namespace ObjectStoreTestSupport;
+
+    constexpr size_t SharedChangesetTestCallbacks = 4;
+    constexpr size_t SharedChangesetTestTransactions = 20;
+}
+
+@interface SharedChangesetTests : XCTestCase
+
+@end
+
+@implementation SharedChangesetTests
+
+- (void)testCallbacksSeeEqualChangesets
+{
+    auto realm = openRealm(objectTestSchema());
+    auto table = tableFor(*realm, "object");
+    std::mt19937 rng(42);
+    int64_t nextId = 0;
+    commitMutations(*realm, *table, rng, nextId);
+
+    realm::Results results(realm, table->where().greater_equal(ObjectTestValueColumn, 50));
+    std::vector<std::unique_ptr<MirroredCallback>> callbacks;
+    const realm::NotificationPriority priorities[] = {realm::NotificationPriority::low, realm::NotificationPriority::normal, realm::NotificationPriority::high};
+    for (size_t i = 0; i < SharedChangesetTestCallbacks; ++i) {
+        callbacks.push_back(std::make_unique<MirroredCallback>(results, priorities[i % 3]));
+    }
+    advanceAndNotify(*realm);
+
+    for (size_t i = 0; i < SharedChangesetTestTransactions; ++i) {
+        commitMutations(*realm, *table, rng, nextId);
+        advanceAndNotify(*realm);
+
+        for (size_t j = 0; j < callbacks.size(); ++j) {
+            XCTAssertTrue(callbacks[j]->mirror.matches(), @"transaction %zu, callback %zu", i, j);
+            // Callbacks which saw the same changes are passed equal changesets
+            XCTAssertTrue(sameChanges(callbacks[j]->changes, callbacks[0]->changes), @"transaction %zu, callback %zu", i, j);
+        }
+    }
+}
+
+- (void)testSuppressedCallbackGetsItsOwnChangeset
+{
+    auto realm = openRealm(objectTestSchema());
+    auto table = tableFor(*realm, "object");
+    std::mt19937 rng(7);
+    int64_t nextId = 0;
+    commitMutations(*realm, *table, rng, nextId);
+
+    realm::Results results(realm, *table);
+    MirroredCallback observer(results);
+    MirroredCallback writer(results);
+    advanceAndNotify(*realm);
+
+    // The writer already knows about its own changes
+    realm->begin_transaction();
+    mutateObjects(*table, rng, nextId);
+    writer.token.suppress_next();
+    realm->commit_transaction();
+    advanceAndNotify(*realm);
+
+    XCTAssertEqual(observer.mirror.deliveries(), 2U);
+    XCTAssertEqual(writer.mirror.deliveries(), 1U);
+    XCTAssertTrue(observer.mirror.matches());
+
+    // After which both are back to seeing the same changes
+    for (size_t i = 0; i < SharedChangesetTestTransactions; ++i) {
+        commitMutations(*realm, *table, rng, nextId);
+        advanceAndNotify(*realm);
+
+        XCTAssertTrue(observer.mirror.matches(), @"transaction %zu", i);
+        XCTAssertTrue(sameChanges(observer.changes, writer.changes), @"transaction %zu", i);
+    }
+}
+
+- (void)testCallbackAddedBetweenDeliveriesJoinsTheSharedChangesets
+{
+    auto realm = openRealm(objectTestSchema());
+    auto table = tableFor(*realm, "object");
+    std::mt19937 rng(3);
+    int64_t nextId = 0;
+    commitMutations(*realm, *table, rng, nextId);
+
+    realm::Results results(realm, *table);
+    MirroredCallback first(results);
+    advanceAndNotify(*realm);
+
+    commitMutations(*realm, *table, rng, nextId);
+    MirroredCallback second(results);
+    advanceAndNotify(*realm);
+
+    XCTAssertEqual(first.mirror.deliveries(), 2U);
+    XCTAssertEqual(second.mirror.deliveries(), 1U);
+    XCTAssertTrue(first.mirror.matches());
+    XCTAssertTrue(second.mirror.matches());
+
+    for (size_t i = 0; i < SharedChangesetTestTransactions; ++i) {
+        commitMutations(*realm, *table, rng, nextId);
+        advanceAndNotify(*realm);
+
+        XCTAssertTrue(first.mirror.matches(), @"transaction %zu", i);
+        XCTAssertTrue(second.mirror.matches(), @"transaction %zu", i);
+        XCTAssertTrue(sameChanges(first.changes, second.changes), @"transaction %zu", i);
+    }
+}
+
+@end
@@ -0,0 +1,111 @@
+//
+//  SpinLockTests.mm
+//  CrashRealmTests
+//
+//  Copyright (c) 2019 retval. All rights reserved.
+//
+
+#include <RxFoundation/Atomic.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+@import XCTest;
+
+namespace {
+    constexpr size_t SpinLockTestThreads = 8;
+    constexpr size_t SpinLockTestIterations = 100000;
+}
+
+@interface SpinLockTests : XCTestCase
+
+@end
+
+@implementation SpinLockTests
+
+- (void)testContendedLockAndUnlock
+{
+    Rx::SpinLock lock("SpinLockTests.contended");
+    // Plain counters, so that two threads inside the lock at once would lose updates
+    size_t counter = 0;
+    size_t inside = 0;
+    std::atomic<size_t> overlaps(0);
+
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < SpinLockTestThreads; ++t) {
+        threads.emplace_back([&, t] {
+            for (size_t i = 0; i < SpinLockTestIterations; ++i) {
+                Rx::LockGuard<Rx::SpinLock> guard(lock);
+                if (inside++ != 0) {
+                    ++overlaps;
+                }
+                ++counter;
+                // Now and then hold the lock long enough for the waiters to park
+                if ((i + t) % 1000 == 0) {
+                    std::this_thread::yield();
+                }
+                --inside;
+            }
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+
+    XCTAssertEqual(counter, SpinLockTestThreads * SpinLockTestIterations);
+    XCTAssertEqual(overlaps.load(), 0U);
+    XCTAssertTrue(lock.tryLock());
+    lock.unlock();
+}
+
+- (void)testTryLockWhileHeld
+{
+    Rx::SpinLock lock;
+    XCTAssertTrue(lock.tryLock());
+    // Not recursive, even on the thread which holds it
+    XCTAssertFalse(lock.tryLock());
+
+    bool acquired = true;
+    std::thread([&] { acquired = lock.tryLock(); }).join();
+    XCTAssertFalse(acquired);
+
+    lock.unlock();
+    std::thread([&] {
+        acquired = lock.tryLock();
+        if (acquired) {
+            lock.unlock();
+        }
+    }).join();
+    XCTAssertTrue(acquired);
+}
+
+- (void)testUnlockWakesParkedWaiter
+{
+    Rx::SpinLock lock;
+    lock.lock();
+
+    std::atomic<bool> waiting(false), acquired(false);
+    std::thread waiter([&] {
+        waiting = true;
+        lock.lock();
+        acquired = true;
+        lock.unlock();
+    });
+    while (!waiting) {
+        std::this_thread::yield();
+    }
+    // Long enough for the waiter to give up spinning and park
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    XCTAssertFalse(acquired.load());
+    XCTAssertFalse(lock.tryLock());
+
+    lock.unlock();
+    waiter.join();
+    XCTAssertTrue(acquired.load());
+    XCTAssertTrue(lock.tryLock());
+    lock.unlock();
+}
+
+@end
@@ -0,0 +1,305 @@
+//
+//  UnicodeCharTests.mm
+//  CrashRealmTests
+//
+//  Copyright (c) 2019 retval. All rights reserved.
+//
+
+#include <RxFoundation/UnicodeChar.hpp>
+
+#include <random>
+#include <vector>
+
+@import XCTest;
+
+namespace {
+    using Rx::UnicodeChar;
+    using Rx::UTF8Char;
+    using Rx::UTF16Char;
+    using Rx::UTF32Char;
+
+    /// A character at a time decoder written from the table of well-formed
+    /// byte sequences in the Unicode standard (table 3-7), independently of the
+    /// lead byte masks the kernels use. Returns false for ill-formed input.
+    bool referenceDecodeUTF8(const std::vector<UTF8Char> &bytes, std::vector<UTF32Char> &characters) {
+        characters.clear();
+        size_t idx = 0;
+        while (idx < bytes.size()) {
+            const UTF8Char lead = bytes[idx];
+            size_t length;
+            UTF8Char secondLow = 0x80, secondHigh = 0xBF;
+            if (lead <= 0x7F) length = 1;
+            else if (lead >= 0xC2 && lead <= 0xDF) length = 2;
+            else if (lead == 0xE0) { length = 3; secondLow = 0xA0; }
+            else if (lead >= 0xE1 && lead <= 0xEC) length = 3;
+            else if (lead == 0xED) { length = 3; secondHigh = 0x9F; }
+            else if (lead >= 0xEE && lead <= 0xEF) length = 3;
+            else if (lead == 0xF0) { length = 4; secondLow = 0x90; }
+            else if (lead >= 0xF1 && lead <= 0xF3) length = 4;
+            else if (lead == 0xF4) { length = 4; secondHigh = 0x8F; }
+            else return false;
+
+            if (bytes.size() - idx < length) return false;
+            UTF32Char value = length == 1 ? lead : lead & (0xFF >> (length + 1));
+            for (size_t offset = 1; offset < length; ++offset) {
+                const UTF8Char byte = bytes[idx + offset];
+                const UTF8Char low = offset == 1 ? secondLow : 0x80;
+                const UTF8Char high = offset == 1 ? secondHigh : 0xBF;
+                if (byte < low || byte > high) return false;
+                value = (value << 6) | (byte & 0x3F);
+            }
+            characters.push_back(value);
+            idx += length;
+        }
+        return true;
+    }
+
+    std::vector<UTF16Char> referenceUTF16(const std::vector<UTF32Char> &characters) {
+        std::vector<UTF16Char> units;
+        for (auto character : characters) {
+            if (character >= 0x10000) {
+                units.push_back((UTF16Char)(0xD800 + ((character - 0x10000) >> 10)));
+                units.push_back((UTF16Char)(0xDC00 + ((character - 0x10000) & 0x3FF)));
+            } else {
+                units.push_back((UTF16Char)character);
+            }
+        }
+        return units;
+    }
+
+    /// Decodes UTF-16, returning false for an unpaired surrogate.
+    bool referenceDecodeUTF16(const std::vector<UTF16Char> &units, std::vector<UTF32Char> &characters) {
+        characters.clear();
+        for (size_t idx = 0; idx < units.size(); ++idx) {
+            const UTF16Char unit = units[idx];
+            if (unit >= 0xDC00 && unit <= 0xDFFF) return false;
+            if (unit >= 0xD800 && unit <= 0xDBFF) {
+                if (idx + 1 == units.size() || units[idx + 1] < 0xDC00 || units[idx + 1] > 0xDFFF) return false;
+                characters.push_back(0x10000 + ((UTF32Char)(unit - 0xD800) << 10) + (units[++idx] - 0xDC00));
+            } else {
+                characters.push_back(unit);
+            }
+        }
+        return true;
+    }
+
+    std::vector<UTF8Char> referenceUTF8(const std::vector<UTF32Char> &characters) {
+        std::vector<UTF8Char> bytes;
+        for (auto character : characters) {
+            if (character < 0x80) {
+                bytes.push_back((UTF8Char)character);
+            } else if (character < 0x800) {
+                bytes.push_back((UTF8Char)(0xC0 | (character >> 6)));
+                bytes.push_back((UTF8Char)(0x80 | (character & 0x3F)));
+            } else if (character < 0x10000) {
+                bytes.push_back((UTF8Char)(0xE0 | (character >> 12)));
+                bytes.push_back((UTF8Char)(0x80 | ((character >> 6) & 0x3F)));
+                bytes.push_back((UTF8Char)(0x80 | (character & 0x3F)));
+            } else {
+                bytes.push_back((UTF8Char)(0xF0 | (character >> 18)));
+                bytes.push_back((UTF8Char)(0x80 | ((character >> 12) & 0x3F)));
+                bytes.push_back((UTF8Char)(0x80 | ((character >> 6) & 0x3F)));
+                bytes.push_back((UTF8Char)(0x80 | (character & 0x3F)));
+            }
+        }
+        return bytes;
+    }
+
+    /// Whether isASCII, isValidUTF8 and convertUTF8ToUTF16 all agree with the reference.
+    bool agreesOnUTF8(const std::vector<UTF8Char> &bytes) {
+        bool ascii = true;
+        for (auto byte : bytes) ascii = ascii && byte < 0x80;
+        if (UnicodeChar::isASCII(bytes.data(), bytes.size()) != ascii) return false;
+
+        std::vector<UTF32Char> characters;
+        const bool valid = referenceDecodeUTF8(bytes, characters);
+        if (UnicodeChar::isValidUTF8(bytes.data(), bytes.size()) != valid) return false;
+
+        // Room for one unit per byte, plus a guard unit to catch overruns
+        std::vector<UTF16Char> units(bytes.size() + 1, 0xFFFF);
+        const Rx::UInteger written = UnicodeChar::convertUTF8ToUTF16(bytes.data(), bytes.size(), units.data());
+        if (units.back() != 0xFFFF) return false;
+        if (!valid) return written == UnicodeChar::NotFound;
+        units.resize(written);
+        return units == referenceUTF16(characters);
+    }
+
+    /// Whether convertUTF16ToUTF8 agrees with the reference.
+    bool agreesOnUTF16(const std::vector<UTF16Char> &units) {
+        std::vector<UTF32Char> characters;
+        const bool valid = referenceDecodeUTF16(units, characters);
+
+        std::vector<UTF8Char> bytes(3 * units.size() + 1, 0xFF);
+        const Rx::UInteger written = UnicodeChar::convertUTF16ToUTF8(units.data(), units.size(), bytes.data());
+        if (bytes.back() != 0xFF) return false;
+        if (!valid) return written == UnicodeChar::NotFound;
+        bytes.resize(written);
+        return bytes == referenceUTF8(characters);
+    }
+
+    /// The sets findFirstMemberOf() classifies in bulk, and one it doesn't.
+    const uint32_t UnicodeCharTestSets[] = {
+        UnicodeChar::WhitespaceCharacterSet,
+        UnicodeChar::WhitespaceAndNewlineCharacterSet,
+        UnicodeChar::NewlineCharacterSet,
+        UnicodeChar::DecimalDigitCharacterSet,
+        UnicodeChar::LetterCharacterSet,
+    };
+
+    /// Text shorter than a block is checked a character at a time against the
+    /// character set bitmaps, so this is the reference for the bulk path.
+    bool isMember(uint32_t charset, UTF16Char unit) {
+        return UnicodeChar::findFirstMemberOf(charset, &unit, 1) == 0;
+    }
+
+    /// Whether findFirstMemberOf agrees with checking each character in turn.
+    bool agreesOnMembers(const std::vector<UTF16Char> &units) {
+        for (auto charset : UnicodeCharTestSets) {
+            Rx::UInteger expected = UnicodeChar::NotFound;
+            for (size_t idx = 0; idx < units.size(); ++idx) {
+                if (isMember(charset, units[idx])) {
+                    expected = idx;
+                    break;
+                }
+            }
+            if (UnicodeChar::findFirstMemberOf(charset, units.data(), units.size()) != expected) return false;
+        }
+        return true;
+    }
+
+    /// Lengths around the 16 byte and 8 unit blocks, including none at all.
+    const size_t UnicodeCharTestLengths[] = {0, 1, 7, 8, 9, 15, 16, 17, 23, 24, 25, 31, 32, 33};
+
+    /// Sequences which are ill-formed only because of their values: overlong
+    /// encodings, surrogates and code points past U+10FFFF, along with the
+    /// well-formed sequences either side of each limit.
+    const std::vector<std::vector<UTF8Char>> UnicodeCharTestSequences = {
+        {0xC0, 0x80}, {0xC1, 0xBF}, {0xC2, 0x80},
+        {0xE0, 0x80, 0x80}, {0xE0, 0x9F, 0xBF}, {0xE0, 0xA0, 0x80},
+        {0xED, 0x9F, 0xBF}, {0xED, 0xA0, 0x80}, {0xED, 0xBF, 0xBF}, {0xEE, 0x80, 0x80},
+        {0xF0, 0x80, 0x80, 0x80}, {0xF0, 0x8F, 0xBF, 0xBF}, {0xF0, 0x90, 0x80, 0x80},
+        {0xF4, 0x8F, 0xBF, 0xBF}, {0xF4, 0x90, 0x80, 0x80}, {0xF5, 0x80, 0x80, 0x80},
+        {0xF8, 0x88, 0x80, 0x80, 0x80}, {0xFF}, {0x80}, {0xBF},
+    };
+}
+
+@interface UnicodeCharTests : XCTestCase
+
+@end
+
+@implementation UnicodeCharTests
+
+- (void)testUTF8SequencesAtBlockEdges
+{
+    // Each sequence at every position in ASCII text, so that it lands at the
+    // start, middle and end of a block and straddles block boundaries
+    for (const auto &sequence : UnicodeCharTestSequences) {
+        for (size_t length : UnicodeCharTestLengths) {
+            for (size_t position = 0; position <= length; ++position) {
+                std::vector<UTF8Char> bytes(length, 'a');
+                bytes.insert(bytes.begin() + position, sequence.begin(), sequence.end());
+                XCTAssertTrue(agreesOnUTF8(bytes), @"sequence %02x at %zu of %zu", sequence[0], position, length);
+            }
+        }
+    }
+}
+
+- (void)testTruncatedUTF8Sequences
+{
+    // Every proper prefix of each well-formed sequence, both at the end of the
+    // text and followed by more ASCII
+    const std::vector<UTF32Char> characters = {0x80, 0x7FF, 0x800, 0xFFFF, 0x10000, 0x10FFFF};
+    for (auto character : characters) {
+        const auto sequence = referenceUTF8({character});
+        for (size_t prefix = 1; prefix < sequence.size(); ++prefix) {
+            for (size_t length : UnicodeCharTestLengths) {
+                std::vector<UTF8Char> bytes(length, 'a');
+                bytes.insert(bytes.end(), sequence.begin(), sequence.begin() + prefix);
+                XCTAssertTrue(agreesOnUTF8(bytes), @"U+%04X cut to %zu after %zu", character, prefix, length);
+                bytes.insert(bytes.end(), 16, 'b');
+                XCTAssertTrue(agreesOnUTF8(bytes), @"U+%04X cut to %zu before ASCII", character, prefix);
+            }
+        }
+    }
+}
+
+- (void)testUTF16SurrogatesAtBlockEdges
+{
+    const std::vector<std::vector<UTF16Char>> sequences = {
+        {0xD800, 0xDC00}, {0xDBFF, 0xDFFF}, {0xD800}, {0xDFFF}, {0xDC00, 0xD800},
+        {0xD800, 'a'}, {0xD800, 0xD800, 0xDC00}, {0x00E9}, {0x07FF, 0x0800}, {0xFFFF},
+    };
+    for (const auto &sequence : sequences) {
+        for (size_t length : UnicodeCharTestLengths) {
+            for (size_t position = 0; position <= length; ++position) {
+                std::vector<UTF16Char> units(length, 'a');
+                units.insert(units.begin() + position, sequence.begin(), sequence.end());
+                XCTAssertTrue(agreesOnUTF16(units), @"sequence %04x at %zu of %zu", sequence[0], position, length);
+            }
+        }
+    }
+}
+
+- (void)testFindFirstMemberOfEveryASCIICharacter
+{
+    // Every ASCII character in every lane of a block, including 0x00 and 0x01
+    // which bound the empty second range of the newline and digit sets
+    for (UTF16Char character = 0; character < 0x80; ++character) {
+        for (size_t length : UnicodeCharTestLengths) {
+            for (size_t position = 0; position < length; ++position) {
+                std::vector<UTF16Char> units(length, 'a');
+                units[position] = character;
+                XCTAssertTrue(agreesOnMembers(units), @"character %02x at %zu of %zu", character, position, length);
+            }
+        }
+    }
+}
+
+- (void)testFindFirstMemberOfAfterNonASCII
+{
+    // Non-ASCII members and non-members of the bulk sets send a block down the
+    // character at a time path
+    const UTF16Char characters[] = {0x0085, 0x00A0, 0x00E9, 0x0660, 0x1680, 0x2028, 0x3000, 0xD800, 0xFFFF};
+    for (auto character : characters) {
+        for (size_t length : UnicodeCharTestLengths) {
+            for (size_t position = 0; position < length; ++position) {
+                std::vector<UTF16Char> units(length, 'a');
+                units[position] = character;
+                if (position + 1 < length) units.back() = ' ';
+                XCTAssertTrue(agreesOnMembers(units), @"character %04x at %zu of %zu", character, position, length);
+            }
+        }
+    }
+}
+
+- (void)testRandomTextAgreesWithReference
+{
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<size_t> lengths(0, 64);
+    std::uniform_int_distribution<int> kinds(0, 3);
+    std::uniform_int_distribution<UTF32Char> ascii(0, 0x7F), bmp(0x80, 0xFFFF), astral(0x10000, 0x10FFFF);
+    std::uniform_int_distribution<int> bytes(0, 0xFF);
+    for (int iteration = 0; iteration < 10000; ++iteration) {
+        // Mostly well-formed text, with the occasional arbitrary byte
+        std::vector<UTF32Char> characters(lengths(rng));
+        for (auto &character : characters) {
+            switch (kinds(rng)) {
+                case 0: case 1: character = ascii(rng); break;
+                case 2: character = bmp(rng); break;
+                default: character = astral(rng); break;
+            }
+        }
+        auto utf8 = referenceUTF8(characters);
+        if (!utf8.empty() && iteration % 4 == 0) {
+            utf8[std::uniform_int_distribution<size_t>(0, utf8.size() - 1)(rng)] = (UTF8Char)bytes(rng);
+        }
+        XCTAssertTrue(agreesOnUTF8(utf8), @"iteration %d", iteration);
+
+        // Random BMP characters include lone surrogates
+        auto utf16 = referenceUTF16(characters);
+        XCTAssertTrue(agreesOnUTF16(utf16), @"iteration %d", iteration);
+        XCTAssertTrue(agreesOnMembers(utf16), @"iteration %d", iteration);
+    }
+}
+
+@end